@@ -0,0 +1,135 @@
+#include "AccumulationBuffer.h"
+#include <iostream>
+#include <GL/glew.h>
+
+void AccumulationBuffer::destroy() {
+    for (int i = 0; i < SLOTS; i++) {
+        if (framebuffers[i] != 0)
+            glDeleteFramebuffers(1, &framebuffers[i]);
+        if (textures[i][0] != 0)
+            glDeleteTextures(has_layers ? LAYERS : 1, textures[i]);
+        framebuffers[i] = 0;
+        for (int layer = 0; layer < LAYERS; layer++)
+            textures[i][layer] = 0;
+    }
+}
+
+void AccumulationBuffer::prepare(int width, int height, uint64_t view_version) {
+    bool moved = view_version != this->view_version;
+    this->view_version = view_version;
+    if (width != this->width || height != this->height || features != has_layers || history != has_history || framebuffers[0] == 0) {
+        // (re)create the targets at the new size
+        destroy();
+        this->width = width;
+        this->height = height;
+        has_layers = features;
+        has_history = history && features;
+        current = 0;
+        previous = -1;
+        samples = 0;
+
+        int layers = has_layers ? LAYERS : 1;
+        const GLenum draw_buffers[LAYERS] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        for (int i = 0; i < (has_history ? SLOTS : 2); i++) {
+            glGenFramebuffers(1, &framebuffers[i]);
+            glGenTextures(layers, textures[i]);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            for (int layer = 0; layer < layers; layer++) {
+                glBindTexture(GL_TEXTURE_2D, textures[i][layer]);
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, draw_buffers[layer], GL_TEXTURE_2D, textures[i][layer], 0);
+            }
+            glDrawBuffers(layers, draw_buffers);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cerr << "Accumulation framebuffer is incomplete" << std::endl;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    } else if (moved && has_history && samples > 0) {
+        // keep the average for the Reprojector, the new view's first sample starts from a cleared framebuffer
+        previous = current;
+        current = next();
+        clear(current);
+        return;
+    } else if (moved) {
+        samples = 0;
+    }
+
+    // the first sample starts from a cleared framebuffer, where every pixel counts no samples
+    if (samples == 0)
+        clear(current);
+}
+
+void AccumulationBuffer::clear(int slot) {
+    const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[slot]);
+    for (int layer = 0; layer < (has_layers ? LAYERS : 1); layer++)
+        glClearBufferfv(GL_COLOR, layer, zero);
+}
+
+void AccumulationBuffer::bind(GLuint texture_unit) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[next()]);
+    glViewport(0, 0, width, height);
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glBindTexture(GL_TEXTURE_2D, textures[current][ACCUMULATION_COLOR]);
+}
+
+void AccumulationBuffer::bind_features(GLuint albedo_unit, GLuint normal_depth_unit) {
+    if (!has_features())
+        return;
+    glActiveTexture(GL_TEXTURE0 + albedo_unit);
+    glBindTexture(GL_TEXTURE_2D, textures[current][ACCUMULATION_ALBEDO]);
+    glActiveTexture(GL_TEXTURE0 + normal_depth_unit);
+    glBindTexture(GL_TEXTURE_2D, textures[current][ACCUMULATION_NORMAL_DEPTH]);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void AccumulationBuffer::bind_images(GLuint read_unit, GLuint write_unit) {
+    glBindImageTexture(read_unit, textures[current][ACCUMULATION_COLOR], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(write_unit, textures[next()][ACCUMULATION_COLOR], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+}
+
+void AccumulationBuffer::bind_feature_images(GLuint first_unit) {
+    if (!has_features())
+        return;
+    for (int layer = ACCUMULATION_ALBEDO; layer < LAYERS; layer++) {
+        GLuint unit = first_unit + 2 * (layer - ACCUMULATION_ALBEDO);
+        glBindImageTexture(unit, textures[current][layer], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(unit + 1, textures[next()][layer], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    }
+}
+
+void AccumulationBuffer::bind_reprojection(GLuint first_texture_unit, GLuint first_image_unit) {
+    for (int layer = 0; layer < LAYERS; layer++) {
+        glActiveTexture(GL_TEXTURE0 + first_texture_unit + layer);
+        glBindTexture(GL_TEXTURE_2D, textures[current][layer]);
+        glActiveTexture(GL_TEXTURE0 + first_texture_unit + LAYERS + layer);
+        glBindTexture(GL_TEXTURE_2D, textures[previous][layer]);
+        glBindImageTexture(first_image_unit + layer, textures[next()][layer], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void AccumulationBuffer::finish() {
+    current = next();
+    samples++;
+}
+
+void AccumulationBuffer::finish_reprojection() {
+    current = next();
+    previous = -1;
+}
+
+void AccumulationBuffer::resolve(GLuint target, int target_width, int target_height)
+    { blit_framebuffer(framebuffers[current], width, height, target, target_width, target_height); }
+
+AccumulationBuffer::~AccumulationBuffer() { destroy(); }
+
+void blit_framebuffer(GLuint source, int width, int height, GLuint target, int target_width, int target_height) {
+    bool scaled = target_width != width || target_height != height;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, target_width, target_height, GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,160 @@
+#ifndef _ACCUMULATIONBUFFER_H_
+#define _ACCUMULATIONBUFFER_H_
+
+#include <cstdint>
+#include <GL/glew.h>
+
+/** The images an AccumulationBuffer averages, in the order of its framebuffers' color attachments. */
+enum AccumulationLayer {
+    ACCUMULATION_COLOR = 0,        /** The color in rgb and the number of samples averaged in the pixel in a, always kept. */
+    ACCUMULATION_ALBEDO = 1,       /** The albedo of the first surface hit, in rgb. Kept with features only. */
+    ACCUMULATION_NORMAL_DEPTH = 2, /** Its normal in rgb and its distance from the camera in a. Kept with features only. */
+};
+
+/**
+ * The AccumulationBuffer class is a floating point render target that averages the samples of consecutive frames.
+ * It ping-pongs between two RGBA32F framebuffers: the shader reads the previous average from one and writes the new one into the other.
+ * Every pixel counts its own samples, so an average can continue from history the Reprojector carried over from another view.
+ * With features, the framebuffers also average the albedo, normal and depth the tracers emit, which guide the Denoiser.
+ * With history, a third framebuffer keeps the previous view's average after the view changed, until it was reprojected.
+ */
+class AccumulationBuffer {
+private:
+    static constexpr int LAYERS = 3; // the layers with features
+    static constexpr int SLOTS = 3;  // the framebuffers with history
+    GLuint framebuffers[SLOTS] = {0, 0, 0};
+    GLuint textures[SLOTS][LAYERS] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    int current = 0;  // the framebuffer holding the latest average
+    int previous = -1; // the framebuffer holding the previous view's average while it is reprojected, -1 otherwise
+    int width = 0, height = 0;
+    bool features = false;     // whether the framebuffers have the feature layers
+    bool has_layers = false;   // whether they were created with them
+    bool history = false;      // whether the previous view's average is kept
+    bool has_history = false;  // whether the framebuffers were created for it
+    uint64_t view_version = 0; // the Camera::get_version() the samples were taken for
+    uint32_t samples = 0;      // the number of samples taken so far, which seeds the next one
+
+    void destroy();
+    /** @return The framebuffer the next average is written into. */
+    inline int next() const {
+        int slot = (current + 1) % (has_history ? SLOTS : 2);
+        return slot == previous ? (slot + 1) % SLOTS : slot;
+    }
+    /** Clears all layers of a framebuffer, which then averages no samples. */
+    void clear(int slot);
+public:
+    AccumulationBuffer() {}
+
+    /**
+     * Prepares the buffer for the next sample, discarding the accumulated samples if the size of the render target
+     * or the view changed. With history, a view change keeps the average for is_reprojecting instead.
+     * @param width The width of the render target.
+     * @param height The height of the render target.
+     * @param view_version The version of the camera's view, see Camera::get_version().
+     */
+    void prepare(int width, int height, uint64_t view_version);
+
+    /** Discards the accumulated samples, the next prepare clears them. */
+    inline void reset() { samples = 0; }
+
+    /**
+     * Sets whether the feature layers are averaged along with the color, from the next prepare on.
+     * @param enabled True to keep ACCUMULATION_ALBEDO and ACCUMULATION_NORMAL_DEPTH, false for the color only.
+     */
+    inline void set_features(bool enabled) { features = enabled; }
+    /** @return True if the feature layers are averaged along with the color. */
+    inline bool has_features() const { return features && has_layers; }
+
+    /**
+     * Sets whether the average is kept when the view changes, from the next prepare on. Needs features.
+     * @param enabled True to keep it for the Reprojector, false to discard it.
+     */
+    inline void set_history(bool enabled) { history = enabled; }
+    /**
+     * @return True if the view changed since the previous average, which was kept to be reprojected:
+     * the next sample is the new view's first, and the Reprojector blends it with the previous view's average.
+     */
+    inline bool is_reprojecting() const { return previous >= 0; }
+
+    /**
+     * @return The index of the sample that is rendered next, which seeds its jitter and random numbers.
+     * Without history, this is also the number of samples accumulated so far.
+     */
+    inline uint32_t get_sample_index() const { return samples; }
+
+    /** @return The size of the buffer, in pixels. */
+    inline int get_width() const { return width; }
+    inline int get_height() const { return height; }
+
+    /**
+     * Gets a layer of the latest average, which is the previous one until finish is called.
+     * @param layer The layer, a feature layer only if has_features.
+     * @return The RGBA32F texture.
+     */
+    inline GLuint get_texture(AccumulationLayer layer) const { return textures[current][layer]; }
+
+    /**
+     * Binds the framebuffer the next average is rendered into, and the previous average as a texture.
+     * @param texture_unit The texture unit to bind the previous average to.
+     */
+    void bind(GLuint texture_unit);
+
+    /**
+     * Binds the previous average's feature layers as textures, for the fragment kernel. Does nothing without features.
+     * @param albedo_unit The texture unit to bind ACCUMULATION_ALBEDO to.
+     * @param normal_depth_unit The texture unit to bind ACCUMULATION_NORMAL_DEPTH to.
+     */
+    void bind_features(GLuint albedo_unit, GLuint normal_depth_unit);
+
+    /**
+     * Binds the previous average and the one the next is written into as images, for compute shaders.
+     * @param read_unit The image unit to bind the previous average to, rgba32f.
+     * @param write_unit The image unit to bind the next average to, rgba32f.
+     */
+    void bind_images(GLuint read_unit, GLuint write_unit);
+
+    /**
+     * Binds the feature layers of the previous average and of the next one as images, like bind_images.
+     * Does nothing without features.
+     * @param first_unit The image unit of the previous albedo, followed by the next albedo, the previous and the next normal and depth.
+     */
+    void bind_feature_images(GLuint first_unit);
+
+    /**
+     * Binds the layers of the latest average, the first sample of the new view, and of the previous view's average
+     * as textures, and the framebuffer the reprojected average is written into as images. Needs is_reprojecting.
+     * @param first_texture_unit The texture unit of the latest color, followed by its albedo and its normal and depth,
+     * then the same layers of the previous view's average.
+     * @param first_image_unit The image unit of the reprojected color, followed by its albedo and its normal and depth, rgba32f.
+     */
+    void bind_reprojection(GLuint first_texture_unit, GLuint first_image_unit);
+
+    /** Finishes the sample: swaps the framebuffers, the new average becomes the latest one. */
+    void finish();
+
+    /** Finishes a reprojection: the reprojected average becomes the latest one, the previous view's is dropped. */
+    void finish_reprojection();
+
+    /**
+     * Copies the latest average into the target framebuffer, upscaling it bilinearly if the target is larger.
+     * @param target The framebuffer to copy the average into, 0 for the window.
+     * @param target_width The width of the target framebuffer.
+     * @param target_height The height of the target framebuffer.
+     */
+    void resolve(GLuint target, int target_width, int target_height);
+
+    /** Frees the framebuffers and textures. */
+    ~AccumulationBuffer();
+
+    // Disallow copying, the GL objects are owned
+    AccumulationBuffer(const AccumulationBuffer&) = delete;
+    AccumulationBuffer& operator=(const AccumulationBuffer&) = delete;
+};
+
+/**
+ * Copies the first color attachment of a framebuffer into another, scaling it bilinearly if the sizes differ.
+ * Leaves the target bound.
+ */
+void blit_framebuffer(GLuint source, int width, int height, GLuint target, int target_width, int target_height);
+
+#endif//_ACCUMULATIONBUFFER_H_
@@ -1,28 +1,214 @@
 #ifndef _BUFFER_H_
 #define _BUFFER_H_
 
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 #include <vector>
 #include <GL/glew.h>
 
+/**
+ * A shader storage buffer of T.
+ * By default its data is (re)specified as a whole with setData. For data that changes every frame it can be switched
+ * to streaming mode with createStream: the storage is then allocated once and stays mapped, and update writes into
+ * one of STREAM_REGIONS copies while the GPU still reads the others, so uploads never allocate or synchronize implicitly.
+ */
 template <typename T>
 class Buffer {
+public:
+    static constexpr int STREAM_REGIONS = 3; /** The copies of the data in streaming mode, the frames the CPU may run ahead. */
 private:
     GLuint bufferID;
+    bool immutable = false;          // whether createStream gave the buffer object storage glBufferData can't respecify
+
+    // streaming mode, mapped is nullptr otherwise
+    T *mapped = nullptr;             // the persistently mapped storage, STREAM_REGIONS regions of region_stride bytes
+    size_t capacity = 0;             // the elements per region
+    size_t region_stride = 0;        // the bytes per region, aligned for glBindBufferRange
+    int region = 0;                  // the region written and bound this frame
+    GLsync fences[STREAM_REGIONS] = {};
+    std::vector<T> shadow;           // the latest data, the source for bringing a region up to date
+    size_t dirty_begin[STREAM_REGIONS] = {}, dirty_end[STREAM_REGIONS] = {}; // the range a region lacks of shadow
+
+    T *getRegion(int index) const { return (T *)((char *)mapped + index * region_stride); }
+
+    void destroyStream() {
+        for (GLsync &fence : fences) {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (mapped) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+        mapped = nullptr;
+        capacity = 0;
+        shadow = std::vector<T>();
+    }
+
+    // leaves streaming mode for storage glBufferData can respecify, which needs a new buffer object after createStream
+    void recreate() {
+        destroyStream();
+        if (!immutable)
+            return;
+        glDeleteBuffers(1, &bufferID);
+        glGenBuffers(1, &bufferID);
+        immutable = false;
+    }
 public:
     Buffer() {
         glGenBuffers(1, &bufferID);
     }
 
     ~Buffer() {
+        destroyStream();
         glDeleteBuffers(1, &bufferID);
     }
 
+    /**
+     * Replaces the buffer's data. In streaming mode this is update(0, data), the data has to fit the capacity.
+     * @param data The new data.
+     * @param usage The usage hint for glBufferData.
+     */
     void setData(const std::vector<T>& data, GLenum usage = GL_STATIC_DRAW) {
+        if (mapped) {
+            update(0, data.data(), data.size());
+            return;
+        }
+        recreate();
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID);
         glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(T), data.data(), usage);
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
 
+    /**
+     * Replaces the buffer's data with uninitialized storage, e.g. for data only the GPU writes and reads.
+     * Leaves streaming mode, the buffer object is replaced then, so it has to be bound again.
+     * @param count The number of elements.
+     * @param usage The usage hint for glBufferData.
+     */
+    void allocate(size_t count, GLenum usage = GL_DYNAMIC_COPY) {
+        recreate();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(T), nullptr, usage);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    /**
+     * Switches the buffer to streaming mode, with immutable storage for STREAM_REGIONS regions of capacity elements each,
+     * persistently and coherently mapped. The contents start zeroed. Any previous storage is discarded.
+     * Needs GL 4.4 or ARB_buffer_storage, the buffer is left as it is without them.
+     * @param capacity The maximum number of elements.
+     * @return true if the storage was created and mapped, false otherwise.
+     */
+    bool createStream(size_t capacity) {
+        // the contexts are 4.3, persistent mapping is an extension there
+        if (!GLEW_ARB_buffer_storage && !GLEW_VERSION_4_4)
+            return false;
+
+        // immutable storage can't be respecified, a new buffer object is needed
+        destroyStream();
+        glDeleteBuffers(1, &bufferID);
+        glGenBuffers(1, &bufferID);
+        immutable = true;
+
+        GLint alignment = 1;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        region_stride = (capacity * sizeof(T) + alignment - 1) / alignment * alignment;
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, STREAM_REGIONS * region_stride, nullptr, flags);
+        mapped = (T *)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, STREAM_REGIONS * region_stride, flags);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (mapped == nullptr) {
+            std::cerr << "Failed to map streaming buffer" << std::endl;
+            return false;
+        }
+
+        this->capacity = capacity;
+        region = 0;
+        shadow.assign(capacity, T());
+        for (int i = 0; i < STREAM_REGIONS; i++) {
+            memset((void *)getRegion(i), 0, capacity * sizeof(T));
+            dirty_begin[i] = dirty_end[i] = 0;
+        }
+        return true;
+    }
+
+    /**
+     * Writes elements into this frame's region. Streaming mode only.
+     * The other regions catch up when they become current, so a range only has to be written when it changes.
+     * @param offset The index of the first element to write.
+     * @param data The elements to write.
+     * @param count The number of elements to write.
+     */
+    void update(size_t offset, const T *data, size_t count) {
+        if (mapped == nullptr || offset + count > capacity) {
+            std::cerr << "Buffer update out of range or not streaming" << std::endl;
+            return;
+        }
+        memcpy((void *)(shadow.data() + offset), data, count * sizeof(T));
+        memcpy((void *)(getRegion(region) + offset), data, count * sizeof(T));
+        for (int i = 0; i < STREAM_REGIONS; i++) {
+            if (i == region)
+                continue;
+            bool clean = dirty_begin[i] == dirty_end[i];
+            dirty_begin[i] = clean ? offset : std::min(dirty_begin[i], offset);
+            dirty_end[i] = clean ? offset + count : std::max(dirty_end[i], offset + count);
+        }
+    }
+
+    /** Writes a range of elements into this frame's region, see update(size_t, const T*, size_t). */
+    void update(size_t offset, const std::vector<T> &data) { update(offset, data.data(), data.size()); }
+
+    /**
+     * Finishes the frame in streaming mode: fences this frame's region, which the GPU reads until the commands issued
+     * so far completed, and makes the next region current. Waits only if the GPU is STREAM_REGIONS frames behind.
+     * Call once per frame, after the draw calls that use the buffer. The next region has to be bound again.
+     */
+    void nextRegion() {
+        if (mapped == nullptr)
+            return;
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % STREAM_REGIONS;
+
+        GLsync &fence = fences[region];
+        if (fence) {
+            GLbitfield flags = 0;
+            while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+                flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        // bring the region up to date with what was written while the GPU read it
+        if (dirty_begin[region] != dirty_end[region]) {
+            size_t begin = dirty_begin[region], end = dirty_end[region];
+            memcpy((void *)(getRegion(region) + begin), shadow.data() + begin, (end - begin) * sizeof(T));
+            dirty_begin[region] = dirty_end[region] = 0;
+        }
+    }
+
+    /**
+     * Binds the buffer to an indexed shader storage binding point, e.g. `layout(std430, binding = 0)`.
+     * In streaming mode only this frame's region is bound.
+     * @param binding The index of the binding point.
+     */
+    void bind(GLuint binding) const {
+        if (mapped)
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, bufferID, region * region_stride, capacity * sizeof(T));
+        else
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, bufferID);
+    }
+
+    /** @return true if the buffer is in streaming mode. */
+    bool isStreaming() const {
+        return mapped != nullptr;
+    }
+
     GLuint getBufferID() const {
         return bufferID;
     }
@@ -34,17 +220,38 @@ public:
     // Allow move semantics
     Buffer(Buffer&& other) noexcept : bufferID(other.bufferID) {
         other.bufferID = 0;
+        takeStream(other);
     }
 
     Buffer& operator=(Buffer&& other) noexcept {
         if (this != &other) {
+            destroyStream();
             glDeleteBuffers(1, &bufferID);
             bufferID = other.bufferID;
             other.bufferID = 0;
+            takeStream(other);
         }
         return *this;
     }
 
+private:
+    void takeStream(Buffer &other) {
+        immutable = other.immutable;
+        mapped = other.mapped;
+        capacity = other.capacity;
+        region_stride = other.region_stride;
+        region = other.region;
+        shadow = std::move(other.shadow);
+        for (int i = 0; i < STREAM_REGIONS; i++) {
+            fences[i] = other.fences[i];
+            dirty_begin[i] = other.dirty_begin[i];
+            dirty_end[i] = other.dirty_end[i];
+            other.fences[i] = nullptr;
+        }
+        other.mapped = nullptr;
+        other.capacity = 0;
+        other.immutable = false;
+    }
 };
 
 #endif//_BUFFER_H_
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "Camera.h"
+#include "Profiler.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -14,6 +17,9 @@ const GLfloat vertices[20] = {
     -1.0f,  1.0f, 0.0f, 0.0f, 1.0f  // Top left corner
 };
 const GLuint indices[6] = { 0, 1, 2, 2, 3, 0 };
+constexpr GLuint ACCUMULATION_TEXTURE_UNIT = 0;
+constexpr GLuint ALBEDO_TEXTURE_UNIT = 2;       // after the brick atlas' unit, see SDFVolume.h
+constexpr GLuint NORMAL_DEPTH_TEXTURE_UNIT = 3;
 
 void init_quad_data(GLuint &VAO, GLuint &VBO, GLuint &EBO)
 {
@@ -40,11 +46,22 @@ void init_quad_data(GLuint &VAO, GLuint &VBO, GLuint &EBO)
     glEnableVertexAttribArray(1);
 }
 
-Camera::Camera(){}
+Camera::Camera() : context(nullptr), shader(nullptr), render_scale(1.0f), VAO(0), VBO(0), EBO(0), version(0), shader_generation(0), wavefront(nullptr), denoiser(nullptr), reprojector(nullptr)
+{
+    set_position(0.0f, 0.0f, -5.0f);
+    set_rotation(0.0f, 0.0f);
+    set_fov(60.0f);
+}
 Camera::Camera(EngineContext *context, Shader *shader)
 {
     this->context = context;
     this->shader = shader;
+    this->version = 0;
+    this->render_scale = 1.0f;
+    this->wavefront = nullptr;
+    this->denoiser = nullptr;
+    this->reprojector = nullptr;
+    this->accumulation = std::make_unique<AccumulationBuffer>();
 
     set_position(0.0f, 0.0f, -5.0f);
     set_rotation(0.0f, 0.0f);
@@ -52,30 +69,101 @@ Camera::Camera(EngineContext *context, Shader *shader)
 
     init_quad_data(VAO, VBO, EBO);
     shader->use();
+
+    uniforms.cam2world      = shader->uniform<mat4>("cam2world");
+    uniforms.near_clip_data = shader->uniform<vec2>("near_clip_data");
+    uniforms.pixel_size     = shader->uniform<vec2>("pixel_size");
+    uniforms.sample_index   = shader->uniform<GLuint>("sample_index");
+    uniforms.accumulation   = shader->uniform<GLint>("accumulation");
+    uniforms.accumulation_albedo       = shader->uniform<GLint>("accumulation_albedo");
+    uniforms.accumulation_normal_depth = shader->uniform<GLint>("accumulation_normal_depth");
+    shader_generation = shader->get_generation() - 1; // set up the uniforms on the first render
 }
 
 void Camera::render() {
-    // calculate & set the cam2world matrix
-    shader->setMatrix("cam2world", inverse(mat4_cast(conjugate(rotation)) * mat4(1,0,0,0,0,1,0,0,0,0,1,0,-position.x,-position.y,-position.z,1)));
-    
-    // calculate & set the near clip data (width, height)
+    // trace at the render scale, the result is upscaled to the render target
+    int width, height;
+    context->get_size(&width, &height);
+    int trace_width = std::max(1, (int)std::lround(width * render_scale));
+    int trace_height = std::max(1, (int)std::lround(height * render_scale));
+
+    {
+        PROFILE_SCOPE("uniforms");
+
+        // a reloaded program starts with default uniforms and renders a different image
+        if (shader->get_generation() != shader_generation) {
+            shader_generation = shader->get_generation();
+            uniforms.accumulation.set(ACCUMULATION_TEXTURE_UNIT);
+            uniforms.accumulation_albedo.set(ALBEDO_TEXTURE_UNIT);
+            uniforms.accumulation_normal_depth.set(NORMAL_DEPTH_TEXTURE_UNIT);
+            accumulation->reset();
+        }
+        if (wavefront && wavefront->reloaded())
+            accumulation->reset();
+
+        // calculate & set the cam2world matrix
+        uniforms.cam2world.set(get_cam2world());
+
+        // calculate & set the near clip data (width, height)
+        uniforms.near_clip_data.set(get_near_clip_data((float)width / (float)height));
+
+        // restart the accumulation if the view or the size changed, then set up the next sample
+        accumulation->prepare(trace_width, trace_height, version);
+        uniforms.sample_index.set(accumulation->get_sample_index());
+        uniforms.pixel_size.set(vec2(1.0f / trace_width, 1.0f / trace_height));
+    }
+
+    if (wavefront) {
+        // the kernels write the new average themselves
+        wavefront->render(get_cam2world(), get_near_clip_data((float)width / (float)height), trace_width, trace_height, *accumulation);
+    } else {
+        PROFILE_GPU_SCOPE("draw");
+
+        // Draw the quad into the accumulation buffer, with the program the compute passes of the last frame replaced
+        shader->use();
+        accumulation->bind_features(ALBEDO_TEXTURE_UNIT, NORMAL_DEPTH_TEXTURE_UNIT);
+        accumulation->bind(ACCUMULATION_TEXTURE_UNIT);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    }
+
+    // the new average becomes the latest one, on the first sample of a new view it still has to be blended with the previous view's
+    accumulation->finish();
+    vec2 near_clip_data = get_near_clip_data((float)width / (float)height);
+    if (reprojector && accumulation->is_reprojecting())
+        reprojector->apply(*accumulation, get_cam2world(), near_clip_data, history_cam2world, history_near_clip_data);
+    history_cam2world = get_cam2world();
+    history_near_clip_data = near_clip_data;
+
+    // copy the new average, or the denoised one, into the window or the offscreen target of a headless context
+    if (denoiser && accumulation->has_features()) {
+        denoiser->apply(*accumulation);
+        PROFILE_GPU_SCOPE("resolve");
+        denoiser->resolve(context->framebuffer, width, height);
+    } else {
+        PROFILE_GPU_SCOPE("resolve");
+        accumulation->resolve(context->framebuffer, width, height);
+    }
+
+    // swap buffers (headless contexts never present)
+    PROFILE_SCOPE("swap");
+    context->present();
+}
+
+mat4 Camera::get_cam2world() const
+    { return inverse(mat4_cast(conjugate(rotation)) * mat4(1,0,0,0,0,1,0,0,0,0,1,0,-position.x,-position.y,-position.z,1)); }
+
+vec2 Camera::get_near_clip_data(float aspect_ratio) const {
     // we use an imaginary clip plane at distance 1.0 to calculate the ray position and direction 
     // we don't actually clip
     GLfloat near_clip_width = 2.0f * tan(radians(fov / 2.0f));
-    GLfloat near_clip_height = near_clip_width / context->get_aspect_ratio();
-    shader->setFloat2("near_clip_data", vec2(near_clip_width, near_clip_height));
-
-    // Draw the quad
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    // swap buffers
-    SDL_GL_SwapWindow(context->window);
+    GLfloat near_clip_height = near_clip_width / aspect_ratio;
+    return vec2(near_clip_width, near_clip_height);
 }
 
 vec3 Camera::get_position()
     { return this->position; }
 void Camera::set_position(vec3 position)
-    { this->position = position; }
+    { this->position = position; version++; }
 
 vec2 Camera::get_rotation()
     { return angular_rotation; }
@@ -83,15 +171,28 @@ vec2 Camera::get_rotation()
 void Camera::set_rotation(GLfloat pitch, GLfloat yaw) {
     angular_rotation = vec2(pitch, yaw);
     rotation = angleAxis(radians(yaw), glm::vec3(0, 1, 0)) * angleAxis(radians(pitch), glm::vec3(1, 0, 0));
+    version++;
 }
 
 GLfloat Camera::get_fov()
     { return this->fov; }
 void Camera::set_fov(float fov)
-    { this->fov = fov; this->fov_rad = radians(fov); }
+    { this->fov = fov; this->fov_rad = radians(fov); version++; }
+
+CameraState Camera::get_state() const
+    { return {position, angular_rotation, fov}; }
+
+void Camera::set_state(const CameraState &state) {
+    if (state.position != position)
+        set_position(state.position);
+    if (state.rotation != angular_rotation)
+        set_rotation(state.rotation);
+    if (state.fov != fov)
+        set_fov(state.fov);
+}
 
 void Camera::move_by(vec3 delta)
-    { this->position += delta; }
+    { set_position(this->position + delta); }
 
 void Camera::move_by_local(vec3 delta)
     { move_by((vec3)(mat4_cast(this->rotation) * vec4(delta.x, 0, delta.z, 1.0f)) + vec3(0,delta.y,0)); }
@@ -106,6 +207,10 @@ void Camera::rotate_by_clamped(GLfloat dpitch, GLfloat dyaw, GLfloat min, GLfloa
 
 Camera::~Camera()
 {
+    // cameras that never rendered through OpenGL have nothing to clean up
+    if (VAO == 0)
+        return;
+
     // Unbind the VAO, VBO, and EBO
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
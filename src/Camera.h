@@ -6,8 +6,23 @@
 #include <glm/gtc/quaternion.hpp>
 #include "EngineContext.h"
 #include "Shader.h"
+#include "AccumulationBuffer.h"
+#include "WavefrontTracer.h"
+#include "Denoiser.h"
+#include "Reprojector.h"
+#include <cstdint>
+#include <memory>
 using namespace glm;
 
+/**
+ * A snapshot of a camera's view, handed from the thread simulating the camera to the one rendering it.
+ */
+struct CameraState {
+    vec3 position;  /** The position. */
+    vec2 rotation;  /** The rotation as (pitch,yaw) in degrees. */
+    float fov;      /** The field of view in degrees. */
+};
+
 /**
  * The Camera class represents a camera in the 3D world.
  * It is responsible for rendering the scene from its point of view.
@@ -21,7 +36,33 @@ private:
     quat rotation;
     float fov;
     float fov_rad;
+    float render_scale; // the resolution frames are traced at, relative to the render target's
     GLuint VAO, VBO, EBO;
+    uint64_t version; // incremented whenever the view changes
+    uint32_t shader_generation; // the generation of the shader program the uniforms were set up for
+    std::unique_ptr<AccumulationBuffer> accumulation;
+    WavefrontTracer *wavefront; // traces the frames instead of the fragment kernel if set
+    Denoiser *denoiser;         // filters the average before it is shown if set
+    Reprojector *reprojector;   // carries the average over to the next view if set
+    mat4 history_cam2world;     // the view the latest average was rendered from, for the reprojector
+    vec2 history_near_clip_data;
+    struct {
+        Uniform<mat4> cam2world;
+        Uniform<vec2> near_clip_data;
+        Uniform<vec2> pixel_size;
+        Uniform<GLuint> sample_index;
+        Uniform<GLint> accumulation;
+        Uniform<GLint> accumulation_albedo;
+        Uniform<GLint> accumulation_normal_depth;
+    } uniforms; // resolved once, they stay valid across shader reloads
+
+    /** Makes the accumulation keep what the denoiser and the reprojector need. */
+    inline void update_accumulation() {
+        if (!accumulation)
+            return;
+        accumulation->set_features(denoiser != nullptr || reprojector != nullptr);
+        accumulation->set_history(reprojector != nullptr);
+    }
 public:
     Camera();
     /**
@@ -106,7 +147,67 @@ public:
     /** Rotates the camera by the specified delta, clamping it vertically to [min,max]. @param delta The delta as (pitch,yaw) in degrees [-180,180]. */
     inline void rotate_by_clamped(vec2 delta, GLfloat min, GLfloat max) { rotate_by_clamped(delta.x, delta.y, min, max); }
 
-    /** Renders the scene from the camera's point of view. */
+    /** Gets the matrix transforming camera space into world space. @return The cam2world matrix. */
+    mat4 get_cam2world() const;
+    /**
+     * Gets the size of the (imaginary) near clip plane at distance 1.0, used to generate the rays.
+     * @param aspect_ratio The aspect ratio of the render target as width / height.
+     * @return The near clip data as (width, height).
+     */
+    vec2 get_near_clip_data(float aspect_ratio) const;
+
+    /**
+     * Gets the version of the camera's view, which changes whenever its position, rotation or fov does.
+     * Renderers accumulating samples over several frames restart when it changes.
+     * @return The version of the view.
+     */
+    inline uint64_t get_version() const { return version; }
+
+    /** Gets a snapshot of the camera's view. @return The camera's position, rotation and field of view. */
+    CameraState get_state() const;
+    /**
+     * Moves the camera to a snapshot of another one's view.
+     * The version only changes if the view does, so a camera that stands still keeps accumulating samples.
+     * @param state The snapshot.
+     */
+    void set_state(const CameraState &state);
+
+    /** Changes the version of the view without moving, so accumulated samples are discarded after the scene changed. */
+    inline void invalidate() { version++; }
+
+    /**
+     * Sets the resolution frames are traced at, they are upscaled to the render target. Changing it discards the accumulated samples.
+     * @param scale The scale of both axes relative to the render target's size, in (0,1].
+     */
+    inline void set_render_scale(float scale) { render_scale = scale; }
+    /** @return The resolution frames are traced at, relative to the render target's. */
+    inline float get_render_scale() const { return render_scale; }
+
+    /**
+     * Traces the frames with the compute kernels of a WavefrontTracer instead of the fragment kernel.
+     * @param tracer The tracer, has to outlive the camera, or nullptr for the fragment kernel.
+     */
+    inline void set_wavefront(WavefrontTracer *tracer) { wavefront = tracer; if (accumulation) accumulation->reset(); }
+
+    /**
+     * Shows the frames filtered by a Denoiser, which makes the tracers average the features guiding it as well.
+     * The accumulation itself stays unfiltered, so every frame filters the average of all samples so far.
+     * @param denoiser The denoiser, has to outlive the camera, or nullptr to show the average as it is.
+     */
+    inline void set_denoiser(Denoiser *denoiser) { this->denoiser = denoiser; update_accumulation(); }
+
+    /**
+     * Reprojects the accumulated average into the new view whenever the camera moves, instead of starting from nothing.
+     * The tracers average the features then, the reprojection finds the same surfaces through their depth and normal.
+     * @param reprojector The reprojector, has to outlive the camera, or nullptr to restart the average on every move.
+     */
+    inline void set_reprojector(Reprojector *reprojector) { this->reprojector = reprojector; update_accumulation(); }
+
+    /**
+     * Renders the scene from the camera's point of view.
+     * While the camera doesn't move, every frame adds one jittered sample per pixel to the average of the previous ones.
+     * After it moved, the first sample of the new view restarts the average, or is blended with the reprojected one.
+     */
     void render();
 
     /** Destroys the camera object. */
@@ -0,0 +1,89 @@
+#include "Denoiser.h"
+#include "Profiler.h"
+#include <iostream>
+
+constexpr const char *DENOISE_SOURCE = "src/shaders/denoise.glsl";
+
+constexpr GLuint COLOR_IN_IMAGE_UNIT = 0;     // `color_in` in denoise.glsl
+constexpr GLuint ALBEDO_IMAGE_UNIT = 1;       // `albedo` in denoise.glsl
+constexpr GLuint NORMAL_DEPTH_IMAGE_UNIT = 2; // `normal_depth` in denoise.glsl
+constexpr GLuint COLOR_OUT_IMAGE_UNIT = 3;    // `color_out` in denoise.glsl
+constexpr GLuint PIXEL_GROUP_SIZE = 8;        // the workgroup size of the kernel along x and y
+
+bool Denoiser::create(const DenoiseSettings &settings) {
+    this->settings = settings;
+    if (!filter.create_compute(DENOISE_SOURCE))
+        return false;
+
+    uniforms.step_size         = filter.uniform<GLint>("step_size");
+    uniforms.inv_sigma_color2  = filter.uniform<GLfloat>("inv_sigma_color2");
+    uniforms.inv_sigma_normal2 = filter.uniform<GLfloat>("inv_sigma_normal2");
+    uniforms.inv_sigma_albedo2 = filter.uniform<GLfloat>("inv_sigma_albedo2");
+    uniforms.sigma_depth2      = filter.uniform<GLfloat>("sigma_depth2");
+    return true;
+}
+
+void Denoiser::destroy() {
+    if (framebuffers[0] != 0)
+        glDeleteFramebuffers(2, framebuffers);
+    if (textures[0] != 0)
+        glDeleteTextures(2, textures);
+    framebuffers[0] = framebuffers[1] = 0;
+    textures[0] = textures[1] = 0;
+}
+
+void Denoiser::resize(int width, int height) {
+    destroy();
+    this->width = width;
+    this->height = height;
+
+    glGenTextures(2, textures);
+    glGenFramebuffers(2, framebuffers);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Denoiser framebuffer is incomplete" << std::endl;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Denoiser::apply(const AccumulationBuffer &accumulation) {
+    PROFILE_GPU_SCOPE("denoise");
+    if (accumulation.get_width() != width || accumulation.get_height() != height)
+        resize(accumulation.get_width(), accumulation.get_height());
+
+    // the guides are the same for every pass, only the colors ping-pong
+    glBindImageTexture(ALBEDO_IMAGE_UNIT, accumulation.get_texture(ACCUMULATION_ALBEDO), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(NORMAL_DEPTH_IMAGE_UNIT, accumulation.get_texture(ACCUMULATION_NORMAL_DEPTH), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    uniforms.inv_sigma_normal2.set(1.0f / (settings.sigma_normal * settings.sigma_normal));
+    uniforms.inv_sigma_albedo2.set(1.0f / (settings.sigma_albedo * settings.sigma_albedo));
+    uniforms.sigma_depth2.set(settings.sigma_depth * settings.sigma_depth);
+
+    GLuint groups_x = (width + PIXEL_GROUP_SIZE - 1) / PIXEL_GROUP_SIZE;
+    GLuint groups_y = (height + PIXEL_GROUP_SIZE - 1) / PIXEL_GROUP_SIZE;
+    GLuint input = accumulation.get_texture(ACCUMULATION_COLOR);
+    for (int pass = 0; pass < settings.passes; pass++) {
+        result = pass % 2;
+        float sigma_color = settings.sigma_color / (float)(1 << pass);
+        uniforms.step_size.set(1 << pass);
+        uniforms.inv_sigma_color2.set(1.0f / (sigma_color * sigma_color));
+        glBindImageTexture(COLOR_IN_IMAGE_UNIT, input, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(COLOR_OUT_IMAGE_UNIT, textures[result], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        filter.dispatch(groups_x, groups_y);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        input = textures[result];
+    }
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+}
+
+void Denoiser::resolve(GLuint target, int target_width, int target_height)
+    { blit_framebuffer(framebuffers[result], width, height, target, target_width, target_height); }
+
+Denoiser::~Denoiser() { destroy(); }
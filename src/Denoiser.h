@@ -0,0 +1,82 @@
+#ifndef _DENOISER_H_
+#define _DENOISER_H_
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "AccumulationBuffer.h"
+using namespace glm;
+
+/**
+ * The parameters of the edge-avoiding à-trous filter, shared by the Denoiser and the CPUDenoiser.
+ * A tap's weight falls off with its difference to the filtered pixel in every guide, relative to the guide's sigma.
+ */
+struct DenoiseSettings {
+    int passes = 5;             /** The passes of the 5x5 kernel, the taps of pass i are 2^i pixels apart. */
+    float sigma_color = 1.0f;   /** The color difference of the first pass, halved every pass as the noise goes down. */
+    float sigma_normal = 0.3f;  /** The normal difference, about 17 degrees. */
+    float sigma_albedo = 0.1f;  /** The albedo difference. */
+    float sigma_depth = 0.05f;  /** The depth difference, relative to the filtered pixel's depth. */
+};
+
+/**
+ * The Denoiser class filters the AccumulationBuffer's average with an edge-avoiding à-trous wavelet filter on the GPU,
+ * guided by the albedo, normal and depth the tracers average along with the color. Every pass is a compute dispatch of
+ * a 5x5 kernel whose taps spread twice as far as the last pass', so a few passes cover a wide footprint at 25 taps each.
+ */
+class Denoiser {
+private:
+    Shader filter;
+    struct {
+        Uniform<GLint> step_size;
+        Uniform<GLfloat> inv_sigma_color2;
+        Uniform<GLfloat> inv_sigma_normal2;
+        Uniform<GLfloat> inv_sigma_albedo2;
+        Uniform<GLfloat> sigma_depth2;
+    } uniforms;
+    DenoiseSettings settings;
+    GLuint framebuffers[2] = {0, 0};
+    GLuint textures[2] = {0, 0}; // the passes ping-pong between them
+    int result = 0;              // the texture holding the last pass' output
+    int width = 0, height = 0;
+
+    void destroy();
+    /** (Re)creates the textures for a number of pixels. */
+    void resize(int width, int height);
+public:
+    Denoiser() {}
+
+    /**
+     * Compiles the filter kernel.
+     * @param settings The parameters of the filter.
+     * @return True if the kernel compiled, false otherwise.
+     */
+    bool create(const DenoiseSettings &settings);
+
+    /** @return The filter kernel, e.g. for the ShaderWatcher. */
+    inline Shader *get_shader() { return &filter; }
+
+    /**
+     * Filters the latest average of an accumulation buffer that keeps features.
+     * @param accumulation The accumulation buffer, after its sample was finished.
+     */
+    void apply(const AccumulationBuffer &accumulation);
+
+    /**
+     * Copies the filtered image into the target framebuffer, upscaling it bilinearly if the target is larger.
+     * @param target The framebuffer to copy the image into, 0 for the window.
+     * @param target_width The width of the target framebuffer.
+     * @param target_height The height of the target framebuffer.
+     */
+    void resolve(GLuint target, int target_width, int target_height);
+
+    /** Frees the textures. */
+    ~Denoiser();
+
+    // Disallow copying, the GL objects are owned
+    Denoiser(const Denoiser&) = delete;
+    Denoiser& operator=(const Denoiser&) = delete;
+};
+
+#endif//_DENOISER_H_
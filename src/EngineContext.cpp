@@ -1,7 +1,11 @@
 #include "EngineContext.h"
 #include <iostream>
+#include <cstring>
+#include <vector>
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 
 bool EngineContext::create(const char *title, int pos_x, int pos_y, int width, int height, int win_flags, int rnd_flags)
 {
@@ -48,15 +52,166 @@ bool EngineContext::create(const char *title, int pos_x, int pos_y, int width, i
     return true;
 }
 
+// creates a surfaceless EGL context (no window, no pbuffer), the display is picked without a window system
+bool create_egl_context(EGLDisplay &display, EGLContext &context)
+{
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (client_extensions != nullptr && strstr(client_extensions, "EGL_MESA_platform_surfaceless") && eglGetPlatformDisplayEXT != nullptr)
+        display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    else
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cerr << "eglInitialize Error: " << std::hex << eglGetError() << std::dec << std::endl;
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (extensions == nullptr || !strstr(extensions, "EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL Error: no surfaceless desktop OpenGL support" << std::endl;
+        return false;
+    }
+
+    // a config is only needed by implementations without EGL_KHR_no_config_context
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!strstr(extensions, "EGL_KHR_no_config_context")) {
+        const EGLint config_attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLint num_configs = 0;
+        if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+            std::cerr << "eglChooseConfig Error: " << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "eglCreateContext Error: " << std::hex << eglGetError() << std::dec << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool EngineContext::create_headless(int width, int height)
+{
+    headless = true;
+    this->width = width;
+    this->height = height;
+
+    if (!create_egl_context(egl_display, egl_context)) {
+        std::cerr << "No OpenGL available, continuing without it (CPU rendering only)" << std::endl;
+        if (egl_display != EGL_NO_DISPLAY)
+            eglTerminate(egl_display);
+        egl_display = EGL_NO_DISPLAY;
+        egl_context = EGL_NO_CONTEXT;
+        return true;
+    }
+
+    // initialize GLEW, GLEW builds for GLX complain about the missing X display but load the functions anyway
+    glewExperimental = GL_TRUE;
+    GLenum glewError = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (glewError == GLEW_ERROR_NO_GLX_DISPLAY)
+        glewError = GLEW_OK;
+#endif
+    if (glewError != GLEW_OK) {
+        std::cerr << "Error initializing GLEW! " << glewGetErrorString(glewError) << std::endl;
+        return false;
+    }
+
+    // create the offscreen render target, it stays bound as the default target
+    glGenTextures(1, &color_texture);
+    glBindTexture(GL_TEXTURE_2D, color_texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+        return false;
+    }
+    glViewport(0, 0, width, height);
+
+    return true;
+}
+
+bool EngineContext::has_gl()
+    { return gl_context != nullptr || egl_context != EGL_NO_CONTEXT; }
+
+void EngineContext::get_size(int *width, int *height)
+{
+    if (headless) {
+        *width = this->width;
+        *height = this->height;
+        return;
+    }
+    SDL_GL_GetDrawableSize(window, width, height);
+}
+
 float EngineContext::get_aspect_ratio()
 {
     int width, height;
-    SDL_GetWindowSize(window, &width, &height);
+    get_size(&width, &height);
     return (float)width / (float)height;
 }
 
+bool EngineContext::make_current(bool current)
+{
+    bool success;
+    if (headless)
+        success = eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, current ? egl_context : EGL_NO_CONTEXT);
+    else
+        success = SDL_GL_MakeCurrent(window, current ? gl_context : nullptr) == 0;
+    if (!success)
+        std::cerr << "Failed to " << (current ? "bind" : "release") << " the OpenGL context" << std::endl;
+    return success;
+}
+
+void EngineContext::present()
+{
+    if (!headless)
+        SDL_GL_SwapWindow(window);
+}
+
+void EngineContext::read_pixels(Framebuffer &out)
+{
+    out.resize(width, height);
+    std::vector<vec3> rows((size_t)width * height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, rows.data());
+
+    // OpenGL returns the rows bottom up
+    for (int y = 0; y < height; y++)
+        std::copy(rows.begin() + (size_t)(height - 1 - y) * width, rows.begin() + (size_t)(height - y) * width, out.pixels.begin() + (size_t)y * width);
+}
+
 EngineContext::~EngineContext()
 {
+    if (framebuffer != 0)
+        glDeleteFramebuffers(1, &framebuffer);
+    if (color_texture != 0)
+        glDeleteTextures(1, &color_texture);
+    if (egl_display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (egl_context != EGL_NO_CONTEXT)
+            eglDestroyContext(egl_display, egl_context);
+        eglTerminate(egl_display);
+    }
+    if (headless)
+        return;
+
     if(renderer != nullptr)
         SDL_DestroyRenderer(renderer);
     if(window != nullptr)
@@ -2,13 +2,26 @@
 #define _ENGINECONTEXT_H_
 
 #include <SDL2/SDL.h>
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include "Framebuffer.h"
 
-/** The EngineContext struct contains the necessary SDL and OpenGL contexts for the engine. */
+/**
+ * The EngineContext struct contains the necessary SDL and OpenGL contexts for the engine.
+ * A headless context has no window, it renders into an offscreen framebuffer using a surfaceless EGL context.
+ */
 struct EngineContext {
-    SDL_Window *window; /** The SDL window. */
-    SDL_Renderer *renderer; /** The SDL renderer. */
+    SDL_Window *window = nullptr; /** The SDL window, nullptr for headless contexts. */
+    SDL_Renderer *renderer = nullptr; /** The SDL renderer, nullptr for headless contexts. */
     SDL_Event event; /** The SDL event. */
-    SDL_GLContext gl_context; /** The OpenGL context. */
+    SDL_GLContext gl_context = nullptr; /** The OpenGL context of the window. */
+
+    bool headless = false; /** Whether this context renders offscreen instead of into a window. */
+    int width = 0, height = 0; /** The size of the headless render target. */
+    EGLDisplay egl_display = EGL_NO_DISPLAY; /** The EGL display of a headless context. */
+    EGLContext egl_context = EGL_NO_CONTEXT; /** The OpenGL context of a headless context. */
+    GLuint framebuffer = 0; /** The framebuffer to render into, 0 (the window) unless headless. */
+    GLuint color_texture = 0; /** The color attachment of the headless framebuffer. */
 
     /**
      * Creates the EngineContext.
@@ -23,6 +36,26 @@ struct EngineContext {
      */
     bool create(const char *title, int pos_x, int pos_y, int width, int height, int win_flags, int rnd_flags);
 
+    /**
+     * Creates a headless EngineContext that renders into an offscreen framebuffer and never presents.
+     * No window and no display are needed. If no OpenGL implementation is available, the context is
+     * still created, but without OpenGL (see has_gl), so only the CPU tracer can be used.
+     * @param width The width of the render target.
+     * @param height The height of the render target.
+     * @return True if the context was created, false otherwise.
+     */
+    bool create_headless(int width, int height);
+
+    /** @return True if the context has an OpenGL context, false for a headless context without OpenGL. */
+    bool has_gl();
+
+    /**
+     * Gets the size of the render target in pixels, the drawable size of the window or the size of the headless target.
+     * @param width Receives the width.
+     * @param height Receives the height.
+     */
+    void get_size(int *width, int *height);
+
     /**
      * Gets the aspect ratio of the window.
      * @return The aspect ratio of the window.
@@ -30,6 +63,23 @@ struct EngineContext {
      */
     float get_aspect_ratio();
 
+    /**
+     * Binds the OpenGL context to the calling thread, or releases it from the calling thread so another one can bind it.
+     * A context is current on the thread that created it, and on at most one thread at a time.
+     * @param current True to bind the context, false to release it.
+     * @return True on success, false otherwise.
+     */
+    bool make_current(bool current);
+
+    /** Presents the rendered frame by swapping the window's buffers. Does nothing for headless contexts. */
+    void present();
+
+    /**
+     * Reads the headless render target back into main memory.
+     * @param out The framebuffer to read into, it is resized to the render target's size.
+     */
+    void read_pixels(Framebuffer &out);
+
     /** Frees the SDL and OpenGL contexts. */
     ~EngineContext();
 };
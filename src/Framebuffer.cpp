@@ -0,0 +1,26 @@
+#include "Framebuffer.h"
+#include <cstdio>
+#include <vector>
+#include <glm/glm.hpp>
+using namespace glm;
+
+bool Framebuffer::write_ppm(const char *filepath) const {
+    FILE *file = fopen(filepath, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not open file: '%s'\n", filepath);
+        return false;
+    }
+
+    std::vector<unsigned char> bytes(pixels.size() * 3);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        vec3 c = clamp(pixels[i], 0.0f, 1.0f) * 255.0f + 0.5f;
+        bytes[i * 3 + 0] = (unsigned char)c.x;
+        bytes[i * 3 + 1] = (unsigned char)c.y;
+        bytes[i * 3 + 2] = (unsigned char)c.z;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool success = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    success &= fclose(file) == 0;
+    return success;
+}
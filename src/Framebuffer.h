@@ -0,0 +1,61 @@
+#ifndef _FRAMEBUFFER_H_
+#define _FRAMEBUFFER_H_
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+using namespace glm;
+
+/**
+ * An in-memory RGB image, rendered into by the CPU tracer or read back from the GPU. Rows are stored top to bottom.
+ * With features, the CPU tracer also averages the albedo, normal and depth of the first surface every pixel shows,
+ * which guide the CPUDenoiser.
+ */
+struct Framebuffer {
+    int width = 0;
+    int height = 0;
+    std::vector<vec3> pixels; /** width * height colors, row major. */
+    bool features = false;      /** Whether the feature planes below are kept, see enable_features. */
+    std::vector<vec3> albedo;   /** width * height albedos like pixels, empty without features. */
+    std::vector<vec3> normals;  /** width * height normals, facing the camera. */
+    std::vector<float> depth;   /** width * height distances from the camera, 0 where nothing was hit. */
+    uint32_t samples = 0;     /** The number of samples averaged in pixels, for progressive rendering. */
+    uint64_t view_version = 0; /** The Camera::get_version() the samples were taken for. */
+
+    Framebuffer() {}
+    Framebuffer(int width, int height) { resize(width, height); }
+
+    /** Resizes the framebuffer, discarding its contents. */
+    void resize(int width, int height) {
+        this->width = width;
+        this->height = height;
+        pixels.assign((size_t)width * height, vec3(0.0f));
+        if (features) {
+            albedo.assign(pixels.size(), vec3(0.0f));
+            normals.assign(pixels.size(), vec3(0.0f));
+            depth.assign(pixels.size(), 0.0f);
+        }
+        samples = 0;
+    }
+
+    /** Keeps the feature planes from now on, discarding the contents. */
+    void enable_features() {
+        features = true;
+        resize(width, height);
+    }
+
+    inline vec3 &at(int x, int y) { return pixels[(size_t)y * width + x]; }
+    inline const vec3 &at(int x, int y) const { return pixels[(size_t)y * width + x]; }
+
+    /** @return The aspect ratio of the framebuffer as width / height. */
+    inline float get_aspect_ratio() const { return (float)width / (float)height; }
+
+    /**
+     * Writes the framebuffer to a binary PPM file, clamping the colors to [0,1].
+     * @param filepath The path of the file to write.
+     * @return True if the file was written successfully, false otherwise.
+     */
+    bool write_ppm(const char *filepath) const;
+};
+
+#endif//_FRAMEBUFFER_H_
@@ -0,0 +1,169 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <iostream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// the index of the worker running on this thread, -1 for threads outside the pool
+thread_local int current_worker = -1;
+// whether this thread runs a background job, whose children are background jobs too
+thread_local bool in_background = false;
+
+JobSystem::JobSystem() {
+    unsigned count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (unsigned i = 0; i <= count; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < count; i++)
+        workers.emplace_back(&JobSystem::work, this, i);
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+JobSystem &JobSystem::get() {
+    static JobSystem jobs;
+    return jobs;
+}
+
+JobSystem::JobHandle JobSystem::create(std::function<void()> function, const JobHandle &parent) {
+    JobHandle job = std::make_shared<Job>();
+    job->function = std::move(function);
+    job->parent = parent;
+    if (parent)
+        parent->unfinished++;
+    return job;
+}
+
+void JobSystem::push(const JobHandle &job, bool is_background) {
+    is_background |= in_background;
+    job->background = is_background;
+    Queue &queue = is_background ? background : *queues[current_worker >= 0 ? current_worker : workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    {
+        // counted under the sleep mutex, so a thread checking before it sleeps can't miss the job
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        (is_background ? queued_background : queued)++;
+    }
+    // a waiting thread may be woken instead of a worker, it ignores background jobs
+    if (is_background)
+        wake.notify_all();
+    else
+        wake.notify_one();
+}
+
+JobSystem::JobHandle JobSystem::take(bool allow_background) {
+    auto pop = [](Queue &queue, bool back) -> JobHandle {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            return nullptr;
+        JobHandle job = back ? std::move(queue.jobs.back()) : std::move(queue.jobs.front());
+        if (back)
+            queue.jobs.pop_back();
+        else
+            queue.jobs.pop_front();
+        return job;
+    };
+
+    if (queued.load() > 0) {
+        size_t count = queues.size();
+        size_t own = current_worker >= 0 ? (size_t)current_worker : count - 1;
+        for (size_t i = 0; i < count; i++) {
+            size_t index = (own + i) % count;
+            // the own deque from the back, everything else from the front
+            JobHandle job = pop(*queues[index], i == 0 && current_worker >= 0);
+            if (job) {
+                queued--;
+                return job;
+            }
+        }
+    }
+    if (allow_background && queued_background.load() > 0) {
+        JobHandle job = pop(background, false);
+        if (job) {
+            queued_background--;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(const JobHandle &job) {
+    bool was_background = in_background;
+    in_background = job->background;
+    if (job->function)
+        job->function();
+    in_background = was_background;
+    finish(job);
+}
+
+void JobSystem::finish(const JobHandle &job) {
+    if (job->unfinished.fetch_sub(1) != 1)
+        return;
+    if (job->parent)
+        finish(job->parent);
+    if (waiting.load() > 0) {
+        // taking the mutex orders the notification after a waiter's check of the job
+        { std::lock_guard<std::mutex> lock(sleep_mutex); }
+        wake.notify_all();
+    }
+}
+
+void JobSystem::work(unsigned index) {
+    current_worker = (int)index;
+    while (true) {
+        JobHandle job = take(true);
+        if (job) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [&]() { return stopping || queued.load() > 0 || queued_background.load() > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+void JobSystem::wait(const JobHandle &job) {
+    while (!is_finished(job)) {
+        JobHandle other = take(in_background);
+        if (other) {
+            execute(other);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        waiting++;
+        wake.wait(lock, [&]() { return queued.load() > 0 || (in_background && queued_background.load() > 0) || is_finished(job); });
+        waiting--;
+    }
+}
+
+bool JobSystem::pin_threads() {
+#ifdef __linux__
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    bool pinned = true;
+    for (size_t i = 0; i < workers.size(); i++) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((i + 1) % cores, &set);
+        pinned &= pthread_setaffinity_np(workers[i].native_handle(), sizeof(set), &set) == 0;
+    }
+    if (!pinned)
+        std::cerr << "Failed to pin the worker threads" << std::endl;
+    return pinned;
+#else
+    std::cerr << "Pinning threads is not supported on this platform" << std::endl;
+    return false;
+#endif
+}
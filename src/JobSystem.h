@@ -0,0 +1,120 @@
+#ifndef _JOBSYSTEM_H_
+#define _JOBSYSTEM_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * The JobSystem class is the engine's one pool of worker threads, shared by rendering, BVH construction and asset
+ * loading, so they never oversubscribe the machine. parallel_for (see parallel.h) runs on it.
+ *
+ * Every worker owns a deque: the jobs it spawns go to its back and it takes its next job from there too, the most
+ * recent one, whose data is likely still cached. Idle workers steal from the front of the others', the oldest and
+ * usually largest jobs. Threads outside the pool push to a shared queue. Waiting for a job runs other jobs meanwhile,
+ * so nested waits can't deadlock, and idle workers sleep instead of spinning.
+ *
+ * Background jobs, e.g. BVH rebuilds, get a queue of their own that only the workers take from, so a thread waiting
+ * for its frame's jobs never picks up one that takes seconds. The jobs a background job spawns, e.g. by parallel_for,
+ * are background jobs too, only a thread that waits inside a background job helps with them.
+ */
+class JobSystem {
+public:
+    /** A unit of work. It finishes once its function returned and all its children finished. */
+    struct Job {
+        std::function<void()> function; /** The work, may be empty for jobs that only group their children. */
+        std::shared_ptr<Job> parent;    /** The job that only finishes after this one, or nullptr. */
+        std::atomic<uint32_t> unfinished{1}; /** 1 for the job itself, plus its unfinished children. */
+        bool background = false;        /** Whether the job was queued as a background job. */
+    };
+    using JobHandle = std::shared_ptr<Job>;
+
+private:
+    // a job queue, a worker's deque or one of the shared queues
+    struct Queue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, then the one threads outside the pool push to
+    Queue background;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<int> queued{0};            // the jobs in the worker and shared queues, briefly -1 while a push completes
+    std::atomic<int> queued_background{0}; // the jobs in the background queue
+    std::atomic<int> waiting{0};           // the threads blocked in wait, woken when any job finishes
+    bool stopping = false;
+
+    /** The loop every worker runs until the pool is destroyed. */
+    void work(unsigned index);
+
+    /** Takes a job: from the back of the own deque, then from the front of the others, then the background queue if allowed. */
+    JobHandle take(bool allow_background);
+
+    /** Runs a job and finishes it. */
+    void execute(const JobHandle &job);
+
+    /** Marks a job's own work or one of its children as done, finishing its parent once it is done as a whole. */
+    void finish(const JobHandle &job);
+
+    /** Queues a job and wakes a thread to run it, as a background job if requested or spawned by one. */
+    void push(const JobHandle &job, bool is_background);
+public:
+    /**
+     * Starts the pool with a worker per hardware thread but the one that drives it, which helps while waiting.
+     * At least one worker is started, so background jobs progress even on a single core.
+     */
+    JobSystem();
+
+    /** Stops the workers, jobs still queued are dropped. */
+    ~JobSystem();
+
+    /** @return The engine's pool, started on first use. */
+    static JobSystem &get();
+
+    /**
+     * Creates a job without queuing it yet, so children can be added first.
+     * @param function The work, may be empty.
+     * @param parent The job that only finishes after this one, or nullptr. It must not have finished yet.
+     * @return The job.
+     */
+    JobHandle create(std::function<void()> function, const JobHandle &parent = nullptr);
+
+    /** Queues a job created by create. @param job The job. */
+    inline void run(const JobHandle &job) { push(job, false); }
+
+    /** Queues a job that may run for long, only the workers take it, never a waiting thread. @param job The job. */
+    inline void run_background(const JobHandle &job) { push(job, true); }
+
+    /**
+     * Returns once a job and all its children finished, running other jobs in the meantime.
+     * @param job The job to wait for, queued by run or run_background.
+     */
+    void wait(const JobHandle &job);
+
+    /** @return True if a job and all its children finished. @param job The job. */
+    inline bool is_finished(const JobHandle &job) const { return job->unfinished.load(std::memory_order_acquire) == 0; }
+
+    /** @return The number of threads jobs run on, the workers plus the thread waiting for them. */
+    inline unsigned get_thread_count() const { return (unsigned)workers.size() + 1; }
+
+    /**
+     * Pins every worker to its own core, leaving the first core to the thread driving the pool.
+     * Linux only, elsewhere the workers stay unpinned.
+     * @return True if all workers were pinned, false otherwise.
+     */
+    bool pin_threads();
+
+    // Disallow copying, the workers reference the pool
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+};
+
+#endif//_JOBSYSTEM_H_
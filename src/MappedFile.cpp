@@ -0,0 +1,47 @@
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open(const std::string &filepath, bool sequential) {
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap refuses empty files, they map to an empty range instead
+    length = (size_t)info.st_size;
+    if (length > 0) {
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        if (sequential)
+            madvise(mapping, length, MADV_SEQUENTIAL);
+        bytes = (const char *)mapping;
+    } else {
+        bytes = "";
+    }
+
+    ::close(fd); // the mapping keeps the file alive
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes != nullptr && length > 0)
+        munmap((void *)bytes, length);
+    bytes = nullptr;
+    length = 0;
+}
+
+MappedFile::~MappedFile() { close(); }
@@ -0,0 +1,42 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+/**
+ * The MappedFile class maps a file read-only into memory, so it can be parsed in place without copying it.
+ * Pages are only read from disk when they are touched.
+ */
+class MappedFile {
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+public:
+    MappedFile() {}
+
+    /**
+     * Maps a file, unmapping the previous one.
+     * @param filepath The path of the file.
+     * @param sequential Whether the file will be read front to back, which makes the kernel read ahead aggressively.
+     * @return true if the file was mapped successfully, false otherwise (errno tells why).
+     */
+    bool open(const std::string &filepath, bool sequential = true);
+
+    /** Unmaps the file. */
+    void close();
+
+    /** @return The first byte of the file, nullptr if no file is mapped. */
+    inline const char *data() const { return bytes; }
+    /** @return The size of the file in bytes. */
+    inline size_t size() const { return length; }
+
+    /** Unmaps the file. */
+    ~MappedFile();
+
+    // Disallow copying, the mapping is owned
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+#endif//_MAPPEDFILE_H_
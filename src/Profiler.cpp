@@ -0,0 +1,218 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <GL/glew.h>
+
+constexpr size_t WINDOW_SIZE = 512;      // samples per phase the percentiles are computed over
+constexpr size_t QUERY_RING_SIZE = 4;    // GPU timers in flight per phase, the frames of latency before a result is read
+constexpr size_t MAX_EVENTS = 1 << 20;   // events kept for dump(), later ones only feed the percentiles
+constexpr uint32_t GPU_THREAD = 1000;    // the trace thread id GPU events are shown on
+
+namespace {
+
+// a fixed size ring of the latest samples
+struct Window {
+    uint64_t samples[WINDOW_SIZE];
+    uint64_t count = 0;
+
+    void add(uint64_t sample) { samples[count++ % WINDOW_SIZE] = sample; }
+};
+
+struct GPUQuery {
+    GLuint query = 0;
+    bool pending = false;
+    uint64_t start_ns; // the CPU time the query was issued at, GPU events are placed there in traces
+    uint64_t frame;
+};
+
+struct Phase {
+    const char *name;
+    Window cpu, gpu;
+    GPUQuery queries[QUERY_RING_SIZE];
+    size_t next_query = 0;
+    uint64_t dropped = 0; // GPU samples skipped because all queries were in flight
+};
+
+struct Event {
+    uint32_t phase;
+    uint32_t thread;
+    uint64_t frame;
+    uint64_t start_ns, duration_ns;
+};
+
+std::mutex profiler_mutex;
+std::deque<Phase> phases; // a deque, so phases don't move when new ones are registered
+std::vector<Event> events;
+uint64_t frame = 0;
+
+// small sequential thread ids for the traces
+uint32_t thread_index() {
+    static std::atomic<uint32_t> next_thread{0};
+    thread_local uint32_t index = next_thread++;
+    return index;
+}
+
+void add_event(uint32_t phase, uint32_t thread, uint64_t frame, uint64_t start_ns, uint64_t duration_ns) {
+    if (events.size() < MAX_EVENTS)
+        events.push_back({phase, thread, frame, start_ns, duration_ns});
+}
+
+// looks up a phase, registration by other threads may modify the deque concurrently
+Phase &get_phase(uint32_t id) {
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    return phases[id];
+}
+
+} // namespace
+
+bool Profiler::active = false;
+
+void Profiler::enable(bool enabled) { active = enabled; }
+
+uint32_t Profiler::phase(const char *name) {
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    for (size_t i = 0; i < phases.size(); i++)
+        if (strcmp(phases[i].name, name) == 0)
+            return (uint32_t)i;
+    phases.emplace_back();
+    phases.back().name = name;
+    return (uint32_t)(phases.size() - 1);
+}
+
+void Profiler::record_cpu(uint32_t phase, uint64_t start_ns, uint64_t end_ns) {
+    uint32_t thread = thread_index();
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    phases[phase].cpu.add(end_ns - start_ns);
+    add_event(phase, thread, frame, start_ns, end_ns - start_ns);
+}
+
+namespace {
+
+// reads a finished query, returns false if it is still in flight
+bool collect(uint32_t id, GPUQuery &query, bool wait) {
+    if (!wait) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &elapsed);
+    query.pending = false;
+
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    phases[id].gpu.add(elapsed);
+    add_event(id, GPU_THREAD, query.frame, query.start_ns, elapsed);
+    return true;
+}
+
+// collects the pending queries of every phase in the order they were issued
+void collect_all(bool wait) {
+    for (uint32_t id = 0; id < phases.size(); id++) {
+        Phase &phase = get_phase(id);
+        for (size_t i = 0; i < QUERY_RING_SIZE; i++) {
+            GPUQuery &query = phase.queries[(phase.next_query + i) % QUERY_RING_SIZE];
+            if (query.pending && !collect(id, query, wait))
+                break;
+        }
+    }
+}
+
+} // namespace
+
+bool Profiler::begin_gpu(uint32_t id) {
+    Phase &phase = get_phase(id);
+    GPUQuery &query = phase.queries[phase.next_query];
+    // never wait for the GPU, rather lose the sample
+    if (query.pending && !collect(id, query, false)) {
+        phase.dropped++;
+        return false;
+    }
+    if (query.query == 0)
+        glGenQueries(1, &query.query);
+
+    query.start_ns = Time::now_ns();
+    query.frame = frame;
+    glBeginQuery(GL_TIME_ELAPSED, query.query);
+    return true;
+}
+
+void Profiler::end_gpu(uint32_t id) {
+    Phase &phase = get_phase(id);
+    glEndQuery(GL_TIME_ELAPSED);
+    phase.queries[phase.next_query].pending = true;
+    phase.next_query = (phase.next_query + 1) % QUERY_RING_SIZE;
+}
+
+void Profiler::end_frame() {
+    if (!active)
+        return;
+    collect_all(false);
+    frame++;
+}
+
+void Profiler::finish() {
+    collect_all(true);
+    for (Phase &phase : phases) {
+        for (GPUQuery &query : phase.queries) {
+            if (query.query != 0)
+                glDeleteQueries(1, &query.query);
+            query.query = 0;
+        }
+    }
+}
+
+Profiler::Stats Profiler::stats(uint32_t id, bool gpu) {
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    const Window &window = gpu ? phases[id].gpu : phases[id].cpu;
+    std::vector<uint64_t> sorted(window.samples, window.samples + std::min<uint64_t>(window.count, WINDOW_SIZE));
+    if (sorted.empty())
+        return {0, 0, 0, 0};
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) { return sorted[(size_t)(p * (sorted.size() - 1) + 0.5)]; };
+    return {window.count, percentile(0.50), percentile(0.95), percentile(0.99)};
+}
+
+void Profiler::report(FILE *out) {
+    fprintf(out, "%-16s %8s %28s %28s\n", "phase", "samples", "cpu p50/p95/p99 (ms)", "gpu p50/p95/p99 (ms)");
+    for (uint32_t id = 0; id < phases.size(); id++) {
+        Stats cpu = stats(id, false), gpu = stats(id, true);
+        fprintf(out, "%-16s %8llu   %8.3f %8.3f %8.3f", phases[id].name, (unsigned long long)cpu.count, cpu.p50 / 1e6, cpu.p95 / 1e6, cpu.p99 / 1e6);
+        if (gpu.count > 0)
+            fprintf(out, "   %8.3f %8.3f %8.3f", gpu.p50 / 1e6, gpu.p95 / 1e6, gpu.p99 / 1e6);
+        if (phases[id].dropped > 0)
+            fprintf(out, "   (%llu gpu samples dropped)", (unsigned long long)phases[id].dropped);
+        fprintf(out, "\n");
+    }
+}
+
+bool Profiler::dump(const char *filepath) {
+    FILE *file = fopen(filepath, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not open profile output file: '%s'\n", filepath);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    size_t length = strlen(filepath);
+    if (length >= 5 && strcmp(filepath + length - 5, ".json") == 0) {
+        // Chrome trace event format, timestamps in µs
+        fprintf(file, "{\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", GPU_THREAD);
+        for (const Event &event : events)
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                    phases[event.phase].name, event.thread, event.start_ns / 1e3, event.duration_ns / 1e3, (unsigned long long)event.frame);
+        fprintf(file, "\n]}\n");
+    } else {
+        fprintf(file, "frame,phase,device,thread,start_ns,duration_ns\n");
+        for (const Event &event : events)
+            fprintf(file, "%llu,%s,%s,%u,%llu,%llu\n", (unsigned long long)event.frame, phases[event.phase].name,
+                    event.thread == GPU_THREAD ? "gpu" : "cpu", event.thread == GPU_THREAD ? 0 : event.thread,
+                    (unsigned long long)event.start_ns, (unsigned long long)event.duration_ns);
+    }
+    return fclose(file) == 0;
+}
\ No newline at end of file
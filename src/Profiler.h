@@ -0,0 +1,93 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <GL/glew.h>
+#include "Time.h"
+
+/**
+ * Frame phase instrumentation built on Time::now_ns.
+ * CPU time is measured with scopes, GPU time with GL_TIME_ELAPSED queries that are read back a few frames later,
+ * so the pipeline never stalls. Every phase keeps a rolling window of samples for percentiles, and the individual
+ * events can be dumped as CSV or as a Chrome trace (chrome://tracing, Perfetto).
+ * While disabled, a scope costs a single branch.
+ */
+namespace Profiler
+{
+    /** Whether samples are recorded. Use enable() to change it. */
+    extern bool active;
+
+    /** @return True if samples are recorded. */
+    inline bool enabled() { return active; }
+    /** Enables or disables recording. */
+    void enable(bool enabled);
+
+    /**
+     * Gets the id of a phase, registering it on the first call.
+     * @param name The name of the phase, has to outlive the profiler (a string literal).
+     * @return The id of the phase.
+     */
+    uint32_t phase(const char *name);
+
+    /** Records a CPU sample of a phase, measured in Time::now_ns. */
+    void record_cpu(uint32_t phase, uint64_t start_ns, uint64_t end_ns);
+
+    /** Starts the GPU timer of a phase. GPU timers can't be nested. @return False if the sample is dropped because all queries are in flight. */
+    bool begin_gpu(uint32_t phase);
+    /** Stops the GPU timer of a phase started by begin_gpu. */
+    void end_gpu(uint32_t phase);
+
+    /** Collects the GPU timers that finished and advances the frame counter. Call once per frame, with the OpenGL context current. */
+    void end_frame();
+    /** Waits for the GPU timers in flight and frees the queries. Call before the OpenGL context is destroyed. */
+    void finish();
+
+    /** Percentiles over the rolling window of a phase, in ns. */
+    struct Stats { uint64_t count; uint64_t p50, p95, p99; };
+    /** @return The stats of a phase's CPU (gpu = false) or GPU (gpu = true) samples. */
+    Stats stats(uint32_t phase, bool gpu);
+
+    /** Prints the percentiles of all phases as a table. */
+    void report(FILE *out);
+    /**
+     * Writes all recorded events to a file, as a Chrome trace if the path ends in .json, as CSV otherwise.
+     * @return True if the file was written successfully, false otherwise.
+     */
+    bool dump(const char *filepath);
+
+    /** Measures the CPU time from its construction to its destruction. */
+    class Scope {
+    private:
+        uint32_t id;
+        bool recording;
+        uint64_t start;
+    public:
+        inline Scope(uint32_t id) : id(id), recording(active), start(recording ? Time::now_ns() : 0) {}
+        inline ~Scope() { if (recording) record_cpu(id, start, Time::now_ns()); }
+    };
+
+    /** Measures the GPU time of the commands issued from its construction to its destruction. */
+    class GPUScope {
+    private:
+        uint32_t id;
+        bool recording;
+    public:
+        inline GPUScope(uint32_t id) : id(id), recording(active && begin_gpu(id)) {}
+        inline ~GPUScope() { if (recording) end_gpu(id); }
+    };
+}
+
+#define PROFILE_CONCAT_(a,b) a##b
+#define PROFILE_CONCAT(a,b) PROFILE_CONCAT_(a,b)
+/** Measures the CPU time of the rest of the enclosing block as the phase NAME. */
+#define PROFILE_SCOPE(NAME) \
+    static const uint32_t PROFILE_CONCAT(_profile_phase_,__LINE__) = Profiler::phase(NAME); \
+    Profiler::Scope PROFILE_CONCAT(_profile_scope_,__LINE__)(PROFILE_CONCAT(_profile_phase_,__LINE__))
+/** Measures the CPU and GPU time of the rest of the enclosing block as the phase NAME. */
+#define PROFILE_GPU_SCOPE(NAME) \
+    static const uint32_t PROFILE_CONCAT(_profile_phase_,__LINE__) = Profiler::phase(NAME); \
+    Profiler::Scope PROFILE_CONCAT(_profile_scope_,__LINE__)(PROFILE_CONCAT(_profile_phase_,__LINE__)); \
+    Profiler::GPUScope PROFILE_CONCAT(_profile_gpu_scope_,__LINE__)(PROFILE_CONCAT(_profile_phase_,__LINE__))
+
+#endif//_PROFILER_H_
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "Reprojector.h"
+#include "Profiler.h"
+
+constexpr const char *REPROJECT_SOURCE = "src/shaders/reproject.glsl";
+
+constexpr GLuint FIRST_TEXTURE_UNIT = 4; // `sample_color` in reproject.glsl, after the units of Camera and SDFVolume
+constexpr GLuint FIRST_IMAGE_UNIT = 0;   // `reprojected_color` in reproject.glsl
+constexpr GLuint PIXEL_GROUP_SIZE = 8;   // the workgroup size of the kernel along x and y
+
+bool Reprojector::create() {
+    if (!kernel.create_compute(REPROJECT_SOURCE))
+        return false;
+
+    uniforms.cam2world               = kernel.uniform<mat4>("cam2world");
+    uniforms.near_clip_data          = kernel.uniform<vec2>("near_clip_data");
+    uniforms.world2previous          = kernel.uniform<mat4>("world2previous");
+    uniforms.previous_near_clip_data = kernel.uniform<vec2>("previous_near_clip_data");
+    return true;
+}
+
+void Reprojector::apply(AccumulationBuffer &accumulation, const mat4 &cam2world, vec2 near_clip_data, const mat4 &previous_cam2world, vec2 previous_near_clip_data) {
+    PROFILE_GPU_SCOPE("reproject");
+    uniforms.cam2world.set(cam2world);
+    uniforms.near_clip_data.set(near_clip_data);
+    uniforms.world2previous.set(inverse(previous_cam2world));
+    uniforms.previous_near_clip_data.set(previous_near_clip_data);
+
+    accumulation.bind_reprojection(FIRST_TEXTURE_UNIT, FIRST_IMAGE_UNIT);
+    GLuint groups_x = (accumulation.get_width() + PIXEL_GROUP_SIZE - 1) / PIXEL_GROUP_SIZE;
+    GLuint groups_y = (accumulation.get_height() + PIXEL_GROUP_SIZE - 1) / PIXEL_GROUP_SIZE;
+    kernel.dispatch(groups_x, groups_y);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    accumulation.finish_reprojection();
+}
@@ -0,0 +1,53 @@
+#ifndef _REPROJECTOR_H_
+#define _REPROJECTOR_H_
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "AccumulationBuffer.h"
+using namespace glm;
+
+/**
+ * The Reprojector class carries the accumulated average over to a new view after the camera moved, instead of starting
+ * from nothing. A compute pass follows every pixel's first sample of the new view back into the previous view, through
+ * its depth, and blends it with the previous average there: bilinearly over the 4 texels around it, each dropped if
+ * its depth or normal shows a different surface, the color clamped to the variance of the new samples around the pixel.
+ * The history counts as at most a few dozen samples, so it keeps following lighting that changes.
+ */
+class Reprojector {
+private:
+    Shader kernel;
+    struct {
+        Uniform<mat4> cam2world;
+        Uniform<vec2> near_clip_data;
+        Uniform<mat4> world2previous;
+        Uniform<vec2> previous_near_clip_data;
+    } uniforms;
+public:
+    Reprojector() {}
+
+    /**
+     * Compiles the reprojection kernel.
+     * @return True if the kernel compiled, false otherwise.
+     */
+    bool create();
+
+    /** @return The reprojection kernel, e.g. for the ShaderWatcher. */
+    inline Shader *get_shader() { return &kernel; }
+
+    /**
+     * Blends the new view's first sample with the previous view's average, which becomes the latest average.
+     * @param accumulation The accumulation buffer, is_reprojecting and after its sample was finished.
+     * @param cam2world The camera matrix of the new view.
+     * @param near_clip_data The size of the new view's image plane at distance 1, see Camera::get_near_clip_data.
+     * @param previous_cam2world The camera matrix of the view the previous average was rendered from.
+     * @param previous_near_clip_data The size of its image plane.
+     */
+    void apply(AccumulationBuffer &accumulation, const mat4 &cam2world, vec2 near_clip_data, const mat4 &previous_cam2world, vec2 previous_near_clip_data);
+
+    // Disallow copying, the kernel is owned
+    Reprojector(const Reprojector&) = delete;
+    Reprojector& operator=(const Reprojector&) = delete;
+};
+
+#endif//_REPROJECTOR_H_
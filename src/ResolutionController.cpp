@@ -0,0 +1,24 @@
+#include "ResolutionController.h"
+#include <algorithm>
+#include <cmath>
+
+constexpr float FRAME_TIME_SMOOTHING = 0.2f; // the weight of the latest frame in the moving average
+constexpr float RESCALE_THRESHOLD = 0.05f;  // the smallest relative change of the scale worth a resize
+
+ResolutionController::ResolutionController(float target_ms, float min_scale)
+    : target_ns(target_ms * 1e6f), min_scale(min_scale) {}
+
+float ResolutionController::update(uint64_t frame_ns) {
+    if (frame_ns == 0)
+        return scale;
+    smoothed_ns = smoothed_ns == 0 ? (float)frame_ns : smoothed_ns + ((float)frame_ns - smoothed_ns) * FRAME_TIME_SMOOTHING;
+
+    float ideal = std::clamp(scale * std::sqrt(target_ns / smoothed_ns), min_scale, 1.0f);
+    if (std::abs(ideal - scale) < scale * RESCALE_THRESHOLD)
+        return scale;
+
+    // predict the frame time at the new scale, so the average doesn't lag behind and overshoot
+    smoothed_ns *= (ideal * ideal) / (scale * scale);
+    scale = ideal;
+    return scale;
+}
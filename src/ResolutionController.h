@@ -0,0 +1,39 @@
+#ifndef _RESOLUTIONCONTROLLER_H_
+#define _RESOLUTIONCONTROLLER_H_
+
+#include <cstdint>
+
+/**
+ * The ResolutionController class adjusts the resolution frames are traced at, so they take a target time.
+ * The scale it returns applies to both axes of the render target, the traced image is upscaled to the window.
+ *
+ * Tracing takes time proportional to the number of pixels, the square of the scale, so every frame the scale is set
+ * to the one that would have met the target, judged by the smoothed frame time. Small corrections are ignored, since
+ * every resize discards the samples accumulated so far.
+ */
+class ResolutionController {
+private:
+    float target_ns;        // the frame time to hold
+    float min_scale;        // the scale never drops below
+    float scale = 1.0f;     // the current scale
+    float smoothed_ns = 0;  // the moving average of the frame time at the current scale, 0 before the first frame
+public:
+    /**
+     * Creates a controller that starts at full resolution.
+     * @param target_ms The frame time to hold in milliseconds.
+     * @param min_scale The smallest scale the resolution is reduced to.
+     */
+    ResolutionController(float target_ms, float min_scale);
+
+    /**
+     * Feeds the time the last frame took and adjusts the scale.
+     * @param frame_ns The last frame's time in nanoseconds, e.g. Time::delta_ns().
+     * @return The scale to render the next frame at, in [min_scale,1].
+     */
+    float update(uint64_t frame_ns);
+
+    /** @return The scale to render the next frame at. */
+    inline float get_scale() const { return scale; }
+};
+
+#endif//_RESOLUTIONCONTROLLER_H_
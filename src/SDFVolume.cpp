@@ -0,0 +1,91 @@
+#include "SDFVolume.h"
+#include <algorithm>
+#include <iostream>
+
+constexpr float ATLAS_GROWTH = 1.5f; // the room a recreated atlas leaves for more bricks
+
+void SDFVolume::attach(Shader *shader) {
+    uniforms.push_back({
+        shader->uniform<GLuint>("render_mode"),
+        shader->uniform<vec3>("brick_map_origin"),
+        shader->uniform<GLfloat>("brick_cell_size"),
+        shader->uniform<ivec3>("brick_map_size"),
+        shader->uniform<GLint>("brick_atlas"),
+    });
+}
+
+void SDFVolume::upload_brick(const BrickMap &map, uint32_t brick) {
+    GLint x = (GLint)(brick % ATLAS_BRICKS * BRICK_SIZE);
+    GLint y = (GLint)(brick / ATLAS_BRICKS % ATLAS_BRICKS * BRICK_SIZE);
+    GLint z = (GLint)(brick / (ATLAS_BRICKS * ATLAS_BRICKS) * BRICK_SIZE);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, x, y, z, BRICK_SIZE, BRICK_SIZE, BRICK_SIZE, GL_RED, GL_FLOAT, &map.bricks[(size_t)brick * BRICK_SAMPLES]);
+}
+
+bool SDFVolume::upload(BrickMap &map) {
+    // freed bricks count too, a later rebake may reuse them
+    uint32_t bricks = (uint32_t)(map.bricks.size() / BRICK_SAMPLES);
+    uint32_t layers = (bricks + ATLAS_BRICKS * ATLAS_BRICKS - 1) / (ATLAS_BRICKS * ATLAS_BRICKS);
+    bool recreate = atlas == 0 || layers > atlas_layers;
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_size);
+    uint32_t max_layers = (uint32_t)max_size / BRICK_SIZE;
+    if (recreate && layers > max_layers) {
+        // the previous upload stays intact, its cells only reference bricks in its atlas
+        std::cerr << "The brick map's " << bricks << " bricks don't fit a 3D texture" << std::endl;
+        return false;
+    }
+
+    origin = map.origin;
+    cell_size = map.cell_size;
+    size = map.size;
+    cell_buffer.setData(map.cells, GL_DYNAMIC_DRAW);
+    if (recreate) {
+        atlas_layers = std::min(max_layers, std::max(1u, (uint32_t)((float)layers * ATLAS_GROWTH)));
+        if (atlas != 0)
+            glDeleteTextures(1, &atlas);
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_3D, atlas);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_R16F, ATLAS_BRICKS * BRICK_SIZE, ATLAS_BRICKS * BRICK_SIZE, atlas_layers * BRICK_SIZE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    } else {
+        glBindTexture(GL_TEXTURE_3D, atlas);
+    }
+
+    // a brick is one tightly packed 8³ block of floats, converted to half floats by the driver
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (recreate) {
+        for (uint32_t brick = 0; brick < bricks; brick++)
+            upload_brick(map, brick);
+    } else {
+        std::sort(map.changed_bricks.begin(), map.changed_bricks.end());
+        map.changed_bricks.erase(std::unique(map.changed_bricks.begin(), map.changed_bricks.end()), map.changed_bricks.end());
+        for (uint32_t brick : map.changed_bricks)
+            upload_brick(map, brick);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+    map.changed_bricks.clear();
+    return true;
+}
+
+void SDFVolume::bind() const {
+    cell_buffer.bind(BRICK_CELLS_BINDING);
+    glActiveTexture(GL_TEXTURE0 + BRICK_ATLAS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_3D, atlas);
+    glActiveTexture(GL_TEXTURE0);
+    for (const ShaderUniforms &shader : uniforms) {
+        shader.render_mode.set(RENDER_MODE_SDF);
+        shader.origin.set(origin);
+        shader.cell_size.set(cell_size);
+        shader.size.set(ivec3(size));
+        shader.atlas.set((GLint)BRICK_ATLAS_TEXTURE_UNIT);
+    }
+}
+
+SDFVolume::~SDFVolume() {
+    if (atlas != 0)
+        glDeleteTextures(1, &atlas);
+}
@@ -0,0 +1,75 @@
+#ifndef _SDFVOLUME_H_
+#define _SDFVOLUME_H_
+
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "Buffer.h"
+#include "sdf/BrickMap.h"
+using namespace glm;
+
+constexpr GLuint BRICK_CELLS_BINDING = 10;     /** The SSBO binding of `BrickCells` in tracing.glsl. */
+constexpr GLuint BRICK_ATLAS_TEXTURE_UNIT = 1; /** The texture unit of `brick_atlas` in tracing.glsl, after the accumulation's. */
+constexpr uint32_t ATLAS_BRICKS = 32;          /** The bricks along x and y of the atlas, ATLAS_BRICKS in tracing.glsl. */
+
+/** What the fragment kernel traces, the values of `render_mode` in tracing.glsl. */
+enum RenderMode : GLuint {
+    RENDER_MODE_TRIANGLES = 0, /** The scene's triangles, through its BVH. */
+    RENDER_MODE_SDF = 1,       /** The SDF baked into the brick map, by sphere tracing. */
+};
+
+/**
+ * The SDFVolume class is the GPU copy of a BrickMap that the fragment kernel sphere traces.
+ * The bricks are packed into a 3D texture atlas of ATLAS_BRICKS x ATLAS_BRICKS x n bricks, filtered in hardware, and
+ * the indirection grid is an SSBO. Uploads after a rebake only write the bricks that changed.
+ */
+class SDFVolume {
+private:
+    GLuint atlas = 0;            // the R16F 3D texture holding the bricks
+    uint32_t atlas_layers = 0;   // the bricks along z of the atlas
+    Buffer<BrickCell> cell_buffer;
+    vec3 origin = vec3(0.0f);
+    float cell_size = 0.0f;
+    uvec3 size = uvec3(0);
+    struct ShaderUniforms {
+        Uniform<GLuint> render_mode;
+        Uniform<vec3> origin;
+        Uniform<GLfloat> cell_size;
+        Uniform<ivec3> size;
+        Uniform<GLint> atlas;
+    };
+    std::vector<ShaderUniforms> uniforms; // of every shader tracing the volume, see attach
+
+    // uploads a brick into its place in the atlas
+    void upload_brick(const BrickMap &map, uint32_t brick);
+public:
+    SDFVolume() {}
+
+    /**
+     * Adds a shader tracing the volume, whose uniforms bind() sets.
+     * @param shader The shader, which has to include tracing.glsl.
+     */
+    void attach(Shader *shader);
+
+    /**
+     * Brings the GPU copy up to date with the map: the cells, and the bricks baked since the last upload.
+     * The atlas is recreated with room to spare once the bricks outgrow it, which uploads all of them.
+     * @param map The map, whose changed_bricks are cleared.
+     * @return True if the atlas fits the GPU's 3D textures, false otherwise, the previous upload is kept then.
+     */
+    bool upload(BrickMap &map);
+
+    /** Binds the atlas and the cells and switches the attached shaders to RENDER_MODE_SDF. Call every frame before rendering. */
+    void bind() const;
+
+    /** Frees the atlas. */
+    ~SDFVolume();
+
+    // Disallow copying, the GL objects are owned
+    SDFVolume(const SDFVolume&) = delete;
+    SDFVolume& operator=(const SDFVolume&) = delete;
+};
+
+#endif//_SDFVOLUME_H_
@@ -0,0 +1,257 @@
+#include "Scene.h"
+#include "parallel.h"
+#include <vector>
+#include <memory>
+#include <numeric>
+#include <cstring>
+#include <iostream>
+#include <GL/glew.h>
+using std::vector, std::unique_ptr, std::make_unique, std::move;
+
+constexpr size_t UPDATE_BLOCK_SIZE = 16384; // triangles per parallel_for index when moving them
+
+namespace {
+
+// writes the runs of changed elements of streaming buffers, switching them to streaming on their first update.
+// Once that failed, failed is set and the buffers are respecified as a whole instead of trying again every frame
+template <typename T>
+void stream_changes(unique_ptr<Buffer<T>> &buffer, const vector<T> &data, const vector<uint8_t> &changed, bool &failed) {
+    if (!buffer->isStreaming()) {
+        if (!failed && buffer->createStream(data.size())) {
+            buffer->setData(data);
+            return;
+        }
+        failed = true;
+        buffer->setData(data, GL_DYNAMIC_DRAW); // replaces a failed stream's immutable storage
+        return;
+    }
+    for (size_t i = 0; i < changed.size();) {
+        if (!changed[i]) {
+            i++;
+            continue;
+        }
+        size_t end = i;
+        while (end < changed.size() && changed[end])
+            end++;
+        buffer->update(i, data.data() + i, end - i);
+        i = end;
+    }
+}
+
+} // namespace
+
+void Scene::set_geometry(vector<Triangle> triangles, BVHBuilder builder) {
+    rebuilder.discard();
+    blas.clear();
+    instances.clear();
+    tlas = TLAS();
+    bvh.build(move(triangles), builder);
+    set_layout(layout);
+}
+
+void Scene::set_mesh(const Mesh &mesh, BVHBuilder builder)
+    { set_geometry(mesh.to_triangles(), builder); }
+
+void Scene::set_bvh(BVH bvh) {
+    rebuilder.discard();
+    blas.clear();
+    instances.clear();
+    tlas = TLAS();
+    this->bvh = move(bvh);
+    // a stored hierarchy is updated in the order of its triangles
+    if (this->bvh.sources.size() != this->bvh.triangles.size()) {
+        this->bvh.sources.resize(this->bvh.triangles.size());
+        std::iota(this->bvh.sources.begin(), this->bvh.sources.end(), 0u);
+    }
+    set_layout(layout);
+}
+
+void Scene::update_geometry(const vector<Triangle> &triangles) {
+    if (is_instanced() || triangles.size() != bvh.triangles.size()) {
+        std::cerr << "Only the triangles of a single mesh scene can be moved, keeping their number" << std::endl;
+        return;
+    }
+    if (bvh.nodes.empty())
+        return;
+
+    // the changes are only tracked for the streaming buffers of the standard layout
+    bool streaming = node_buffer != nullptr;
+    vector<uint8_t> changed_triangles(streaming ? bvh.triangles.size() : 0);
+    vector<uint8_t> changed_nodes(streaming ? bvh.nodes.size() : 0);
+    uint32_t blocks = (uint32_t)((triangles.size() + UPDATE_BLOCK_SIZE - 1) / UPDATE_BLOCK_SIZE);
+    parallel_for(blocks, [&](uint32_t block) {
+        size_t end = std::min((block + 1) * UPDATE_BLOCK_SIZE, triangles.size());
+        for (size_t i = block * UPDATE_BLOCK_SIZE; i < end; i++) {
+            const Triangle &tri = triangles[bvh.sources[i]];
+            if (streaming)
+                changed_triangles[i] = memcmp(&tri, &bvh.triangles[i], sizeof(Triangle)) != 0;
+            bvh.triangles[i] = tri;
+        }
+    });
+    bvh.refit(0, (uint32_t)bvh.nodes.size(), streaming ? &changed_nodes : nullptr);
+
+    if (!rebuilder.busy() && bvh.sah_cost(0, (uint32_t)bvh.nodes.size()) > bvh.build_cost * REBUILD_COST_RATIO)
+        rebuilder.start(triangles, bvh.builder);
+
+    if (layout == BVH_LAYOUT_COMPRESSED) {
+        // every child is quantized relative to its parent's box, so the compressed nodes are encoded and uploaded anew
+        compressed.build(bvh);
+        if (compressed_node_buffer) {
+            compressed_node_buffer->setData(compressed.nodes, GL_DYNAMIC_DRAW);
+            record_buffer->setData(compressed.triangles, GL_DYNAMIC_DRAW);
+        }
+    } else if (streaming) {
+        stream_changes(node_buffer, bvh.nodes, changed_nodes, streaming_failed);
+        stream_changes(triangle_buffer, bvh.triangles, changed_triangles, streaming_failed);
+    }
+}
+
+bool Scene::end_frame() {
+    if (node_buffer)
+        node_buffer->nextRegion();
+    if (triangle_buffer)
+        triangle_buffer->nextRegion();
+
+    BVH rebuilt;
+    if (!rebuilder.poll(rebuilt))
+        return false;
+
+    // the triangles moved on while the rebuild ran, it keeps the cost it was built with, so further degradation counts
+    vector<Triangle> latest(bvh.triangles.size());
+    for (size_t i = 0; i < bvh.triangles.size(); i++)
+        latest[bvh.sources[i]] = bvh.triangles[i];
+    for (size_t i = 0; i < rebuilt.triangles.size(); i++)
+        rebuilt.triangles[i] = latest[rebuilt.sources[i]];
+    rebuilt.refit(0, (uint32_t)rebuilt.nodes.size());
+    bvh = move(rebuilt);
+    set_layout(layout);
+    if (node_buffer || compressed_node_buffer)
+        upload_geometry();
+    return true;
+}
+
+uint32_t Scene::add_mesh(const Mesh &mesh, BVHBuilder builder) {
+    // the first mesh replaces geometry that was set as a whole
+    if (blas.empty())
+        set_geometry({});
+
+    BVH mesh_bvh;
+    mesh_bvh.build(mesh.to_triangles(), builder);
+    BLAS entry;
+        entry.first_triangle = (uint32_t)bvh.triangles.size();
+        entry.root = bvh.append(mesh_bvh);
+        entry.node_count = (uint32_t)mesh_bvh.nodes.size();
+        entry.triangle_count = (uint32_t)mesh_bvh.triangles.size();
+        if (!mesh_bvh.nodes.empty())
+            entry.bounds = {mesh_bvh.nodes[0].bbmin, mesh_bvh.nodes[0].bbmax};
+    blas.push_back(entry);
+    set_layout(layout);
+    return (uint32_t)blas.size() - 1;
+}
+
+uint32_t Scene::add_instance(uint32_t blas, const mat4x3 &transform) {
+    Instance instance = {};
+    instance.set_transform(transform);
+    instance.root = this->blas[blas].root;
+    instance.blas = blas;
+    instances.push_back(instance);
+    return (uint32_t)instances.size() - 1;
+}
+
+void Scene::set_transform(uint32_t instance, const mat4x3 &transform)
+    { instances[instance].set_transform(transform); }
+
+void Scene::build_tlas()
+    { tlas.build(instances, blas); }
+
+AABB Scene::bounds() const {
+    const vector<BVHNode> &nodes = is_instanced() ? tlas.nodes : bvh.nodes;
+    if (nodes.empty())
+        return AABB();
+    return {nodes[0].bbmin, nodes[0].bbmax};
+}
+
+void Scene::set_layout(BVHLayout layout) {
+    if (layout == BVH_LAYOUT_COMPRESSED && is_instanced()) {
+        std::cerr << "The compressed layout does not support instancing, using the standard layout" << std::endl;
+        layout = BVH_LAYOUT_STANDARD;
+    }
+    this->layout = layout;
+    if (layout == BVH_LAYOUT_COMPRESSED)
+        compressed.build(bvh);
+    else
+        compressed = CompressedBVH();
+}
+
+void Scene::upload(Shader *shader) {
+    attach(shader);
+    upload_geometry();
+}
+
+void Scene::attach(Shader *shader) {
+    layout_uniforms.push_back(shader->uniform<GLuint>("bvh_layout"));
+    instance_count_uniforms.push_back(shader->uniform<GLint>("instance_count"));
+}
+
+void Scene::upload_geometry() {
+    // only the buffers of the layout in use take GPU memory
+    if (layout == BVH_LAYOUT_COMPRESSED) {
+        node_buffer.reset();
+        triangle_buffer.reset();
+        if (!compressed_node_buffer)
+            compressed_node_buffer = make_unique<Buffer<CompressedNode>>();
+        if (!record_buffer)
+            record_buffer = make_unique<Buffer<TriangleRecord>>();
+        compressed_node_buffer->setData(compressed.nodes);
+        record_buffer->setData(compressed.triangles);
+    } else {
+        compressed_node_buffer.reset();
+        record_buffer.reset();
+        // streaming storage has a fixed size, a whole new hierarchy starts over with static buffers
+        if (node_buffer && node_buffer->isStreaming())
+            node_buffer.reset();
+        if (triangle_buffer && triangle_buffer->isStreaming())
+            triangle_buffer.reset();
+        if (!node_buffer)
+            node_buffer = make_unique<Buffer<BVHNode>>();
+        if (!triangle_buffer)
+            triangle_buffer = make_unique<Buffer<Triangle>>();
+        node_buffer->setData(bvh.nodes);
+        triangle_buffer->setData(bvh.triangles);
+    }
+    upload_instances();
+}
+
+void Scene::upload_instances() {
+    if (!is_instanced()) {
+        tlas_node_buffer.reset();
+        instance_buffer.reset();
+    } else {
+        if (!tlas_node_buffer)
+            tlas_node_buffer = make_unique<Buffer<BVHNode>>();
+        if (!instance_buffer)
+            instance_buffer = make_unique<Buffer<Instance>>();
+        tlas_node_buffer->setData(tlas.nodes);
+        instance_buffer->setData(tlas.instances);
+    }
+    bind();
+}
+
+void Scene::bind() const {
+    if (node_buffer)
+        node_buffer->bind(BVH_NODES_BINDING);
+    if (triangle_buffer)
+        triangle_buffer->bind(TRIANGLES_BINDING);
+    if (compressed_node_buffer)
+        compressed_node_buffer->bind(COMPRESSED_NODES_BINDING);
+    if (record_buffer)
+        record_buffer->bind(TRIANGLE_RECORDS_BINDING);
+    if (tlas_node_buffer)
+        tlas_node_buffer->bind(TLAS_NODES_BINDING);
+    if (instance_buffer)
+        instance_buffer->bind(INSTANCES_BINDING);
+    for (const Uniform<GLuint> &uniform : layout_uniforms)
+        uniform.set(layout);
+    for (const Uniform<GLint> &uniform : instance_count_uniforms)
+        uniform.set(is_instanced() ? (GLint)tlas.instances.size() : -1);
+}
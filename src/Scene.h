@@ -0,0 +1,154 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include "Buffer.h"
+#include "Shader.h"
+#include "bvh/BVH.h"
+#include "bvh/CompressedBVH.h"
+#include "bvh/TLAS.h"
+#include "bvh/BVHRebuilder.h"
+#include "mesh/Mesh.h"
+
+constexpr GLuint BVH_NODES_BINDING = 0;        /** The SSBO binding of `BVHNodes` in tracing.glsl. */
+constexpr GLuint TRIANGLES_BINDING = 1;        /** The SSBO binding of `Triangles` in tracing.glsl. */
+constexpr GLuint COMPRESSED_NODES_BINDING = 2; /** The SSBO binding of `CompressedBVHNodes` in tracing.glsl. */
+constexpr GLuint TRIANGLE_RECORDS_BINDING = 3; /** The SSBO binding of `TriangleRecords` in tracing.glsl. */
+constexpr GLuint TLAS_NODES_BINDING = 4;       /** The SSBO binding of `TLASNodes` in tracing.glsl. */
+constexpr GLuint INSTANCES_BINDING = 5;        /** The SSBO binding of `Instances` in tracing.glsl. */
+
+/** How much the SAH cost of a refitted BVH may grow over the cost it was built with before it is rebuilt. */
+constexpr float REBUILD_COST_RATIO = 1.5f;
+
+/** The memory layouts of the acceleration structure the tracers can traverse, the values of `bvh_layout` in tracing.glsl. */
+enum BVHLayout : GLuint {
+    BVH_LAYOUT_STANDARD = 0,   /** BVHNode and Triangle, 32 and 48 bytes. */
+    BVH_LAYOUT_COMPRESSED = 1, /** CompressedNode and TriangleRecord, 16 and 36 bytes. */
+};
+
+/**
+ * The Scene struct holds the traced geometry and its acceleration structure.
+ * A scene is either a single mesh, traced through bvh from nodes[0], or instanced: bvh then holds one BLAS per unique mesh
+ * and the tracers find the instances through the TLAS, transforming rays into object space at its leaves.
+ * The GPU copies are only created on upload, so a scene can also be used without an OpenGL context.
+ */
+struct Scene {
+    BVH bvh; /** The acceleration structure, including the (reordered) triangles. All BLAS in an instanced scene. */
+    std::vector<BLAS> blas;           /** The meshes that can be instanced, empty unless add_mesh was used. */
+    std::vector<Instance> instances;  /** The placed meshes, in the order they were added. */
+    TLAS tlas;                        /** The hierarchy over instances, rebuilt by build_tlas. */
+    BVHLayout layout = BVH_LAYOUT_STANDARD; /** The layout the tracers traverse, change it with set_layout. */
+    CompressedBVH compressed; /** The compressed form of bvh, only built for BVH_LAYOUT_COMPRESSED. */
+    std::unique_ptr<Buffer<BVHNode>> node_buffer;      /** The GPU copy of bvh.nodes. */
+    std::unique_ptr<Buffer<Triangle>> triangle_buffer; /** The GPU copy of bvh.triangles. */
+    std::unique_ptr<Buffer<CompressedNode>> compressed_node_buffer; /** The GPU copy of compressed.nodes. */
+    std::unique_ptr<Buffer<TriangleRecord>> record_buffer;          /** The GPU copy of compressed.triangles. */
+    std::unique_ptr<Buffer<BVHNode>> tlas_node_buffer;  /** The GPU copy of tlas.nodes. */
+    std::unique_ptr<Buffer<Instance>> instance_buffer;  /** The GPU copy of tlas.instances. */
+    std::vector<Uniform<GLuint>> layout_uniforms;        /** `bvh_layout` of every shader tracing the scene, see attach. */
+    std::vector<Uniform<GLint>> instance_count_uniforms; /** `instance_count` of every shader tracing the scene, see attach. */
+    BVHRebuilder rebuilder;                 /** Rebuilds bvh in the background once refitting degraded it too far. */
+    bool streaming_failed = false;          /** Set once a buffer couldn't switch to streaming, updates respecify them then. */
+
+    /**
+     * Replaces the scene's geometry and rebuilds the acceleration structure.
+     * @param triangles The triangles making up the scene.
+     * @param builder The algorithm to build the BVH with.
+     */
+    void set_geometry(std::vector<Triangle> triangles, BVHBuilder builder = BVH_BUILDER_SAH);
+
+    /**
+     * Replaces the scene's geometry with an indexed mesh and rebuilds the acceleration structure.
+     * @param mesh The mesh making up the scene.
+     * @param builder The algorithm to build the BVH with.
+     */
+    void set_mesh(const Mesh &mesh, BVHBuilder builder = BVH_BUILDER_SAH);
+
+    /**
+     * Replaces the scene's geometry with an already built acceleration structure, e.g. one loaded from a file.
+     * @param bvh The acceleration structure, including its triangles.
+     */
+    void set_bvh(BVH bvh);
+
+    /**
+     * Moves the triangles of a single mesh scene, e.g. to animate it, and refits the BVH instead of rebuilding it.
+     * If the refitted tree's SAH cost exceeds REBUILD_COST_RATIO times its build cost, a rebuild is started in the
+     * background with the BVH's builder, which end_frame swaps in once it is done. Uploaded buffers are switched to streaming mode on the first
+     * update, so later ones only write the nodes and triangles that changed (the compressed layout is uploaded whole).
+     * The CPU tracer has to be updated afterwards.
+     * @param triangles The moved triangles, in the order the geometry was set in, see BVH::sources.
+     */
+    void update_geometry(const std::vector<Triangle> &triangles);
+
+    /**
+     * Finishes a frame of an animated scene: advances the streaming buffers and swaps in a finished background rebuild,
+     * refitted to the latest positions and uploaded if the scene was. Call once per frame after rendering.
+     * @return True if the BVH was replaced, the CPU tracer has to be updated then.
+     */
+    bool end_frame();
+
+    /**
+     * Adds a mesh that can be instanced, building its BLAS. The first one replaces the geometry set as a whole.
+     * The mesh itself is not traced, only its instances.
+     * @param mesh The mesh to add.
+     * @param builder The algorithm to build the mesh's BLAS with.
+     * @return The index of the mesh's BLAS.
+     */
+    uint32_t add_mesh(const Mesh &mesh, BVHBuilder builder = BVH_BUILDER_SAH);
+
+    /**
+     * Places a copy of a mesh. Call build_tlas once all instances are added.
+     * @param blas The index of the mesh's BLAS, as returned by add_mesh.
+     * @param transform The object to world transform, see Instance.
+     * @return The index of the instance.
+     */
+    uint32_t add_instance(uint32_t blas, const mat4x3 &transform);
+
+    /**
+     * Moves an instance. Only the TLAS depends on it, call build_tlas and upload_instances afterwards.
+     * @param instance The index of the instance, as returned by add_instance.
+     * @param transform The new object to world transform.
+     */
+    void set_transform(uint32_t instance, const mat4x3 &transform);
+
+    /** Rebuilds the TLAS over the instances. The CPU tracer uses it right away, the GPU after upload_instances. */
+    void build_tlas();
+
+    /** @return True if the scene is traced through the TLAS, as soon as a mesh was added. */
+    inline bool is_instanced() const { return !blas.empty(); }
+
+    /** @return The world space box around all geometry. */
+    AABB bounds() const;
+
+    /**
+     * Changes the layout the tracers traverse, building the compressed form if needed. Upload again afterwards.
+     * Instanced scenes are always traced in the standard layout.
+     * @param layout The new layout.
+     */
+    void set_layout(BVHLayout layout);
+
+    /**
+     * Uploads the acceleration structure in the scene's layout to the GPU and binds it to the SSBO bindings of tracing.glsl.
+     * @param shader The shader tracing the scene, whose `bvh_layout` is set by bind().
+     */
+    void upload(Shader *shader);
+
+    /**
+     * Adds another shader tracing the scene, e.g. a kernel of the WavefrontTracer, whose uniforms are set by bind() too.
+     * @param shader The shader, which has to use `bvh_layout` and `instance_count`.
+     */
+    void attach(Shader *shader);
+
+    /** Uploads the acceleration structure in the scene's layout again, e.g. after it was replaced, and binds it. */
+    void upload_geometry();
+
+    /** Uploads only the TLAS and the instances, after instances were moved. The BLAS stay untouched. */
+    void upload_instances();
+
+    /** Binds the uploaded buffers and sets `bvh_layout` and `instance_count`. Call every frame before rendering, it survives shader reloads. */
+    void bind() const;
+};
+
+#endif//_SCENE_H_
@@ -1,5 +1,7 @@
 #include "Shader.h"
 #include "shader_loading.h"
+#include "program_cache.h"
+#include <algorithm>
 #include <iostream>
 #include <unordered_map>
 #include <string>
@@ -17,52 +19,70 @@ using namespace glm;
     fprintf(stderr, "Shader compilation failed:\n%s\n", info); \
     delete[] info; } while(0)
 
-bool Shader::create(string vertexSourceFile, string fragmentSourceFile)
-{   
-    string vertexSource;
-    string fragmentSource;
-    try {
-        vertexSource = loadShaderSource(vertexSourceFile);
-        fragmentSource = loadShaderSource(fragmentSourceFile);
-    } catch (std::runtime_error &e) {
-        fprintf(stderr, "Error loading shader source file: %s\n", e.what());
-        return false;
+// issues the compilation and linking of a program without waiting for the results
+void startCompile(const std::vector<GLenum> &types, const std::vector<string> &sources, Shader::PendingProgram &build)
+{
+    // Create the shaders, load the source code into them and compile them
+    for (size_t i = 0; i < types.size(); i++) {
+        const char *source = sources[i].c_str();
+        GLuint shader = glCreateShader(types[i]);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        build.shaders.push_back(shader);
     }
 
-    // Create the shaders
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    // Link the shaders into a program, asking the driver to keep the binary for the program cache
+    build.program = glCreateProgram();
+    glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    for (GLuint shader : build.shaders)
+        glAttachShader(build.program, shader);
+    glLinkProgram(build.program);
+}
+
+// deletes a program that is still being compiled
+void discardCompile(Shader::PendingProgram &build)
+{
+    for (GLuint shader : build.shaders)
+        glDeleteShader(shader);
+    glDeleteProgram(build.program);
+    build = {};
+}
 
-    // Load the source code into the shaders
-    const char *vertexSource_ptr = vertexSource.c_str();
-    const char *fragmentSource_ptr = fragmentSource.c_str();
-    glShaderSource(vertexShader, 1, &vertexSource_ptr, NULL);
-    glShaderSource(fragmentShader, 1, &fragmentSource_ptr, NULL);
+// with KHR/ARB_parallel_shader_compile the driver compiles in the background and can be asked whether it's done,
+// without it any status query blocks until the program is linked
+bool isCompileDone(const Shader::PendingProgram &build)
+{
+    if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+        return true;
+    GLint done = GL_TRUE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
 
-    // Compile the shaders
-    glCompileShader(vertexShader);
-    glCompileShader(fragmentShader);
+// checks the results of startCompile, returns the linked program or 0 on failure
+GLuint finishCompile(Shader::PendingProgram &build)
+{
+    GLuint program = build.program;
 
     // Check if shaders compiled successfully
     GLint status;
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE)
-    {
-        printCompileError(vertexShader);
-        return false;
-    }
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE)
-    {
-        printCompileError(fragmentShader);
-        return false;
+    bool compiled = true;
+    for (GLuint shader : build.shaders) {
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status == GL_FALSE) {
+            printCompileError(shader);
+            compiled = false;
+        }
     }
 
-    // Link the shaders into a program
-    program = glCreateProgram();
-    glAttachShader(program, vertexShader);
-    glAttachShader(program, fragmentShader);
-    glLinkProgram(program);
+    // Clean up shaders (we don't need them anymore because they are in the program)
+    for (GLuint shader : build.shaders)
+        glDeleteShader(shader);
+    build = {};
+    if (!compiled) {
+        glDeleteProgram(program);
+        return 0;
+    }
 
     // Check if shaders linked successfully
     glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -74,14 +94,108 @@ bool Shader::create(string vertexSourceFile, string fragmentSourceFile)
         glGetProgramInfoLog(program, length, NULL, info);
         fprintf(stderr, "Shader linking failed:\n%s\n", info);
         delete[] info;
-        return false;   
+        glDeleteProgram(program);
+        return 0;
     }
 
-    // Clean up shaders (we don't need them anymore because they are in the program)
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    return program;
+}
+
+bool Shader::create(string vertexSourceFile, string fragmentSourceFile)
+    { return create_stages({GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}, {vertexSourceFile, fragmentSourceFile}); }
+
+bool Shader::create_compute(string computeSourceFile)
+    { return create_stages({GL_COMPUTE_SHADER}, {computeSourceFile}); }
+
+bool Shader::create_stages(std::vector<GLenum> types, std::vector<string> files)
+{
+    this->stage_types = std::move(types);
+    this->stage_files = std::move(files);
+
+    // let the driver compile on as many threads as it likes, this is what makes reloads non-blocking
+    static bool compiler_threads_set = false;
+    if (!compiler_threads_set) {
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        compiler_threads_set = true;
+    }
+
+    if (!reload())
+        return false;
+    // the first program is needed right away, wait for it
+    while (pending.program != 0 && !poll_reload()) {}
+    return program != 0;
+}
+
+bool Shader::reload()
+{
+    std::vector<string> sources;
+    try {
+        for (const string &file : stage_files)
+            sources.push_back(loadShaderSource(file));
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "Error loading shader source file: %s\n", e.what());
+        return false;
+    }
+
+    // a reload that is still compiling is outdated now
+    if (pending.program != 0)
+        discardCompile(pending);
+
+    // Reuse the binary of an earlier run if the expanded sources and the driver are unchanged
+    uint64_t cache_key = programCacheKey(sources.data(), (int)sources.size());
+    GLuint cached = loadCachedProgram(cache_key);
+    if (cached != 0) {
+        replace_program(cached);
+        return true;
+    }
+
+    startCompile(stage_types, sources, pending);
+    pending.cache_key = cache_key;
+    return true;
+}
+
+bool Shader::poll_reload()
+{
+    if (pending.program == 0 || !isCompileDone(pending))
+        return false;
+
+    uint64_t cache_key = pending.cache_key;
+    GLuint linked = finishCompile(pending);
+    if (linked == 0)
+        return false; // keep the current program
+    storeCachedProgram(cache_key, linked);
+    replace_program(linked);
+    return true;
+}
+
+std::vector<string> Shader::get_source_files() const
+{
+    std::vector<string> files;
+    for (const string &stage_file : stage_files)
+        for (const string &file : getShaderDependencies(stage_file))
+            if (std::find(files.begin(), files.end(), file) == files.end())
+                files.push_back(file);
+    return files;
+}
+
+void Shader::replace_program(GLuint program)
+{
+    GLint current = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    bool in_use = this->program != 0 && (GLuint)current == this->program;
+    if (this->program != 0)
+        glDeleteProgram(this->program);
+    this->program = program;
+    generation++;
+    if (in_use)
+        use();
 
     // Populate the uniform_locations map for faster access to uniform variables
+    uniform_ids.clear();
+    uniform_types.clear();
     GLint numUniforms = 0;
     glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
     for (GLint i = 0; i < numUniforms; ++i) {
@@ -95,44 +209,143 @@ bool Shader::create(string vertexSourceFile, string fragmentSourceFile)
 
         GLint location = glGetUniformLocation(program, name);
         uniform_ids[name] = location;
+        uniform_types[name] = type;
     }
 
-    return true;
+    // the handles keep their slots, only the locations move
+    for (uint32_t slot = 0; slot < slot_names.size(); slot++)
+        resolve_slot(slot);
+}
+
+// whether a uniform type is set through its unit with glUniform1i, like samplers and images
+bool is_unit_type(GLenum type)
+{
+    switch (type) {
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_CUBE_MAP_ARRAY:
+    case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW: case GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_SAMPLER_BUFFER:
+    case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW:
+    case GL_INT_SAMPLER_1D: case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_CUBE:
+    case GL_INT_SAMPLER_1D_ARRAY: case GL_INT_SAMPLER_2D_ARRAY: case GL_INT_SAMPLER_CUBE_MAP_ARRAY:
+    case GL_INT_SAMPLER_2D_MULTISAMPLE: case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_INT_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D_RECT:
+    case GL_UNSIGNED_INT_SAMPLER_1D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D:
+    case GL_UNSIGNED_INT_SAMPLER_CUBE: case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY: case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_CUBE_MAP_ARRAY: case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+    case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+    case GL_IMAGE_1D: case GL_IMAGE_2D: case GL_IMAGE_3D: case GL_IMAGE_2D_RECT: case GL_IMAGE_CUBE:
+    case GL_IMAGE_BUFFER: case GL_IMAGE_1D_ARRAY: case GL_IMAGE_2D_ARRAY: case GL_IMAGE_CUBE_MAP_ARRAY:
+    case GL_IMAGE_2D_MULTISAMPLE: case GL_IMAGE_2D_MULTISAMPLE_ARRAY:
+    case GL_INT_IMAGE_1D: case GL_INT_IMAGE_2D: case GL_INT_IMAGE_3D: case GL_INT_IMAGE_2D_RECT: case GL_INT_IMAGE_CUBE:
+    case GL_INT_IMAGE_BUFFER: case GL_INT_IMAGE_1D_ARRAY: case GL_INT_IMAGE_2D_ARRAY: case GL_INT_IMAGE_CUBE_MAP_ARRAY:
+    case GL_INT_IMAGE_2D_MULTISAMPLE: case GL_INT_IMAGE_2D_MULTISAMPLE_ARRAY:
+    case GL_UNSIGNED_INT_IMAGE_1D: case GL_UNSIGNED_INT_IMAGE_2D: case GL_UNSIGNED_INT_IMAGE_3D:
+    case GL_UNSIGNED_INT_IMAGE_2D_RECT: case GL_UNSIGNED_INT_IMAGE_CUBE: case GL_UNSIGNED_INT_IMAGE_BUFFER:
+    case GL_UNSIGNED_INT_IMAGE_1D_ARRAY: case GL_UNSIGNED_INT_IMAGE_2D_ARRAY: case GL_UNSIGNED_INT_IMAGE_CUBE_MAP_ARRAY:
+    case GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE: case GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE_ARRAY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Shader::resolve_slot(uint32_t slot)
+{
+    const string &name = slot_names[slot];
+    auto location = uniform_ids.find(name);
+    GLenum type = location != uniform_ids.end() ? uniform_types.at(name) : GL_NONE;
+    bool matches = location != uniform_ids.end()
+        && (type == slot_types[slot] || (slot_types[slot] == GL_INT && is_unit_type(type))); // GL_INT also stands for samplers and images
+    slot_locations[slot] = matches ? location->second : -1;
+    if (!matches && !slot_reported[slot]) {
+        fprintf(stderr, location == uniform_ids.end()
+            ? "Shader has no active uniform '%s'\n"
+            : "Shader uniform '%s' has a different type than requested\n", name.c_str());
+        slot_reported[slot] = true;
+    }
+}
+
+uint32_t Shader::get_slot(const string &name, GLenum type)
+{
+    for (uint32_t slot = 0; slot < slot_names.size(); slot++)
+        if (slot_names[slot] == name && slot_types[slot] == type)
+            return slot;
+
+    slot_names.push_back(name);
+    slot_types.push_back(type);
+    slot_locations.push_back(-1);
+    slot_reported.push_back(false);
+    resolve_slot((uint32_t)(slot_names.size() - 1));
+    return (uint32_t)(slot_names.size() - 1);
+}
+
+GLint Shader::get_location(const string &name)
+{
+    auto location = uniform_ids.find(name);
+    if (location != uniform_ids.end())
+        return location->second;
+
+    // location -1 is ignored by glUniform*
+    if (reported_names.insert(name).second)
+        fprintf(stderr, "Shader has no active uniform '%s'\n", name.c_str());
+    return -1;
 }
 
 void Shader::use() { glUseProgram(program); }
 
-void Shader::setInt    (string name, GLint    value) { glUniform1i (uniform_ids[name], value); }
-void Shader::setUInt   (string name, GLuint   value) { glUniform1ui(uniform_ids[name], value); }
-void Shader::setFloat  (string name, GLfloat  value) { glUniform1f (uniform_ids[name], value); }
-void Shader::setDouble (string name, GLdouble value) { glUniform1d (uniform_ids[name], value); }
-
-void Shader::setInt2   (string name, GLint x,GLint y)       { glUniform2i (uniform_ids[name], x, y); }
-void Shader::setUInt2  (string name, GLuint x,GLuint y)     { glUniform2ui(uniform_ids[name], x, y); }
-void Shader::setFloat2 (string name, GLfloat x,GLfloat y)   { glUniform2f (uniform_ids[name], x, y); }
-void Shader::setFloat2 (string name, const vec2 &v )        { glUniform2f (uniform_ids[name], v.x, v.y); }
-void Shader::setDouble2(string name, GLdouble x,GLdouble y) { glUniform2d (uniform_ids[name], x, y); }
-
-void Shader::setInt3   (string name, GLint x,GLint y,GLint z)          { glUniform3i (uniform_ids[name], x, y, z); }
-void Shader::setUInt3  (string name, GLuint x,GLuint y,GLuint z)       { glUniform3ui(uniform_ids[name], x, y, z); }
-void Shader::setFloat3 (string name, GLfloat x,GLfloat y,GLfloat z)    { glUniform3f (uniform_ids[name], x, y, z); }
-void Shader::setFloat3 (string name, const vec3 &v )                   { glUniform3f (uniform_ids[name], v.x, v.y, v.z); }
-void Shader::setDouble3(string name, GLdouble x,GLdouble y,GLdouble z) { glUniform3d (uniform_ids[name], x, y, z); }
-
-void Shader::setInt4   (string name, GLint x,GLint y,GLint z,GLint w)             { glUniform4i (uniform_ids[name], x, y, z, w); }
-void Shader::setUInt4  (string name, GLuint x,GLuint y,GLuint z,GLuint w)         { glUniform4ui(uniform_ids[name], x, y, z, w); }
-void Shader::setFloat4 (string name, GLfloat x,GLfloat y,GLfloat z,GLfloat w)     { glUniform4f (uniform_ids[name], x, y, z, w); }
-void Shader::setFloat4 (string name, const vec4 &v )                              { glUniform4f (uniform_ids[name], v.x, v.y, v.z, v.w); }
-void Shader::setDouble4(string name, GLdouble x,GLdouble y,GLdouble z,GLdouble w) { glUniform4d (uniform_ids[name], x, y, z, w); }
-
-void Shader::setMatrix (string name, const mat2x2 &m) { glUniformMatrix2fv  (uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat2x3 &m) { glUniformMatrix2x3fv(uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat2x4 &m) { glUniformMatrix2x4fv(uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat3x2 &m) { glUniformMatrix3x2fv(uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat3x3 &m) { glUniformMatrix3fv  (uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat3x4 &m) { glUniformMatrix3x4fv(uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat4x2 &m) { glUniformMatrix4x2fv(uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat4x3 &m) { glUniformMatrix4x3fv(uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-void Shader::setMatrix (string name, const mat4x4 &m) { glUniformMatrix4fv  (uniform_ids[name], 1, GL_FALSE, value_ptr(m)); }
-
-Shader::~Shader() { glDeleteProgram(program); }
\ No newline at end of file
+void Shader::dispatch(GLuint groups_x, GLuint groups_y, GLuint groups_z)
+{
+    glUseProgram(program);
+    glDispatchCompute(groups_x, groups_y, groups_z);
+}
+
+void Shader::dispatch_indirect(GLuint buffer, GLintptr offset)
+{
+    glUseProgram(program);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer);
+    glDispatchComputeIndirect(offset);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void Shader::setInt    (const string &name, GLint    value) { glUniform1i (get_location(name), value); }
+void Shader::setUInt   (const string &name, GLuint   value) { glUniform1ui(get_location(name), value); }
+void Shader::setFloat  (const string &name, GLfloat  value) { glUniform1f (get_location(name), value); }
+void Shader::setDouble (const string &name, GLdouble value) { glUniform1d (get_location(name), value); }
+
+void Shader::setInt2   (const string &name, GLint x,GLint y)       { glUniform2i (get_location(name), x, y); }
+void Shader::setUInt2  (const string &name, GLuint x,GLuint y)     { glUniform2ui(get_location(name), x, y); }
+void Shader::setFloat2 (const string &name, GLfloat x,GLfloat y)   { glUniform2f (get_location(name), x, y); }
+void Shader::setFloat2 (const string &name, const vec2 &v )        { glUniform2f (get_location(name), v.x, v.y); }
+void Shader::setDouble2(const string &name, GLdouble x,GLdouble y) { glUniform2d (get_location(name), x, y); }
+
+void Shader::setInt3   (const string &name, GLint x,GLint y,GLint z)          { glUniform3i (get_location(name), x, y, z); }
+void Shader::setUInt3  (const string &name, GLuint x,GLuint y,GLuint z)       { glUniform3ui(get_location(name), x, y, z); }
+void Shader::setFloat3 (const string &name, GLfloat x,GLfloat y,GLfloat z)    { glUniform3f (get_location(name), x, y, z); }
+void Shader::setFloat3 (const string &name, const vec3 &v )                   { glUniform3f (get_location(name), v.x, v.y, v.z); }
+void Shader::setDouble3(const string &name, GLdouble x,GLdouble y,GLdouble z) { glUniform3d (get_location(name), x, y, z); }
+
+void Shader::setInt4   (const string &name, GLint x,GLint y,GLint z,GLint w)             { glUniform4i (get_location(name), x, y, z, w); }
+void Shader::setUInt4  (const string &name, GLuint x,GLuint y,GLuint z,GLuint w)         { glUniform4ui(get_location(name), x, y, z, w); }
+void Shader::setFloat4 (const string &name, GLfloat x,GLfloat y,GLfloat z,GLfloat w)     { glUniform4f (get_location(name), x, y, z, w); }
+void Shader::setFloat4 (const string &name, const vec4 &v )                              { glUniform4f (get_location(name), v.x, v.y, v.z, v.w); }
+void Shader::setDouble4(const string &name, GLdouble x,GLdouble y,GLdouble z,GLdouble w) { glUniform4d (get_location(name), x, y, z, w); }
+
+void Shader::setMatrix (const string &name, const mat2x2 &m) { glUniformMatrix2fv  (get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat2x3 &m) { glUniformMatrix2x3fv(get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat2x4 &m) { glUniformMatrix2x4fv(get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat3x2 &m) { glUniformMatrix3x2fv(get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat3x3 &m) { glUniformMatrix3fv  (get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat3x4 &m) { glUniformMatrix3x4fv(get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat4x2 &m) { glUniformMatrix4x2fv(get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat4x3 &m) { glUniformMatrix4x3fv(get_location(name), 1, GL_FALSE, value_ptr(m)); }
+void Shader::setMatrix (const string &name, const mat4x4 &m) { glUniformMatrix4fv  (get_location(name), 1, GL_FALSE, value_ptr(m)); }
+
+Shader::~Shader()
+{
+    if (pending.program != 0)
+        discardCompile(pending);
+    glDeleteProgram(program);
+}
\ No newline at end of file
@@ -1,18 +1,73 @@
 #ifndef _SHADER_H_
 #define _SHADER_H_
 
+#include <cstdint>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <vector>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 using namespace glm;
 
+struct Shader;
+
+/**
+ * A handle to a uniform variable of a shader program, resolved once by Shader::uniform.
+ * Setting it is a single glProgramUniform* call without strings or hashing, and the program doesn't have to be in use.
+ * Handles stay valid when the program is reloaded.
+ * @tparam T The C++ type of the variable, e.g. GLint (also for samplers), GLuint, GLfloat, vec3 or mat4.
+ */
+template <typename T>
+class Uniform {
+private:
+    const Shader *shader = nullptr;
+    uint32_t slot = 0;
+public:
+    Uniform() {}
+    Uniform(const Shader *shader, uint32_t slot) : shader(shader), slot(slot) {}
+
+    /** Sets the variable's value. Does nothing if the program has no such variable. @param value The value to set. */
+    inline void set(const T &value) const;
+};
+
 /** A struct representing a shader program. */
 struct Shader {
+    /** A program that is being compiled, possibly in the background. */
+    struct PendingProgram {
+        std::vector<GLuint> shaders; /** One per stage, in the order of the stages. */
+        GLuint program = 0;
+        uint64_t cache_key = 0; /** The key the program is stored under in the program cache once linked. */
+    };
 private:
     std::unordered_map<std::string, GLint> uniform_ids; /** A map of uniform variable names to their locations. */
-    GLuint program; /** The OpenGL shader program. */
+    GLuint program = 0; /** The OpenGL shader program. */
+    std::vector<GLenum> stage_types; /** The stages of the program, e.g. GL_VERTEX_SHADER. */
+    std::vector<std::string> stage_files; /** The source file of each stage, kept for reloading. */
+    PendingProgram pending; /** The program started by reload(), swapped in by poll_reload(). */
+    uint32_t generation = 0; /** Incremented whenever the program is replaced. */
+    std::unordered_map<std::string, GLenum> uniform_types; /** The types of the uniform variables. */
+
+    // The variables resolved by uniform(), by slot. Only the locations change when the program is replaced.
+    std::vector<std::string> slot_names;
+    std::vector<GLenum> slot_types;
+    std::vector<GLint> slot_locations;
+    std::vector<bool> slot_reported; /** Whether a missing variable has been reported already. */
+    std::unordered_set<std::string> reported_names; /** The missing variables the string setters have reported. */
+
+    template <typename T> friend class Uniform;
+
+    /** Replaces the program with a newly linked one and looks up its uniforms. */
+    void replace_program(GLuint program);
+    /** Looks up the location of a slot in the current program, reporting it once if it's missing or has another type. */
+    void resolve_slot(uint32_t slot);
+    /** Finds or adds the slot of a variable. */
+    uint32_t get_slot(const std::string &name, GLenum type);
+    /** Looks up the location of a variable for the string setters, reporting it once if it's missing. */
+    GLint get_location(const std::string &name);
+    /** Builds the first program from the stages' source files, waiting for it. */
+    bool create_stages(std::vector<GLenum> types, std::vector<std::string> files);
 public:
     /**
      * Creates a shader program from the given vertex and fragment source code files.
@@ -22,36 +77,88 @@ public:
      */
     bool create(std::string vertexSource, std::string fragmentSource);
 
+    /**
+     * Creates a compute shader program from the given source code file.
+     * @param computeSource The source code file for the compute shader.
+     * @return true if the shader program was created successfully, false otherwise.
+     */
+    bool create_compute(std::string computeSource);
+
+    /**
+     * Starts rebuilding the program from its (changed) source files. Unless a cached binary is found, the driver compiles it
+     * in the background if it supports KHR_parallel_shader_compile, and poll_reload() swaps it in once it's linked.
+     * The current program stays in use until then, and for good if the new one fails to compile.
+     * @return false if the sources could not be loaded, true otherwise.
+     */
+    bool reload();
+
+    /**
+     * Swaps in the program started by reload() if it finished compiling. Call at a frame boundary.
+     * @return true if the program was replaced, false otherwise.
+     */
+    bool poll_reload();
+
+    /** Gets the files the program is built from, including everything they include. @return The normalized paths. */
+    std::vector<std::string> get_source_files() const;
+
+    /** Gets a number that changes whenever the program is replaced, e.g. by a reload. @return The program's generation. */
+    inline uint32_t get_generation() const { return generation; }
+
     /** Sets this shader program as the current one. */
     void use();
 
+    /**
+     * Runs a compute shader program over a grid of workgroups.
+     * @param groups_x The number of workgroups along x.
+     * @param groups_y The number of workgroups along y.
+     * @param groups_z The number of workgroups along z.
+     */
+    void dispatch(GLuint groups_x, GLuint groups_y = 1, GLuint groups_z = 1);
+
+    /**
+     * Runs a compute shader program over the number of workgroups the GPU wrote into a buffer, without reading it back.
+     * @param buffer The buffer holding the workgroup counts as three consecutive uints.
+     * @param offset The offset of the counts in the buffer in bytes, a multiple of 4.
+     */
+    void dispatch_indirect(GLuint buffer, GLintptr offset);
+
+    /**
+     * Resolves a uniform variable to a handle for fast repeated setting.
+     * Names that don't exist in the program, or have a different type, are reported once.
+     * @tparam T The C++ type of the variable, see Uniform.
+     * @param name The name of the uniform variable.
+     * @return The handle.
+     */
+    template <typename T>
+    Uniform<T> uniform(const std::string &name);
+
     /**
      * Sets a uniform 32bit integer (glsl:int) value in this shader program.
      * @param name The name of the uniform variable.
      * @param value The value to set.
      */
-    void setInt(std::string name, GLint value);
+    void setInt(const std::string &name, GLint value);
 
     /**
      * Sets a uniform unsigned 32bit integer (glsl:uint) value in this shader program.
      * @param name The name of the uniform variable.
      * @param value The value to set.
      */
-    void setUInt(std::string name, GLuint value);
+    void setUInt(const std::string &name, GLuint value);
 
     /**
      * Sets a uniform float (glsl:float) value in this shader program.
      * @param name The name of the uniform variable.
      * @param value The value to set.
      */
-    void setFloat(std::string name, GLfloat value);
+    void setFloat(const std::string &name, GLfloat value);
 
     /**
      * Sets a uniform double (glsl:double) value in this shader program.
      * @param name The name of the uniform variable.
      * @param value The value to set.
      */
-    void setDouble(std::string name, GLdouble value);
+    void setDouble(const std::string &name, GLdouble value);
 
     /**
      * Sets two uniform 32bit integer (glsl:ivec2) values in this shader program.
@@ -59,7 +166,7 @@ public:
      * @param value1 The first value to set.
      * @param value2 The second value to set.
      */
-    void setInt2(std::string name, GLint value1, GLint value2);
+    void setInt2(const std::string &name, GLint value1, GLint value2);
 
     /**
      * Sets two uniform unsigned 32bit integer (glsl:uvec2) values in this shader program.
@@ -67,7 +174,7 @@ public:
      * @param value1 The first value to set.
      * @param value2 The second value to set.
      */
-    void setUInt2(std::string name, GLuint value1, GLuint value2);
+    void setUInt2(const std::string &name, GLuint value1, GLuint value2);
 
     /**
      * Sets two uniform float (glsl:vec2) values in this shader program.
@@ -75,13 +182,13 @@ public:
      * @param value1 The first value to set.
      * @param value2 The second value to set.
      */
-    void setFloat2(std::string name, GLfloat value1, GLfloat value2);
+    void setFloat2(const std::string &name, GLfloat value1, GLfloat value2);
     /**
      * Sets two uniform double (glsl:dvec2) values in this shader program.
      * @param name The name of the uniform variable.
      * @param value The value to set.
     */
-    void setFloat2(std::string name, const vec2 &value);
+    void setFloat2(const std::string &name, const vec2 &value);
 
     /**
      * Sets two uniform double (glsl:dvec2) values in this shader program.
@@ -89,7 +196,7 @@ public:
      * @param value1 The first value to set.
      * @param value2 The second value to set.
      */
-    void setDouble2(std::string name, GLdouble value1, GLdouble value2);
+    void setDouble2(const std::string &name, GLdouble value1, GLdouble value2);
 
     /**
      * Sets three uniform 32bit integer (glsl:ivec3) values in this shader program.
@@ -98,7 +205,7 @@ public:
      * @param value2 The second value to set.
      * @param value3 The third value to set.
      */
-    void setInt3(std::string name, GLint value1, GLint value2, GLint value3);
+    void setInt3(const std::string &name, GLint value1, GLint value2, GLint value3);
 
     /**
      * Sets three uniform unsigned 32bit integer (glsl:uvec3) values in this shader program.
@@ -107,7 +214,7 @@ public:
      * @param value2 The second value to set.
      * @param value3 The third value to set.
      */
-    void setUInt3(std::string name, GLuint value1, GLuint value2, GLuint value3);
+    void setUInt3(const std::string &name, GLuint value1, GLuint value2, GLuint value3);
 
     /**
      * Sets three uniform float (glsl:vec3) values in this shader program.
@@ -116,13 +223,13 @@ public:
      * @param value2 The second value to set.
      * @param value3 The third value to set.
      */
-    void setFloat3(std::string name, GLfloat value1, GLfloat value2, GLfloat value3);
+    void setFloat3(const std::string &name, GLfloat value1, GLfloat value2, GLfloat value3);
     /**
      * Sets three uniform float (glsl:vec3) values in this shader program.
      * @param name The name of the uniform variable.
      * @param value The value to set.
      */
-    void setFloat3(std::string name, const vec3 &value);
+    void setFloat3(const std::string &name, const vec3 &value);
 
     /**
      * Sets three uniform double (glsl:dvec3) values in this shader program.
@@ -131,7 +238,7 @@ public:
      * @param value2 The second value to set.
      * @param value3 The third value to set.
      */
-    void setDouble3(std::string name, GLdouble value1, GLdouble value2, GLdouble value3);
+    void setDouble3(const std::string &name, GLdouble value1, GLdouble value2, GLdouble value3);
 
     /**
      * Sets four uniform 32bit integer (glsl:ivec4) values in this shader program.
@@ -141,7 +248,7 @@ public:
      * @param value3 The third value to set.
      * @param value4 The fourth value to set.
      */
-    void setInt4(std::string name, GLint value1, GLint value2, GLint value3, GLint value4);
+    void setInt4(const std::string &name, GLint value1, GLint value2, GLint value3, GLint value4);
 
     /**
      * Sets four uniform unsigned 32bit integer (glsl:uvec4) values in this shader program.
@@ -151,7 +258,7 @@ public:
      * @param value3 The third value to set.
      * @param value4 The fourth value to set.
      */
-    void setUInt4(std::string name, GLuint value1, GLuint value2, GLuint value3, GLuint value4);
+    void setUInt4(const std::string &name, GLuint value1, GLuint value2, GLuint value3, GLuint value4);
 
     /**
      * Sets four uniform float (glsl:vec4) values in this shader program.
@@ -161,13 +268,13 @@ public:
      * @param value3 The third value to set.
      * @param value4 The fourth value to set.
      */
-    void setFloat4(std::string name, GLfloat value1, GLfloat value2, GLfloat value3, GLfloat value4);
+    void setFloat4(const std::string &name, GLfloat value1, GLfloat value2, GLfloat value3, GLfloat value4);
     /**
      * Sets four uniform float (glsl:vec4) values in this shader program.
      * @param name The name of the uniform variable.
      * @param value The value to set.
      */
-    void setFloat4(std::string name, const vec4 &value);
+    void setFloat4(const std::string &name, const vec4 &value);
 
     /**
      * Sets four uniform double (glsl:dvec4) values in this shader program.
@@ -177,70 +284,70 @@ public:
      * @param value3 The third value to set.
      * @param value4 The fourth value to set.
      */
-    void setDouble4(std::string name, GLdouble value1, GLdouble value2, GLdouble value3, GLdouble value4);
+    void setDouble4(const std::string &name, GLdouble value1, GLdouble value2, GLdouble value3, GLdouble value4);
 
     /**
      * Sets a 2x2 uniform matrix of float values (glsl:mat2) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat2x2&);
+    void setMatrix(const std::string &name, const mat2x2&);
 
     /**
      * Sets a 2x3 uniform matrix of float values (glsl:mat2x3) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat2x3&);
+    void setMatrix(const std::string &name, const mat2x3&);
 
     /**
      * Sets a 2x4 uniform matrix of float values (glsl:mat2x4) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat2x4&);
+    void setMatrix(const std::string &name, const mat2x4&);
 
     /**
      * Sets a 3x2 uniform matrix of float values (glsl:mat3x2) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat3x2&);
+    void setMatrix(const std::string &name, const mat3x2&);
 
     /**
      * Sets a 3x3 uniform matrix of float values (glsl:mat3) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat3x3&);
+    void setMatrix(const std::string &name, const mat3x3&);
 
     /**
      * Sets a 3x4 uniform matrix of float values (glsl:mat3x4) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat3x4&);
+    void setMatrix(const std::string &name, const mat3x4&);
 
     /**
      * Sets a 4x2 uniform matrix of float values (glsl:mat4x2) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat4x2&);
+    void setMatrix(const std::string &name, const mat4x2&);
 
     /**
      * Sets a 4x3 uniform matrix of float values (glsl:mat4x3) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat4x3&);
+    void setMatrix(const std::string &name, const mat4x3&);
 
     /**
      * Sets a 4x4 uniform matrix of float values (glsl:mat4) in this shader program.
      * @param name The name of the uniform variable.
      * @param value The values to set.
      */
-    void setMatrix(std::string name, const mat4x4&);
+    void setMatrix(const std::string &name, const mat4x4&);
 
 //     /**
 //      * Sets a Shader Storage Buffer Object (from a vector) in this shader program.
@@ -248,7 +355,7 @@ public:
 //      * @param value The values to set.
 //     */
 //    template<typename T> // because of template, implementation in header is needed
-//    void setBuffer(std::string name, const std::vector<T>) {
+//    void setBuffer(const std::string &name, const std::vector<T>) {
 
 //    }
 
@@ -256,4 +363,46 @@ public:
     ~Shader();
 };
 
+// The GL type of every C++ type a Uniform can have, GL_INT also stands for samplers and images
+template <typename T> struct UniformType;
+#define UNIFORM_TYPE(T, GLTYPE) template <> struct UniformType<T> { static constexpr GLenum value = GLTYPE; };
+UNIFORM_TYPE(GLint, GL_INT)   UNIFORM_TYPE(ivec2, GL_INT_VEC2)          UNIFORM_TYPE(ivec3, GL_INT_VEC3)          UNIFORM_TYPE(ivec4, GL_INT_VEC4)
+UNIFORM_TYPE(GLuint, GL_UNSIGNED_INT) UNIFORM_TYPE(uvec2, GL_UNSIGNED_INT_VEC2) UNIFORM_TYPE(uvec3, GL_UNSIGNED_INT_VEC3) UNIFORM_TYPE(uvec4, GL_UNSIGNED_INT_VEC4)
+UNIFORM_TYPE(GLfloat, GL_FLOAT) UNIFORM_TYPE(vec2, GL_FLOAT_VEC2)       UNIFORM_TYPE(vec3, GL_FLOAT_VEC3)         UNIFORM_TYPE(vec4, GL_FLOAT_VEC4)
+UNIFORM_TYPE(mat2, GL_FLOAT_MAT2)     UNIFORM_TYPE(mat3, GL_FLOAT_MAT3)     UNIFORM_TYPE(mat4, GL_FLOAT_MAT4)
+UNIFORM_TYPE(mat2x3, GL_FLOAT_MAT2x3) UNIFORM_TYPE(mat2x4, GL_FLOAT_MAT2x4) UNIFORM_TYPE(mat3x2, GL_FLOAT_MAT3x2)
+UNIFORM_TYPE(mat3x4, GL_FLOAT_MAT3x4) UNIFORM_TYPE(mat4x2, GL_FLOAT_MAT4x2) UNIFORM_TYPE(mat4x3, GL_FLOAT_MAT4x3)
+#undef UNIFORM_TYPE
+
+template <typename T>
+Uniform<T> Shader::uniform(const std::string &name)
+    { return Uniform<T>(this, get_slot(name, UniformType<T>::value)); }
+
+// glProgramUniform* for every type a Uniform can have
+inline void setProgramUniform(GLuint p, GLint l, GLint v)        { glProgramUniform1i(p, l, v); }
+inline void setProgramUniform(GLuint p, GLint l, const ivec2 &v) { glProgramUniform2i(p, l, v.x, v.y); }
+inline void setProgramUniform(GLuint p, GLint l, const ivec3 &v) { glProgramUniform3i(p, l, v.x, v.y, v.z); }
+inline void setProgramUniform(GLuint p, GLint l, const ivec4 &v) { glProgramUniform4i(p, l, v.x, v.y, v.z, v.w); }
+inline void setProgramUniform(GLuint p, GLint l, GLuint v)       { glProgramUniform1ui(p, l, v); }
+inline void setProgramUniform(GLuint p, GLint l, const uvec2 &v) { glProgramUniform2ui(p, l, v.x, v.y); }
+inline void setProgramUniform(GLuint p, GLint l, const uvec3 &v) { glProgramUniform3ui(p, l, v.x, v.y, v.z); }
+inline void setProgramUniform(GLuint p, GLint l, const uvec4 &v) { glProgramUniform4ui(p, l, v.x, v.y, v.z, v.w); }
+inline void setProgramUniform(GLuint p, GLint l, GLfloat v)      { glProgramUniform1f(p, l, v); }
+inline void setProgramUniform(GLuint p, GLint l, const vec2 &v)  { glProgramUniform2f(p, l, v.x, v.y); }
+inline void setProgramUniform(GLuint p, GLint l, const vec3 &v)  { glProgramUniform3f(p, l, v.x, v.y, v.z); }
+inline void setProgramUniform(GLuint p, GLint l, const vec4 &v)  { glProgramUniform4f(p, l, v.x, v.y, v.z, v.w); }
+inline void setProgramUniform(GLuint p, GLint l, const mat2 &m)   { glProgramUniformMatrix2fv  (p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat3 &m)   { glProgramUniformMatrix3fv  (p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat4 &m)   { glProgramUniformMatrix4fv  (p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat2x3 &m) { glProgramUniformMatrix2x3fv(p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat2x4 &m) { glProgramUniformMatrix2x4fv(p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat3x2 &m) { glProgramUniformMatrix3x2fv(p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat3x4 &m) { glProgramUniformMatrix3x4fv(p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat4x2 &m) { glProgramUniformMatrix4x2fv(p, l, 1, GL_FALSE, value_ptr(m)); }
+inline void setProgramUniform(GLuint p, GLint l, const mat4x3 &m) { glProgramUniformMatrix4x3fv(p, l, 1, GL_FALSE, value_ptr(m)); }
+
+template <typename T>
+inline void Uniform<T>::set(const T &value) const
+    { if (shader) setProgramUniform(shader->program, shader->slot_locations[slot], value); }
+
 #endif//_SHADER_H_
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "ShaderWatcher.h"
+#include "shader_loading.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+#include <sys/inotify.h>
+#include <unistd.h>
+using std::string;
+
+// the directory of a normalized path, "." for files in the working directory
+string get_directory(const string &filepath) {
+    size_t last_slash = filepath.find_last_of('/');
+    return last_slash == string::npos ? "." : filepath.substr(0, last_slash);
+}
+
+bool ShaderWatcher::create() {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        std::cerr << "Failed to create the shader watcher: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ShaderWatcher::add_watches(const Shader *shader) {
+    for (const string &file : shader->get_source_files()) {
+        string directory = get_directory(file);
+        // adding an already watched directory returns its existing descriptor
+        int wd = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+            std::cerr << "Failed to watch '" << directory << "': " << strerror(errno) << std::endl;
+        else
+            directories[wd] = directory;
+    }
+}
+
+void ShaderWatcher::watch(Shader *shader) {
+    if (std::find(shaders.begin(), shaders.end(), shader) == shaders.end())
+        shaders.push_back(shader);
+    if (inotify_fd >= 0)
+        add_watches(shader);
+}
+
+void ShaderWatcher::poll() {
+    if (inotify_fd < 0)
+        return;
+
+    // drain all pending events, saving a file usually produces several
+    std::unordered_set<string> changed;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length; ) {
+            const inotify_event *event = (const inotify_event *)ptr;
+            auto directory = directories.find(event->wd);
+            if (event->len > 0 && directory != directories.end())
+                changed.insert(normalizeShaderPath(directory->second + "/" + event->name));
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    if (!changed.empty()) {
+        for (const string &file : changed)
+            invalidateShaderSource(file);
+
+        for (Shader *shader : shaders) {
+            std::vector<string> files = shader->get_source_files();
+            bool affected = std::any_of(files.begin(), files.end(), [&](const string &file) { return changed.count(file) > 0; });
+            if (affected && shader->reload())
+                add_watches(shader); // the changed file may include new files
+        }
+    }
+
+    for (Shader *shader : shaders)
+        shader->poll_reload();
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+}
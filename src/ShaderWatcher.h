@@ -0,0 +1,48 @@
+#ifndef _SHADERWATCHER_H_
+#define _SHADERWATCHER_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Shader.h"
+
+/**
+ * The ShaderWatcher class reloads shaders when their source files change on disk, using inotify.
+ * It watches the directories of all files a shader is built from (including its #includes), so editors
+ * that save by replacing the file are noticed too. Only the shaders depending on a changed file are rebuilt.
+ */
+class ShaderWatcher {
+private:
+    int inotify_fd = -1;
+    std::unordered_map<int, std::string> directories; // watch descriptor -> watched directory
+    std::vector<Shader*> shaders;
+
+    /** Adds watches for the directories of a shader's source files. */
+    void add_watches(const Shader *shader);
+public:
+    ShaderWatcher() {}
+
+    /**
+     * Creates the inotify instance.
+     * @return true if the watcher was created successfully, false otherwise.
+     */
+    bool create();
+
+    /** Starts watching the source files of a shader. @param shader The shader, has to outlive the watcher. */
+    void watch(Shader *shader);
+
+    /**
+     * Starts reloading the shaders whose files changed since the last call, and swaps in the reloaded programs
+     * that finished compiling. Never blocks on the file system, call once per frame at a frame boundary.
+     */
+    void poll();
+
+    /** Closes the inotify instance. */
+    ~ShaderWatcher();
+
+    // Disallow copying, the inotify instance is owned
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+};
+
+#endif//_SHADERWATCHER_H_
@@ -1,18 +1,24 @@
 #include "Time.h"
-#include <SDL2/SDL.h>
+#include <chrono>
 constexpr float expected_delta = 10.75;
 
+const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
 uint64_t last_frametime;
 uint64_t curr_frametime;
 uint64_t _delta;
 float _normaldelta;
 
-uint64_t Time::delta() {return _delta;}
+uint64_t Time::delta() {return _delta/1000000;}
+uint64_t Time::delta_ns() {return _delta;}
 float Time::normaldelta() {return _normaldelta;}
 
+uint64_t Time::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
 void Time::step() {
     last_frametime = curr_frametime;
-    curr_frametime = SDL_GetTicks64();
+    curr_frametime = now_ns();
     _delta = curr_frametime-last_frametime;
-    _normaldelta = _delta/expected_delta;
+    _normaldelta = (_delta/1e6f)/expected_delta;
 }
\ No newline at end of file
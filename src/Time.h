@@ -1,16 +1,21 @@
 #ifndef _TIME_H_CUSTOM_
 #define _TIME_H_CUSTOM_
 
+#include <cstdint>
 #include <SDL2/SDL.h>
 
 namespace Time
 {
     /**The time in ms since last iteration*/
     uint64_t delta();
+    /**The time in ns since last iteration*/
+    uint64_t delta_ns();
     /**The time since the last iteration normalized to be aproximately 1*/
     float normaldelta();
     /**Steps the time forward to the current iteration*/
     void step();
+    /**The time in ns since the program started, from a monotonic clock*/
+    uint64_t now_ns();
 }
 
 
@@ -0,0 +1,56 @@
+#ifndef _TRIPLEBUFFER_H_
+#define _TRIPLEBUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * A lock-free handoff of values from one writer thread to one reader thread, e.g. the simulation's snapshots to the
+ * renderer. Neither side ever waits for the other: the writer fills its back slot and swaps it with the middle one,
+ * the reader swaps the middle slot with its front one whenever the writer published a newer value since.
+ * The reader always sees the latest complete value, values it was too slow for are skipped.
+ */
+template <typename T>
+class TripleBuffer {
+private:
+    static constexpr uint8_t INDEX_MASK = 3; // the bits of the middle state holding the slot index
+    static constexpr uint8_t FRESH = 4;      // set in the middle state while it holds a value the reader hasn't taken
+
+    // each slot on its own cache line, so the threads don't invalidate each other's while filling and reading them
+    struct alignas(64) Slot {
+        T value;
+    };
+
+    Slot slots[3];
+    alignas(64) std::atomic<uint8_t> middle{1}; // the slot in between, and whether it is fresh
+    alignas(64) uint8_t back = 0;               // the slot only the writer touches
+    alignas(64) uint8_t front = 2;              // the slot only the reader touches
+public:
+    /** @return The slot the writer fills before publishing it. Writer only. */
+    inline T &back_buffer() { return slots[back].value; }
+
+    /** Hands the back slot to the reader, the writer continues with the slot it replaces. Writer only. */
+    inline void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK; }
+
+    /** Copies a value into the back slot and publishes it. Writer only. @param value The value. */
+    inline void write(const T &value) {
+        back_buffer() = value;
+        publish();
+    }
+
+    /**
+     * Takes the latest published value, if any is newer than the front one. Reader only.
+     * @return True if the front slot changed, false otherwise.
+     */
+    inline bool update() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    /** @return The value taken by the last update. Reader only. */
+    inline const T &front_buffer() const { return slots[front].value; }
+};
+
+#endif//_TRIPLEBUFFER_H_
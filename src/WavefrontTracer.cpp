@@ -0,0 +1,142 @@
+#include "WavefrontTracer.h"
+#include "Profiler.h"
+#include <cstddef>
+
+constexpr const char *WAVEFRONT_RAYGEN     = "src/shaders/wavefront_raygen.glsl";
+constexpr const char *WAVEFRONT_EXTEND     = "src/shaders/wavefront_extend.glsl";
+constexpr const char *WAVEFRONT_SHADE      = "src/shaders/wavefront_shade.glsl";
+constexpr const char *WAVEFRONT_QUEUE      = "src/shaders/wavefront_queue.glsl";
+constexpr const char *WAVEFRONT_SHADOW     = "src/shaders/wavefront_shadow.glsl";
+constexpr const char *WAVEFRONT_ACCUMULATE = "src/shaders/wavefront_accumulate.glsl";
+
+constexpr GLuint RADIANCE_IMAGE_UNIT = 0;         // `radiance_image` in wavefront.glsl
+constexpr GLuint PREVIOUS_AVERAGE_IMAGE_UNIT = 1; // `previous_average` in wavefront_accumulate.glsl and wavefront_shade.glsl
+constexpr GLuint AVERAGE_IMAGE_UNIT = 2;          // `average` in wavefront_accumulate.glsl
+constexpr GLuint FEATURE_IMAGE_UNIT = 3;          // `previous_albedo` in wavefront_shade.glsl, followed by the other feature images
+constexpr GLuint PIXEL_GROUP_SIZE = 8;            // the workgroup size of the per pixel kernels along x and y
+constexpr GLuint QUEUE_GROUP_SIZE = 64;           // WAVEFRONT_GROUP_SIZE in wavefront.glsl
+
+bool WavefrontTracer::create(Scene *scene, uint32_t bounces) {
+    this->bounces = bounces;
+    if (!raygen.create_compute(WAVEFRONT_RAYGEN) || !extend.create_compute(WAVEFRONT_EXTEND) || !shade.create_compute(WAVEFRONT_SHADE)
+        || !queue.create_compute(WAVEFRONT_QUEUE) || !shadow.create_compute(WAVEFRONT_SHADOW) || !accumulate.create_compute(WAVEFRONT_ACCUMULATE))
+        return false;
+
+    uniforms.cam2world               = raygen.uniform<mat4>("cam2world");
+    uniforms.near_clip_data          = raygen.uniform<vec2>("near_clip_data");
+    uniforms.pixel_size              = raygen.uniform<vec2>("pixel_size");
+    uniforms.raygen_sample_index     = raygen.uniform<GLuint>("sample_index");
+    uniforms.shade_sample_index      = shade.uniform<GLuint>("sample_index");
+    uniforms.max_bounces             = shade.uniform<GLuint>("max_bounces");
+    uniforms.write_features          = shade.uniform<GLuint>("write_features");
+
+    // the kernels that traverse the scene or read its triangles
+    scene->attach(&extend);
+    scene->attach(&shade);
+    scene->attach(&shadow);
+    return true;
+}
+
+std::vector<Shader*> WavefrontTracer::get_shaders()
+    { return {&raygen, &extend, &shade, &queue, &shadow, &accumulate}; }
+
+void WavefrontTracer::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+
+    // every path queues at most one ray and one shadow ray per bounce
+    size_t pixels = (size_t)width * height;
+    rays[0].allocate(pixels);
+    rays[1].allocate(pixels);
+    shadow_rays.allocate(pixels);
+
+    if (radiance_texture != 0)
+        glDeleteTextures(1, &radiance_texture);
+    glGenTextures(1, &radiance_texture);
+    glBindTexture(GL_TEXTURE_2D, radiance_texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool WavefrontTracer::reloaded() {
+    uint32_t kernels = 0;
+    for (Shader *kernel : get_shaders())
+        kernels += kernel->get_generation();
+    bool changed = kernels != generation;
+    generation = kernels;
+    return changed;
+}
+
+void WavefrontTracer::render(const mat4 &cam2world, vec2 near_clip_data, int width, int height, AccumulationBuffer &accumulation) {
+    if (width != this->width || height != this->height)
+        resize(width, height);
+
+    GLuint pixels = (GLuint)(width * height);
+    GLuint groups_x = (width + PIXEL_GROUP_SIZE - 1) / PIXEL_GROUP_SIZE;
+    GLuint groups_y = (height + PIXEL_GROUP_SIZE - 1) / PIXEL_GROUP_SIZE;
+    {
+        PROFILE_SCOPE("uniforms");
+        uint32_t sample_index = accumulation.get_sample_index();
+        uniforms.cam2world.set(cam2world);
+        uniforms.near_clip_data.set(near_clip_data);
+        uniforms.pixel_size.set(vec2(1.0f / width, 1.0f / height));
+        uniforms.raygen_sample_index.set(sample_index);
+        uniforms.shade_sample_index.set(sample_index);
+        uniforms.max_bounces.set(bounces);
+        uniforms.write_features.set(accumulation.has_features() ? 1u : 0u);
+
+        // the camera rays fill the first queue, the others start empty
+        WavefrontQueues start = {};
+        start.extend_dispatch = uvec4((pixels + QUEUE_GROUP_SIZE - 1) / QUEUE_GROUP_SIZE, 1, 1, pixels);
+        start.shadow_dispatch = uvec4(0, 1, 1, 0);
+        queues.setData({start}, GL_DYNAMIC_DRAW);
+        queues.bind(WAVEFRONT_QUEUES_BINDING);
+        shadow_rays.bind(SHADOW_RAYS_BINDING);
+        glBindImageTexture(RADIANCE_IMAGE_UNIT, radiance_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        accumulation.bind_images(PREVIOUS_AVERAGE_IMAGE_UNIT, AVERAGE_IMAGE_UNIT);
+        accumulation.bind_feature_images(FEATURE_IMAGE_UNIT);
+    }
+
+    const GLbitfield STAGE_BARRIER = GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+    rays[0].bind(RAYS_IN_BINDING);
+    {
+        PROFILE_GPU_SCOPE("raygen");
+        raygen.dispatch(groups_x, groups_y);
+    }
+    glMemoryBarrier(STAGE_BARRIER);
+
+    for (uint32_t bounce = 0; bounce <= bounces; bounce++) {
+        rays[bounce % 2].bind(RAYS_IN_BINDING);
+        rays[1 - bounce % 2].bind(RAYS_OUT_BINDING);
+        {
+            PROFILE_GPU_SCOPE("extend");
+            extend.dispatch_indirect(queues.getBufferID(), offsetof(WavefrontQueues, extend_dispatch));
+        }
+        glMemoryBarrier(STAGE_BARRIER);
+        {
+            PROFILE_GPU_SCOPE("shade");
+            shade.dispatch_indirect(queues.getBufferID(), offsetof(WavefrontQueues, extend_dispatch));
+        }
+        glMemoryBarrier(STAGE_BARRIER);
+        if (bounces == 0)
+            break; // the preview shading queues nothing
+        queue.dispatch(1);
+        glMemoryBarrier(STAGE_BARRIER | GL_COMMAND_BARRIER_BIT);
+        {
+            PROFILE_GPU_SCOPE("shadow");
+            shadow.dispatch_indirect(queues.getBufferID(), offsetof(WavefrontQueues, shadow_dispatch));
+        }
+        glMemoryBarrier(STAGE_BARRIER);
+    }
+
+    {
+        PROFILE_GPU_SCOPE("accumulate");
+        accumulate.dispatch(groups_x, groups_y);
+    }
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+WavefrontTracer::~WavefrontTracer() {
+    if (radiance_texture != 0)
+        glDeleteTextures(1, &radiance_texture);
+}
@@ -0,0 +1,115 @@
+#ifndef _WAVEFRONTTRACER_H_
+#define _WAVEFRONTTRACER_H_
+
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "Buffer.h"
+#include "Scene.h"
+#include "AccumulationBuffer.h"
+using namespace glm;
+
+constexpr GLuint WAVEFRONT_QUEUES_BINDING = 6; /** The SSBO binding of `WavefrontQueues` in wavefront.glsl. */
+constexpr GLuint RAYS_IN_BINDING = 7;          /** The SSBO binding of `RaysIn` in wavefront.glsl. */
+constexpr GLuint RAYS_OUT_BINDING = 8;         /** The SSBO binding of `RaysOut` in wavefront.glsl. */
+constexpr GLuint SHADOW_RAYS_BINDING = 9;      /** The SSBO binding of `ShadowRays` in wavefront.glsl. */
+
+/** A path's next ray and its closest hit, must match `RayRecord` in wavefront.glsl. */
+struct RayRecord {
+    vec3 origin; uint32_t pixel;
+    vec3 dir; float dst;
+    vec3 throughput; int32_t triangle;
+    int32_t instance; uint32_t depth;
+    uint32_t _pad0, _pad1;
+};
+
+/** A ray towards the light, must match `ShadowRecord` in wavefront.glsl. */
+struct ShadowRecord {
+    vec3 origin; uint32_t pixel;
+    vec3 contribution; float _pad0;
+};
+
+/** The queue counters and the indirect dispatch arguments, must match `WavefrontQueues` in wavefront.glsl. */
+struct WavefrontQueues {
+    uvec4 extend_dispatch;
+    uvec4 shadow_dispatch;
+    uint32_t next_ray_count;
+    uint32_t shadow_count;
+    uint32_t _pad0, _pad1;
+};
+
+/**
+ * The WavefrontTracer class traces the scene with compute shaders instead of the fragment kernel, as a path tracer
+ * split into kernels that each work through a queue of rays:
+ * raygen queues a camera ray per pixel, extend finds the rays' closest hits, shade adds the light of the paths that left
+ * the scene and queues a bounce and a shadow ray for the others, shadow adds the light the unblocked shadow rays carry.
+ * Extend, shade and shadow run once per bounce. Shade compacts the surviving paths into the next queue, and a one thread
+ * kernel turns the queue sizes into the indirect dispatches of the next bounce, so nothing is read back and the lanes of
+ * a warp never idle on finished paths. Finally accumulate averages the sample into the AccumulationBuffer's image.
+ * If the accumulation keeps features, shade averages those of the camera rays' hits into it right away.
+ */
+class WavefrontTracer {
+private:
+    Shader raygen, extend, shade, shadow, queue, accumulate;
+    struct {
+        Uniform<mat4> cam2world;
+        Uniform<vec2> near_clip_data;
+        Uniform<vec2> pixel_size;
+        Uniform<GLuint> raygen_sample_index;
+        Uniform<GLuint> shade_sample_index;
+        Uniform<GLuint> max_bounces;
+        Uniform<GLuint> write_features;
+    } uniforms;
+    Buffer<WavefrontQueues> queues;
+    Buffer<RayRecord> rays[2]; // the queue being extended and the one shade appends to, swapped every bounce
+    Buffer<ShadowRecord> shadow_rays;
+    GLuint radiance_texture = 0; // the light each pixel's path gathered this sample
+    int width = 0, height = 0;   // the size of the buffers, in pixels
+    uint32_t bounces = 0;
+    uint32_t generation = 0;     // the sum of the kernels' generations, changes when one is reloaded
+
+    /** (Re)creates the ray queues and the radiance image for a number of pixels. */
+    void resize(int width, int height);
+public:
+    WavefrontTracer() {}
+
+    /**
+     * Compiles the kernels, and attaches those tracing rays to the scene so bind() sets their uniforms.
+     * @param scene The scene to trace.
+     * @param bounces The bounces after the camera ray. 0 shades the first hit like the fragment kernel.
+     * @return True if all kernels compiled, false otherwise.
+     */
+    bool create(Scene *scene, uint32_t bounces);
+
+    /** @return The kernels, e.g. for the ShaderWatcher. */
+    std::vector<Shader*> get_shaders();
+
+    /**
+     * Checks whether a kernel was reloaded since the last check, which renders a different image, so the accumulated
+     * samples have to be discarded before the accumulation buffer is prepared.
+     * @return True if a kernel was reloaded, or on the first check, false otherwise.
+     */
+    bool reloaded();
+
+    /**
+     * Traces one sample per pixel and adds it to the accumulation buffer, which must be prepared for the size.
+     * The scene must be bound.
+     * @param cam2world The camera's cam2world matrix.
+     * @param near_clip_data The size of the camera's near clip plane at distance 1.
+     * @param width The width of the image to trace.
+     * @param height The height of the image to trace.
+     * @param accumulation The accumulation buffer.
+     */
+    void render(const mat4 &cam2world, vec2 near_clip_data, int width, int height, AccumulationBuffer &accumulation);
+
+    /** Frees the radiance image. */
+    ~WavefrontTracer();
+
+    // Disallow copying, the GL objects are owned
+    WavefrontTracer(const WavefrontTracer&) = delete;
+    WavefrontTracer& operator=(const WavefrontTracer&) = delete;
+};
+
+#endif//_WAVEFRONTTRACER_H_
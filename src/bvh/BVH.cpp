@@ -0,0 +1,261 @@
+#include "BVH.h"
+#include "../parallel.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <glm/glm.hpp>
+using std::vector;
+using namespace glm;
+
+namespace {
+
+constexpr int SAH_BINS = 16;
+constexpr uint32_t MAX_LEAF_SIZE = 8;
+constexpr float COST_TRAVERSAL = 1.0f;
+constexpr float COST_INTERSECTION = 1.0f;
+constexpr size_t BUILD_BLOCK_SIZE = 16384; // triangles per parallel_for index
+constexpr unsigned REFIT_TASKS_PER_THREAD = 4; // independent subtrees per thread, so uneven subtrees still balance
+
+// per triangle data that is only needed during the build
+struct BuildPrimitive {
+    AABB bounds;
+    vec3 centroid;
+};
+
+struct BuildState {
+    vector<BVHNode> &nodes;
+    vector<BuildPrimitive> &prims;
+    vector<uint32_t> &indices; // permutation of triangle indices, partitioned in place
+};
+
+struct SplitCandidate {
+    int axis = -1;
+    int bin = 0;     // primitives in bins [0,bin] go left
+    float cost = 1e30f;
+};
+
+// bins the centroids of indices[first,first+count) along every axis and returns the cheapest split
+SplitCandidate find_split(const BuildState &state, uint32_t first, uint32_t count, const AABB &centroid_bounds) {
+    SplitCandidate best;
+    for (int axis = 0; axis < 3; axis++) {
+        float cmin = centroid_bounds.min[axis];
+        float extent = centroid_bounds.max[axis] - cmin;
+        if (extent <= 0.0f)
+            continue;
+
+        AABB bin_bounds[SAH_BINS];
+        uint32_t bin_count[SAH_BINS] = {};
+        float scale = SAH_BINS / extent;
+        for (uint32_t i = first; i < first + count; i++) {
+            const BuildPrimitive &prim = state.prims[state.indices[i]];
+            int bin = std::min(SAH_BINS - 1, (int)((prim.centroid[axis] - cmin) * scale));
+            bin_count[bin]++;
+            bin_bounds[bin].grow(prim.bounds);
+        }
+
+        // sweep from the right to collect the right side areas, then from the left to evaluate the splits
+        float right_area[SAH_BINS - 1];
+        uint32_t right_count[SAH_BINS - 1];
+        AABB right;
+        uint32_t right_sum = 0;
+        for (int i = SAH_BINS - 1; i > 0; i--) {
+            right.grow(bin_bounds[i]);
+            right_sum += bin_count[i];
+            right_area[i - 1] = right.area();
+            right_count[i - 1] = right_sum;
+        }
+
+        AABB left;
+        uint32_t left_sum = 0;
+        for (int i = 0; i < SAH_BINS - 1; i++) {
+            left.grow(bin_bounds[i]);
+            left_sum += bin_count[i];
+            if (left_sum == 0 || right_count[i] == 0)
+                continue;
+            float cost = left.area() * left_sum + right_area[i] * right_count[i];
+            if (cost < best.cost)
+                best = {axis, i, cost};
+        }
+    }
+    return best;
+}
+
+uint32_t build_node(BuildState &state, uint32_t first, uint32_t count, int depth) {
+    AABB bounds, centroid_bounds;
+    for (uint32_t i = first; i < first + count; i++) {
+        const BuildPrimitive &prim = state.prims[state.indices[i]];
+        bounds.grow(prim.bounds);
+        centroid_bounds.grow(prim.centroid);
+    }
+
+    uint32_t node_idx = (uint32_t)state.nodes.size();
+    state.nodes.push_back({bounds.min, first, bounds.max, count});
+    if (count == 1 || depth >= (int)BVH_MAX_DEPTH)
+        return node_idx;
+
+    // the SAH cost of a split is relative to the parent, so the leaf cost has to be scaled the same way
+    SplitCandidate split = find_split(state, first, count, centroid_bounds);
+    float leaf_cost = count * COST_INTERSECTION;
+    float split_cost = COST_TRAVERSAL + COST_INTERSECTION * split.cost / bounds.area();
+    uint32_t mid;
+    if (split.axis >= 0 && (split_cost < leaf_cost || count > MAX_LEAF_SIZE)) {
+        int axis = split.axis;
+        float cmin = centroid_bounds.min[axis];
+        float scale = SAH_BINS / (centroid_bounds.max[axis] - cmin);
+        auto begin = state.indices.begin() + first;
+        mid = (uint32_t)(std::partition(begin, begin + count, [&](uint32_t idx) {
+            int bin = std::min(SAH_BINS - 1, (int)((state.prims[idx].centroid[axis] - cmin) * scale));
+            return bin <= split.bin;
+        }) - state.indices.begin());
+    } else if (count > MAX_LEAF_SIZE) {
+        // all centroids coincide, the SAH can't tell them apart, so just halve the range
+        mid = first + count / 2;
+    } else {
+        return node_idx;
+    }
+
+    // the left child is emitted right after its parent, the right child after the whole left subtree
+    build_node(state, first, mid - first, depth + 1);
+    uint32_t right_idx = build_node(state, mid, first + count - mid, depth + 1);
+    state.nodes[node_idx].index = right_idx;
+    state.nodes[node_idx].count = 0;
+    return node_idx;
+}
+
+} // namespace
+
+vector<uint32_t> build_hierarchy(const vector<AABB> &bounds, vector<BVHNode> &nodes) {
+    nodes.clear();
+    if (bounds.empty())
+        return {};
+
+    vector<BuildPrimitive> prims(bounds.size());
+    vector<uint32_t> indices(bounds.size());
+    for (size_t i = 0; i < bounds.size(); i++) {
+        prims[i].bounds = bounds[i];
+        prims[i].centroid = (bounds[i].min + bounds[i].max) * 0.5f;
+        indices[i] = (uint32_t)i;
+    }
+
+    nodes.reserve(bounds.size() * 2 - 1);
+    BuildState state = {nodes, prims, indices};
+    build_node(state, 0, (uint32_t)bounds.size(), 0);
+    return indices;
+}
+
+void BVH::build(vector<Triangle> input, BVHBuilder builder) {
+    // the linear builder is fast enough for the serial passes around it to matter
+    uint32_t blocks = (uint32_t)((input.size() + BUILD_BLOCK_SIZE - 1) / BUILD_BLOCK_SIZE);
+    vector<AABB> bounds(input.size());
+    parallel_for(blocks, [&](uint32_t block) {
+        for (size_t i = block * BUILD_BLOCK_SIZE; i < std::min((block + 1) * BUILD_BLOCK_SIZE, input.size()); i++) {
+            bounds[i].grow(input[i].a);
+            bounds[i].grow(input[i].b);
+            bounds[i].grow(input[i].c);
+        }
+    });
+    vector<uint32_t> order = builder == BVH_BUILDER_SAH
+        ? build_hierarchy(bounds, nodes)
+        : build_linear_hierarchy(bounds, nodes, builder == BVH_BUILDER_LBVH_TREELETS);
+
+    triangles.resize(input.size());
+    parallel_for(blocks, [&](uint32_t block) {
+        for (size_t i = block * BUILD_BLOCK_SIZE; i < std::min((block + 1) * BUILD_BLOCK_SIZE, input.size()); i++)
+            triangles[i] = input[order[i]];
+    });
+    sources = std::move(order);
+    build_cost = sah_cost(0, (uint32_t)nodes.size());
+    this->builder = builder;
+}
+
+uint32_t BVH::append(const BVH &other) {
+    uint32_t node_offset = (uint32_t)nodes.size();
+    uint32_t triangle_offset = (uint32_t)triangles.size();
+    nodes.reserve(nodes.size() + other.nodes.size());
+    for (BVHNode node : other.nodes) {
+        node.index += node.is_leaf() ? triangle_offset : node_offset;
+        nodes.push_back(node);
+    }
+    triangles.insert(triangles.end(), other.triangles.begin(), other.triangles.end());
+    sources.reserve(sources.size() + other.sources.size());
+    for (uint32_t source : other.sources)
+        sources.push_back(source + triangle_offset);
+    return node_offset;
+}
+
+namespace {
+
+// recomputes the box of a node from its triangles or its children, which have to be up to date
+bool refit_node(BVH &bvh, uint32_t index) {
+    BVHNode &node = bvh.nodes[index];
+    AABB bounds;
+    if (node.is_leaf()) {
+        for (uint32_t i = node.index; i < node.index + node.count; i++) {
+            bounds.grow(bvh.triangles[i].a);
+            bounds.grow(bvh.triangles[i].b);
+            bounds.grow(bvh.triangles[i].c);
+        }
+    } else {
+        const BVHNode &left = bvh.nodes[index + 1], &right = bvh.nodes[node.index];
+        bounds.grow(AABB{left.bbmin, left.bbmax});
+        bounds.grow(AABB{right.bbmin, right.bbmax});
+    }
+    bool changed = bounds.min != node.bbmin || bounds.max != node.bbmax;
+    node.bbmin = bounds.min;
+    node.bbmax = bounds.max;
+    return changed;
+}
+
+} // namespace
+
+void BVH::refit(uint32_t root, uint32_t end, vector<uint8_t> *changed) {
+    if (root >= end)
+        return;
+
+    // split off subtrees by opening the largest one until there are enough, the opened nodes stay for last
+    struct Subtree { uint32_t root, end; };
+    vector<Subtree> subtrees = {{root, end}};
+    vector<uint32_t> opened;
+    size_t target = JobSystem::get().get_thread_count() * REFIT_TASKS_PER_THREAD;
+    while (subtrees.size() < target) {
+        auto largest = std::max_element(subtrees.begin(), subtrees.end(), [](const Subtree &a, const Subtree &b) {
+            return a.end - a.root < b.end - b.root;
+        });
+        const BVHNode &node = nodes[largest->root];
+        if (node.is_leaf())
+            break; // the largest subtree is a single leaf, so all are
+        Subtree subtree = *largest;
+        opened.push_back(subtree.root);
+        *largest = {subtree.root + 1, node.index};
+        subtrees.push_back({node.index, subtree.end});
+    }
+
+    // children have larger indices than their parents, so walking a subtree backwards visits them first
+    auto refit_range = [&](uint32_t first, uint32_t last) {
+        for (uint32_t i = last; i-- > first;) {
+            bool node_changed = refit_node(*this, i);
+            if (changed)
+                (*changed)[i] = node_changed;
+        }
+    };
+    parallel_for((uint32_t)subtrees.size(), [&](uint32_t i) { refit_range(subtrees[i].root, subtrees[i].end); });
+    std::sort(opened.begin(), opened.end(), std::greater<uint32_t>());
+    for (uint32_t index : opened)
+        refit_range(index, index + 1);
+}
+
+float BVH::sah_cost(uint32_t root, uint32_t end) const {
+    if (root >= end)
+        return 0.0f;
+    float root_area = AABB{nodes[root].bbmin, nodes[root].bbmax}.area();
+    if (root_area <= 0.0f)
+        return 0.0f;
+
+    double cost = 0.0;
+    for (uint32_t i = root; i < end; i++) {
+        const BVHNode &node = nodes[i];
+        float area = AABB{node.bbmin, node.bbmax}.area();
+        cost += area * (node.is_leaf() ? node.count * COST_INTERSECTION : COST_TRAVERSAL);
+    }
+    return (float)(cost / root_area);
+}
@@ -0,0 +1,145 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+using namespace glm;
+
+/**
+ * A triangle as laid out in the `Triangle` SSBO struct of tracing.glsl (std430).
+ * The padding keeps every vertex 16 byte aligned, like a glsl vec3.
+ */
+struct Triangle {
+    vec3 a; float _pad0;
+    vec3 b; float _pad1;
+    vec3 c; float _pad2;
+};
+static_assert(sizeof(Triangle) == 48, "Triangle must match the std430 layout in tracing.glsl");
+
+/**
+ * A node of the flattened BVH as laid out in the `BVHNode` SSBO struct of tracing.glsl (std430).
+ * Nodes are stored depth first, so the left child of an inner node always directly follows its parent.
+ */
+struct BVHNode {
+    vec3 bbmin;     /** The minimum corner of the node's bounding box. */
+    uint32_t index; /** Inner node: index of the right child. Leaf: index of the first triangle. */
+    vec3 bbmax;     /** The maximum corner of the node's bounding box. */
+    uint32_t count; /** The number of triangles in the leaf, 0 for inner nodes. */
+
+    /** @return True if this node is a leaf, false if it is an inner node. */
+    inline bool is_leaf() const { return count != 0; }
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode must match the std430 layout in tracing.glsl");
+
+/** The most inner nodes above any leaf: traversal pushes one far child per level onto fixed stacks of this size. */
+constexpr uint32_t BVH_MAX_DEPTH = 64; // must match BVH_STACK_SIZE in tracing.glsl
+
+/**
+ * Interleaves the lower 10 bits of three cell coordinates into a 30 bit Morton code, x taking the highest bit.
+ * Used by the LBVH builder to order primitives and by the CPU tracer to order rays.
+ */
+inline uint32_t morton_interleave(uint32_t x, uint32_t y, uint32_t z) {
+    auto spread = [](uint32_t v) { // leaves two zero bits between each of the lower 10 bits
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    };
+    return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+/** An axis aligned bounding box. */
+struct AABB {
+    vec3 min = vec3( 1e30f);
+    vec3 max = vec3(-1e30f);
+
+    inline void grow(const vec3 &p) { min = glm::min(min, p); max = glm::max(max, p); }
+    inline void grow(const AABB &b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+    /** @return The surface area of the box, 0 for an empty box. */
+    inline float area() const {
+        vec3 e = max - min;
+        return e.x < 0 ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+/** The algorithms a BVH can be built with. */
+enum BVHBuilder {
+    BVH_BUILDER_SAH = 0,            /** Top down with a binned surface area heuristic, single threaded. The best trees. */
+    BVH_BUILDER_LBVH = 1,           /** A linear BVH over the triangles' Morton codes, built in parallel. Much faster, worse trees. */
+    BVH_BUILDER_LBVH_TREELETS = 2,  /** A linear BVH whose treelets are restructured for the lowest SAH cost afterwards. */
+};
+
+/**
+ * A bounding volume hierarchy over a triangle soup.
+ * Built on the CPU with a binned surface area heuristic and flattened depth first,
+ * so `nodes` and `triangles` can be uploaded to the tracing.glsl SSBOs as they are.
+ */
+struct BVH {
+    std::vector<BVHNode> nodes;      /** The flattened nodes, nodes[0] is the root. Empty if there are no triangles. */
+    std::vector<Triangle> triangles; /** The triangles, reordered so every leaf references a contiguous range. */
+    std::vector<uint32_t> sources;   /** For every triangle, its index in the triangles the hierarchy was built over. */
+    float build_cost = 0.0f;         /** The SAH cost (see sah_cost) of the hierarchy when it was built. */
+    BVHBuilder builder = BVH_BUILDER_SAH; /** The algorithm the hierarchy was built with, rebuilds use it again. */
+
+    /**
+     * Builds the hierarchy, replacing any previous contents.
+     * @param triangles The triangles to build the hierarchy over.
+     * @param builder The algorithm to build it with.
+     */
+    void build(std::vector<Triangle> triangles, BVHBuilder builder = BVH_BUILDER_SAH);
+
+    /**
+     * Appends the nodes and triangles of another hierarchy, so several hierarchies share one pair of buffers.
+     * The appended nodes keep referencing their own triangles, but the root of the appended tree is no longer nodes[0].
+     * @param other The hierarchy to append.
+     * @return The index of the appended root node, or of the end of the nodes if other is empty.
+     */
+    uint32_t append(const BVH &other);
+
+    /**
+     * Recomputes the boxes of a subtree bottom up after its triangles moved, keeping the topology.
+     * Nodes are stored depth first, so every subtree is a contiguous range and children follow their parents:
+     * the range is split into independent subtrees refitted in parallel, then the nodes above them are refitted in order.
+     * @param root The index of the subtree's root.
+     * @param end The index after the subtree's last node, nodes.size() for the whole hierarchy.
+     * @param changed If not null, receives 1 for every node whose box changed, it must hold nodes.size() entries.
+     */
+    void refit(uint32_t root, uint32_t end, std::vector<uint8_t> *changed = nullptr);
+
+    /**
+     * Computes the expected cost of tracing a ray through a subtree with the surface area heuristic of the builder,
+     * relative to the root's area. It grows as refitted boxes stretch and overlap, tracking how far the tree degraded.
+     * @param root The index of the subtree's root.
+     * @param end The index after the subtree's last node.
+     * @return The cost, 0 for an empty subtree.
+     */
+    float sah_cost(uint32_t root, uint32_t end) const;
+};
+
+/**
+ * Builds the nodes of a hierarchy over arbitrary primitives, given by their boxes, with the same heuristic as BVH::build.
+ * @param bounds The boxes of the primitives.
+ * @param nodes Receives the flattened nodes, whose leaves reference ranges of the returned order.
+ * @return The primitive indices in the order the leaves reference them.
+ */
+std::vector<uint32_t> build_hierarchy(const std::vector<AABB> &bounds, std::vector<BVHNode> &nodes);
+
+/**
+ * Builds the nodes of a linear BVH (LBVH) over arbitrary primitives, given by their boxes, on the JobSystem's threads.
+ * The primitives are sorted by the Morton codes of their centroids, a binary radix tree is emitted over the codes in
+ * parallel (Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees"), then small subtrees
+ * are collapsed into leaves where the surface area heuristic favors it. Every level of the tree splits the codes at a
+ * lower bit, so it is at most BVH_MAX_DEPTH levels deep, like the trees of build_hierarchy. Optimized treelets can
+ * deepen it, a tree that grew past the limit is rebuilt with build_hierarchy instead.
+ * @param bounds The boxes of the primitives.
+ * @param nodes Receives the flattened nodes, in the layout build_hierarchy emits.
+ * @param optimize True to restructure the tree on the way up: the treelet of the 7 largest subtrees below every node
+ *                 is rebuilt in the topology with the lowest SAH cost (Karras and Aila, "Fast Parallel Construction of
+ *                 High-Quality Bounding Volume Hierarchies"). One pass, at a few times the cost of the plain build.
+ * @return The primitive indices in the order the leaves reference them.
+ */
+std::vector<uint32_t> build_linear_hierarchy(const std::vector<AABB> &bounds, std::vector<BVHNode> &nodes, bool optimize);
+
+#endif//_BVH_H_
\ No newline at end of file
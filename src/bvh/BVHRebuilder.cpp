@@ -0,0 +1,30 @@
+#include "BVHRebuilder.h"
+#include <vector>
+using std::vector;
+
+void BVHRebuilder::start(vector<Triangle> triangles, BVHBuilder builder) {
+    if (busy())
+        return;
+    JobSystem &jobs = JobSystem::get();
+    job = jobs.create([this, builder, triangles = std::move(triangles)]() mutable {
+        result.build(std::move(triangles), builder);
+    });
+    jobs.run_background(job);
+}
+
+bool BVHRebuilder::poll(BVH &bvh) {
+    if (!busy() || !JobSystem::get().is_finished(job))
+        return false;
+    job.reset();
+    bvh = std::move(result);
+    result = BVH();
+    return true;
+}
+
+void BVHRebuilder::discard() {
+    if (!busy())
+        return;
+    JobSystem::get().wait(job);
+    job.reset();
+    result = BVH();
+}
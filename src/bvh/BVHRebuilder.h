@@ -0,0 +1,48 @@
+#ifndef _BVH_REBUILDER_H_
+#define _BVH_REBUILDER_H_
+
+#include <vector>
+#include "BVH.h"
+#include "../JobSystem.h"
+
+/**
+ * Builds a BVH as a background job of the JobSystem, so a refitted hierarchy can be replaced without stalling frames.
+ * The build works on its own copy of the triangles, which may be out of date by the time it finishes:
+ * the new hierarchy is refitted to the latest positions when it is swapped in, see Scene::end_frame.
+ */
+class BVHRebuilder {
+private:
+    JobSystem::JobHandle job;
+    BVH result;
+public:
+    BVHRebuilder() = default;
+
+    /** Waits for a running build, its result is discarded. */
+    ~BVHRebuilder() { discard(); }
+
+    /**
+     * Starts building a hierarchy. Does nothing while a build is running.
+     * @param triangles The triangles to build over, in the order BVH::sources will refer to.
+     * @param builder The algorithm to build with.
+     */
+    void start(std::vector<Triangle> triangles, BVHBuilder builder);
+
+    /** @return True if a build was started whose result has not been taken yet. */
+    inline bool busy() const { return job != nullptr; }
+
+    /**
+     * Takes the result of a finished build, without waiting for a running one.
+     * @param bvh Receives the new hierarchy, if there is one.
+     * @return True if a build finished and bvh was replaced, false otherwise.
+     */
+    bool poll(BVH &bvh);
+
+    /** Waits for a running build and drops its result, e.g. when the geometry was replaced in the meantime. */
+    void discard();
+
+    // Disallow copying, the job references the rebuilder
+    BVHRebuilder(const BVHRebuilder&) = delete;
+    BVHRebuilder& operator=(const BVHRebuilder&) = delete;
+};
+
+#endif//_BVH_REBUILDER_H_
@@ -0,0 +1,80 @@
+#include "CompressedBVH.h"
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+using std::vector;
+using namespace glm;
+
+namespace {
+
+// quantizes a child box relative to its parent's box, rounding outwards so the dequantized box always contains it
+void quantize(const AABB &child, const vec3 &bbmin, const vec3 &scale, uint32_t &qmin, uint32_t &qmax) {
+    qmin = qmax = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        int lo = 0, hi = 0;
+        if (scale[axis] > 0) {
+            lo = (int)clamp(std::floor((child.min[axis] - bbmin[axis]) / scale[axis]), 0.0f, 255.0f);
+            hi = (int)clamp(std::ceil((child.max[axis] - bbmin[axis]) / scale[axis]), 0.0f, 255.0f);
+            // the division rounds, so check against the exact decoding
+            while (lo > 0 && bbmin[axis] + (float)lo * scale[axis] > child.min[axis])
+                lo--;
+            while (hi < 255 && bbmin[axis] + (float)hi * scale[axis] < child.max[axis])
+                hi++;
+        }
+        qmin |= (uint32_t)lo << (8 * axis);
+        qmax |= (uint32_t)hi << (8 * axis);
+    }
+}
+
+// encodes the children of an inner node, given the box the traversal will have decoded for the node itself
+void compress_node(const BVH &bvh, vector<CompressedNode> &nodes, uint32_t index, const AABB &bounds) {
+    const BVHNode &node = bvh.nodes[index];
+    CompressedNode &result = nodes[COMPRESSED_HEADER_NODES + index];
+    if (node.is_leaf()) {
+        result = {node.index, node.count, 0, 0};
+        return;
+    }
+
+    uint32_t children[2] = {index + 1, node.index};
+    vec3 scale = compressed_scale(bounds.min, bounds.max);
+    uint32_t words[4];
+    AABB child_bounds[2];
+    for (int child = 0; child < 2; child++) {
+        const BVHNode &child_node = bvh.nodes[children[child]];
+        quantize({child_node.bbmin, child_node.bbmax}, bounds.min, scale, words[2 * child], words[2 * child + 1]);
+        child_bounds[child].min = dequantize(words[2 * child], bounds.min, scale);
+        child_bounds[child].max = dequantize(words[2 * child + 1], bounds.min, scale);
+    }
+
+    uint32_t link = node.index
+        | (bvh.nodes[children[0]].is_leaf() ? COMPRESSED_LINK_LEFT_LEAF : 0)
+        | (bvh.nodes[children[1]].is_leaf() ? COMPRESSED_LINK_RIGHT_LEAF : 0);
+    result.x = words[0] | (link << 24);
+    result.y = words[1] | ((link >> 8) << 24);
+    result.z = words[2] | ((link >> 16) << 24);
+    result.w = words[3] | (link & 0xFF000000u);
+
+    // the children are encoded relative to the boxes the traversal decodes, not their exact ones
+    compress_node(bvh, nodes, children[0], child_bounds[0]);
+    compress_node(bvh, nodes, children[1], child_bounds[1]);
+}
+
+} // namespace
+
+void CompressedBVH::build(const BVH &bvh) {
+    nodes.clear();
+    triangles.resize(bvh.triangles.size());
+    for (size_t i = 0; i < bvh.triangles.size(); i++) {
+        const Triangle &tri = bvh.triangles[i];
+        triangles[i] = {tri.a, tri.b - tri.a, tri.c - tri.a};
+    }
+    if (bvh.nodes.empty())
+        return;
+
+    // the header holds the root's exact box, like the struct at the start of the SSBO
+    const BVHNode &root = bvh.nodes[0];
+    nodes.resize(COMPRESSED_HEADER_NODES + bvh.nodes.size());
+    nodes[0] = {floatBitsToUint(root.bbmin.x), floatBitsToUint(root.bbmin.y), floatBitsToUint(root.bbmin.z), root.is_leaf() ? 1u : 0u};
+    nodes[1] = {floatBitsToUint(root.bbmax.x), floatBitsToUint(root.bbmax.y), floatBitsToUint(root.bbmax.z), (uint32_t)bvh.nodes.size()};
+    compress_node(bvh, nodes, 0, {root.bbmin, root.bbmax});
+}
@@ -0,0 +1,83 @@
+#ifndef _COMPRESSED_BVH_H_
+#define _COMPRESSED_BVH_H_
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "BVH.h"
+using namespace glm;
+
+/**
+ * A triangle prepared for intersection as laid out in the `TriangleRecords` SSBO of tracing.glsl (std430, 9 floats).
+ * The edges are computed once instead of per test, and exactly as intsec_rayTriangle would, so hits are bit identical.
+ */
+struct TriangleRecord {
+    vec3 v0; /** The first vertex, a. */
+    vec3 e1; /** b - a. */
+    vec3 e2; /** c - a. */
+};
+static_assert(sizeof(TriangleRecord) == 36, "TriangleRecord must match the std430 layout in tracing.glsl");
+
+/**
+ * A node of the compressed BVH, a uvec4 in the `CompressedBVHNodes` SSBO of tracing.glsl.
+ * Inner node: the boxes of both children, quantized to 8 bits per axis relative to the node's own (dequantized) box.
+ *   The low 24 bits of x,y hold the left child's min,max corner, those of z,w the right child's, as bytes x,y,z.
+ *   The high bytes of x,y,z,w hold a 32 bit link, see COMPRESSED_LINK_*.
+ * Leaf: x is the index of the first triangle, y the number of triangles.
+ * Whether a node is a leaf is stored in its parent's link (the header for the root), nodes have the indices of the BVH's.
+ */
+struct CompressedNode {
+    uint32_t x, y, z, w;
+};
+static_assert(sizeof(CompressedNode) == 16, "CompressedNode must match the std430 layout in tracing.glsl");
+
+constexpr uint32_t COMPRESSED_LINK_INDEX = 0x3FFFFFFFu;   /** The bits of a link holding the index of the right child. */
+constexpr uint32_t COMPRESSED_LINK_LEFT_LEAF = 1u << 30;  /** Set in a link if the left child is a leaf. */
+constexpr uint32_t COMPRESSED_LINK_RIGHT_LEAF = 1u << 31; /** Set in a link if the right child is a leaf. */
+constexpr uint32_t COMPRESSED_HEADER_NODES = 2;           /** The nodes taken by the header, holding the root's exact box. */
+constexpr float COMPRESSED_STEP = 1.0f / 254.0f;          /** A quantization step relative to the parent box, 255 steps cover it with margin. */
+
+/** @return The quantization step of a box's children, per axis. */
+inline vec3 compressed_scale(const vec3 &bbmin, const vec3 &bbmax) {
+    return (bbmax - bbmin) * COMPRESSED_STEP;
+}
+
+/** @return The corner stored in the low 24 bits of a node word. Must match dequantize in tracing.glsl. */
+inline vec3 dequantize(uint32_t word, const vec3 &bbmin, const vec3 &scale) {
+    return bbmin + vec3((float)(word & 0xFF), (float)((word >> 8) & 0xFF), (float)((word >> 16) & 0xFF)) * scale;
+}
+
+/** @return The link of an inner node. */
+inline uint32_t compressed_link(const CompressedNode &node) {
+    return (node.x >> 24) | ((node.y >> 24) << 8) | ((node.z >> 24) << 16) | (node.w & 0xFF000000u);
+}
+
+/**
+ * A BVH with half size nodes and triangles prepared for intersection, derived from a built BVH.
+ * It halves the memory traversal streams through, at the cost of decoding the child boxes on every visit, so it only
+ * pays off where traversal is bandwidth bound: the CPU packet tracer, which is not, runs slower on it.
+ */
+struct CompressedBVH {
+    std::vector<CompressedNode> nodes;       /** The header, then the nodes. Empty if the BVH is. */
+    std::vector<TriangleRecord> triangles;   /** The BVH's triangles, in the same order. */
+
+    /**
+     * Builds the compressed form of a BVH, replacing any previous contents.
+     * @param bvh The BVH to compress.
+     */
+    void build(const BVH &bvh);
+
+    /** @return The exact box of the root node. */
+    inline AABB root_bounds() const {
+        AABB bounds;
+        bounds.min = vec3(uintBitsToFloat(nodes[0].x), uintBitsToFloat(nodes[0].y), uintBitsToFloat(nodes[0].z));
+        bounds.max = vec3(uintBitsToFloat(nodes[1].x), uintBitsToFloat(nodes[1].y), uintBitsToFloat(nodes[1].z));
+        return bounds;
+    }
+    /** @return True if the root node is a leaf. */
+    inline bool root_is_leaf() const { return nodes[0].w != 0; }
+    /** @return The node with the index of the BVH's node. */
+    inline const CompressedNode &node(uint32_t index) const { return nodes[COMPRESSED_HEADER_NODES + index]; }
+};
+
+#endif//_COMPRESSED_BVH_H_
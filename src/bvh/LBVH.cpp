@@ -0,0 +1,357 @@
+#include "BVH.h"
+#include "../parallel.h"
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+using std::vector;
+using namespace glm;
+
+namespace {
+
+constexpr uint32_t MAX_LEAF_SIZE = 8; // like the SAH builder's
+constexpr float COST_TRAVERSAL = 1.0f;
+constexpr float COST_INTERSECTION = 1.0f;
+constexpr int MORTON_BITS = 10; // per axis, the codes take the upper 30 bits of a key's upper half
+constexpr size_t BLOCK_SIZE = 16384; // primitives or nodes per parallel_for index
+constexpr unsigned TASKS_PER_THREAD = 4; // independent subtrees per thread, so uneven subtrees still balance
+constexpr int TREELET_LEAVES = 7; // the subtrees a treelet is rebuilt from, the work grows with 3^TREELET_LEAVES
+
+// an inner node of the radix tree, child references below the number of inner nodes are inner nodes, the others leaves
+struct RadixNode {
+    uint32_t left, right;
+    AABB bounds;
+    float cost;      // the SAH cost of the subtree, not relative to any area
+    uint32_t prims;  // the primitives below the node
+    uint32_t size;   // the flattened nodes of the subtree
+    uint32_t height; // the inner nodes on the longest path down the flattened subtree, 0 for a leaf
+    bool leaf;       // the subtree is collapsed into a single leaf
+};
+
+struct RadixTree {
+    vector<RadixNode> inner;      // the n - 1 inner nodes, inner[0] is the root
+    vector<uint32_t> order;       // the primitive indices sorted by their Morton codes
+    const vector<AABB> &bounds;   // the primitives' boxes, by primitive index
+
+    inline bool is_inner(uint32_t ref) const { return ref < inner.size(); }
+    inline uint32_t primitive(uint32_t ref) const { return order[ref - inner.size()]; }
+};
+
+// the properties of a child a parent is built from, for inner and primitive children alike
+struct ChildInfo {
+    AABB bounds;
+    float cost;
+    uint32_t prims;
+    uint32_t size;
+    uint32_t height;
+};
+
+ChildInfo child_info(const RadixTree &tree, uint32_t ref) {
+    if (tree.is_inner(ref)) {
+        const RadixNode &node = tree.inner[ref];
+        return {node.bounds, node.cost, node.prims, node.size, node.height};
+    }
+    const AABB &bounds = tree.bounds[tree.primitive(ref)];
+    return {bounds, COST_INTERSECTION * bounds.area(), 1, 1, 0};
+}
+
+// the Morton code of a point given relative to the cube around the centroids, each coordinate in [0,1]
+uint32_t morton_code(const vec3 &p) {
+    const float scale = (float)(1 << MORTON_BITS);
+    uint32_t x = (uint32_t)std::min(std::max(p.x * scale, 0.0f), scale - 1.0f);
+    uint32_t y = (uint32_t)std::min(std::max(p.y * scale, 0.0f), scale - 1.0f);
+    uint32_t z = (uint32_t)std::min(std::max(p.z * scale, 0.0f), scale - 1.0f);
+    return morton_interleave(x, y, z);
+}
+
+// the length of the common prefix of two sorted keys, -1 if j is out of range. Keys are unique, so never 64
+inline int common_prefix(const vector<uint64_t> &keys, int64_t i, int64_t j) {
+    if (j < 0 || j >= (int64_t)keys.size())
+        return -1;
+    return __builtin_clzll(keys[i] ^ keys[j]);
+}
+
+// finds the range of keys inner node i covers and where it splits, see Karras 2012
+void emit_radix_node(RadixTree &tree, const vector<uint64_t> &keys, int64_t i) {
+    int direction = common_prefix(keys, i, i + 1) > common_prefix(keys, i, i - 1) ? 1 : -1;
+    int min_prefix = common_prefix(keys, i, i - direction);
+
+    // the other end of the range: an upper bound by doubling, then a binary search
+    int64_t max_length = 2;
+    while (common_prefix(keys, i, i + max_length * direction) > min_prefix)
+        max_length *= 2;
+    int64_t length = 0;
+    for (int64_t step = max_length / 2; step >= 1; step /= 2) {
+        if (common_prefix(keys, i, i + (length + step) * direction) > min_prefix)
+            length += step;
+    }
+    int64_t j = i + length * direction;
+
+    // the split: the last key sharing more than the range's common prefix with key i
+    int node_prefix = common_prefix(keys, i, j);
+    int64_t split = 0;
+    for (int64_t divisor = 2, step = (length + 1) / 2; ; divisor *= 2, step = (length + divisor - 1) / divisor) {
+        if (common_prefix(keys, i, i + (split + step) * direction) > node_prefix)
+            split += step;
+        if (step <= 1)
+            break;
+    }
+    int64_t gamma = i + split * direction + std::min(direction, 0);
+
+    uint32_t leaves = (uint32_t)tree.inner.size();
+    RadixNode &node = tree.inner[i];
+    node.left = std::min(i, j) == gamma ? leaves + (uint32_t)gamma : (uint32_t)gamma;
+    node.right = std::max(i, j) == gamma + 1 ? leaves + (uint32_t)gamma + 1 : (uint32_t)gamma + 1;
+    node.prims = (uint32_t)(length + 1); // the weight split_tasks balances the first pass by
+    node.leaf = false;
+}
+
+// computes a node's box and cost from its children and decides whether it becomes a leaf
+void finish_node(RadixTree &tree, uint32_t index) {
+    RadixNode &node = tree.inner[index];
+    ChildInfo left = child_info(tree, node.left), right = child_info(tree, node.right);
+    node.bounds = left.bounds;
+    node.bounds.grow(right.bounds);
+    node.prims = left.prims + right.prims;
+    float area = node.bounds.area();
+    float split_cost = COST_TRAVERSAL * area + left.cost + right.cost;
+    float leaf_cost = COST_INTERSECTION * area * node.prims;
+    node.leaf = node.prims <= MAX_LEAF_SIZE && leaf_cost <= split_cost;
+    node.cost = node.leaf ? leaf_cost : split_cost;
+    node.size = node.leaf ? 1 : 1 + left.size + right.size;
+    node.height = node.leaf ? 0 : 1 + std::max(left.height, right.height);
+}
+
+// rebuilds the treelet of up to TREELET_LEAVES subtrees below a finished node in the topology with the lowest SAH cost,
+// found by dynamic programming over all subsets of its leaves (Karras and Aila, "Fast Parallel Construction of
+// High-Quality Bounding Volume Hierarchies"). The treelet's inner nodes are reused, so the node stays where it is
+void optimize_treelet(RadixTree &tree, uint32_t index) {
+    // grow the treelet by opening the leaf with the largest area, the one the most rays enter
+    uint32_t leaves[TREELET_LEAVES] = {tree.inner[index].left, tree.inner[index].right};
+    uint32_t inner[TREELET_LEAVES - 1] = {index};
+    int leaf_count = 2, inner_count = 1;
+    while (leaf_count < TREELET_LEAVES) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < leaf_count; i++) {
+            if (tree.is_inner(leaves[i]) && tree.inner[leaves[i]].bounds.area() > best_area) {
+                best = i;
+                best_area = tree.inner[leaves[i]].bounds.area();
+            }
+        }
+        if (best < 0)
+            break;
+        uint32_t opened = leaves[best];
+        inner[inner_count++] = opened;
+        leaves[best] = tree.inner[opened].left;
+        leaves[leaf_count++] = tree.inner[opened].right;
+    }
+    if (leaf_count < 3)
+        return; // two leaves have a single topology
+
+    // the cheapest subtree over every subset of the leaves, smaller subsets first
+    constexpr int SUBSETS = 1 << TREELET_LEAVES;
+    AABB bounds[SUBSETS];
+    float cost[SUBSETS];
+    uint32_t prims[SUBSETS] = {};
+    uint8_t partition[SUBSETS] = {};
+    uint32_t all = (1u << leaf_count) - 1;
+    for (int i = 0; i < leaf_count; i++) {
+        ChildInfo leaf = child_info(tree, leaves[i]);
+        bounds[1u << i] = leaf.bounds;
+        cost[1u << i] = leaf.cost;
+        prims[1u << i] = leaf.prims;
+    }
+    for (uint32_t set = 1; set <= all; set++) {
+        uint32_t lowest = set & (0u - set);
+        if (set == lowest)
+            continue;
+        bounds[set] = bounds[set ^ lowest];
+        bounds[set].grow(bounds[lowest]);
+        prims[set] = prims[set ^ lowest] + prims[lowest];
+
+        // every split once: the side with the lowest leaf goes left
+        float best_split = 1e30f;
+        for (uint32_t left = (set - 1) & set; left != 0; left = (left - 1) & set) {
+            if ((left & lowest) == 0)
+                continue;
+            float split = cost[left] + cost[set ^ left];
+            if (split < best_split) {
+                best_split = split;
+                partition[set] = (uint8_t)left;
+            }
+        }
+        float area = bounds[set].area();
+        float split_cost = COST_TRAVERSAL * area + best_split;
+        float leaf_cost = COST_INTERSECTION * area * prims[set];
+        cost[set] = prims[set] <= MAX_LEAF_SIZE && leaf_cost <= split_cost ? leaf_cost : split_cost;
+    }
+    if (cost[all] >= tree.inner[index].cost)
+        return;
+
+    // emit the new topology into the treelet's inner nodes, finishing them bottom up
+    int next_inner = 0;
+    auto emit = [&](auto &self, uint32_t set) -> uint32_t {
+        if ((set & (set - 1)) == 0)
+            return leaves[__builtin_ctz(set)];
+        uint32_t node = inner[next_inner++];
+        uint32_t left = self(self, partition[set]);
+        uint32_t right = self(self, set ^ partition[set]);
+        tree.inner[node].left = left;
+        tree.inner[node].right = right;
+        finish_node(tree, node);
+        return node;
+    };
+    emit(emit, all);
+}
+
+// finishes a node whose children are finished, optimizing its treelet if requested and it is large enough to matter
+void finish_and_optimize(RadixTree &tree, uint32_t index, bool optimize) {
+    finish_node(tree, index);
+    if (optimize && tree.inner[index].prims >= TREELET_LEAVES)
+        optimize_treelet(tree, index);
+}
+
+// finishes a subtree bottom up
+void finish_subtree(RadixTree &tree, uint32_t index, bool optimize) {
+    const RadixNode &node = tree.inner[index];
+    if (tree.is_inner(node.left))
+        finish_subtree(tree, node.left, optimize);
+    if (tree.is_inner(node.right))
+        finish_subtree(tree, node.right, optimize);
+    finish_and_optimize(tree, index, optimize);
+}
+
+// splits the tree into independent subtrees by opening the heaviest until there are enough for all threads.
+// opened receives the opened inner nodes, each before its children
+template <typename Weight>
+void split_tasks(const RadixTree &tree, Weight weight, vector<uint32_t> &roots, vector<uint32_t> &opened) {
+    size_t target = JobSystem::get().get_thread_count() * TASKS_PER_THREAD;
+    roots = {0};
+    while (roots.size() < target) {
+        auto heaviest = std::max_element(roots.begin(), roots.end(), [&](uint32_t a, uint32_t b) { return weight(a) < weight(b); });
+        if (weight(*heaviest) == 0)
+            break;
+        uint32_t index = *heaviest;
+        opened.push_back(index);
+        *heaviest = tree.inner[index].left;
+        roots.push_back(tree.inner[index].right);
+    }
+}
+
+// appends the primitives below a node to the output order
+void collect_primitives(const RadixTree &tree, uint32_t ref, vector<uint32_t> &out, uint32_t &position) {
+    if (!tree.is_inner(ref)) {
+        out[position++] = tree.primitive(ref);
+        return;
+    }
+    collect_primitives(tree, tree.inner[ref].left, out, position);
+    collect_primitives(tree, tree.inner[ref].right, out, position);
+}
+
+// a subtree to flatten, with where its nodes and its primitives go
+struct FlattenTask {
+    uint32_t ref;
+    uint32_t node;
+    uint32_t first;
+};
+
+// flattens a subtree depth first, the left child right after its parent. Stops at nodes that are not marked in
+// expand, if given, adding them to tasks instead
+void flatten(const RadixTree &tree, FlattenTask task, vector<BVHNode> &nodes, vector<uint32_t> &out,
+             const vector<uint8_t> *expand, vector<FlattenTask> *tasks) {
+    if (expand && !(tree.is_inner(task.ref) && (*expand)[task.ref])) {
+        tasks->push_back(task);
+        return;
+    }
+    ChildInfo info = child_info(tree, task.ref);
+    if (!tree.is_inner(task.ref) || tree.inner[task.ref].leaf) {
+        nodes[task.node] = {info.bounds.min, task.first, info.bounds.max, info.prims};
+        uint32_t position = task.first;
+        collect_primitives(tree, task.ref, out, position);
+        return;
+    }
+    const RadixNode &node = tree.inner[task.ref];
+    ChildInfo left = child_info(tree, node.left);
+    uint32_t right_node = task.node + 1 + left.size;
+    nodes[task.node] = {info.bounds.min, right_node, info.bounds.max, 0};
+    flatten(tree, {node.left, task.node + 1, task.first}, nodes, out, expand, tasks);
+    flatten(tree, {node.right, right_node, task.first + left.prims}, nodes, out, expand, tasks);
+}
+
+} // namespace
+
+vector<uint32_t> build_linear_hierarchy(const vector<AABB> &bounds, vector<BVHNode> &nodes, bool optimize) {
+    nodes.clear();
+    if (bounds.empty())
+        return {};
+    uint32_t count = (uint32_t)bounds.size();
+    if (count == 1) {
+        nodes.push_back({bounds[0].min, 0, bounds[0].max, 1});
+        return {0};
+    }
+    uint32_t blocks = (uint32_t)((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+    // the box around all centroids, which the Morton codes quantize
+    vector<AABB> block_bounds(blocks);
+    parallel_for(blocks, [&](uint32_t block) {
+        for (size_t i = block * BLOCK_SIZE; i < std::min<size_t>((block + 1) * BLOCK_SIZE, count); i++)
+            block_bounds[block].grow((bounds[i].min + bounds[i].max) * 0.5f);
+    });
+    AABB centroid_bounds;
+    for (const AABB &block : block_bounds)
+        centroid_bounds.grow(block);
+    // a cube, so the codes split thin geometry along its long axes first instead of alternating evenly
+    vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+    float scale = max_extent > 0.0f ? 1.0f / max_extent : 0.0f;
+
+    // the primitive index in the lower half makes the keys unique, equal codes stay in index order since the sort is stable
+    vector<uint64_t> keys(count);
+    parallel_for(blocks, [&](uint32_t block) {
+        for (size_t i = block * BLOCK_SIZE; i < std::min<size_t>((block + 1) * BLOCK_SIZE, count); i++) {
+            vec3 centroid = (bounds[i].min + bounds[i].max) * 0.5f;
+            keys[i] = (uint64_t)morton_code((centroid - centroid_bounds.min) * scale) << 32 | i;
+        }
+    });
+    parallel_radix_sort(keys, 32, 32 + 3 * MORTON_BITS);
+
+    RadixTree tree = {vector<RadixNode>(count - 1), vector<uint32_t>(count), bounds};
+    parallel_for(blocks, [&](uint32_t block) {
+        for (size_t i = block * BLOCK_SIZE; i < std::min<size_t>((block + 1) * BLOCK_SIZE, count); i++)
+            tree.order[i] = (uint32_t)keys[i];
+    });
+    uint32_t inner_blocks = (uint32_t)((count - 1 + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    parallel_for(inner_blocks, [&](uint32_t block) {
+        for (size_t i = block * BLOCK_SIZE; i < std::min<size_t>((block + 1) * BLOCK_SIZE, count - 1); i++)
+            emit_radix_node(tree, keys, (int64_t)i);
+    });
+
+    // bottom up: the subtrees in parallel, then the nodes above them, children before parents
+    vector<uint32_t> roots, opened;
+    split_tasks(tree, [&](uint32_t ref) { return tree.is_inner(ref) ? tree.inner[ref].prims : 0u; }, roots, opened);
+    parallel_for((uint32_t)roots.size(), [&](uint32_t i) {
+        if (tree.is_inner(roots[i]))
+            finish_subtree(tree, roots[i], optimize);
+    });
+    for (auto index = opened.rbegin(); index != opened.rend(); index++)
+        finish_and_optimize(tree, *index, optimize);
+
+    // the radix tree splits at a lower bit on every level, so only treelets rebuilt into chains can grow it deeper than
+    // the tracers' traversal stacks reach. That is rare enough to rebuild such trees with the depth limited SAH builder
+    if (tree.inner[0].height > BVH_MAX_DEPTH)
+        return build_hierarchy(bounds, nodes);
+
+    // top down: optimized treelets changed the topology, so the subtrees are split anew by their flattened size
+    vector<uint32_t> order(count);
+    nodes.resize(tree.inner[0].size);
+    roots.clear();
+    opened.clear();
+    split_tasks(tree, [&](uint32_t ref) { return tree.is_inner(ref) && !tree.inner[ref].leaf ? tree.inner[ref].size : 0u; }, roots, opened);
+    vector<uint8_t> expand(count - 1, 0);
+    for (uint32_t index : opened)
+        expand[index] = 1;
+    vector<FlattenTask> tasks;
+    flatten(tree, {0, 0, 0}, nodes, order, &expand, &tasks);
+    parallel_for((uint32_t)tasks.size(), [&](uint32_t i) { flatten(tree, tasks[i], nodes, order, nullptr, nullptr); });
+    return order;
+}
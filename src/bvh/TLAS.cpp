@@ -0,0 +1,44 @@
+#include "TLAS.h"
+#include <vector>
+#include <glm/glm.hpp>
+using std::vector;
+using namespace glm;
+
+void Instance::set_transform(const mat4x3 &transform) {
+    mat3 linear = mat3(transform);
+    mat3 inverse_linear = inverse(linear);
+    mat4x3 inverse_transform = mat4x3(inverse_linear[0], inverse_linear[1], inverse_linear[2], -(inverse_linear * transform[3]));
+    object_to_world = transpose(transform);
+    world_to_object = transpose(inverse_transform);
+}
+
+mat4x3 Instance::get_transform() const {
+    return transpose(object_to_world);
+}
+
+// the box around a box transformed into world space
+AABB world_bounds(const Instance &instance, const AABB &bounds) {
+    AABB result;
+    for (int corner = 0; corner < 8; corner++) {
+        vec3 p = vec3(corner & 1 ? bounds.max.x : bounds.min.x, corner & 2 ? bounds.max.y : bounds.min.y, corner & 4 ? bounds.max.z : bounds.min.z);
+        result.grow(transform_point(instance.object_to_world, p));
+    }
+    return result;
+}
+
+void TLAS::build(const vector<Instance> &input, const vector<BLAS> &blas) {
+    // instances of empty meshes can't be hit, they are left out
+    vector<const Instance *> placed;
+    vector<AABB> bounds;
+    for (const Instance &instance : input) {
+        if (blas[instance.blas].node_count == 0)
+            continue;
+        placed.push_back(&instance);
+        bounds.push_back(world_bounds(instance, blas[instance.blas].bounds));
+    }
+    vector<uint32_t> order = build_hierarchy(bounds, nodes);
+
+    instances.resize(placed.size());
+    for (size_t i = 0; i < order.size(); i++)
+        instances[i] = *placed[order[i]];
+}
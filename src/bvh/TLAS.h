@@ -0,0 +1,75 @@
+#ifndef _TLAS_H_
+#define _TLAS_H_
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "BVH.h"
+using namespace glm;
+
+/**
+ * A bottom level acceleration structure: one mesh's BVH, stored in the scene's BVH after the ones added before it.
+ * Any number of instances can reference it, its triangles are only stored once.
+ */
+struct BLAS {
+    uint32_t root;           /** The index of the root node in the scene's BVH. */
+    uint32_t node_count;     /** The number of nodes, root to root + node_count. */
+    uint32_t first_triangle; /** The index of the first triangle in the scene's BVH. */
+    uint32_t triangle_count; /** The number of triangles. */
+    AABB bounds;             /** The box of the root node, in object space. */
+};
+
+/**
+ * A placed copy of a BLAS as laid out in the `Instance` SSBO struct of tracing.glsl (std430).
+ * The affine transforms are given as mat4x3 (3x4, the last row being 0 0 0 1 implicitly), but stored transposed as mat3x4,
+ * whose three columns std430 packs without padding. The columns are the rows of the mat4x3, so a point p is transformed
+ * by dot(vec4(p, 1), column) per coordinate, `vec4(p, 1) * m` in GLSL.
+ * Transforms must not mirror, the tracers cull back faces by their winding.
+ */
+struct Instance {
+    mat3x4 world_to_object; /** The transposed inverse of the world transform. */
+    mat3x4 object_to_world; /** The transposed world transform. */
+    uint32_t root;          /** The root node of the instanced BLAS in the scene's BVH. */
+    uint32_t blas;          /** The index of the instanced BLAS. */
+    uint32_t _pad0, _pad1;
+
+    /**
+     * Sets both transforms from the world transform.
+     * @param transform The object to world transform.
+     */
+    void set_transform(const mat4x3 &transform);
+
+    /** @return The object to world transform. */
+    mat4x3 get_transform() const;
+};
+static_assert(sizeof(Instance) == 112, "Instance must match the std430 layout in tracing.glsl");
+
+/** @return A point transformed by a transposed affine transform, see Instance. */
+inline vec3 transform_point(const mat3x4 &m, const vec3 &p) {
+    vec4 h = vec4(p, 1.0f);
+    return vec3(dot(h, m[0]), dot(h, m[1]), dot(h, m[2]));
+}
+
+/** @return A direction transformed by a transposed affine transform, see Instance. */
+inline vec3 transform_vector(const mat3x4 &m, const vec3 &v) {
+    vec4 h = vec4(v, 0.0f);
+    return vec3(dot(h, m[0]), dot(h, m[1]), dot(h, m[2]));
+}
+
+/**
+ * The top level acceleration structure, a BVH over instances.
+ * It only depends on the instances' transforms and their BLAS' boxes, so moving an instance rebuilds it alone.
+ */
+struct TLAS {
+    std::vector<BVHNode> nodes;       /** The flattened nodes, leaves reference ranges of instances. Empty without instances. */
+    std::vector<Instance> instances;  /** The instances, reordered like BVH::triangles. */
+
+    /**
+     * Builds the hierarchy, replacing any previous contents.
+     * @param instances The instances to build the hierarchy over.
+     * @param blas The BLAS the instances reference, for their boxes.
+     */
+    void build(const std::vector<Instance> &instances, const std::vector<BLAS> &blas);
+};
+
+#endif//_TLAS_H_
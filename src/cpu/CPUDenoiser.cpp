@@ -0,0 +1,85 @@
+#include "CPUDenoiser.h"
+#include "../parallel.h"
+#include "../Profiler.h"
+#include <algorithm>
+
+constexpr int MAX_SIMD_WIDTH = 8; // the pixels a kernel may write past the end of a row, see SimdKernels::atrousRow
+
+// the planes, one float per pixel and channel
+enum {
+    PLANE_COLOR = 0,   // the input colors and, at PLANE_COLOR + 3, the output colors, which the passes ping-pong
+    PLANE_ALBEDO = 6,
+    PLANE_NORMAL = 9,
+    PLANE_DEPTH = 12,
+    PLANE_MASK = 13,
+    PLANE_COUNT = 14,
+};
+
+CPUDenoiser::CPUDenoiser(const DenoiseSettings &settings) : settings(settings), kernels(simd_kernels()) {}
+
+void CPUDenoiser::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    // the last pass' taps are 2 * 2^(passes - 1) pixels away, from the pixels a kernel writes past the end of a row too
+    border = (1 << settings.passes) + MAX_SIMD_WIDTH;
+    stride = width + 2 * border;
+    plane_size = (size_t)stride * (height + 2 * border);
+    planes.assign(plane_size * PLANE_COUNT, 0.0f);
+
+    float *mask = plane(PLANE_MASK);
+    for (int y = 0; y < height; y++)
+        std::fill_n(mask + offset(0, y), width, 1.0f);
+}
+
+void CPUDenoiser::denoise(const Framebuffer &noisy, Framebuffer &denoised) {
+    PROFILE_SCOPE("cpu_denoise");
+    if (denoised.width != noisy.width || denoised.height != noisy.height)
+        denoised.resize(noisy.width, noisy.height);
+    denoised.samples = noisy.samples;
+    denoised.view_version = noisy.view_version;
+    if (!noisy.features || settings.passes <= 0) {
+        denoised.pixels = noisy.pixels;
+        return;
+    }
+    if (noisy.width != width || noisy.height != height)
+        resize(noisy.width, noisy.height);
+
+    // split the pixels and features into planes
+    float *colors[2][3] = {{plane(PLANE_COLOR), plane(PLANE_COLOR + 1), plane(PLANE_COLOR + 2)},
+                           {plane(PLANE_COLOR + 3), plane(PLANE_COLOR + 4), plane(PLANE_COLOR + 5)}};
+    float *albedo[3] = {plane(PLANE_ALBEDO), plane(PLANE_ALBEDO + 1), plane(PLANE_ALBEDO + 2)};
+    float *normal[3] = {plane(PLANE_NORMAL), plane(PLANE_NORMAL + 1), plane(PLANE_NORMAL + 2)};
+    float *depth = plane(PLANE_DEPTH);
+    parallel_for(height, [&](uint32_t y) {
+        size_t source = (size_t)y * width, target = offset(0, y);
+        for (int x = 0; x < width; x++, source++, target++) {
+            for (int c = 0; c < 3; c++) {
+                colors[0][c][target] = noisy.pixels[source][c];
+                albedo[c][target] = noisy.albedo[source][c];
+                normal[c][target] = noisy.normals[source][c];
+            }
+            depth[target] = noisy.depth[source];
+        }
+    });
+
+    AtrousPlanes input = {{}, {albedo[0], albedo[1], albedo[2]}, {normal[0], normal[1], normal[2]}, depth, plane(PLANE_MASK), stride};
+    AtrousPass pass;
+    pass.inv_sigma_normal2 = 1.0f / (settings.sigma_normal * settings.sigma_normal);
+    pass.inv_sigma_albedo2 = 1.0f / (settings.sigma_albedo * settings.sigma_albedo);
+    pass.sigma_depth2 = settings.sigma_depth * settings.sigma_depth;
+    for (int i = 0; i < settings.passes; i++) {
+        float sigma_color = settings.sigma_color / (float)(1 << i);
+        pass.step = 1 << i;
+        pass.inv_sigma_color2 = 1.0f / (sigma_color * sigma_color);
+        std::copy_n(colors[i % 2], 3, input.color);
+        float *const *output = colors[(i + 1) % 2];
+        parallel_for(height, [&](uint32_t y) { kernels.atrousRow(input, pass, offset(0, y), width, output); });
+    }
+
+    const float *const *result = colors[settings.passes % 2];
+    parallel_for(height, [&](uint32_t y) {
+        size_t source = offset(0, y), target = (size_t)y * width;
+        for (int x = 0; x < width; x++, source++, target++)
+            denoised.pixels[target] = vec3(result[0][source], result[1][source], result[2][source]);
+    });
+}
@@ -0,0 +1,43 @@
+#ifndef _CPUDENOISER_H_
+#define _CPUDENOISER_H_
+
+#include <cstddef>
+#include <vector>
+#include "../Denoiser.h"
+#include "../Framebuffer.h"
+#include "simd.h"
+
+/**
+ * The CPUDenoiser class filters a Framebuffer the CPUTracer rendered with features, with the same edge-avoiding à-trous
+ * filter as the Denoiser. The rows of every pass are spread over the JobSystem's threads and filtered with the SIMD
+ * kernels, in planes of one channel each whose border is as wide as the farthest tap, so no tap needs a bounds check.
+ */
+class CPUDenoiser {
+private:
+    DenoiseSettings settings;
+    const SimdKernels &kernels;
+    int width = 0, height = 0;
+    int border = 0;          // the pixels around the image in every plane
+    ptrdiff_t stride = 0;    // the floats per row of a plane
+    size_t plane_size = 0;   // the floats per plane
+    std::vector<float> planes; // all planes back to back, kept between calls so they are not allocated again
+
+    /** (Re)creates the planes for a number of pixels, with their borders cleared. */
+    void resize(int width, int height);
+    inline float *plane(int index) { return planes.data() + index * plane_size; }
+    /** @return The offset of a pixel in every plane. */
+    inline size_t offset(int x, int y) const { return (size_t)(y + border) * stride + x + border; }
+public:
+    /** @param settings The parameters of the filter. */
+    explicit CPUDenoiser(const DenoiseSettings &settings);
+
+    /**
+     * Filters the colors of a framebuffer, guided by its features.
+     * A framebuffer without features is copied unfiltered.
+     * @param noisy The framebuffer to filter.
+     * @param denoised The framebuffer to write the filtered image to, resized to the noisy one's size if needed.
+     */
+    void denoise(const Framebuffer &noisy, Framebuffer &denoised);
+};
+
+#endif//_CPUDENOISER_H_
@@ -0,0 +1,987 @@
+#include "CPUTracer.h"
+#include "../parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <glm/glm.hpp>
+using namespace glm;
+
+constexpr int BVH_STACK_SIZE = BVH_MAX_DEPTH; // the builders limit the tree depth accordingly
+constexpr size_t REFIT_CHUNK_SIZE = 16384; // nodes per parallel_for index when refreshing the leaf blocks
+const vec3 LIGHT_DIR = vec3(0.486664f, 0.811107f, -0.324443f);
+constexpr float PI = 3.14159265f;
+constexpr float ALBEDO = 0.8f;         // the fraction of the light every surface reflects, like in wavefront_shade
+constexpr float LIGHT_STRENGTH = 1.0f; // the irradiance of the light at LIGHT_DIR over pi
+constexpr float RAY_OFFSET = 1e-4f;    // how far new rays start off the surface, relative to the magnitude of the position
+constexpr int SORT_MORTON_BITS = 9;    // per axis, below the 3 octant bits the sort keys take the lower 30 bits of their upper half
+constexpr float PACKET_MIN_COS = 0.95f; // the cosine between the directions of a packet's rays, below it they are traced alone
+constexpr size_t CACHE_LINE_SIZE = 64; // the granularity node fetches are counted in by the distinct lines of a batch
+constexpr uint32_t DEAD_RAY = 0xFFFFFFFF; // the pixel of a queue slot that holds no ray
+constexpr int SCATTER_NEXT = 1;        // scatter continued the path
+constexpr int SCATTER_SHADOW = 2;      // scatter queued a shadow ray
+
+// the nodes visited by the traversals on this thread, collected per tile by render
+thread_local uint64_t node_visits = 0;
+
+// the cache lines of the nodes visited on this thread, each node's first line shifted left by 8 bits above the count of
+// its further lines, collected per batch by trace_queue. Null when not collected
+thread_local std::vector<uintptr_t> *node_lines = nullptr;
+
+// counts the nodes a traversal visits, adding them to node_visits when it returns, and records their lines into node_lines
+struct VisitCounter {
+    uint64_t count = 0;
+    std::vector<uintptr_t> *lines = node_lines;
+    ~VisitCounter() { node_visits += count; }
+
+    inline void visit(const void *node, size_t size) {
+        count++;
+        if (lines != nullptr) {
+            uintptr_t first = (uintptr_t)node / CACHE_LINE_SIZE;
+            lines->push_back(first << 8 | (((uintptr_t)node + size - 1) / CACHE_LINE_SIZE - first));
+        }
+    }
+};
+
+// the widest BVH the kernels test in one call, unless RTX_BVH_WIDTH overrides it
+int select_bvh_width(const SimdKernels &kernels) {
+    const char *requested = getenv("RTX_BVH_WIDTH");
+    if (requested != nullptr) {
+        int width = atoi(requested);
+        if (width == 2 || width == 4 || width == 8)
+            return width;
+        fprintf(stderr, "Unknown RTX_BVH_WIDTH value '%s', picking the width for the instruction set\n", requested);
+    }
+    // the scalar kernels stay a port of the binary traversal in tracing.glsl
+    return kernels.width >= 8 ? 8 : kernels.width >= 4 ? 4 : 2;
+}
+
+CPUTracer::CPUTracer(const Scene *scene) : scene(scene), kernels(&simd_kernels()), bvh_width(select_bvh_width(*kernels)) { update(); }
+
+void CPUTracer::update() {
+    const std::vector<BVHNode> &nodes = scene->bvh.nodes;
+    const std::vector<Triangle> &triangles = scene->bvh.triangles;
+
+    // both layouts share the node indices, so the leaf blocks serve both
+
+    leaf_blocks.clear();
+    node_blocks.assign(nodes.size(), 0);
+    for (size_t n = 0; n < nodes.size(); n++) {
+        if (!nodes[n].is_leaf())
+            continue;
+        node_blocks[n] = (uint32_t)leaf_blocks.size();
+        for (uint32_t i = 0; i < nodes[n].count; i++) {
+            if (i % 4 == 0)
+                leaf_blocks.push_back({}); // zero initialized lanes are degenerate triangles that never hit
+            const Triangle &tri = triangles[nodes[n].index + i];
+            leaf_blocks.back().set(i % 4, tri.a, tri.b, tri.c);
+        }
+    }
+
+    // in an instanced scene every BLAS is collapsed on its own, the TLAS is traversed as it is
+    wide4.nodes.clear();
+    wide8.nodes.clear();
+    wide_roots.clear();
+    if (bvh_width == 2 || scene->bvh.nodes.empty())
+        return;
+    auto collapse = [&](uint32_t root) { return bvh_width == 4 ? wide4.add(scene->bvh, root) : wide8.add(scene->bvh, root); };
+    if (!scene->is_instanced()) {
+        wide_roots.push_back(collapse(0));
+        return;
+    }
+    // instances of empty meshes are not in the TLAS, their root is never used
+    for (const BLAS &blas : scene->blas)
+        wide_roots.push_back(blas.node_count > 0 ? collapse(blas.root) : 0);
+}
+
+void CPUTracer::refit() {
+    const std::vector<BVHNode> &nodes = scene->bvh.nodes;
+    const std::vector<Triangle> &triangles = scene->bvh.triangles;
+
+    // the leaves keep their blocks, only the vertices are written again
+    uint32_t chunks = (uint32_t)((nodes.size() + REFIT_CHUNK_SIZE - 1) / REFIT_CHUNK_SIZE);
+    parallel_for(chunks, [&](uint32_t chunk) {
+        size_t end = std::min((chunk + 1) * REFIT_CHUNK_SIZE, nodes.size());
+        for (size_t n = chunk * REFIT_CHUNK_SIZE; n < end; n++) {
+            if (!nodes[n].is_leaf())
+                continue;
+            for (uint32_t i = 0; i < nodes[n].count; i++) {
+                const Triangle &tri = triangles[nodes[n].index + i];
+                leaf_blocks[node_blocks[n] + i / 4].set(i % 4, tri.a, tri.b, tri.c);
+            }
+        }
+    });
+
+    if (bvh_width == 4)
+        wide4.refit(scene->bvh);
+    else if (bvh_width == 8)
+        wide8.refit(scene->bvh);
+}
+
+Hit CPUTracer::intsec_rayBVH(const Ray &ray) const {
+    if (scene->layout == BVH_LAYOUT_COMPRESSED)
+        return intsec_rayCompressedBVH(ray);
+
+    Hit hit = {1e30f, -1, -1};
+    if (scene->is_instanced()) {
+        if (!scene->tlas.nodes.empty())
+            intsec_rayTLAS(ray, hit);
+    }
+    else if (!scene->bvh.nodes.empty())
+        intsec_rayBLAS(ray, 0, -1, hit);
+    return hit;
+}
+
+void CPUTracer::intsec_rayBLAS(const Ray &ray, uint32_t blas, int instance, Hit &hit) const {
+    if (bvh_width == 8)
+        return intsec_rayWideBLAS<8>(ray, wide8, wide_roots[blas], instance, hit);
+    if (bvh_width == 4)
+        return intsec_rayWideBLAS<4>(ray, wide4, wide_roots[blas], instance, hit);
+    const std::vector<BVHNode> &nodes = scene->bvh.nodes;
+    uint32_t root = scene->blas.empty() ? 0 : scene->blas[blas].root;
+    if (intsec_rayAABB(ray, nodes[root].bbmin, nodes[root].bbmax) < 0)
+        return;
+
+    // the left child directly follows its parent, only far children are pushed
+    uint32_t stack[BVH_STACK_SIZE];
+    float stack_dst[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    uint32_t node_idx = root;
+    VisitCounter visits;
+    while (true) {
+        const BVHNode &node = nodes[node_idx];
+        visits.visit(&node, sizeof(node));
+        if (node.is_leaf()) {
+            // one ray against 4 triangles at a time
+            float t[4];
+            const TriangleSoA<4> *block = &leaf_blocks[node_blocks[node_idx]];
+            for (uint32_t i = 0; i < node.count; i += 4, block++) {
+                kernels->rayTriangle4(ray, *block, t);
+                for (uint32_t lane = 0; lane < 4 && i + lane < node.count; lane++) {
+                    if (t[lane] >= 0 && t[lane] < hit.dst) {
+                        hit.dst = t[lane];
+                        hit.triangle = (int)(node.index + i + lane);
+                        hit.instance = instance;
+                    }
+                }
+            }
+        } else {
+            uint32_t left = node_idx + 1;
+            uint32_t right = node.index;
+            float tl = intsec_rayAABB(ray, nodes[left].bbmin, nodes[left].bbmax);
+            float tr = intsec_rayAABB(ray, nodes[right].bbmin, nodes[right].bbmax);
+            bool hit_left = tl >= 0 && tl < hit.dst;
+            bool hit_right = tr >= 0 && tr < hit.dst;
+
+            if (hit_left && hit_right) {
+                bool left_first = tl <= tr;
+                stack[stack_ptr] = left_first ? right : left;
+                stack_dst[stack_ptr] = left_first ? tr : tl;
+                stack_ptr++;
+                node_idx = left_first ? left : right;
+                continue;
+            }
+            if (hit_left)  { node_idx = left;  continue; }
+            if (hit_right) { node_idx = right; continue; }
+        }
+
+        // pop the next node that may still be closer than the closest hit
+        do {
+            if (stack_ptr == 0)
+                return;
+            stack_ptr--;
+        } while (stack_dst[stack_ptr] >= hit.dst);
+        node_idx = stack[stack_ptr];
+    }
+}
+
+// a child of a wide node to visit, count is 0 for inner nodes
+struct WideEntry {
+    uint32_t index;
+    uint32_t count;
+    float dst;
+};
+
+template <int W>
+void CPUTracer::intsec_rayWideBLAS(const Ray &ray, const WideBVH<W> &bvh, uint32_t root, int instance, Hit &hit) const {
+    const std::vector<BVHNode> &nodes = scene->bvh.nodes;
+
+    // a node pushes at most W - 1 children per level, the wide tree is no deeper than the binary one
+    WideEntry stack[BVH_STACK_SIZE * (W - 1)];
+    int stack_ptr = 0;
+    WideEntry current = {root, 0, 0};
+    VisitCounter visits;
+    while (true) {
+        if (current.count > 0) {
+            // a leaf child is the binary BVH's leaf, which holds where its triangles start
+            visits.visit(&nodes[current.index], sizeof(BVHNode));
+            float t[4];
+            uint32_t first = nodes[current.index].index;
+            const TriangleSoA<4> *block = &leaf_blocks[node_blocks[current.index]];
+            for (uint32_t i = 0; i < current.count; i += 4, block++) {
+                kernels->rayTriangle4(ray, *block, t);
+                for (uint32_t lane = 0; lane < 4 && i + lane < current.count; lane++) {
+                    if (t[lane] >= 0 && t[lane] < hit.dst) {
+                        hit.dst = t[lane];
+                        hit.triangle = (int)(first + i + lane);
+                        hit.instance = instance;
+                    }
+                }
+            }
+        } else {
+            // all children in one call, the ones hit are sorted by distance, the farthest first
+            const WideNode<W> &node = bvh.nodes[current.index];
+            visits.visit(&node, sizeof(node));
+            float t[W];
+            kernels->rayAABB<W>(ray, node.bounds, t);
+            WideEntry hit_children[W];
+            int hit_count = 0;
+            for (uint32_t c = 0; c < node.child_count; c++) {
+                if (t[c] < 0 || t[c] >= hit.dst)
+                    continue;
+                int i = hit_count++;
+                for (; i > 0 && hit_children[i - 1].dst < t[c]; i--)
+                    hit_children[i] = hit_children[i - 1];
+                hit_children[i] = {node.child[c], node.count[c], t[c]};
+            }
+
+            if (hit_count > 0) {
+                for (int i = 0; i < hit_count - 1; i++)
+                    stack[stack_ptr++] = hit_children[i];
+                current = hit_children[hit_count - 1];
+                continue;
+            }
+        }
+
+        // pop the next node that may still be closer than the closest hit
+        do {
+            if (stack_ptr == 0)
+                return;
+            stack_ptr--;
+        } while (stack[stack_ptr].dst >= hit.dst);
+        current = stack[stack_ptr];
+    }
+}
+
+void CPUTracer::intsec_rayTLAS(const Ray &ray, Hit &hit) const {
+    const std::vector<BVHNode> &nodes = scene->tlas.nodes;
+    const std::vector<Instance> &instances = scene->tlas.instances;
+    if (intsec_rayAABB(ray, nodes[0].bbmin, nodes[0].bbmax) < 0)
+        return;
+
+    uint32_t stack[BVH_STACK_SIZE];
+    float stack_dst[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    uint32_t node_idx = 0;
+    VisitCounter visits;
+    while (true) {
+        const BVHNode &node = nodes[node_idx];
+        visits.visit(&node, sizeof(node));
+        if (node.is_leaf()) {
+            // the direction is not normalized, so distances in object space are the same as in world space
+            for (uint32_t i = node.index; i < node.index + node.count; i++) {
+                Ray local;
+                    local.origin = transform_point(instances[i].world_to_object, ray.origin);
+                    local.dir = transform_vector(instances[i].world_to_object, ray.dir);
+                    local.invDir = 1.0f / local.dir;
+                intsec_rayBLAS(local, instances[i].blas, (int)i, hit);
+            }
+        } else {
+            uint32_t left = node_idx + 1;
+            uint32_t right = node.index;
+            float tl = intsec_rayAABB(ray, nodes[left].bbmin, nodes[left].bbmax);
+            float tr = intsec_rayAABB(ray, nodes[right].bbmin, nodes[right].bbmax);
+            bool hit_left = tl >= 0 && tl < hit.dst;
+            bool hit_right = tr >= 0 && tr < hit.dst;
+
+            if (hit_left && hit_right) {
+                bool left_first = tl <= tr;
+                stack[stack_ptr] = left_first ? right : left;
+                stack_dst[stack_ptr] = left_first ? tr : tl;
+                stack_ptr++;
+                node_idx = left_first ? left : right;
+                continue;
+            }
+            if (hit_left)  { node_idx = left;  continue; }
+            if (hit_right) { node_idx = right; continue; }
+        }
+
+        do {
+            if (stack_ptr == 0)
+                return;
+            stack_ptr--;
+        } while (stack_dst[stack_ptr] >= hit.dst);
+        node_idx = stack[stack_ptr];
+    }
+}
+
+// the children of a compressed inner node, decoded relative to the node's box
+struct CompressedChildren {
+    vec3 bbmin[2], bbmax[2];
+    uint32_t index[2];
+    bool leaf[2];
+
+    inline CompressedChildren(const CompressedNode &node, uint32_t node_idx, const vec3 &bbmin, const vec3 &bbmax) {
+        // the same operations as dequantize(), unrolled per axis
+        for (int axis = 0; axis < 3; axis++) {
+            float scale = (bbmax[axis] - bbmin[axis]) * COMPRESSED_STEP;
+            int shift = 8 * axis;
+            this->bbmin[0][axis] = bbmin[axis] + (float)((node.x >> shift) & 0xFF) * scale;
+            this->bbmax[0][axis] = bbmin[axis] + (float)((node.y >> shift) & 0xFF) * scale;
+            this->bbmin[1][axis] = bbmin[axis] + (float)((node.z >> shift) & 0xFF) * scale;
+            this->bbmax[1][axis] = bbmin[axis] + (float)((node.w >> shift) & 0xFF) * scale;
+        }
+        uint32_t link = compressed_link(node);
+        index[0] = node_idx + 1;
+        index[1] = link & COMPRESSED_LINK_INDEX;
+        leaf[0] = (link & COMPRESSED_LINK_LEFT_LEAF) != 0;
+        leaf[1] = (link & COMPRESSED_LINK_RIGHT_LEAF) != 0;
+    }
+};
+
+// a node to visit in the compressed layout, with the box its children are decoded relative to
+struct CompressedEntry {
+    uint32_t index;
+    bool leaf;
+    vec3 bbmin, bbmax;
+    float dst;
+};
+
+Hit CPUTracer::intsec_rayCompressedBVH(const Ray &ray) const {
+    const CompressedBVH &bvh = scene->compressed;
+
+    Hit hit = {1e30f, -1};
+    if (bvh.nodes.empty())
+        return hit;
+    AABB root = bvh.root_bounds();
+    if (intsec_rayAABB(ray, root.min, root.max) < 0)
+        return hit;
+
+    CompressedEntry stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    CompressedEntry current = {0, bvh.root_is_leaf(), root.min, root.max, 0};
+    VisitCounter visits;
+    while (true) {
+        const CompressedNode &node = bvh.node(current.index);
+        visits.visit(&node, sizeof(node));
+        if (current.leaf) {
+            float t[4];
+            const TriangleSoA<4> *block = &leaf_blocks[node_blocks[current.index]];
+            for (uint32_t i = 0; i < node.y; i += 4, block++) {
+                kernels->rayTriangle4(ray, *block, t);
+                for (uint32_t lane = 0; lane < 4 && i + lane < node.y; lane++) {
+                    if (t[lane] >= 0 && t[lane] < hit.dst) {
+                        hit.dst = t[lane];
+                        hit.triangle = (int)(node.x + i + lane);
+                    }
+                }
+            }
+        } else {
+            CompressedChildren children(node, current.index, current.bbmin, current.bbmax);
+            float tl = intsec_rayAABB(ray, children.bbmin[0], children.bbmax[0]);
+            float tr = intsec_rayAABB(ray, children.bbmin[1], children.bbmax[1]);
+            bool hit_left = tl >= 0 && tl < hit.dst;
+            bool hit_right = tr >= 0 && tr < hit.dst;
+
+            if (hit_left || hit_right) {
+                int near = hit_left && (!hit_right || tl <= tr) ? 0 : 1;
+                if (hit_left && hit_right) {
+                    int far = 1 - near;
+                    stack[stack_ptr++] = {children.index[far], children.leaf[far], children.bbmin[far], children.bbmax[far], far ? tr : tl};
+                }
+                current = {children.index[near], children.leaf[near], children.bbmin[near], children.bbmax[near], 0};
+                continue;
+            }
+        }
+
+        // pop the next node that may still be closer than the closest hit
+        do {
+            if (stack_ptr == 0)
+                return hit;
+            stack_ptr--;
+        } while (stack[stack_ptr].dst >= hit.dst);
+        current = stack[stack_ptr];
+    }
+}
+
+template <int N>
+void CPUTracer::intsec_packetCompressedBVH(const RayPacket<N> &rays, Hit *hits) const {
+    const CompressedBVH &bvh = scene->compressed;
+
+    for (int lane = 0; lane < N; lane++)
+        hits[lane] = {1e30f, -1};
+    if (bvh.nodes.empty())
+        return;
+
+    float t[N], tr[N];
+    auto any_hit = [&](const float *t) {
+        for (int lane = 0; lane < N; lane++)
+            if (t[lane] >= 0 && t[lane] < hits[lane].dst)
+                return true;
+        return false;
+    };
+    AABB root = bvh.root_bounds();
+    kernels->packetAABB<N>(rays, root.min, root.max, t);
+    if (!any_hit(t))
+        return;
+
+    CompressedEntry stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    CompressedEntry current = {0, bvh.root_is_leaf(), root.min, root.max, 0};
+    VisitCounter visits;
+    while (true) {
+        const CompressedNode &node = bvh.node(current.index);
+        visits.visit(&node, sizeof(node));
+        if (current.leaf) {
+            for (uint32_t i = node.x; i < node.x + node.y; i++) {
+                const TriangleRecord &tri = bvh.triangles[i];
+                kernels->packetTriangle<N>(rays, tri.v0, tri.e1, tri.e2, t);
+                for (int lane = 0; lane < N; lane++) {
+                    if (t[lane] >= 0 && t[lane] < hits[lane].dst) {
+                        hits[lane].dst = t[lane];
+                        hits[lane].triangle = (int)i;
+                    }
+                }
+            }
+        } else {
+            CompressedChildren children(node, current.index, current.bbmin, current.bbmax);
+            kernels->packetAABB<N>(rays, children.bbmin[0], children.bbmax[0], t);
+            kernels->packetAABB<N>(rays, children.bbmin[1], children.bbmax[1], tr);
+            bool hit_left = any_hit(t);
+            bool hit_right = any_hit(tr);
+
+            if (hit_left || hit_right) {
+                int near = hit_left ? 0 : 1;
+                if (hit_left && hit_right) {
+                    // visit the child first that most rays of the packet reach first
+                    int votes = 0;
+                    for (int lane = 0; lane < N; lane++)
+                        votes += t[lane] <= tr[lane] ? 1 : -1;
+                    near = votes >= 0 ? 0 : 1;
+                    int far = 1 - near;
+                    stack[stack_ptr++] = {children.index[far], children.leaf[far], children.bbmin[far], children.bbmax[far], 0};
+                }
+                current = {children.index[near], children.leaf[near], children.bbmin[near], children.bbmax[near], 0};
+                continue;
+            }
+        }
+
+        if (stack_ptr == 0)
+            return;
+        current = stack[--stack_ptr];
+    }
+}
+
+template <int N>
+void CPUTracer::intsec_packetBVH(const RayPacket<N> &rays, Hit *hits) const {
+    if (scene->layout == BVH_LAYOUT_COMPRESSED)
+        return intsec_packetCompressedBVH<N>(rays, hits);
+    if (scene->is_instanced()) {
+        for (int lane = 0; lane < N; lane++)
+            hits[lane] = intsec_rayBVH(rays.get(lane));
+        return;
+    }
+    const std::vector<BVHNode> &nodes = scene->bvh.nodes;
+    const std::vector<Triangle> &triangles = scene->bvh.triangles;
+
+    for (int lane = 0; lane < N; lane++)
+        hits[lane] = {1e30f, -1};
+    if (nodes.empty())
+        return;
+
+    // a node is entered as soon as one ray of the packet hits it closer than its closest hit so far
+    float t[N], tr[N];
+    auto any_hit = [&](const float *t) {
+        for (int lane = 0; lane < N; lane++)
+            if (t[lane] >= 0 && t[lane] < hits[lane].dst)
+                return true;
+        return false;
+    };
+    kernels->packetAABB<N>(rays, nodes[0].bbmin, nodes[0].bbmax, t);
+    if (!any_hit(t))
+        return;
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    uint32_t node_idx = 0;
+    VisitCounter visits;
+    while (true) {
+        const BVHNode &node = nodes[node_idx];
+        visits.visit(&node, sizeof(node));
+        if (node.is_leaf()) {
+            for (uint32_t i = node.index; i < node.index + node.count; i++) {
+                const Triangle &tri = triangles[i];
+                kernels->packetTriangle<N>(rays, tri.a, tri.b - tri.a, tri.c - tri.a, t);
+                for (int lane = 0; lane < N; lane++) {
+                    if (t[lane] >= 0 && t[lane] < hits[lane].dst) {
+                        hits[lane].dst = t[lane];
+                        hits[lane].triangle = (int)i;
+                    }
+                }
+            }
+        } else {
+            uint32_t left = node_idx + 1;
+            uint32_t right = node.index;
+            kernels->packetAABB<N>(rays, nodes[left].bbmin, nodes[left].bbmax, t);
+            kernels->packetAABB<N>(rays, nodes[right].bbmin, nodes[right].bbmax, tr);
+            bool hit_left = any_hit(t);
+            bool hit_right = any_hit(tr);
+
+            if (hit_left && hit_right) {
+                // visit the child first that most rays of the packet reach first
+                int votes = 0;
+                for (int lane = 0; lane < N; lane++)
+                    votes += t[lane] <= tr[lane] ? 1 : -1;
+                bool left_first = votes >= 0;
+                stack[stack_ptr++] = left_first ? right : left;
+                node_idx = left_first ? left : right;
+                continue;
+            }
+            if (hit_left)  { node_idx = left;  continue; }
+            if (hit_right) { node_idx = right; continue; }
+        }
+
+        if (stack_ptr == 0)
+            return;
+        node_idx = stack[--stack_ptr];
+    }
+}
+
+template void CPUTracer::intsec_packetBVH<4>(const RayPacket<4> &rays, Hit *hits) const;
+template void CPUTracer::intsec_packetBVH<8>(const RayPacket<8> &rays, Hit *hits) const;
+
+CPUTracer::TraversalStats CPUTracer::get_stats() const {
+    return {ray_count.load(), visit_count.load(), secondary_ray_count.load(), secondary_visit_count.load(), packet_ray_count.load(), batch_count.load(), batch_line_count.load()};
+}
+
+void CPUTracer::reset_stats() {
+    ray_count = 0;
+    visit_count = 0;
+    secondary_ray_count = 0;
+    secondary_visit_count = 0;
+    packet_ray_count = 0;
+    batch_count = 0;
+    batch_line_count = 0;
+}
+
+vec3 CPUTracer::get_hitNormal(const Hit &hit) const {
+    const Triangle &tri = scene->bvh.triangles[hit.triangle];
+    vec3 normal = cross(tri.b - tri.a, tri.c - tri.a);
+    // normals transform with the inverse transpose, whose columns are the rows of world_to_object's linear part
+    if (hit.instance >= 0) {
+        const mat3x4 &world_to_object = scene->tlas.instances[hit.instance].world_to_object;
+        normal = vec3(world_to_object[0]) * normal.x + vec3(world_to_object[1]) * normal.y + vec3(world_to_object[2]) * normal.z;
+    }
+    return normalize(normal);
+}
+
+Features CPUTracer::get_features(const Ray &ray, const Hit &hit) const {
+    if (hit.triangle < 0)
+        return {};
+    vec3 normal = get_hitNormal(hit);
+    // the preview shading is white, path tracing reflects ALBEDO
+    return {vec3(bounces == 0 ? 1.0f : ALBEDO), dot(normal, ray.dir) > 0 ? -normal : normal, hit.dst};
+}
+
+vec3 CPUTracer::shade(const Ray &ray, const Hit &hit) const {
+    if (hit.triangle >= 0) {
+        float light = dot(get_hitNormal(hit), LIGHT_DIR) * 0.5f + 0.5f;
+        return vec3(1.0f, 1.0f, 1.0f) * light;
+    }
+
+    return ray.dir;
+}
+
+// the ray through uv, (0,0) being the bottom left corner like on the fullscreen quad
+Ray generate_ray(const mat4 &cam2world, const vec2 &near_clip_data, const vec2 &uv) {
+    vec4 world_pos = cam2world * vec4(near_clip_data * (uv - 0.5f), 1.0f, 1.0f);
+
+    Ray ray;
+        ray.origin = vec3(cam2world[3]);
+        ray.dir = normalize(vec3(world_pos) / world_pos.w - ray.origin);
+        ray.invDir = 1.0f / ray.dir;
+    return ray;
+}
+
+vec3 CPUTracer::trace(const mat4 &cam2world, const vec2 &near_clip_data, const vec2 &uv) const {
+    Ray ray = generate_ray(cam2world, near_clip_data, uv);
+    return shade(ray, intsec_rayBVH(ray));
+}
+
+// the uv of a sample in pixel (x,y) of a framebuffer stored top to bottom
+inline vec2 pixel_uv(const Framebuffer &framebuffer, int x, int y, const vec2 &jitter) {
+    return vec2((x + jitter.x) / framebuffer.width, (framebuffer.height - 1 - y + jitter.y) / framebuffer.height);
+}
+
+// blends the features of a new sample into a pixel's, with the weight its color was blended with
+inline void blend_features(Framebuffer &framebuffer, int x, int y, const Features &features, float weight) {
+    size_t i = (size_t)y * framebuffer.width + x;
+    framebuffer.albedo[i] = mix(framebuffer.albedo[i], features.albedo, weight);
+    framebuffer.normals[i] = mix(framebuffer.normals[i], features.normal, weight);
+    framebuffer.depth[i] = mix(framebuffer.depth[i], features.depth, weight);
+}
+
+// renders the pixels [x0,x1)x[y0,y1) in packets of PW x PH pixels, lanes outside the framebuffer are traced but discarded
+// the new sample is blended into the pixels with the given weight
+template <int PW, int PH>
+void render_packets(const CPUTracer &tracer, const mat4 &cam2world, const vec2 &near_clip_data, const vec2 &jitter, float weight,
+                    Framebuffer &framebuffer, int x0, int y0, int x1, int y1) {
+    constexpr int N = PW * PH;
+    RayPacket<N> rays;
+    Ray lane_rays[N];
+    Hit hits[N];
+    for (int y = y0; y < y1; y += PH)
+    for (int x = x0; x < x1; x += PW) {
+        for (int lane = 0; lane < N; lane++) {
+            lane_rays[lane] = generate_ray(cam2world, near_clip_data, pixel_uv(framebuffer, x + lane % PW, y + lane / PW, jitter));
+            rays.set(lane, lane_rays[lane]);
+        }
+        tracer.intsec_packetBVH<N>(rays, hits);
+        for (int lane = 0; lane < N; lane++) {
+            int px = x + lane % PW, py = y + lane / PW;
+            if (px >= x1 || py >= y1)
+                continue;
+            framebuffer.at(px, py) = mix(framebuffer.at(px, py), tracer.shade(lane_rays[lane], hits[lane]), weight);
+            if (framebuffer.features)
+                blend_features(framebuffer, px, py, tracer.get_features(lane_rays[lane], hits[lane]), weight);
+        }
+    }
+}
+
+void CPUTracer::render(const Camera &camera, Framebuffer &framebuffer) const {
+    mat4 cam2world = camera.get_cam2world();
+    vec2 near_clip_data = camera.get_near_clip_data(framebuffer.get_aspect_ratio());
+
+    // add one jittered sample per pixel to the average, starting over if the view changed
+    if (framebuffer.view_version != camera.get_version()) {
+        framebuffer.view_version = camera.get_version();
+        framebuffer.samples = 0;
+    }
+    if (bounces > 0) {
+        if (ray_order == RAY_ORDER_DEPTH_FIRST)
+            render_depth_first(cam2world, near_clip_data, framebuffer.samples, framebuffer);
+        else
+            render_breadth_first(cam2world, near_clip_data, framebuffer.samples, framebuffer);
+        framebuffer.samples++;
+        return;
+    }
+    vec2 jitter = sample_jitter(framebuffer.samples);
+    float weight = 1.0f / (float)(framebuffer.samples + 1);
+
+    // tiles are handed out dynamically, so cheap (empty) tiles don't leave cores idle
+    int tiles_x = (framebuffer.width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (framebuffer.height + TILE_SIZE - 1) / TILE_SIZE;
+    parallel_for(tiles_x * tiles_y, [&](uint32_t tile) {
+        int x0 = (tile % tiles_x) * TILE_SIZE;
+        int y0 = (tile / tiles_x) * TILE_SIZE;
+        int x1 = std::min(x0 + TILE_SIZE, framebuffer.width);
+        int y1 = std::min(y0 + TILE_SIZE, framebuffer.height);
+        uint64_t visits_before = node_visits;
+
+        // primary rays are coherent, so the binary BVH traces them as packets of the kernels' native width,
+        // a wide BVH fills the vector lanes with the children of a node instead
+        bool packets = traces_packets();
+        if (packets && kernels->width >= 8) {
+            render_packets<4, 2>(*this, cam2world, near_clip_data, jitter, weight, framebuffer, x0, y0, x1, y1);
+        } else if (packets && kernels->width >= 4) {
+            render_packets<2, 2>(*this, cam2world, near_clip_data, jitter, weight, framebuffer, x0, y0, x1, y1);
+        } else {
+            for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++) {
+                Ray ray = generate_ray(cam2world, near_clip_data, pixel_uv(framebuffer, x, y, jitter));
+                Hit hit = intsec_rayBVH(ray);
+                framebuffer.at(x, y) = mix(framebuffer.at(x, y), shade(ray, hit), weight);
+                if (framebuffer.features)
+                    blend_features(framebuffer, x, y, get_features(ray, hit), weight);
+            }
+        }
+        ray_count.fetch_add((uint64_t)(x1 - x0) * (y1 - y0), std::memory_order_relaxed);
+        visit_count.fetch_add(node_visits - visits_before, std::memory_order_relaxed);
+    });
+    framebuffer.samples++;
+}
+
+// the PCG hash, a well distributed permutation of 32 bits. Port of pcg_hash
+inline uint32_t pcg_hash(uint32_t value) {
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// two random numbers in [0,1), different for every pixel, sample and bounce. Port of random2
+inline vec2 random2(uint32_t pixel, uint32_t sample_index, uint32_t depth) {
+    uint32_t first = pcg_hash(pixel ^ pcg_hash(sample_index ^ pcg_hash(depth)));
+    return vec2((float)first, (float)pcg_hash(first)) * (1.0f / 4294967296.0f);
+}
+
+// a direction in the hemisphere around a normal, with a density proportional to its cosine to the normal. Port of sample_cosine
+vec3 sample_cosine(const vec3 &normal, const vec2 &u) {
+    vec3 tangent = normalize(cross(std::abs(normal.x) > 0.5f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f), normal));
+    vec3 bitangent = cross(normal, tangent);
+    float phi = 2.0f * PI * u.x;
+    float r = std::sqrt(u.y);
+    return normalize(tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + normal * std::sqrt(1.0f - u.y));
+}
+
+// the octant of a direction, one bit per negative component
+inline uint32_t octant(const vec3 &dir) {
+    return (dir.x < 0 ? 1u : 0u) | (dir.y < 0 ? 2u : 0u) | (dir.z < 0 ? 4u : 0u);
+}
+
+// calls fn(begin, end) for the batches of BATCH_SIZE rays of a queue with count rays, spread over all cores
+template <typename F>
+void for_each_batch(size_t count, F fn) {
+    uint32_t batches = (uint32_t)((count + CPUTracer::BATCH_SIZE - 1) / CPUTracer::BATCH_SIZE);
+    parallel_for(batches, [&](uint32_t batch) {
+        size_t begin = (size_t)batch * CPUTracer::BATCH_SIZE;
+        fn(begin, std::min(count, begin + CPUTracer::BATCH_SIZE));
+    });
+}
+
+int CPUTracer::scatter(const PathRay &path, const Hit &hit, uint32_t sample_index, vec3 &light, PathRay &next, PathRay &shadow) const {
+    const Ray &ray = path.ray;
+    if (hit.triangle < 0) {
+        // the background shows the direction, only its positive part lights the scene
+        light += path.throughput * (path.depth == 0 ? ray.dir : max(ray.dir, vec3(0.0f)));
+        return 0;
+    }
+
+    vec3 normal = get_hitNormal(hit);
+    if (dot(normal, ray.dir) > 0)
+        normal = -normal;
+    vec3 position = ray.origin + ray.dir * hit.dst;
+    position += normal * RAY_OFFSET * (1.0f + std::max(std::max(std::abs(position.x), std::abs(position.y)), std::abs(position.z)));
+    vec3 throughput = path.throughput * ALBEDO;
+    int emitted = 0;
+
+    // the light reflected straight to the camera, if nothing is in the way
+    float cos_light = dot(normal, LIGHT_DIR);
+    if (cos_light > 0) {
+        shadow = {{position, LIGHT_DIR, 1.0f / LIGHT_DIR}, throughput * cos_light * LIGHT_STRENGTH, path.pixel, path.depth};
+        emitted |= SCATTER_SHADOW;
+    }
+
+    // the cosine of the sampled direction cancels with its density, leaving the albedo
+    if (path.depth < bounces) {
+        vec3 dir = sample_cosine(normal, random2(path.pixel, sample_index, path.depth));
+        next = {{position, dir, 1.0f / dir}, throughput, path.pixel, path.depth + 1};
+        emitted |= SCATTER_NEXT;
+    }
+    return emitted;
+}
+
+void CPUTracer::render_depth_first(const mat4 &cam2world, const vec2 &near_clip_data, uint32_t sample_index, Framebuffer &framebuffer) const {
+    vec2 jitter = sample_jitter(sample_index);
+    float weight = 1.0f / (float)(sample_index + 1);
+
+    int tiles_x = (framebuffer.width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (framebuffer.height + TILE_SIZE - 1) / TILE_SIZE;
+    parallel_for(tiles_x * tiles_y, [&](uint32_t tile) {
+        int x0 = (tile % tiles_x) * TILE_SIZE;
+        int y0 = (tile / tiles_x) * TILE_SIZE;
+        int x1 = std::min(x0 + TILE_SIZE, framebuffer.width);
+        int y1 = std::min(y0 + TILE_SIZE, framebuffer.height);
+        uint64_t rays = 0, visits = 0, secondary_rays = 0, secondary_visits = 0;
+        auto trace_ray = [&](const PathRay &path, bool secondary) {
+            uint64_t visits_before = node_visits;
+            Hit hit = intsec_rayBVH(path.ray);
+            rays++;
+            visits += node_visits - visits_before;
+            if (secondary) {
+                secondary_rays++;
+                secondary_visits += node_visits - visits_before;
+            }
+            return hit;
+        };
+
+        for (int y = y0; y < y1; y++)
+        for (int x = x0; x < x1; x++) {
+            uint32_t pixel = (uint32_t)((framebuffer.height - 1 - y) * framebuffer.width + x);
+            PathRay path = {generate_ray(cam2world, near_clip_data, pixel_uv(framebuffer, x, y, jitter)), vec3(1.0f), pixel, 0};
+            vec3 light = vec3(0.0f);
+            while (true) {
+                PathRay next, shadow;
+                Hit hit = trace_ray(path, path.depth > 0);
+                if (path.depth == 0 && framebuffer.features)
+                    blend_features(framebuffer, x, y, get_features(path.ray, hit), weight);
+                int emitted = scatter(path, hit, sample_index, light, next, shadow);
+                if ((emitted & SCATTER_SHADOW) && trace_ray(shadow, true).triangle < 0)
+                    light += shadow.throughput;
+                if ((emitted & SCATTER_NEXT) == 0)
+                    break;
+                path = next;
+            }
+            framebuffer.at(x, y) = mix(framebuffer.at(x, y), light, weight);
+        }
+        ray_count.fetch_add(rays, std::memory_order_relaxed);
+        visit_count.fetch_add(visits, std::memory_order_relaxed);
+        secondary_ray_count.fetch_add(secondary_rays, std::memory_order_relaxed);
+        secondary_visit_count.fetch_add(secondary_visits, std::memory_order_relaxed);
+    });
+}
+
+void CPUTracer::sort_queue(std::vector<PathRay> &queue) const {
+    // the box around the origins, which the Morton codes quantize
+    AABB bounds;
+    for (const PathRay &path : queue)
+        bounds.grow(path.ray.origin);
+    vec3 scale = (float)(1 << SORT_MORTON_BITS) / max(bounds.max - bounds.min, vec3(1e-30f));
+    const float max_cell = (float)((1 << SORT_MORTON_BITS) - 1);
+
+    // the octant decides first, rays of different octants never share a packet
+    sort_keys.resize(queue.size());
+    for_each_batch(queue.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            vec3 cell = min(max((queue[i].ray.origin - bounds.min) * scale, vec3(0.0f)), vec3(max_cell));
+            uint32_t morton = morton_interleave((uint32_t)cell.x, (uint32_t)cell.y, (uint32_t)cell.z);
+            sort_keys[i] = (uint64_t)(octant(queue[i].ray.dir) << (3 * SORT_MORTON_BITS) | morton) << 32 | i;
+        }
+    });
+    parallel_radix_sort(sort_keys, 32, 32 + 3 + 3 * SORT_MORTON_BITS);
+
+    // the rays move too, so the batches read their rays from consecutive memory
+    sorted_queue.resize(queue.size());
+    for_each_batch(queue.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            sorted_queue[i] = queue[(uint32_t)sort_keys[i]];
+    });
+    queue.swap(sorted_queue);
+}
+
+template <int N>
+uint32_t CPUTracer::trace_batch(const PathRay *rays, uint32_t count, Hit *hits) const {
+    RayPacket<N> packet;
+    uint32_t packet_rays = 0;
+    uint32_t i = 0;
+    while (i < count) {
+        // lanes that diverge visit the union of their nodes, so packets only take rays of one octant within a narrow cone
+        bool coherent = i + N <= count;
+        for (uint32_t lane = 1; coherent && lane < N; lane++) {
+            const vec3 &dir = rays[i + lane].ray.dir;
+            coherent = octant(dir) == octant(rays[i].ray.dir) && dot(dir, rays[i].ray.dir) >= PACKET_MIN_COS;
+        }
+        if (!coherent) {
+            hits[i] = intsec_rayBVH(rays[i].ray);
+            i++;
+            continue;
+        }
+        for (int lane = 0; lane < N; lane++)
+            packet.set(lane, rays[i + lane].ray);
+        intsec_packetBVH<N>(packet, hits + i);
+        packet_rays += N;
+        i += N;
+    }
+    return packet_rays;
+}
+
+void CPUTracer::trace_queue(const std::vector<PathRay> &queue, bool secondary) const {
+    // like render's camera rays, only the binary BVH is traversed with packets
+    bool packets = traces_packets();
+    queue_hits.resize(queue.size());
+    for_each_batch(queue.size(), [&](size_t begin, size_t end) {
+        uint32_t count = (uint32_t)(end - begin);
+        uint64_t visits_before = node_visits;
+        // the nodes a batch shares are fetched once while it runs, so its distinct lines are what ordering the rays saves
+        thread_local std::vector<uintptr_t> lines;
+        lines.clear();
+        if (secondary)
+            node_lines = &lines;
+        uint32_t packet_rays = 0;
+        if (packets && kernels->width >= 8)
+            packet_rays = trace_batch<8>(&queue[begin], count, &queue_hits[begin]);
+        else if (packets && kernels->width >= 4)
+            packet_rays = trace_batch<4>(&queue[begin], count, &queue_hits[begin]);
+        else
+            for (size_t i = begin; i < end; i++)
+                queue_hits[i] = intsec_rayBVH(queue[i].ray);
+        node_lines = nullptr;
+
+        uint64_t visits = node_visits - visits_before;
+        ray_count.fetch_add(count, std::memory_order_relaxed);
+        visit_count.fetch_add(visits, std::memory_order_relaxed);
+        if (secondary) {
+            secondary_ray_count.fetch_add(count, std::memory_order_relaxed);
+            secondary_visit_count.fetch_add(visits, std::memory_order_relaxed);
+            packet_ray_count.fetch_add(packet_rays, std::memory_order_relaxed);
+            batch_count.fetch_add(1, std::memory_order_relaxed);
+            // sorted by their first line, the lines of one node only overlap those of the nodes before it
+            std::sort(lines.begin(), lines.end());
+            uint64_t distinct = 0;
+            uintptr_t next = 0;
+            for (uintptr_t span : lines) {
+                uintptr_t first = std::max(span >> 8, next), last = (span >> 8) + (span & 0xFF);
+                if (last >= first) {
+                    distinct += last - first + 1;
+                    next = last + 1;
+                }
+            }
+            batch_line_count.fetch_add(distinct, std::memory_order_relaxed);
+        }
+    });
+}
+
+void CPUTracer::render_breadth_first(const mat4 &cam2world, const vec2 &near_clip_data, uint32_t sample_index, Framebuffer &framebuffer) const {
+    int width = framebuffer.width, height = framebuffer.height;
+    vec2 jitter = sample_jitter(sample_index);
+    float weight = 1.0f / (float)(sample_index + 1);
+    radiance.assign((size_t)width * height, vec3(0.0f));
+
+    // the camera rays are queued tile by tile, so consecutive rays are as coherent as render's packets
+    int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    path_queue.resize((size_t)width * height);
+    parallel_for(tiles_x * tiles_y, [&](uint32_t tile) {
+        int x0 = (tile % tiles_x) * TILE_SIZE;
+        int y0 = (tile / tiles_x) * TILE_SIZE;
+        int x1 = std::min(x0 + TILE_SIZE, width);
+        int y1 = std::min(y0 + TILE_SIZE, height);
+        // after the rows of tiles above come the tiles to the left, all as high as this one
+        size_t slot = (size_t)y0 * width + (size_t)(y1 - y0) * x0;
+        for (int y = y0; y < y1; y++)
+        for (int x = x0; x < x1; x++)
+            path_queue[slot++] = {generate_ray(cam2world, near_clip_data, pixel_uv(framebuffer, x, y, jitter)), vec3(1.0f), (uint32_t)((height - 1 - y) * width + x), 0};
+    });
+
+    auto dead = [](const PathRay &path) { return path.pixel == DEAD_RAY; };
+    for (uint32_t depth = 0; depth <= bounces && !path_queue.empty(); depth++) {
+        // the rays scattered off the last bounce's hits point anywhere, sorting brings those that traverse the same nodes together
+        if (depth > 0 && ray_order == RAY_ORDER_SORTED)
+            sort_queue(path_queue);
+        trace_queue(path_queue, depth > 0);
+
+        // every ray continues into its own slots, the empty ones are removed afterwards
+        next_queue.resize(path_queue.size());
+        shadow_queue.resize(path_queue.size());
+        for_each_batch(path_queue.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                // a path has one ray per queue, so no other ray adds to the pixel
+                const PathRay &path = path_queue[i];
+                if (depth == 0 && framebuffer.features)
+                    blend_features(framebuffer, (int)(path.pixel % width), height - 1 - (int)(path.pixel / width), get_features(path.ray, queue_hits[i]), weight);
+                int emitted = scatter(path, queue_hits[i], sample_index, radiance[path.pixel], next_queue[i], shadow_queue[i]);
+                if ((emitted & SCATTER_NEXT) == 0)
+                    next_queue[i].pixel = DEAD_RAY;
+                if ((emitted & SCATTER_SHADOW) == 0)
+                    shadow_queue[i].pixel = DEAD_RAY;
+            }
+        });
+        next_queue.erase(std::remove_if(next_queue.begin(), next_queue.end(), dead), next_queue.end());
+        shadow_queue.erase(std::remove_if(shadow_queue.begin(), shadow_queue.end(), dead), shadow_queue.end());
+
+        if (ray_order == RAY_ORDER_SORTED)
+            sort_queue(shadow_queue);
+        trace_queue(shadow_queue, true);
+        for_each_batch(shadow_queue.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                if (queue_hits[i].triangle < 0)
+                    radiance[shadow_queue[i].pixel] += shadow_queue[i].throughput;
+        });
+        path_queue.swap(next_queue);
+    }
+
+    parallel_for(height, [&](uint32_t y) {
+        const vec3 *row = &radiance[(size_t)(height - 1 - y) * width];
+        for (int x = 0; x < width; x++)
+            framebuffer.at(x, y) = mix(framebuffer.at(x, y), row[x], weight);
+    });
+}
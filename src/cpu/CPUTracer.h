@@ -0,0 +1,240 @@
+#ifndef _CPUTRACER_H_
+#define _CPUTRACER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "../Camera.h"
+#include "../Scene.h"
+#include "../Framebuffer.h"
+#include "tracing.h"
+#include "simd.h"
+#include "WideBVH.h"
+using namespace glm;
+
+/** The order in which the CPU tracer follows the bounces of its paths. */
+enum RayOrder {
+    RAY_ORDER_DEPTH_FIRST = 0,   /** Every path to its end before the next one, tile by tile. */
+    RAY_ORDER_BREADTH_FIRST = 1, /** One bounce of all paths at a time, the rays queued in the order they were shaded. */
+    RAY_ORDER_SORTED = 2,        /** Breadth-first, every bounce's rays sorted by direction octant and origin first, see CPUTracer::set_ray_order. */
+};
+
+/**
+ * The CPUTracer class is the CPU render backend, a reference implementation of src/shaders/tracing.glsl.
+ * It renders the scene into an in-memory framebuffer in tiles, spread over all cores.
+ * With bounces it path traces instead, like WavefrontTracer, either path by path or a bounce of all paths at a time.
+ */
+class CPUTracer {
+private:
+    const Scene *scene;
+    const SimdKernels *kernels;
+    std::vector<TriangleSoA<4>> leaf_blocks; /** The triangles of all leaves in blocks of 4, padded with degenerate triangles. */
+    std::vector<uint32_t> node_blocks;       /** For every leaf node, the index of its first block in leaf_blocks. */
+    int bvh_width;                           /** The branching factor the standard layout is traversed with, 2, 4 or 8. */
+    WideBVH<4> wide4;                        /** The collapsed BVH if bvh_width is 4. */
+    WideBVH<8> wide8;                        /** The collapsed BVH if bvh_width is 8. */
+    std::vector<uint32_t> wide_roots;        /** The root of every BLAS in wide4 / wide8, just the root of the BVH without instancing. */
+    mutable std::atomic<uint64_t> ray_count{0};  /** The rays traced by render since the last reset_stats. */
+    mutable std::atomic<uint64_t> visit_count{0}; /** The nodes the traversals of those rays visited, leaves included. */
+    mutable std::atomic<uint64_t> secondary_ray_count{0};   /** Of the rays, the bounces and shadow rays. */
+    mutable std::atomic<uint64_t> secondary_visit_count{0}; /** The nodes the traversals of the secondary rays visited. */
+    mutable std::atomic<uint64_t> packet_ray_count{0};      /** The secondary rays traced in packets. */
+    mutable std::atomic<uint64_t> batch_count{0};           /** The batches the secondary rays were traced in, breadth-first. */
+    mutable std::atomic<uint64_t> batch_line_count{0};      /** The distinct node cache lines each of those batches fetched, summed. */
+    uint32_t bounces = 0;                 /** The bounces a path follows after the camera ray, 0 for the preview shading. */
+    RayOrder ray_order = RAY_ORDER_DEPTH_FIRST; /** The order the bounces are traced in. */
+
+    /** A ray of a path, or a shadow ray, and the light its pixel receives through it. */
+    struct PathRay {
+        Ray ray;
+        vec3 throughput; /** The fraction of the light along the ray that reaches the camera, a shadow ray's contribution. */
+        uint32_t pixel;  /** y * width + x with y counted from the bottom, like the wavefront kernels' random numbers. */
+        uint32_t depth;  /** The bounces before the ray, 0 for camera rays. */
+    };
+    // the buffers of the breadth-first order, kept between frames so they are not allocated again
+    mutable std::vector<PathRay> path_queue, next_queue, shadow_queue, sorted_queue;
+    mutable std::vector<Hit> queue_hits;
+    mutable std::vector<uint64_t> sort_keys;
+    mutable std::vector<vec3> radiance;
+
+    /** Path traces one sample per pixel into the framebuffer, every path to its end before the next. */
+    void render_depth_first(const mat4 &cam2world, const vec2 &near_clip_data, uint32_t sample_index, Framebuffer &framebuffer) const;
+    /** Path traces one sample per pixel into the framebuffer, one bounce of all paths at a time. */
+    void render_breadth_first(const mat4 &cam2world, const vec2 &near_clip_data, uint32_t sample_index, Framebuffer &framebuffer) const;
+    /**
+     * Shades a traced path ray, port of wavefront_shade: adds the light it received to light and continues the path.
+     * @return Flags of SCATTER_NEXT and SCATTER_SHADOW for the rays written to next and shadow.
+     */
+    int scatter(const PathRay &path, const Hit &hit, uint32_t sample_index, vec3 &light, PathRay &next, PathRay &shadow) const;
+    /** Sorts a queue of rays by their direction octant, then by the Morton code of their origin. */
+    void sort_queue(std::vector<PathRay> &queue) const;
+    /** Traces all rays of a queue in batches of BATCH_SIZE, spread over all cores. */
+    void trace_queue(const std::vector<PathRay> &queue, bool secondary) const;
+    /** Traces a batch of queued rays, runs of N rays of one octant and a narrow cone as packets. @return The rays traced in packets. */
+    template <int N>
+    uint32_t trace_batch(const PathRay *rays, uint32_t count, Hit *hits) const;
+public:
+    /** Counters of the work done by render, to compare acceleration structures and ray orders. */
+    struct TraversalStats {
+        uint64_t rays;        /** The rays traced. */
+        uint64_t node_visits; /** The nodes visited, a node visited by a packet counts once for the whole packet. */
+        uint64_t secondary_rays;        /** Of the rays, the bounces and shadow rays. */
+        uint64_t secondary_node_visits; /** Of the node visits, those of the secondary rays. */
+        uint64_t packet_rays;           /** The secondary rays traced in packets, which fetch every node once for all lanes. */
+        uint64_t batches;               /** The batches the secondary rays were traced in, 0 depth-first. */
+        uint64_t batch_node_lines;      /** The distinct cache lines of nodes each batch fetched, summed over the batches. */
+    };
+
+
+    static constexpr int TILE_SIZE = 16; /** The edge length of the square tiles the image is split into. */
+    static constexpr uint32_t BATCH_SIZE = 256; /** The queued rays traced together, breadth-first. */
+
+    /**
+     * Constructs a new CPUTracer.
+     * The intersection kernels are picked for the instruction set of the CPU, see simd_kernels().
+     * The BVH width follows: 8 for AVX2, 4 for SSE2, the binary BVH for the scalar kernels.
+     * It can be overridden with the environment variable RTX_BVH_WIDTH=2|4|8.
+     * @param scene The scene to trace, only its CPU side data is used.
+     */
+    CPUTracer(const Scene *scene);
+
+    /**
+     * Updates the tracer's copy of the scene's leaf triangles and collapses its BVH to the tracer's width.
+     * Has to be called after the scene's geometry changed, but not after instances were moved, the TLAS is used as it is.
+     */
+    void update();
+
+    /**
+     * Refreshes the tracer's copy of the leaf triangles and the boxes of its wide BVH in place, after
+     * Scene::update_geometry moved triangles and refitted the BVH. Much cheaper than update, which is needed instead
+     * whenever the BVH was replaced, e.g. when Scene::end_frame swapped in a rebuild.
+     */
+    void refit();
+
+    /**
+     * Renders the scene from the camera's point of view, exactly like Camera::render does on the GPU.
+     * Adds one jittered sample per pixel to the average already in the framebuffer, unless the camera moved since.
+     * Its features are averaged too, if it keeps them.
+     * @param camera The camera to render from.
+     * @param framebuffer The framebuffer to render into, its size determines the resolution.
+     */
+    void render(const Camera &camera, Framebuffer &framebuffer) const;
+
+    /**
+     * Finds the closest triangle hit along a ray, in the scene's layout. Port of intsec_rayBVH.
+     * @param ray The ray to trace.
+     * @return The closest hit.
+     */
+    Hit intsec_rayBVH(const Ray &ray) const;
+
+    /**
+     * Finds the closest triangle hits along N coherent rays at once, using the packet kernels.
+     * Packets always traverse the binary BVH, testing N rays against W children costs more than the visits it saves.
+     * The rays of instanced scenes are traced one by one, each instance transforms them differently.
+     * @param rays The rays to trace, N has to be 4 or 8.
+     * @param hits Receives the closest hit of every ray.
+     */
+    template <int N>
+    void intsec_packetBVH(const RayPacket<N> &rays, Hit *hits) const;
+
+    /**
+     * Finds the closest hit in a BLAS that is closer than the hit so far, in the standard layout. Port of intsec_rayBLAS.
+     * @param ray The ray to trace, in the BLAS' object space.
+     * @param blas The index of the BLAS, 0 without instancing.
+     * @param instance The instance recorded with a closer hit, -1 without instancing.
+     * @param hit The closest hit so far, updated if a closer one is found.
+     */
+    void intsec_rayBLAS(const Ray &ray, uint32_t blas, int instance, Hit &hit) const;
+
+    /** intsec_rayBLAS for the BLAS collapsed to a W wide BVH starting at the given wide node, children are visited closest first. */
+    template <int W>
+    void intsec_rayWideBLAS(const Ray &ray, const WideBVH<W> &bvh, uint32_t root, int instance, Hit &hit) const;
+
+    /**
+     * Finds the closest hit among the instances of an instanced scene, closer than the hit so far. Port of intsec_rayTLAS.
+     * @param ray The ray to trace, in world space.
+     * @param hit The closest hit so far, updated if a closer one is found.
+     */
+    void intsec_rayTLAS(const Ray &ray, Hit &hit) const;
+
+    /**
+     * intsec_rayBVH for the compressed layout. Port of intsec_rayCompressedBVH, except that the leaves are tested
+     * against leaf_blocks, 4 triangles per kernel call, instead of the layout's TriangleRecords one at a time.
+     * The blocks hold the same triangles in the same order, and a single ray tests them faster 4 at a time.
+     */
+    Hit intsec_rayCompressedBVH(const Ray &ray) const;
+
+    /** intsec_packetBVH for the compressed layout, reading the layout's TriangleRecords like the GPU kernel. */
+    template <int N>
+    void intsec_packetCompressedBVH(const RayPacket<N> &rays, Hit *hits) const;
+
+    /**
+     * Traces a single primary ray. Port of trace.
+     * @param cam2world The camera to world matrix.
+     * @param near_clip_data The (width, height) of the near clip plane at distance 1.
+     * @param uv The position on the screen in [0,1]², (0,0) being the bottom left corner.
+     * @return The color seen along the ray.
+     */
+    vec3 trace(const mat4 &cam2world, const vec2 &near_clip_data, const vec2 &uv) const;
+
+    /**
+     * Shades a ray that has been traced. The shading part of trace.
+     * @param ray The traced ray.
+     * @param hit The closest hit along the ray.
+     * @return The color seen along the ray.
+     */
+    vec3 shade(const Ray &ray, const Hit &hit) const;
+
+    /**
+     * Returns the normal of the triangle hit, facing the side its vertices are counter clockwise on. Port of get_hitNormal.
+     * @param hit A hit of a triangle.
+     * @return The normalized normal, in world space.
+     */
+    vec3 get_hitNormal(const Hit &hit) const;
+
+    /**
+     * Gets the features of the surface a camera ray hit, which guide the denoiser. Port of get_features.
+     * @param ray The traced camera ray.
+     * @param hit The closest hit along the ray.
+     * @return The albedo, the normal facing the ray and the distance of the hit, all zero on a miss.
+     */
+    Features get_features(const Ray &ray, const Hit &hit) const;
+
+    /**
+     * Sets the bounces render follows after the camera rays, shading diffuse surfaces under a directional light and the
+     * sky like wavefront_shade does. 0 shades the first hit like trace, which is the default.
+     * @param bounces The number of bounces.
+     */
+    inline void set_bounces(uint32_t bounces) { this->bounces = bounces; }
+    /** @return The bounces render follows after the camera rays. */
+    inline uint32_t get_bounces() const { return bounces; }
+
+    /**
+     * Sets the order render follows the bounces in, to compare how well the traversals use the caches.
+     * Every order renders the same image. Sorting brings rays that fetch the same nodes into one batch, but only
+     * traces_packets() tracers turn runs of them into packets, which fetch every node once for all their rays.
+     * @param order The order, depth-first by default.
+     */
+    inline void set_ray_order(RayOrder order) { ray_order = order; }
+    /** @return The order render follows the bounces in. */
+    inline RayOrder get_ray_order() const { return ray_order; }
+
+    /** @return The name of the instruction set the tracer's kernels use. */
+    inline const char *get_isa() const { return kernels->name; }
+    /** @return The branching factor of the BVH the tracer traverses in the standard layout. */
+    inline int get_bvh_width() const { return bvh_width; }
+    /**
+     * Only the binary BVH is traversed with packets, a wide one fills the vector lanes with the children of a node instead.
+     * The standard layout of a scene without instances takes RTX_BVH_WIDTH=2 for it, unless the kernels are scalar.
+     * @return Whether coherent rays are traced in packets.
+     */
+    inline bool traces_packets() const { return (bvh_width == 2 && !scene->is_instanced()) || scene->layout == BVH_LAYOUT_COMPRESSED; }
+
+    /** @return The work done by render since the tracer was created or reset_stats was called. */
+    TraversalStats get_stats() const;
+    /** Sets the counters of get_stats back to zero. */
+    void reset_stats();
+};
+
+#endif//_CPUTRACER_H_
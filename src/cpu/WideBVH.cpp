@@ -0,0 +1,98 @@
+#include "WideBVH.h"
+using std::vector;
+
+namespace {
+
+// collapses the subtree below a binary inner node into wide nodes, returns the index of the wide node
+template <int N>
+uint32_t collapse(const BVH &bvh, vector<WideNode<N>> &nodes, uint32_t index) {
+    const BVHNode &node = bvh.nodes[index];
+    uint32_t children[N] = {index + 1, node.index};
+    uint32_t child_count = 2;
+
+    // open the inner child with the largest area until the node is full, it is the one most rays enter
+    while (child_count < N) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (uint32_t i = 0; i < child_count; i++) {
+            const BVHNode &child = bvh.nodes[children[i]];
+            float area = AABB{child.bbmin, child.bbmax}.area();
+            if (!child.is_leaf() && area > best_area) {
+                best = (int)i;
+                best_area = area;
+            }
+        }
+        if (best < 0)
+            break;
+        uint32_t opened = children[best];
+        children[best] = opened + 1;
+        children[child_count++] = bvh.nodes[opened].index;
+    }
+
+    uint32_t wide_index = (uint32_t)nodes.size();
+    nodes.push_back({}); // unused lanes stay zero
+    for (uint32_t i = 0; i < child_count; i++) {
+        const BVHNode &child = bvh.nodes[children[i]];
+        uint32_t target = child.is_leaf() ? children[i] : collapse(bvh, nodes, children[i]);
+        // the recursion may have reallocated the nodes
+        WideNode<N> &wide = nodes[wide_index];
+        wide.bounds.set(i, child.bbmin, child.bbmax);
+        wide.child[i] = target;
+        wide.count[i] = child.count;
+    }
+    nodes[wide_index].child_count = child_count;
+    return wide_index;
+}
+
+} // namespace
+
+template <int N>
+void WideBVH<N>::build(const BVH &bvh) {
+    nodes.clear();
+    if (bvh.nodes.empty())
+        return;
+
+    // half the binary nodes are inner ones and a full wide node replaces N - 1 of them
+    nodes.reserve(bvh.nodes.size() / (2 * (N - 1)) + 1);
+    add(bvh, 0);
+}
+
+template <int N>
+uint32_t WideBVH<N>::add(const BVH &bvh, uint32_t root) {
+    const BVHNode &node = bvh.nodes[root];
+    if (!node.is_leaf())
+        return collapse<N>(bvh, nodes, root);
+
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.push_back({});
+    nodes[index].bounds.set(0, node.bbmin, node.bbmax);
+    nodes[index].child[0] = root;
+    nodes[index].count[0] = node.count;
+    nodes[index].child_count = 1;
+    return index;
+}
+
+template <int N>
+void WideBVH<N>::refit(const BVH &bvh) {
+    for (size_t n = nodes.size(); n-- > 0;) {
+        WideNode<N> &node = nodes[n];
+        for (uint32_t i = 0; i < node.child_count; i++) {
+            if (node.count[i] > 0) {
+                const BVHNode &leaf = bvh.nodes[node.child[i]];
+                node.bounds.set(i, leaf.bbmin, leaf.bbmax);
+                continue;
+            }
+            // the children of an inner child partition its binary subtree, so their union is its refitted box
+            const WideNode<N> &child = nodes[node.child[i]];
+            AABB bounds;
+            for (uint32_t j = 0; j < child.child_count; j++) {
+                bounds.grow(vec3(child.bounds.minx[j], child.bounds.miny[j], child.bounds.minz[j]));
+                bounds.grow(vec3(child.bounds.maxx[j], child.bounds.maxy[j], child.bounds.maxz[j]));
+            }
+            node.bounds.set(i, bounds.min, bounds.max);
+        }
+    }
+}
+
+template struct WideBVH<4>;
+template struct WideBVH<8>;
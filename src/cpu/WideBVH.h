@@ -0,0 +1,56 @@
+#ifndef _WIDE_BVH_H_
+#define _WIDE_BVH_H_
+
+#include <vector>
+#include <cstdint>
+#include "../bvh/BVH.h"
+#include "simd.h"
+
+/**
+ * A node of a WideBVH, holding the boxes of up to N children in SoA layout, so one ray is tested against all of them
+ * with a single rayAABB4 / rayAABB8 call.
+ */
+template <int N>
+struct WideNode {
+    AABBSoA<N> bounds;      /** The children's boxes, lanes from child_count on are unused. */
+    uint32_t child[N];      /** Inner child: the index of its WideNode. Leaf child: the index of the BVH's leaf node. */
+    uint32_t count[N];      /** The number of triangles of a leaf child, 0 for inner children. */
+    uint32_t child_count;   /** The number of children, 1 only if the whole BVH is a single leaf. */
+};
+
+/**
+ * A BVH with N children per node, collapsed from a built binary BVH.
+ * The leaves are the binary BVH's, so they keep referencing its triangles (and the CPUTracer's leaf blocks).
+ */
+template <int N>
+struct WideBVH {
+    std::vector<WideNode<N>> nodes; /** The nodes, nodes[0] is the root. Empty if the BVH is. */
+
+    /**
+     * Collapses a binary BVH, replacing any previous contents.
+     * Every node is filled by repeatedly opening the inner child with the largest surface area, the children's order is
+     * irrelevant since traversal sorts them by distance.
+     * @param bvh The BVH to collapse.
+     */
+    void build(const BVH &bvh);
+
+    /**
+     * Appends the collapsed subtree below one node of a binary BVH, e.g. one BLAS of an instanced scene.
+     * @param bvh The BVH the subtree is part of.
+     * @param root The index of the subtree's root in the BVH.
+     * @return The index of the subtree's root in nodes.
+     */
+    uint32_t add(const BVH &bvh, uint32_t root);
+
+    /**
+     * Updates the boxes after the binary BVH was refitted, keeping the collapsed topology.
+     * Every node is added before its children, so walking the nodes backwards updates the children first.
+     * @param bvh The refitted BVH, the one the nodes were collapsed from.
+     */
+    void refit(const BVH &bvh);
+};
+
+extern template struct WideBVH<4>;
+extern template struct WideBVH<8>;
+
+#endif//_WIDE_BVH_H_
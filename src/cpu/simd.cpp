@@ -0,0 +1,88 @@
+#include "simd.h"
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+template <int N>
+void scalar_rayTriangle(const Ray &ray, const TriangleSoA<N> &tris, float *t) {
+    for (int i = 0; i < N; i++)
+        t[i] = intsec_rayTriangleEdges(ray, vec3(tris.ax[i], tris.ay[i], tris.az[i]), vec3(tris.e1x[i], tris.e1y[i], tris.e1z[i]), vec3(tris.e2x[i], tris.e2y[i], tris.e2z[i]));
+}
+
+template <int N>
+void scalar_rayAABB(const Ray &ray, const AABBSoA<N> &boxes, float *t) {
+    for (int i = 0; i < N; i++)
+        t[i] = intsec_rayAABB(ray, vec3(boxes.minx[i], boxes.miny[i], boxes.minz[i]), vec3(boxes.maxx[i], boxes.maxy[i], boxes.maxz[i]));
+}
+
+template <int N>
+void scalar_packetTriangle(const RayPacket<N> &rays, const vec3 &a, const vec3 &e1, const vec3 &e2, float *t) {
+    for (int i = 0; i < N; i++)
+        t[i] = intsec_rayTriangleEdges(rays.get(i), a, e1, e2);
+}
+
+template <int N>
+void scalar_packetAABB(const RayPacket<N> &rays, const vec3 &bbmin, const vec3 &bbmax, float *t) {
+    for (int i = 0; i < N; i++)
+        t[i] = intsec_rayAABB(rays.get(i), bbmin, bbmax);
+}
+
+inline float squared_distance(const float *const *a, size_t p, size_t q) {
+    float d0 = a[0][p] - a[0][q], d1 = a[1][p] - a[1][q], d2 = a[2][p] - a[2][q];
+    return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+void scalar_atrousRow(const AtrousPlanes &planes, const AtrousPass &pass, size_t offset, int count, float *const *out) {
+    for (size_t p = offset; p < offset + count; p++) {
+        float depth = planes.depth[p];
+        float inv_depth2 = 1.0f / (pass.sigma_depth2 * (depth * depth) + ATROUS_DEPTH_EPSILON);
+        float sum[3] = {0.0f, 0.0f, 0.0f}, weight_sum = 0.0f;
+        for (int y = -2; y <= 2; y++)
+            for (int x = -2; x <= 2; x++) {
+                size_t q = p + ((ptrdiff_t)y * planes.stride + x) * pass.step;
+                float dz = depth - planes.depth[q];
+                float difference = (squared_distance(planes.color, p, q) * pass.inv_sigma_color2 + squared_distance(planes.normal, p, q) * pass.inv_sigma_normal2)
+                                 + (squared_distance(planes.albedo, p, q) * pass.inv_sigma_albedo2 + dz * dz * inv_depth2);
+
+                float weight = ATROUS_KERNEL[abs(x)] * ATROUS_KERNEL[abs(y)] * planes.mask[q] * atrous_edge_weight(difference);
+                for (int c = 0; c < 3; c++)
+                    sum[c] += planes.color[c][q] * weight;
+                weight_sum += weight;
+            }
+        for (int c = 0; c < 3; c++)
+            out[c][p] = weight_sum > 0.0f ? sum[c] / weight_sum : 0.0f;
+    }
+}
+
+const SimdKernels simd_kernels_scalar = {
+    "scalar", 1,
+    scalar_rayTriangle<4>, scalar_rayTriangle<8>,
+    scalar_rayAABB<4>, scalar_rayAABB<8>,
+    scalar_packetTriangle<4>, scalar_packetTriangle<8>,
+    scalar_packetAABB<4>, scalar_packetAABB<8>,
+    scalar_atrousRow,
+};
+
+const SimdKernels &select_simd_kernels() {
+    const char *requested = getenv("RTX_SIMD");
+#if defined(__x86_64__) || defined(__i386__)
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (requested == nullptr || strcmp(requested, "avx2") == 0) {
+        if (has_avx2)
+            return simd_kernels_avx2;
+        if (requested != nullptr)
+            fprintf(stderr, "RTX_SIMD=avx2 requested, but the CPU does not support it\n");
+        return simd_kernels_sse2;
+    }
+    if (strcmp(requested, "sse2") == 0)
+        return simd_kernels_sse2;
+#endif
+    if (requested != nullptr && strcmp(requested, "scalar") != 0)
+        fprintf(stderr, "Unknown RTX_SIMD value '%s', using scalar kernels\n", requested);
+    return simd_kernels_scalar;
+}
+
+const SimdKernels &simd_kernels() {
+    static const SimdKernels &kernels = select_simd_kernels();
+    return kernels;
+}
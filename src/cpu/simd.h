@@ -0,0 +1,164 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "tracing.h"
+using namespace glm;
+
+// SIMD versions of intsec_rayTriangleEdges and intsec_rayAABB from tracing.h.
+// Every lane produces exactly what the scalar function would for the same inputs
+// (same operations in the same order, no FMA contraction, no approximate reciprocals).
+
+/**
+ * N triangles in SoA layout, as their first vertex and precomputed edges.
+ * Unused lanes should hold degenerate (all zero) triangles, which never hit.
+ */
+template <int N>
+struct alignas(32) TriangleSoA {
+    float ax[N], ay[N], az[N];
+    float e1x[N], e1y[N], e1z[N];
+    float e2x[N], e2y[N], e2z[N];
+
+    /** Stores a triangle given as its first vertex and edges (b - a, c - a) in the given lane. */
+    inline void set_edges(int lane, const vec3 &a, const vec3 &e1, const vec3 &e2) {
+        ax[lane] = a.x;   ay[lane] = a.y;   az[lane] = a.z;
+        e1x[lane] = e1.x; e1y[lane] = e1.y; e1z[lane] = e1.z;
+        e2x[lane] = e2.x; e2y[lane] = e2.y; e2z[lane] = e2.z;
+    }
+
+    /** Stores a triangle in the given lane. */
+    inline void set(int lane, const vec3 &a, const vec3 &b, const vec3 &c) { set_edges(lane, a, b - a, c - a); }
+};
+
+/** N axis aligned boxes in SoA layout. Results for unused lanes are meaningless and have to be masked by the caller. */
+template <int N>
+struct alignas(32) AABBSoA {
+    float minx[N], miny[N], minz[N];
+    float maxx[N], maxy[N], maxz[N];
+
+    /** Stores a box in the given lane. */
+    inline void set(int lane, const vec3 &bbmin, const vec3 &bbmax) {
+        minx[lane] = bbmin.x; miny[lane] = bbmin.y; minz[lane] = bbmin.z;
+        maxx[lane] = bbmax.x; maxy[lane] = bbmax.y; maxz[lane] = bbmax.z;
+    }
+};
+
+/** N rays in SoA layout. */
+template <int N>
+struct alignas(32) RayPacket {
+    float ox[N], oy[N], oz[N];
+    float dx[N], dy[N], dz[N];
+    float idx[N], idy[N], idz[N];
+
+    /** Stores a ray in the given lane. */
+    inline void set(int lane, const Ray &ray) {
+        ox[lane] = ray.origin.x; oy[lane] = ray.origin.y; oz[lane] = ray.origin.z;
+        dx[lane] = ray.dir.x;    dy[lane] = ray.dir.y;    dz[lane] = ray.dir.z;
+        idx[lane] = ray.invDir.x; idy[lane] = ray.invDir.y; idz[lane] = ray.invDir.z;
+    }
+
+    /** @return The ray in the given lane. */
+    inline Ray get(int lane) const {
+        return { vec3(ox[lane], oy[lane], oz[lane]), vec3(dx[lane], dy[lane], dz[lane]), vec3(idx[lane], idy[lane], idz[lane]) };
+    }
+};
+
+/** The weights of the 5 taps of the B3 spline kernel along an axis, by their distance from the center. */
+constexpr float ATROUS_KERNEL[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+constexpr float ATROUS_DEPTH_EPSILON = 1e-8f; // keeps the depth term finite for a pixel that hit nothing, whose depth is 0
+
+/**
+ * The planes of an image the à-trous filter reads, one float per pixel and channel, rows stride floats apart.
+ * The image is surrounded by a border as wide as the farthest tap whose mask is 0, so no tap needs a bounds check.
+ */
+struct AtrousPlanes {
+    const float *color[3];
+    const float *albedo[3];
+    const float *normal[3];
+    const float *depth;
+    const float *mask; /** 1 inside the image, 0 in the border. */
+    ptrdiff_t stride;
+};
+
+/** The parameters of one à-trous pass, like the uniforms of denoise.glsl. */
+struct AtrousPass {
+    int step;                /** The distance between the taps in pixels. */
+    float inv_sigma_color2;  /** 1 / sigma_color^2 of this pass. */
+    float inv_sigma_normal2;
+    float inv_sigma_albedo2;
+    float sigma_depth2;
+};
+
+/**
+ * The weight of a tap by its summed, sigma scaled squared differences x, about exp(-x) as in denoise.glsl:
+ * the reciprocal of the Taylor series of exp(x) up to x^4, which needs neither exp nor a branch.
+ * Evaluated in Estrin's scheme, whose dependency chain is half as long as Horner's.
+ */
+inline float atrous_edge_weight(float x) {
+    float x2 = x * x;
+    return 1.0f / ((1.0f + x) + x2 * ((1.0f / 2.0f + x * (1.0f / 6.0f)) + x2 * (1.0f / 24.0f)));
+}
+
+/**
+ * A set of intersection kernels for one instruction set.
+ * All kernels write one distance per lane to `t`, -1 meaning a miss, like their scalar counterparts.
+ */
+struct SimdKernels {
+    const char *name; /** The instruction set, "scalar", "sse2" or "avx2". */
+    int width;        /** The native vector width, the preferred N for the kernels below. */
+
+    /** One ray against 4 / 8 triangles. */
+    void (*rayTriangle4)(const Ray &ray, const TriangleSoA<4> &tris, float *t);
+    void (*rayTriangle8)(const Ray &ray, const TriangleSoA<8> &tris, float *t);
+    /** One ray against 4 / 8 boxes. */
+    void (*rayAABB4)(const Ray &ray, const AABBSoA<4> &boxes, float *t);
+    void (*rayAABB8)(const Ray &ray, const AABBSoA<8> &boxes, float *t);
+    /** 4 / 8 rays against one triangle, given as its first vertex a and edges b - a, c - a. */
+    void (*packetTriangle4)(const RayPacket<4> &rays, const vec3 &a, const vec3 &e1, const vec3 &e2, float *t);
+    void (*packetTriangle8)(const RayPacket<8> &rays, const vec3 &a, const vec3 &e1, const vec3 &e2, float *t);
+    /** 4 / 8 rays against one box. */
+    void (*packetAABB4)(const RayPacket<4> &rays, const vec3 &bbmin, const vec3 &bbmax, float *t);
+    void (*packetAABB8)(const RayPacket<8> &rays, const vec3 &bbmin, const vec3 &bbmax, float *t);
+    /**
+     * One à-trous pass over count pixels starting at offset, writing their filtered colors to out[0..2] at the same
+     * offsets. Writes up to width - 1 pixels beyond count, which the planes must have room for.
+     */
+    void (*atrousRow)(const AtrousPlanes &planes, const AtrousPass &pass, size_t offset, int count, float *const *out);
+
+    /** Calls rayAABB4 or rayAABB8, for code that is templated on the number of boxes. */
+    template <int N> void rayAABB(const Ray &ray, const AABBSoA<N> &boxes, float *t) const;
+    /** Calls packetTriangle4 or packetTriangle8, for code that is templated on the packet width. */
+    template <int N> void packetTriangle(const RayPacket<N> &rays, const vec3 &a, const vec3 &e1, const vec3 &e2, float *t) const;
+    /** Calls packetAABB4 or packetAABB8, for code that is templated on the packet width. */
+    template <int N> void packetAABB(const RayPacket<N> &rays, const vec3 &bbmin, const vec3 &bbmax, float *t) const;
+};
+
+template <> inline void SimdKernels::rayAABB<4>(const Ray &ray, const AABBSoA<4> &boxes, float *t) const
+    { rayAABB4(ray, boxes, t); }
+template <> inline void SimdKernels::rayAABB<8>(const Ray &ray, const AABBSoA<8> &boxes, float *t) const
+    { rayAABB8(ray, boxes, t); }
+template <> inline void SimdKernels::packetTriangle<4>(const RayPacket<4> &rays, const vec3 &a, const vec3 &e1, const vec3 &e2, float *t) const
+    { packetTriangle4(rays, a, e1, e2, t); }
+template <> inline void SimdKernels::packetTriangle<8>(const RayPacket<8> &rays, const vec3 &a, const vec3 &e1, const vec3 &e2, float *t) const
+    { packetTriangle8(rays, a, e1, e2, t); }
+template <> inline void SimdKernels::packetAABB<4>(const RayPacket<4> &rays, const vec3 &bbmin, const vec3 &bbmax, float *t) const
+    { packetAABB4(rays, bbmin, bbmax, t); }
+template <> inline void SimdKernels::packetAABB<8>(const RayPacket<8> &rays, const vec3 &bbmin, const vec3 &bbmax, float *t) const
+    { packetAABB8(rays, bbmin, bbmax, t); }
+
+/**
+ * Gets the kernels for the best instruction set the CPU supports, picked once on the first call.
+ * The choice can be overridden with the environment variable RTX_SIMD=scalar|sse2|avx2.
+ * @return The selected kernels.
+ */
+const SimdKernels &simd_kernels();
+
+/** The portable reference kernels, built on the scalar functions in tracing.h. */
+extern const SimdKernels simd_kernels_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+extern const SimdKernels simd_kernels_sse2; /** SSE2 kernels, the 8 wide ones process two halves. */
+extern const SimdKernels simd_kernels_avx2; /** AVX2 kernels, compiled in their own translation unit with -mavx2. */
+#endif
+
+#endif//_SIMD_H_
\ No newline at end of file
@@ -0,0 +1,58 @@
+// This translation unit is compiled with -mavx2 (see the makefile) and must only be entered
+// through simd_kernels_avx2, after the CPU was checked for AVX2 support.
+#include "simd.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+struct AVX2 {
+    static constexpr int W = 8;
+    using F = __m256;
+    static inline F load(const float *p) { return _mm256_loadu_ps(p); }
+    static inline void store(float *p, F a) { _mm256_storeu_ps(p, a); }
+    static inline F set1(float f) { return _mm256_set1_ps(f); }
+    static inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static inline F div(F a, F b) { return _mm256_div_ps(a, b); }
+    // operands swapped to get std::min / std::max semantics, see simd_sse2.cpp
+    static inline F min(F a, F b) { return _mm256_min_ps(b, a); }
+    static inline F max(F a, F b) { return _mm256_max_ps(b, a); }
+    static inline F lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline F gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline F or_(F a, F b) { return _mm256_or_ps(a, b); }
+    static inline F andnot(F a, F b) { return _mm256_andnot_ps(b, a); }
+    static inline F select(F mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+};
+
+// the 4 wide kernels use the VEX encoded 128 bit instructions
+struct AVX2_128 {
+    static constexpr int W = 4;
+    using F = __m128;
+    static inline F load(const float *p) { return _mm_loadu_ps(p); }
+    static inline void store(float *p, F a) { _mm_storeu_ps(p, a); }
+    static inline F set1(float f) { return _mm_set1_ps(f); }
+    static inline F add(F a, F b) { return _mm_add_ps(a, b); }
+    static inline F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static inline F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static inline F div(F a, F b) { return _mm_div_ps(a, b); }
+    static inline F min(F a, F b) { return _mm_min_ps(b, a); }
+    static inline F max(F a, F b) { return _mm_max_ps(b, a); }
+    static inline F lt(F a, F b) { return _mm_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline F gt(F a, F b) { return _mm_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline F or_(F a, F b) { return _mm_or_ps(a, b); }
+    static inline F andnot(F a, F b) { return _mm_andnot_ps(b, a); }
+    static inline F select(F mask, F a, F b) { return _mm_blendv_ps(b, a, mask); }
+};
+
+#include "simd_kernels.inl"
+
+const SimdKernels simd_kernels_avx2 = {
+    "avx2", 8,
+    rayTriangle<AVX2_128, 4>, rayTriangle<AVX2, 8>,
+    rayAABB<AVX2_128, 4>, rayAABB<AVX2, 8>,
+    packetTriangle<AVX2_128, 4>, packetTriangle<AVX2, 8>,
+    packetAABB<AVX2_128, 4>, packetAABB<AVX2, 8>,
+    atrousRow<AVX2>,
+};
+
+#endif
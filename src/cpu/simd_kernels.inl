@@ -0,0 +1,171 @@
+// Instruction set independent bodies of the SIMD intersection kernels.
+// Included by the per-ISA translation units (simd_sse2.cpp, simd_avx2.cpp) after they defined a
+// vector type `V` providing: W (lanes), F (register type), load, store, set1, add, sub, mul, div,
+// min/max (with std::min/std::max semantics), lt, gt, or_, andnot (a & ~b) and select(mask, a, b).
+// The operation order mirrors intsec_rayTriangleEdges / intsec_rayAABB in tracing.h exactly.
+// atrousRow filters W neighbouring pixels of a row at once, every lane reading its own taps.
+
+namespace {
+
+template <class V>
+inline typename V::F intsec_triangle(
+    typename V::F ox, typename V::F oy, typename V::F oz,
+    typename V::F dx, typename V::F dy, typename V::F dz,
+    typename V::F ax, typename V::F ay, typename V::F az,
+    typename V::F e1x, typename V::F e1y, typename V::F e1z,
+    typename V::F e2x, typename V::F e2y, typename V::F e2z)
+{
+    using F = typename V::F;
+    const F EPSILON = V::set1(0.0000001f);
+    const F ZERO = V::set1(0.0f);
+    const F ONE = V::set1(1.0f);
+
+    // h = cross(dir, edge2)
+    F hx = V::sub(V::mul(dy, e2z), V::mul(dz, e2y));
+    F hy = V::sub(V::mul(dz, e2x), V::mul(dx, e2z));
+    F hz = V::sub(V::mul(dx, e2y), V::mul(dy, e2x));
+    F a_dot_h = V::add(V::add(V::mul(e1x, hx), V::mul(e1y, hy)), V::mul(e1z, hz));
+    F miss = V::lt(a_dot_h, EPSILON); // parallel or backface
+
+    F f = V::div(ONE, a_dot_h);
+    F sx = V::sub(ox, ax), sy = V::sub(oy, ay), sz = V::sub(oz, az);
+    F u = V::mul(f, V::add(V::add(V::mul(sx, hx), V::mul(sy, hy)), V::mul(sz, hz)));
+    miss = V::or_(miss, V::or_(V::lt(u, ZERO), V::gt(u, ONE)));
+
+    // q = cross(s, edge1)
+    F qx = V::sub(V::mul(sy, e1z), V::mul(sz, e1y));
+    F qy = V::sub(V::mul(sz, e1x), V::mul(sx, e1z));
+    F qz = V::sub(V::mul(sx, e1y), V::mul(sy, e1x));
+    F v = V::mul(f, V::add(V::add(V::mul(dx, qx), V::mul(dy, qy)), V::mul(dz, qz)));
+    miss = V::or_(miss, V::or_(V::lt(v, ZERO), V::gt(V::add(u, v), ONE)));
+
+    F t = V::mul(f, V::add(V::add(V::mul(e2x, qx), V::mul(e2y, qy)), V::mul(e2z, qz)));
+    F hit = V::andnot(V::gt(t, EPSILON), miss);
+    return V::select(hit, t, V::set1(-1.0f));
+}
+
+template <class V>
+inline typename V::F intsec_AABB(
+    typename V::F ox, typename V::F oy, typename V::F oz,
+    typename V::F idx, typename V::F idy, typename V::F idz,
+    typename V::F minx, typename V::F miny, typename V::F minz,
+    typename V::F maxx, typename V::F maxy, typename V::F maxz)
+{
+    using F = typename V::F;
+    F t1x = V::mul(V::sub(minx, ox), idx), t1y = V::mul(V::sub(miny, oy), idy), t1z = V::mul(V::sub(minz, oz), idz);
+    F t2x = V::mul(V::sub(maxx, ox), idx), t2y = V::mul(V::sub(maxy, oy), idy), t2z = V::mul(V::sub(maxz, oz), idz);
+
+    F tNear = V::max(V::max(V::min(t1x, t2x), V::min(t1y, t2y)), V::min(t1z, t2z));
+    F tFar  = V::min(V::min(V::max(t1x, t2x), V::max(t1y, t2y)), V::max(t1z, t2z));
+
+    F miss = V::or_(V::gt(tNear, tFar), V::lt(tFar, V::set1(0.0f)));
+    return V::select(miss, V::set1(-1.0f), V::max(tNear, V::set1(0.0f)));
+}
+
+template <class V, int N>
+void rayTriangle(const Ray &ray, const TriangleSoA<N> &tris, float *t) {
+    using F = typename V::F;
+    F ox = V::set1(ray.origin.x), oy = V::set1(ray.origin.y), oz = V::set1(ray.origin.z);
+    F dx = V::set1(ray.dir.x), dy = V::set1(ray.dir.y), dz = V::set1(ray.dir.z);
+    for (int i = 0; i < N; i += V::W)
+        V::store(t + i, intsec_triangle<V>(ox, oy, oz, dx, dy, dz,
+            V::load(tris.ax + i), V::load(tris.ay + i), V::load(tris.az + i),
+            V::load(tris.e1x + i), V::load(tris.e1y + i), V::load(tris.e1z + i),
+            V::load(tris.e2x + i), V::load(tris.e2y + i), V::load(tris.e2z + i)));
+}
+
+template <class V, int N>
+void rayAABB(const Ray &ray, const AABBSoA<N> &boxes, float *t) {
+    using F = typename V::F;
+    F ox = V::set1(ray.origin.x), oy = V::set1(ray.origin.y), oz = V::set1(ray.origin.z);
+    F idx = V::set1(ray.invDir.x), idy = V::set1(ray.invDir.y), idz = V::set1(ray.invDir.z);
+    for (int i = 0; i < N; i += V::W)
+        V::store(t + i, intsec_AABB<V>(ox, oy, oz, idx, idy, idz,
+            V::load(boxes.minx + i), V::load(boxes.miny + i), V::load(boxes.minz + i),
+            V::load(boxes.maxx + i), V::load(boxes.maxy + i), V::load(boxes.maxz + i)));
+}
+
+template <class V, int N>
+void packetTriangle(const RayPacket<N> &rays, const vec3 &a, const vec3 &e1, const vec3 &e2, float *t) {
+    using F = typename V::F;
+    F ax = V::set1(a.x), ay = V::set1(a.y), az = V::set1(a.z);
+    F e1x = V::set1(e1.x), e1y = V::set1(e1.y), e1z = V::set1(e1.z);
+    F e2x = V::set1(e2.x), e2y = V::set1(e2.y), e2z = V::set1(e2.z);
+    for (int i = 0; i < N; i += V::W)
+        V::store(t + i, intsec_triangle<V>(
+            V::load(rays.ox + i), V::load(rays.oy + i), V::load(rays.oz + i),
+            V::load(rays.dx + i), V::load(rays.dy + i), V::load(rays.dz + i),
+            ax, ay, az, e1x, e1y, e1z, e2x, e2y, e2z));
+}
+
+template <class V, int N>
+void packetAABB(const RayPacket<N> &rays, const vec3 &bbmin, const vec3 &bbmax, float *t) {
+    using F = typename V::F;
+    F minx = V::set1(bbmin.x), miny = V::set1(bbmin.y), minz = V::set1(bbmin.z);
+    F maxx = V::set1(bbmax.x), maxy = V::set1(bbmax.y), maxz = V::set1(bbmax.z);
+    for (int i = 0; i < N; i += V::W)
+        V::store(t + i, intsec_AABB<V>(
+            V::load(rays.ox + i), V::load(rays.oy + i), V::load(rays.oz + i),
+            V::load(rays.idx + i), V::load(rays.idy + i), V::load(rays.idz + i),
+            minx, miny, minz, maxx, maxy, maxz));
+}
+
+template <class V>
+inline typename V::F squared_distance(const float *const *a, const float *const *b, size_t p, size_t q) {
+    using F = typename V::F;
+    F d0 = V::sub(V::load(a[0] + p), V::load(b[0] + q));
+    F d1 = V::sub(V::load(a[1] + p), V::load(b[1] + q));
+    F d2 = V::sub(V::load(a[2] + p), V::load(b[2] + q));
+    return V::add(V::add(V::mul(d0, d0), V::mul(d1, d1)), V::mul(d2, d2));
+}
+
+template <class V>
+void atrousRow(const AtrousPlanes &planes, const AtrousPass &pass, size_t offset, int count, float *const *out) {
+    using F = typename V::F;
+    const F ZERO = V::set1(0.0f), ONE = V::set1(1.0f);
+    const F C2 = V::set1(1.0f / 2.0f), C3 = V::set1(1.0f / 6.0f), C4 = V::set1(1.0f / 24.0f);
+    const F EPSILON = V::set1(ATROUS_DEPTH_EPSILON);
+    const F inv_sigma_color2 = V::set1(pass.inv_sigma_color2), inv_sigma_normal2 = V::set1(pass.inv_sigma_normal2);
+    const F inv_sigma_albedo2 = V::set1(pass.inv_sigma_albedo2), sigma_depth2 = V::set1(pass.sigma_depth2);
+
+    // the taps' offsets and kernel weights are the same for every pixel
+    ptrdiff_t taps[25];
+    float kernel[25];
+    for (int y = -2; y <= 2; y++)
+        for (int x = -2; x <= 2; x++) {
+            int tap = (y + 2) * 5 + x + 2;
+            taps[tap] = ((ptrdiff_t)y * planes.stride + x) * pass.step;
+            kernel[tap] = ATROUS_KERNEL[abs(x)] * ATROUS_KERNEL[abs(y)];
+        }
+
+    for (int i = 0; i < count; i += V::W) {
+        size_t p = offset + i;
+        F depth = V::load(planes.depth + p);
+        F inv_depth2 = V::div(ONE, V::add(V::mul(sigma_depth2, V::mul(depth, depth)), EPSILON));
+        F sum_r = ZERO, sum_g = ZERO, sum_b = ZERO, weight_sum = ZERO;
+        for (int tap = 0; tap < 25; tap++) {
+            size_t q = p + taps[tap];
+            F color_difference = V::mul(squared_distance<V>(planes.color, planes.color, p, q), inv_sigma_color2);
+            F normal_difference = V::mul(squared_distance<V>(planes.normal, planes.normal, p, q), inv_sigma_normal2);
+            F albedo_difference = V::mul(squared_distance<V>(planes.albedo, planes.albedo, p, q), inv_sigma_albedo2);
+            F dz = V::sub(depth, V::load(planes.depth + q));
+            F x = V::add(V::add(color_difference, normal_difference), V::add(albedo_difference, V::mul(V::mul(dz, dz), inv_depth2)));
+
+            // kernel * mask * atrous_edge_weight(x)
+            F x2 = V::mul(x, x);
+            F series = V::add(V::add(ONE, x), V::mul(x2, V::add(V::add(C2, V::mul(x, C3)), V::mul(x2, C4))));
+            F weight = V::div(V::mul(V::set1(kernel[tap]), V::load(planes.mask + q)), series);
+            sum_r = V::add(sum_r, V::mul(V::load(planes.color[0] + q), weight));
+            sum_g = V::add(sum_g, V::mul(V::load(planes.color[1] + q), weight));
+            sum_b = V::add(sum_b, V::mul(V::load(planes.color[2] + q), weight));
+            weight_sum = V::add(weight_sum, weight);
+        }
+        // the border's pixels have no taps inside the image, they are written as 0
+        F valid = V::gt(weight_sum, ZERO);
+        V::store(out[0] + p, V::select(valid, V::div(sum_r, weight_sum), ZERO));
+        V::store(out[1] + p, V::select(valid, V::div(sum_g, weight_sum), ZERO));
+        V::store(out[2] + p, V::select(valid, V::div(sum_b, weight_sum), ZERO));
+    }
+}
+
+} // namespace
@@ -0,0 +1,36 @@
+#include "simd.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+
+struct SSE2 {
+    static constexpr int W = 4;
+    using F = __m128;
+    static inline F load(const float *p) { return _mm_loadu_ps(p); }
+    static inline void store(float *p, F a) { _mm_storeu_ps(p, a); }
+    static inline F set1(float f) { return _mm_set1_ps(f); }
+    static inline F add(F a, F b) { return _mm_add_ps(a, b); }
+    static inline F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static inline F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static inline F div(F a, F b) { return _mm_div_ps(a, b); }
+    // _mm_min_ps(a,b) is a<b?a:b, std::min(a,b) is b<a?b:a, hence the swapped operands (matters for NaNs)
+    static inline F min(F a, F b) { return _mm_min_ps(b, a); }
+    static inline F max(F a, F b) { return _mm_max_ps(b, a); }
+    static inline F lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static inline F gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static inline F or_(F a, F b) { return _mm_or_ps(a, b); }
+    static inline F andnot(F a, F b) { return _mm_andnot_ps(b, a); }
+    static inline F select(F mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+};
+
+#include "simd_kernels.inl"
+
+const SimdKernels simd_kernels_sse2 = {
+    "sse2", 4,
+    rayTriangle<SSE2, 4>, rayTriangle<SSE2, 8>,
+    rayAABB<SSE2, 4>, rayAABB<SSE2, 8>,
+    packetTriangle<SSE2, 4>, packetTriangle<SSE2, 8>,
+    packetAABB<SSE2, 4>, packetAABB<SSE2, 8>,
+    atrousRow<SSE2>,
+};
+
+#endif
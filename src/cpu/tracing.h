@@ -0,0 +1,77 @@
+#ifndef _CPU_TRACING_H_
+#define _CPU_TRACING_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <glm/glm.hpp>
+using namespace glm;
+
+// C++ ports of the intersection routines in src/shaders/tracing.glsl.
+// Keep them in sync, the CPU tracer has to produce the same image as the GPU.
+
+struct Ray { vec3 origin; vec3 dir; vec3 invDir; };
+
+struct Hit { float dst; int triangle; int instance = -1; }; // triangle is -1 if nothing was hit, instance -1 outside instances
+
+/** The first surface a camera ray hits, which guides the denoiser, all zero on a miss. Port of Features. */
+struct Features { vec3 albedo = vec3(0.0f); vec3 normal = vec3(0.0f); float depth = 0.0f; };
+
+/** @return The sub-pixel position of a sample in [0,1]², sample 0 being the pixel center. Port of sample_jitter. */
+inline vec2 sample_jitter(uint32_t sample_index) {
+    return fract(0.5f + (float)sample_index * vec2(0.7548776662f, 0.5698402910f));
+}
+
+/** @return The distance at which the ray enters the box, 0 if it starts inside, -1 on a miss. */
+inline float intsec_rayAABB(const Ray &ray, const vec3 &bbmin, const vec3 &bbmax) {
+    vec3 t1 = (bbmin - ray.origin) * ray.invDir;
+    vec3 t2 = (bbmax - ray.origin) * ray.invDir;
+
+    vec3 tmin = min(t1, t2);
+    vec3 tmax = max(t1, t2);
+
+    float tNear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+    float tFar  = std::min(std::min(tmax.x, tmax.y), tmax.z);
+
+    if (tNear > tFar || tFar < 0)
+        return -1;
+
+    return std::max(tNear, 0.0f);
+}
+
+/** Möller-Trumbore with precomputed edges. @return The distance to the hit, -1 on a miss or backface. */
+inline float intsec_rayTriangleEdges(const Ray &ray, const vec3 &a, const vec3 &edge1, const vec3 &edge2) {
+    const float EPSILON = 0.0000001f;
+
+    vec3 h = cross(ray.dir, edge2);
+    float a_dot_h = dot(edge1, h);
+
+    if (a_dot_h < EPSILON) // parallel or backface
+        return -1;
+
+    float f = 1 / a_dot_h;
+    vec3 s = ray.origin - a;
+    float u = f * dot(s, h);
+
+    if (u < 0.0f || u > 1.0f)
+        return -1;
+
+    vec3 q = cross(s, edge1);
+    float v = f * dot(ray.dir, q);
+
+    if (v < 0.0f || u + v > 1.0f)
+        return -1;
+
+    float t = f * dot(edge2, q);
+
+    if (t > EPSILON)
+        return t;
+
+    return -1;
+}
+
+/** Möller-Trumbore. @return The distance to the hit, -1 on a miss or backface. */
+inline float intsec_rayTriangle(const Ray &ray, const vec3 &a, const vec3 &b, const vec3 &c) {
+    return intsec_rayTriangleEdges(ray, a, b - a, c - a);
+}
+
+#endif//_CPU_TRACING_H_
@@ -1,11 +1,31 @@
 #include "EngineContext.h"
 #include "Shader.h"
 #include "Camera.h"
+#include "Scene.h"
 #include "Time.h"
+#include "Profiler.h"
+#include "ShaderWatcher.h"
+#include "cpu/CPUTracer.h"
+#include "Framebuffer.h"
+#include "mesh/mesh_import.h"
+#include "scene_file.h"
+#include "JobSystem.h"
+#include "TripleBuffer.h"
+#include "ResolutionController.h"
+#include "WavefrontTracer.h"
+#include "SDFVolume.h"
+#include "Denoiser.h"
+#include "cpu/CPUDenoiser.h"
+#include "Reprojector.h"
 #include <memory>
+#include <atomic>
+#include <thread>
 #include <list>
+#include <vector>
+#include <chrono>
+#include <cstring>
 #include <SDL2/SDL.h>
-using std::unique_ptr, std::make_unique, std::move;
+using std::unique_ptr, std::make_unique, std::move, std::vector;
 
 constexpr const char *WINDOW_TITLE = "Shaded Window. Exciting stuff!";
 constexpr int WINDOW_POS_X   = 100;
@@ -18,67 +38,424 @@ constexpr int RENDERER_FLAGS = SDL_RENDERER_ACCELERATED;
 constexpr const char *SHADER_SOURCE_VERTEX   = "src/shaders/vertex.glsl";
 constexpr const char *SHADER_SOURCE_FRAGMENT = "src/shaders/fragment.glsl";
 
-constexpr float MOVESPEED = 0.02;
-constexpr float TURNSPEED = 0.5;
+constexpr float MOVESPEED = 1.86f;  // units per second
+constexpr float TURNSPEED = 46.5f;  // degrees per second
 constexpr float EXPECTED_DELTA_TIME = 0.016;
+constexpr uint64_t SIMULATION_STEP_NS = 8333333;        // the fixed timestep of the simulation, 120 steps per second
+constexpr uint64_t MAX_SIMULATION_LAG_NS = 250000000;   // the simulation skips ahead instead of catching up if it fell further behind
+constexpr float DEFAULT_FRAME_BUDGET_MS = 33.3f; // the frame time interactive sessions scale their resolution to hold
+constexpr float MIN_RENDER_SCALE = 0.25f;        // the smallest resolution frames are traced at, relative to the window's
+constexpr int DEFAULT_BOUNCES = 2;               // the bounces the wavefront path tracer follows after the camera ray
+constexpr float SDF_VOXEL_SIZE = 1.0f / 32.0f;   // the spacing of the samples SDF scenes are baked with
+constexpr float SDF_SHAPE_SIZE = 0.5f;           // the size of the shapes of an SDF scene, the original demo's
+constexpr float SDF_BOB_HEIGHT = 0.25f;          // how far the animated shape of an SDF scene moves up and down
 
-EngineContext context;
+EngineContext *context;
 Shader shader;
-Camera camera;
+constexpr float ANIMATION_TWIST = 1.5f; // the largest angle the top of an animated mesh is turned against its bottom
+
+// twists a mesh back and forth around the vertical axis through its center, the more the further up a vertex is
+struct Animation {
+    Mesh rest; // the mesh as loaded
+
+    // the triangles of the twisted mesh at a point in time, in the order of the rest mesh's
+    vector<Triangle> frame(float time) const {
+        AABB bounds = rest.bounds();
+        vec3 center = (bounds.min + bounds.max) * 0.5f;
+        float height = std::max(bounds.max.y - bounds.min.y, 1e-6f);
+        Mesh twisted = rest;
+        for (size_t i = 0; i < rest.vertex_count(); i++) {
+            float angle = sin(time) * ANIMATION_TWIST * (rest.y[i] - center.y) / height;
+            float x = rest.x[i] - center.x, z = rest.z[i] - center.z;
+            twisted.x[i] = center.x + x * cos(angle) - z * sin(angle);
+            twisted.z[i] = center.z + x * sin(angle) + z * cos(angle);
+        }
+        return twisted.to_triangles();
+    }
+};
+
+// an SDF scene, the brick map baked from it and its copy on the GPU
+struct SDFState {
+    SDFScene scene;
+    BrickMap map;
+    SDFVolume volume;
+    bool animated = false;     // bob a shape up and down, rebaking the cells it passes
+    uint32_t bobbing = 0;      // the shape that moves
+    vec3 rest = vec3(0.0f);    // where it rests
+    int rebakes = 0;           // the rebakes so far, with their total time and bricks
+    double rebake_seconds = 0.0;
+    uint64_t rebaked_bricks = 0;
+};
+
+// the snapshot the simulation hands the renderer after every step
+struct FrameState {
+    CameraState camera; // the view to render
+    float time = 0.0f;  // the simulated time in seconds, which poses an animated mesh
+};
+
 struct init_result { 
     bool success;
     unique_ptr<EngineContext> context_ptr;
     unique_ptr<Shader> shader_ptr;
     unique_ptr<Camera> camera_ptr;
+    unique_ptr<Scene> scene_ptr;
+    unique_ptr<Animation> animation_ptr;
+    unique_ptr<WavefrontTracer> wavefront_ptr;
+    unique_ptr<SDFState> sdf_ptr;
+    unique_ptr<Denoiser> denoiser_ptr;
+    unique_ptr<Reprojector> reprojector_ptr;
 };
-init_result init() {
+
+struct options {
+    bool headless = false;        // render into an offscreen target instead of a window
+    bool cpu = false;             // render with the CPU tracer, implies headless
+    int width = WINDOW_SIZE_W;    // the size of the headless render target
+    int height = WINDOW_SIZE_H;
+    int frames = 1;               // the number of frames to render headless
+    const char *output = nullptr; // the PPM file the last headless frame is written to
+    const char *profile = nullptr; // the CSV or Chrome trace (.json) file the profile is written to on exit
+    const char *mesh = nullptr;   // the OBJ or PLY file to render instead of the default triangle
+    int instances = 0;            // the number of copies of the mesh to place on a grid, 0 to render it once without instancing
+    bool animate = false;         // twist the mesh every frame, refitting its BVH, or bob a shape of the SDF scene
+    const char *scene = nullptr;  // the binary scene file (see scene_file.h) to render instead of the default triangle
+    BVHLayout bvh_layout = BVH_LAYOUT_STANDARD; // the memory layout of the acceleration structure the tracers traverse
+    BVHBuilder builder = BVH_BUILDER_SAH;        // the algorithm the mesh's BVH is built with
+    bool pin_threads = false;     // pin the JobSystem's workers to their own cores
+    float frame_budget = -1.0f;   // the frame time in ms the resolution is scaled to hold, 0 for full resolution, negative for the default
+    bool wavefront = false;       // path trace with the compute kernels instead of the fragment kernel
+    int bounces = -1;             // the bounces the wavefront or CPU path tracer follows, negative for the default
+    RayOrder ray_order = RAY_ORDER_DEPTH_FIRST; // the order the CPU tracer follows the bounces in
+    int sdf = 0;                  // the number of shapes of an SDF scene to sphere trace instead of triangles, 0 for none
+    bool denoise = false;         // filter the average with the à-trous denoiser, guided by the tracers' features
+    bool temporal = false;        // reproject the average into the new view when the camera moves instead of restarting it
+    float turn = 0.0f;            // the degrees the camera turns by after every headless frame
+};
+
+bool parse_layout(const char *name, BVHLayout &layout) {
+    if (strcmp(name, "standard") == 0)
+        layout = BVH_LAYOUT_STANDARD;
+    else if (strcmp(name, "compressed") == 0)
+        layout = BVH_LAYOUT_COMPRESSED;
+    else
+        return false;
+    return true;
+}
+
+bool parse_builder(const char *name, BVHBuilder &builder) {
+    if (strcmp(name, "sah") == 0)
+        builder = BVH_BUILDER_SAH;
+    else if (strcmp(name, "lbvh") == 0)
+        builder = BVH_BUILDER_LBVH;
+    else if (strcmp(name, "lbvh-treelets") == 0)
+        builder = BVH_BUILDER_LBVH_TREELETS;
+    else
+        return false;
+    return true;
+}
+
+bool parse_ray_order(const char *name, RayOrder &order) {
+    if (strcmp(name, "depth-first") == 0)
+        order = RAY_ORDER_DEPTH_FIRST;
+    else if (strcmp(name, "breadth-first") == 0)
+        order = RAY_ORDER_BREADTH_FIRST;
+    else if (strcmp(name, "sorted") == 0)
+        order = RAY_ORDER_SORTED;
+    else
+        return false;
+    return true;
+}
+
+bool parse_options(int argc, char *argv[], options &opts) {
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0)
+            opts.headless = true;
+        else if (strcmp(argv[i], "--cpu") == 0)
+            opts.headless = opts.cpu = true;
+        else if (strcmp(argv[i], "--size") == 0 && has_value && sscanf(argv[++i], "%dx%d", &opts.width, &opts.height) == 2 && opts.width > 0 && opts.height > 0)
+            continue;
+        else if (strcmp(argv[i], "--frames") == 0 && has_value && sscanf(argv[++i], "%d", &opts.frames) == 1 && opts.frames > 0)
+            continue;
+        else if (strcmp(argv[i], "--output") == 0 && has_value)
+            opts.output = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0 && has_value)
+            opts.profile = argv[++i];
+        else if (strcmp(argv[i], "--mesh") == 0 && has_value)
+            opts.mesh = argv[++i];
+        else if (strcmp(argv[i], "--scene") == 0 && has_value)
+            opts.scene = argv[++i];
+        else if (strcmp(argv[i], "--instances") == 0 && has_value && sscanf(argv[++i], "%d", &opts.instances) == 1 && opts.instances > 0)
+            continue;
+        else if (strcmp(argv[i], "--bvh") == 0 && has_value && parse_layout(argv[++i], opts.bvh_layout))
+            continue;
+        else if (strcmp(argv[i], "--builder") == 0 && has_value && parse_builder(argv[++i], opts.builder))
+            continue;
+        else if (strcmp(argv[i], "--pin-threads") == 0)
+            opts.pin_threads = true;
+        else if (strcmp(argv[i], "--animate") == 0)
+            opts.animate = true;
+        else if (strcmp(argv[i], "--wavefront") == 0)
+            opts.wavefront = true;
+        else if (strcmp(argv[i], "--bounces") == 0 && has_value && sscanf(argv[++i], "%d", &opts.bounces) == 1 && opts.bounces >= 0)
+            continue;
+        else if (strcmp(argv[i], "--ray-order") == 0 && has_value && parse_ray_order(argv[++i], opts.ray_order))
+            continue;
+        else if (strcmp(argv[i], "--sdf") == 0 && has_value && sscanf(argv[++i], "%d", &opts.sdf) == 1 && opts.sdf > 0)
+            continue;
+        else if (strcmp(argv[i], "--denoise") == 0)
+            opts.denoise = true;
+        else if (strcmp(argv[i], "--temporal") == 0)
+            opts.temporal = true;
+        else if (strcmp(argv[i], "--turn") == 0 && has_value && sscanf(argv[++i], "%f", &opts.turn) == 1)
+            continue;
+        else if (strcmp(argv[i], "--frame-budget") == 0 && has_value && sscanf(argv[++i], "%f", &opts.frame_budget) == 1 && opts.frame_budget >= 0)
+            continue;
+        else {
+            fprintf(stderr, "Usage: %s [--headless] [--cpu] [--size WIDTHxHEIGHT] [--frames N] [--output image.ppm] [--profile profile.csv|trace.json] [--mesh model.obj|model.ply [--instances N | --animate] [--builder sah|lbvh|lbvh-treelets]] [--scene scene.rtxs] [--bvh standard|compressed] [--pin-threads] [--frame-budget MS] [--wavefront] [--bounces N] [--ray-order depth-first|breadth-first|sorted] [--sdf N [--animate]] [--denoise] [--temporal] [--turn DEGREES]\n", argv[0]);
+            return false;
+        }
+    }
+    if (opts.animate && opts.sdf == 0 && (opts.mesh == nullptr || opts.instances > 0)) {
+        fprintf(stderr, "--animate needs a --mesh that is not instanced, or --sdf\n");
+        return false;
+    }
+    if (opts.sdf > 0 && (opts.mesh || opts.scene)) {
+        fprintf(stderr, "--sdf replaces --mesh and --scene\n");
+        return false;
+    }
+    if (opts.sdf > 0 && (opts.cpu || opts.wavefront)) {
+        fprintf(stderr, "--sdf needs the GPU tracer without --wavefront\n");
+        return false;
+    }
+    if (opts.cpu && opts.wavefront) {
+        fprintf(stderr, "--wavefront needs the GPU tracer\n");
+        return false;
+    }
+    if (opts.cpu && opts.temporal) {
+        fprintf(stderr, "--temporal needs the GPU tracer\n");
+        return false;
+    }
+    if (opts.bounces >= 0 && !opts.wavefront && !opts.cpu) {
+        fprintf(stderr, "--bounces needs --wavefront or --cpu\n");
+        return false;
+    }
+    // the CPU tracer keeps shading like the fragment kernel unless asked to path trace
+    if (opts.bounces < 0)
+        opts.bounces = opts.cpu ? 0 : DEFAULT_BOUNCES;
+    if (opts.cpu && opts.frame_budget > 0) {
+        fprintf(stderr, "--frame-budget needs the GPU tracer\n");
+        return false;
+    }
+    // headless runs measure the full resolution unless asked to scale it
+    if (opts.frame_budget < 0)
+        opts.frame_budget = opts.headless ? 0.0f : DEFAULT_FRAME_BUDGET_MS;
+    return true;
+}
+
+vector<Triangle> default_geometry() {
+    return {{vec3(-0.5,-0.5,0.0),0, vec3(0.0,0.5,0.0),0, vec3(0.5,-0.5,0.0),0}};
+}
+
+// places copies of a mesh on a square grid facing the default camera, each turned further by the golden angle around y
+void place_instances(Scene &scene, uint32_t blas, int count) {
+    const AABB &bounds = scene.blas[blas].bounds;
+    vec3 center = (bounds.min + bounds.max) * 0.5f;
+    vec3 extent = bounds.max - bounds.min;
+    float spacing = std::max(length(vec2(extent.x, extent.z)), extent.y) * 1.1f; // the size of the mesh in any rotation, with a gap
+    int columns = (int)ceil(sqrt((float)count));
+    for (int i = 0; i < count; i++) {
+        float angle = (float)i * 2.39996323f;
+        mat3 rotation = mat3(vec3(cos(angle), 0.0f, -sin(angle)), vec3(0.0f, 1.0f, 0.0f), vec3(sin(angle), 0.0f, cos(angle)));
+        vec3 position = vec3((float)(i % columns), (float)(i / columns), 0.0f) * spacing;
+        scene.add_instance(blas, mat4x3(rotation[0], rotation[1], rotation[2], position - rotation * center));
+    }
+    scene.build_tlas();
+}
+
+// places shapes on a square grid facing the default camera, far enough apart not to touch
+void place_sdf_shapes(SDFScene &scene, int count) {
+    float spacing = SDF_SHAPE_SIZE * 3.0f;
+    int columns = (int)ceil(sqrt((float)count));
+    for (int i = 0; i < count; i++)
+        scene.shapes.push_back({vec3((float)(i % columns), (float)(i / columns), 0.0f) * spacing, SDF_SHAPE_SIZE});
+}
+
+// builds the SDF scene given on the command line and bakes it, the animated shape is the middle one
+unique_ptr<SDFState> create_sdf(const options &opts, Shader *shader) {
+    unique_ptr<SDFState> sdf = make_unique<SDFState>();
+    place_sdf_shapes(sdf->scene, opts.sdf);
+    sdf->animated = opts.animate;
+    sdf->bobbing = (uint32_t)opts.sdf / 2;
+    sdf->rest = sdf->scene.shapes[sdf->bobbing].center;
+
+    auto start = std::chrono::steady_clock::now();
+    sdf->map.bake(sdf->scene, SDF_VOXEL_SIZE);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const BrickMap &map = sdf->map;
+    printf("Baked %d SDF shapes: %u bricks in %ux%ux%u cells (%.1f%% occupied) in %.3fs\n", opts.sdf, map.brick_count(), map.size.x, map.size.y, map.size.z,
+           100.0 * map.brick_count() / (double)map.cells.size(), seconds);
+    if (!sdf->volume.upload(sdf->map))
+        return nullptr;
+    sdf->volume.attach(shader);
+    return sdf;
+}
+
+// loads the mesh or scene file given on the command line into the scene, or the default triangle without one
+bool load_geometry(const options &opts, Scene &scene, AABB &bounds, unique_ptr<Animation> &animation) {
+    if (opts.mesh == nullptr && opts.scene == nullptr) {
+        scene.set_geometry(default_geometry());
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    try {
+        if (opts.scene) {
+            loadSceneFile(opts.scene, scene);
+            printf("Loaded '%s': %zu triangles, %zu BVH nodes, %zu instances in %.3fs\n", opts.scene, scene.bvh.triangles.size(), scene.bvh.nodes.size(), scene.instances.size(), elapsed());
+            bounds = scene.bounds();
+        } else {
+            Mesh mesh = loadMesh(opts.mesh);
+            printf("Loaded '%s': %zu vertices, %zu triangles in %.3fs\n", opts.mesh, mesh.vertex_count(), mesh.triangle_count(), elapsed());
+            if (opts.instances > 0) {
+                place_instances(scene, scene.add_mesh(mesh, opts.builder), opts.instances);
+                printf("Placed %d instances at %.3fs\n", opts.instances, elapsed());
+                bounds = scene.bounds();
+            } else {
+                bounds = mesh.bounds();
+                scene.set_mesh(mesh, opts.builder);
+                printf("Built BVH: %zu nodes, SAH cost %.1f at %.3fs\n", scene.bvh.nodes.size(), scene.bvh.build_cost, elapsed());
+                if (opts.animate)
+                    animation = make_unique<Animation>(Animation{move(mesh)});
+            }
+        }
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+// moves the camera back along its view direction (+z) until the bounds fit its field of view
+void frame_bounds(Camera &camera, const AABB &bounds) {
+    vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius = length(bounds.max - bounds.min) * 0.5f;
+    float distance = radius / sin(radians(camera.get_fov()) * 0.5f);
+    camera.set_rotation(0.0f, 0.0f);
+    camera.set_position(center - vec3(0.0f, 0.0f, distance));
+}
+
+init_result init(const options &opts) {
     // initialize EngineContext
     unique_ptr<EngineContext> context_ptr = make_unique<EngineContext>();
-    if(!context_ptr->create(WINDOW_TITLE, WINDOW_POS_X,WINDOW_POS_Y, WINDOW_SIZE_W,WINDOW_SIZE_H, WINDOW_FLAGS, RENDERER_FLAGS))
-        return {false, nullptr, nullptr, nullptr};
+    bool created = opts.headless
+        ? context_ptr->create_headless(opts.width, opts.height)
+        : context_ptr->create(WINDOW_TITLE, WINDOW_POS_X,WINDOW_POS_Y, WINDOW_SIZE_W,WINDOW_SIZE_H, WINDOW_FLAGS, RENDERER_FLAGS);
+    if(!created)
+        return {false, nullptr, nullptr, nullptr, nullptr};
+
+    unique_ptr<Scene> scene_ptr = make_unique<Scene>();
+    scene_ptr->set_layout(opts.bvh_layout);
+    AABB bounds;
+    unique_ptr<Animation> animation_ptr;
+    if(!load_geometry(opts, *scene_ptr, bounds, animation_ptr))
+        return {false, nullptr, nullptr, nullptr, nullptr};
+
+    // the CPU tracer needs neither shaders nor GPU buffers
+    if(opts.cpu || !context_ptr->has_gl()) {
+        if(opts.sdf > 0) {
+            fprintf(stderr, "--sdf needs the GPU tracer\n");
+            return {false, nullptr, nullptr, nullptr, nullptr};
+        }
+        unique_ptr<Camera> camera_ptr = make_unique<Camera>();
+        if(opts.mesh || opts.scene)
+            frame_bounds(*camera_ptr, bounds);
+        return {true, move(context_ptr), nullptr, move(camera_ptr), move(scene_ptr), move(animation_ptr)};
+    }
 
     // initialize shader
     unique_ptr<Shader> shader_ptr = make_unique<Shader>();
     if(!shader_ptr->create(SHADER_SOURCE_VERTEX,SHADER_SOURCE_FRAGMENT))
-        return {false, nullptr, nullptr, nullptr};
+        return {false, nullptr, nullptr, nullptr, nullptr};
 
     unique_ptr<Camera> camera_ptr = make_unique<Camera>(context_ptr.get(), shader_ptr.get());
+    if(opts.mesh || opts.scene)
+        frame_bounds(*camera_ptr, bounds);
+
+    // upload the scene
+    scene_ptr->upload(shader_ptr.get());
+
+    // the compute kernels trace the scene uploaded for the fragment kernel
+    unique_ptr<WavefrontTracer> wavefront_ptr;
+    if(opts.wavefront) {
+        wavefront_ptr = make_unique<WavefrontTracer>();
+        if(!wavefront_ptr->create(scene_ptr.get(), (uint32_t)opts.bounces))
+            return {false, nullptr, nullptr, nullptr, nullptr};
+        camera_ptr->set_wavefront(wavefront_ptr.get());
+    }
+
+    // the fragment kernel sphere traces the SDF scene instead of the scene's triangles
+    unique_ptr<SDFState> sdf_ptr;
+    if(opts.sdf > 0) {
+        sdf_ptr = create_sdf(opts, shader_ptr.get());
+        if(!sdf_ptr)
+            return {false, nullptr, nullptr, nullptr, nullptr};
+        frame_bounds(*camera_ptr, sdf_ptr->scene.bounds());
+    }
+
+    // the average is filtered before it is shown, guided by the features the kernels average along with it
+    unique_ptr<Denoiser> denoiser_ptr;
+    if(opts.denoise) {
+        denoiser_ptr = make_unique<Denoiser>();
+        if(!denoiser_ptr->create(DenoiseSettings()))
+            return {false, nullptr, nullptr, nullptr, nullptr};
+        camera_ptr->set_denoiser(denoiser_ptr.get());
+    }
 
-    return {true, move(context_ptr), move(shader_ptr), move(camera_ptr)};
+    // moving the camera carries the average over to the new view, through the depth and normals the kernels average
+    unique_ptr<Reprojector> reprojector_ptr;
+    if(opts.temporal) {
+        reprojector_ptr = make_unique<Reprojector>();
+        if(!reprojector_ptr->create())
+            return {false, nullptr, nullptr, nullptr, nullptr};
+        camera_ptr->set_reprojector(reprojector_ptr.get());
+    }
+
+    return {true, move(context_ptr), move(shader_ptr), move(camera_ptr), move(scene_ptr), move(animation_ptr), move(wavefront_ptr), move(sdf_ptr), move(denoiser_ptr), move(reprojector_ptr)};
 }
 
 const Uint8 *keyboard_state = SDL_GetKeyboardState(NULL);
 #define isKeyDown(KEY) keyboard_state[KEY]
 #define getAxis(KEYLOW,KEYHIGH) (keyboard_state[KEYHIGH] - keyboard_state[KEYLOW])
-bool loop(EngineContext *context) {
-    printf("%f|%f\n",(double)Time::delta(),Time::normaldelta());
+// handles the window's events, waiting at most timeout_ms for the first one, returns false once the window should close
+bool poll_events(EngineContext *context, int timeout_ms) {
     SDL_Event *event = &context->event;
     bool running = true;
-    while (SDL_PollEvent(event)) {
+    bool pending = SDL_WaitEventTimeout(event, timeout_ms) != 0;
+    while (pending) {
         switch (event->type) {
             case SDL_QUIT:
                 running = false;
                 break;
-            
-            case SDL_WINDOWEVENT:
-                if (event->window.event == SDL_WINDOWEVENT_RESIZED)
-                    glViewport(0, 0, event->window.data1, event->window.data2);
-                break;
-            
+
             // case SDL_MOUSEMOTION:
             //     camera.rotate_by_clamped(event->motion.yrel * 0.1, event->motion.xrel * 0.1);
             //     break;
 
             default:break;
         }
-
+        pending = SDL_PollEvent(event) != 0;
     }
 
     if(isKeyDown(SDL_SCANCODE_ESCAPE))
         running = false;
+    return running;
+}
 
-    GLfloat dpitch = -getAxis(SDL_SCANCODE_DOWN,SDL_SCANCODE_UP) * TURNSPEED * Time::normaldelta();
-    GLfloat dyaw = getAxis(SDL_SCANCODE_LEFT,SDL_SCANCODE_RIGHT) * TURNSPEED * Time::normaldelta();
+// advances the camera by one simulation step, moving it with the keys held down
+void simulate(Camera &camera, float seconds) {
+    GLfloat dpitch = -getAxis(SDL_SCANCODE_DOWN,SDL_SCANCODE_UP) * TURNSPEED * seconds;
+    GLfloat dyaw = getAxis(SDL_SCANCODE_LEFT,SDL_SCANCODE_RIGHT) * TURNSPEED * seconds;
     if(dpitch != 0 || dyaw != 0)
         camera.rotate_by_clamped(dpitch,dyaw);
 
@@ -88,22 +465,267 @@ bool loop(EngineContext *context) {
     vec3 dmove = vec3(dx,dy,dz);
     if(length(dmove) > 1)
         dmove = normalize(dmove);
-    camera.move_by_local(dmove * MOVESPEED * Time::normaldelta());
+    if(dx != 0 || dy != 0 || dz != 0)
+        camera.move_by_local(dmove * MOVESPEED * seconds);
+}
 
-    return running;
+// moves the animated shape of an SDF scene to its position at a point in time, rebaking only the cells it affects.
+// Returns false if the rebaked map no longer fits the GPU
+bool animate_sdf(SDFState &sdf, float time) {
+    PROFILE_SCOPE("rebake_sdf");
+    auto start = std::chrono::steady_clock::now();
+    AABB changed = sdf.scene.influence(sdf.bobbing);
+    sdf.scene.shapes[sdf.bobbing].center = sdf.rest + vec3(0.0f, sin(time) * SDF_BOB_HEIGHT, 0.0f);
+    changed.grow(sdf.scene.influence(sdf.bobbing));
+    sdf.map.rebake(sdf.scene, changed);
+    sdf.rebaked_bricks += sdf.map.changed_bricks.size();
+    bool uploaded = sdf.volume.upload(sdf.map);
+    sdf.rebake_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sdf.rebakes++;
+    return uploaded;
+}
+
+// moves an animated mesh to its pose at a point in time, the CPU tracer (if any) picks up the refitted BVH
+void animate(init_result &inited, float time, CPUTracer *tracer) {
+    if (inited.sdf_ptr && inited.sdf_ptr->animated) {
+        // a map that outgrew the GPU's 3D textures stays at the last pose that fit
+        if (!animate_sdf(*inited.sdf_ptr, time)) {
+            fprintf(stderr, "Stopped animating the SDF scene\n");
+            inited.sdf_ptr->animated = false;
+        }
+        inited.camera_ptr->invalidate();
+        return;
+    }
+    if (!inited.animation_ptr)
+        return;
+    PROFILE_SCOPE("animate");
+    inited.scene_ptr->update_geometry(inited.animation_ptr->frame(time));
+    inited.camera_ptr->invalidate();
+    if (tracer)
+        tracer->refit();
+}
+
+// measures the frame that just finished and sets the resolution the next one is traced at, if it is scaled
+void scale_resolution(ResolutionController *controller, Camera &camera) {
+    Time::step();
+    if (controller)
+        camera.set_render_scale(controller->update(Time::delta_ns()));
+}
+
+// renders a fixed number of frames without a window, reports the throughput and writes the last frame
+int run_headless(init_result &inited, const options &opts) {
+    Framebuffer framebuffer(opts.width, opts.height);
+    unique_ptr<CPUTracer> tracer = inited.shader_ptr ? nullptr : make_unique<CPUTracer>(inited.scene_ptr.get());
+    if (tracer && opts.cpu) {
+        tracer->set_bounces((uint32_t)opts.bounces);
+        tracer->set_ray_order(opts.ray_order);
+        if (opts.denoise)
+            framebuffer.enable_features();
+    }
+    unique_ptr<ResolutionController> controller = opts.frame_budget > 0 && !tracer ? make_unique<ResolutionController>(opts.frame_budget, MIN_RENDER_SCALE) : nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+    int rebuilds = 0;
+    Time::step();
+    for (int i = 0; i < opts.frames; i++) {
+        animate(inited, (float)i * EXPECTED_DELTA_TIME, tracer.get());
+        if (i > 0 && opts.turn != 0.0f)
+            inited.camera_ptr->rotate_by(0.0f, opts.turn);
+        if (tracer) {
+            PROFILE_SCOPE("cpu_trace");
+            tracer->render(*inited.camera_ptr, framebuffer);
+        } else {
+            inited.scene_ptr->bind();
+            if (inited.sdf_ptr)
+                inited.sdf_ptr->volume.bind();
+            inited.camera_ptr->render();
+            // nothing presents a headless frame, so wait for it to be traced before measuring it
+            if (controller)
+                glFinish();
+        }
+        if (inited.scene_ptr->end_frame()) {
+            rebuilds++;
+            if (tracer)
+                tracer->update();
+        }
+        scale_resolution(controller.get(), *inited.camera_ptr);
+        Profiler::end_frame();
+    }
+    if (!tracer)
+        glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // path tracing on the CPU traces more rays than there are pixels
+    double rays = tracer ? (double)tracer->get_stats().rays : (double)opts.frames * opts.width * opts.height;
+    printf("%s: %d frames at %dx%d in %.3fs, %.2f Mrays/s\n", tracer ? "CPU" : inited.wavefront_ptr ? "GPU wavefront" : "GPU", opts.frames, opts.width, opts.height, seconds, rays / seconds / 1e6);
+    if (tracer) {
+        // the compressed layout is always traversed as the binary tree it encodes
+        CPUTracer::TraversalStats stats = tracer->get_stats();
+        int width = inited.scene_ptr->layout == BVH_LAYOUT_COMPRESSED ? 2 : tracer->get_bvh_width();
+        printf("CPU: %s kernels, %d wide BVH, %.2f node visits per ray\n", tracer->get_isa(), width, (double)stats.node_visits / (double)stats.rays);
+        // a ray fetches as many nodes in any order, but nodes a packet visits are fetched once for all its rays,
+        // and a sorted batch's rays mostly fetch the same lines
+        if (stats.secondary_rays > 0) {
+            const char *orders[] = {"depth-first", "breadth-first", "sorted"};
+            printf("CPU: %u bounces %s, %.2f node fetches per secondary ray, %.0f%% in packets", tracer->get_bounces(), orders[tracer->get_ray_order()],
+                   (double)stats.secondary_node_visits / (double)stats.secondary_rays, 100.0 * (double)stats.packet_rays / (double)stats.secondary_rays);
+            if (!tracer->traces_packets() && !inited.scene_ptr->is_instanced())
+                printf(" (packets need RTX_BVH_WIDTH=2)");
+            if (stats.batches > 0)
+                printf(", %.1f rays and %.0f distinct node cache lines per batch", (double)stats.secondary_rays / (double)stats.batches,
+                       (double)stats.batch_node_lines / (double)stats.batches);
+            printf("\n");
+        }
+    }
+    if (controller)
+        printf("Render scale: %.2f for a %.1f ms frame budget\n", controller->get_scale(), opts.frame_budget);
+    if (inited.sdf_ptr && inited.sdf_ptr->rebakes > 0) {
+        const SDFState &sdf = *inited.sdf_ptr;
+        printf("SDF: %d rebakes, %.2f ms and %.0f bricks each, %u bricks now\n", sdf.rebakes, sdf.rebake_seconds * 1e3 / sdf.rebakes,
+               (double)sdf.rebaked_bricks / sdf.rebakes, sdf.map.brick_count());
+    }
+    if (inited.animation_ptr) {
+        const BVH &bvh = inited.scene_ptr->bvh;
+        printf("Animated: %d BVH rebuilds, SAH cost %.1f, %.2fx its build cost\n", rebuilds, bvh.sah_cost(0, (uint32_t)bvh.nodes.size()), bvh.sah_cost(0, (uint32_t)bvh.nodes.size()) / bvh.build_cost);
+    }
+
+    // the GPU filters every frame before it is shown, the CPU only the frame that is written
+    Framebuffer denoised;
+    if (tracer && opts.denoise) {
+        CPUDenoiser denoiser{DenoiseSettings()};
+        auto denoise_start = std::chrono::steady_clock::now();
+        denoiser.denoise(framebuffer, denoised);
+        double denoise_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - denoise_start).count();
+        printf("CPU: denoised in %.2f ms\n", denoise_seconds * 1e3);
+    }
+
+    if (opts.output == nullptr)
+        return 0;
+    if (!tracer)
+        inited.context_ptr->read_pixels(framebuffer);
+    return (tracer && opts.denoise ? denoised : framebuffer).write_ppm(opts.output) ? 0 : 1;
+}
+
+// renders the latest snapshot of the simulation until running is cleared, on its own thread that owns the OpenGL context,
+// so a slow frame never holds up the input or the simulation
+void render_loop(init_result &inited, const options &opts, TripleBuffer<FrameState> &frames, std::atomic<bool> &running) {
+    EngineContext *context = inited.context_ptr.get();
+    Camera *camera = inited.camera_ptr.get();
+    if (!context->make_current(true)) {
+        running = false;
+        return;
+    }
+
+    // rebuild the shaders when their sources are edited
+    ShaderWatcher watcher;
+    if (watcher.create()) {
+        watcher.watch(inited.shader_ptr.get());
+        if (inited.wavefront_ptr)
+            for (Shader *kernel : inited.wavefront_ptr->get_shaders())
+                watcher.watch(kernel);
+        if (inited.denoiser_ptr)
+            watcher.watch(inited.denoiser_ptr->get_shader());
+        if (inited.reprojector_ptr)
+            watcher.watch(inited.reprojector_ptr->get_shader());
+    }
+
+    // trace at the resolution that holds the frame budget, upscaled to the window
+    unique_ptr<ResolutionController> controller = opts.frame_budget > 0 ? make_unique<ResolutionController>(opts.frame_budget, MIN_RENDER_SCALE) : nullptr;
+
+    float time = 0.0f;
+    int width = 0, height = 0;
+    Time::step();
+    while (running.load()) {
+        frames.update();
+        const FrameState &frame = frames.front_buffer();
+        {
+            PROFILE_SCOPE("shader_reload");
+            watcher.poll();
+        }
+        if (frame.time != time) {
+            time = frame.time;
+            animate(inited, time, nullptr);
+        }
+        camera->set_state(frame.camera);
+
+        int new_width, new_height;
+        context->get_size(&new_width, &new_height);
+        if (new_width != width || new_height != height) {
+            width = new_width;
+            height = new_height;
+            glViewport(0, 0, width, height);
+        }
+
+        inited.scene_ptr->bind();
+        if (inited.sdf_ptr)
+            inited.sdf_ptr->volume.bind();
+        camera->render();
+        inited.scene_ptr->end_frame();
+        scale_resolution(controller.get(), *camera);
+        Profiler::end_frame();
+    }
+    context->make_current(false);
+}
+
+// prints the frame phase percentiles and writes the recorded events, if profiling is enabled
+void finish_profile(const init_result &inited, const options &opts) {
+    if (!Profiler::enabled())
+        return;
+    if (inited.context_ptr->has_gl())
+        Profiler::finish();
+    Profiler::report(stdout);
+    Profiler::dump(opts.profile);
 }
 
 int main(int argc, char *argv[]) {
-    init_result inited = init();
+    options opts;
+    if (!parse_options(argc, argv, opts)) return 1;
+    Profiler::enable(opts.profile != nullptr);
+    if (opts.pin_threads)
+        JobSystem::get().pin_threads();
+
+    init_result inited = init(opts);
     if (!inited.success) return 1;
 
-    context = *inited.context_ptr;
-    camera = *inited.camera_ptr;
+    if (opts.headless) {
+        int status = run_headless(inited, opts);
+        finish_profile(inited, opts);
+        return status;
+    }
+
+    // the renderer takes over the OpenGL context, this thread keeps the window's events and simulates at a fixed rate
+    context = inited.context_ptr.get();
+    Camera simulated;
+    simulated.set_state(inited.camera_ptr->get_state());
+    TripleBuffer<FrameState> frames;
+    frames.write({simulated.get_state(), 0.0f});
+    std::atomic<bool> running{context->make_current(false)};
+    std::thread renderer(render_loop, std::ref(inited), std::cref(opts), std::ref(frames), std::ref(running));
 
-    bool running = true;
-    while(running) {
-        Time::step();
-        running = loop(&context);
-        camera.render();
+    uint64_t steps = 0;
+    uint64_t next_step = Time::now_ns();
+    while (running.load()) {
+        uint64_t now = Time::now_ns();
+        int timeout_ms = next_step > now ? (int)((next_step - now + 999999) / 1000000) : 0;
+        if (!poll_events(context, timeout_ms))
+            running = false;
+
+        // run the steps that are due, or skip them after a stall rather than racing through them
+        now = Time::now_ns();
+        if (now > next_step + MAX_SIMULATION_LAG_NS)
+            next_step = now;
+        if (now < next_step)
+            continue;
+        while (next_step <= now) {
+            simulate(simulated, SIMULATION_STEP_NS / 1e9f);
+            steps++;
+            next_step += SIMULATION_STEP_NS;
+        }
+        frames.write({simulated.get_state(), (float)(steps * SIMULATION_STEP_NS / 1e9)});
     }
+    renderer.join();
+
+    // the context is needed again to read the GPU timings and to free the GPU resources
+    context->make_current(true);
+    finish_profile(inited, opts);
 }
@@ -0,0 +1,38 @@
+#include "Mesh.h"
+#include "../parallel.h"
+#include <algorithm>
+#include <vector>
+using std::vector;
+
+constexpr size_t BLOCK_SIZE = 1 << 16; // the elements per parallel task
+
+AABB Mesh::bounds() const {
+    uint32_t blocks = (uint32_t)((vertex_count() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    vector<AABB> block_bounds(blocks);
+    parallel_for(blocks, [&](uint32_t block) {
+        size_t end = std::min((block + 1) * BLOCK_SIZE, vertex_count());
+        for (size_t i = block * BLOCK_SIZE; i < end; i++)
+            block_bounds[block].grow(vertex((uint32_t)i));
+    });
+
+    AABB result;
+    for (const AABB &bounds : block_bounds)
+        result.grow(bounds);
+    return result;
+}
+
+vector<Triangle> Mesh::to_triangles() const {
+    vector<Triangle> triangles(triangle_count());
+    uint32_t blocks = (uint32_t)((triangles.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    parallel_for(blocks, [&](uint32_t block) {
+        size_t end = std::min((block + 1) * BLOCK_SIZE, triangles.size());
+        for (size_t i = block * BLOCK_SIZE; i < end; i++) {
+            Triangle &tri = triangles[i];
+            tri.a = vertex(indices[3 * i + 0]);
+            tri.b = vertex(indices[3 * i + 1]);
+            tri.c = vertex(indices[3 * i + 2]);
+            tri._pad0 = tri._pad1 = tri._pad2 = 0;
+        }
+    });
+    return triangles;
+}
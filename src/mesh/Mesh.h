@@ -0,0 +1,24 @@
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#include <cstdint>
+#include <vector>
+#include "../bvh/BVH.h"
+
+/** An indexed triangle mesh with its vertex positions stored as structure of arrays. */
+struct Mesh {
+    std::vector<float> x, y, z;    /** The vertex positions, one array per component. */
+    std::vector<uint32_t> indices; /** Three vertex indices per triangle. */
+
+    inline size_t vertex_count() const { return x.size(); }
+    inline size_t triangle_count() const { return indices.size() / 3; }
+    inline vec3 vertex(uint32_t index) const { return vec3(x[index], y[index], z[index]); }
+
+    /** @return The bounding box of all vertices. */
+    AABB bounds() const;
+
+    /** @return The triangles of the mesh, in the layout the BVH and the tracers use. */
+    std::vector<Triangle> to_triangles() const;
+};
+
+#endif//_MESH_H_
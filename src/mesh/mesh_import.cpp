@@ -0,0 +1,643 @@
+#include "mesh_import.h"
+#include "../MappedFile.h"
+#include "../parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using std::string, std::vector;
+
+constexpr size_t OBJ_CHUNK_SIZE = 4 << 20; // the bytes of an OBJ file parsed per task, cut at line ends
+constexpr size_t BLOCK_SIZE = 1 << 16;     // the vertices, faces or indices per task
+constexpr uint32_t DEDUP_BUCKETS = 256;    // the hash partitions vertices are deduplicated in independently
+
+uint32_t block_count(size_t count) { return (uint32_t)((count + BLOCK_SIZE - 1) / BLOCK_SIZE); }
+
+// calls fn(begin, end) for consecutive ranges of BLOCK_SIZE indices in parallel
+template <typename F>
+void parallel_blocks(size_t count, F fn) {
+    parallel_for(block_count(count), [&](uint32_t block) {
+        fn(block * BLOCK_SIZE, std::min((block + 1) * BLOCK_SIZE, count));
+    });
+}
+
+// the 1 based number of the line containing a byte, only used for error messages
+size_t line_number(const char *data, size_t offset) {
+    return std::count(data, data + offset, '\n') + 1;
+}
+
+[[noreturn]] void throw_at(const string &message, const string &filepath, const char *data, size_t offset) {
+    throw std::runtime_error(message + " in file: '" + filepath + "' (line " + std::to_string(line_number(data, offset)) + ")");
+}
+
+//
+// OBJ
+//
+
+// the result of parsing a chunk of an OBJ file
+struct ObjChunk {
+    vector<float> x, y, z;
+    vector<uint32_t> indices; // 0 based, relative ones are patched once the vertices of the previous chunks are counted
+    vector<std::pair<size_t, int64_t>> relative; // (position in indices, index relative to the chunk's first vertex)
+    const char *error = nullptr; // the start of the first malformed line
+    const char *error_message;
+};
+
+inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && is_blank(*p))
+        p++;
+    return p;
+}
+
+inline const char *parse_float(const char *p, const char *end, float &value) {
+    p = skip_blanks(p, end);
+    if (p < end && *p == '+') // from_chars doesn't accept a plus sign
+        p++;
+    std::from_chars_result result = std::from_chars(p, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+// parses the v and f lines of [begin,end), which starts at a line start and ends after a line end or at the file end
+void parse_obj_chunk(const char *begin, const char *end, ObjChunk &chunk) {
+    vector<int64_t> polygon;
+    for (const char *line = begin; line < end; ) {
+        const char *line_end = (const char *)memchr(line, '\n', end - line);
+        line_end = line_end ? line_end : end;
+        const char *p = skip_blanks(line, line_end);
+
+        if (line_end - p >= 2 && p[0] == 'v' && is_blank(p[1])) {
+            float x, y, z;
+            p += 1;
+            if ((p = parse_float(p, line_end, x)) == nullptr
+                    || (p = parse_float(p, line_end, y)) == nullptr
+                    || (p = parse_float(p, line_end, z)) == nullptr) {
+                chunk.error = line;
+                chunk.error_message = "Invalid vertex";
+                return;
+            }
+            chunk.x.push_back(x);
+            chunk.y.push_back(y);
+            chunk.z.push_back(z);
+        } else if (line_end - p >= 2 && p[0] == 'f' && is_blank(p[1])) {
+            // every corner is v, v/vt, v/vt/vn or v//vn, only v is used
+            polygon.clear();
+            for (p = skip_blanks(p + 1, line_end); p < line_end; p = skip_blanks(p, line_end)) {
+                int64_t index;
+                std::from_chars_result result = std::from_chars(p, line_end, index);
+                if (result.ec != std::errc() || index == 0) {
+                    polygon.clear();
+                    break;
+                }
+                polygon.push_back(index);
+                for (p = result.ptr; p < line_end && !is_blank(*p); p++);
+            }
+            if (polygon.size() < 3) {
+                chunk.error = line;
+                chunk.error_message = "Invalid face";
+                return;
+            }
+
+            int64_t local_count = (int64_t)chunk.x.size();
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                for (int64_t index : {polygon[0], polygon[i], polygon[i + 1]}) {
+                    if (index > 0 && index <= UINT32_MAX) {
+                        chunk.indices.push_back((uint32_t)(index - 1));
+                    } else {
+                        // negative indices count back from the last vertex defined so far
+                        chunk.relative.push_back({chunk.indices.size(), index < 0 ? local_count + index : -INT64_MAX});
+                        chunk.indices.push_back(0);
+                    }
+                }
+            }
+        }
+        line = line_end + 1;
+    }
+}
+
+Mesh load_obj(const string &filepath, const char *data, size_t size) {
+    // cut the file into chunks at line ends
+    vector<size_t> bounds = {0};
+    for (size_t position = OBJ_CHUNK_SIZE; position < size; position += OBJ_CHUNK_SIZE) {
+        position = std::max(position, bounds.back());
+        const char *line_end = (const char *)memchr(data + position, '\n', size - position);
+        bounds.push_back(line_end ? line_end - data + 1 : size);
+    }
+    bounds.push_back(size);
+
+    vector<ObjChunk> chunks(bounds.size() - 1);
+    parallel_for((uint32_t)chunks.size(), [&](uint32_t i) {
+        parse_obj_chunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+    });
+    for (const ObjChunk &chunk : chunks)
+        if (chunk.error)
+            throw_at(chunk.error_message, filepath, data, chunk.error - data);
+
+    // the first vertex and index of every chunk in the mesh
+    vector<size_t> first_vertex(chunks.size() + 1, 0), first_index(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        first_vertex[i + 1] = first_vertex[i] + chunks[i].x.size();
+        first_index[i + 1] = first_index[i] + chunks[i].indices.size();
+    }
+    size_t vertex_count = first_vertex.back();
+    if (vertex_count > UINT32_MAX)
+        throw std::runtime_error("Too many vertices in file: '" + filepath + "'");
+
+    Mesh mesh;
+    mesh.x.resize(vertex_count);
+    mesh.y.resize(vertex_count);
+    mesh.z.resize(vertex_count);
+    mesh.indices.resize(first_index.back());
+
+    std::atomic<size_t> invalid_chunk{SIZE_MAX};
+    parallel_for((uint32_t)chunks.size(), [&](uint32_t i) {
+        ObjChunk &chunk = chunks[i];
+        for (const auto &[position, index] : chunk.relative) {
+            int64_t absolute = (int64_t)first_vertex[i] + index;
+            chunk.indices[position] = absolute >= 0 ? (uint32_t)absolute : UINT32_MAX;
+        }
+        for (uint32_t index : chunk.indices)
+            if (index >= vertex_count)
+                invalid_chunk = i;
+
+        std::copy(chunk.x.begin(), chunk.x.end(), mesh.x.begin() + first_vertex[i]);
+        std::copy(chunk.y.begin(), chunk.y.end(), mesh.y.begin() + first_vertex[i]);
+        std::copy(chunk.z.begin(), chunk.z.end(), mesh.z.begin() + first_vertex[i]);
+        std::copy(chunk.indices.begin(), chunk.indices.end(), mesh.indices.begin() + first_index[i]);
+        chunk = ObjChunk(); // free the chunk as soon as it is copied
+    });
+    if (invalid_chunk != SIZE_MAX)
+        throw std::runtime_error("Face references a missing vertex in file: '" + filepath + "'");
+    return mesh;
+}
+
+//
+// PLY
+//
+
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+const size_t PLY_TYPE_SIZE[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+PlyType get_plyType(const string &name) {
+    const char *names[][2] = {{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+                              {"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}};
+    for (int type = 0; type < PLY_INVALID; type++)
+        if (name == names[type][0] || name == names[type][1])
+            return (PlyType)type;
+    return PLY_INVALID;
+}
+
+struct PlyProperty {
+    string name;
+    PlyType type;
+    bool is_list = false;
+    PlyType count_type; // the type of a list's length
+};
+
+struct PlyElement {
+    string name;
+    size_t count;
+    vector<PlyProperty> properties;
+
+    // the bytes per record, 0 if it contains lists and the size varies
+    size_t fixed_stride() const {
+        size_t stride = 0;
+        for (const PlyProperty &property : properties) {
+            if (property.is_list)
+                return 0;
+            stride += PLY_TYPE_SIZE[property.type];
+        }
+        return stride;
+    }
+};
+
+// reads a value stored in the file's byte order
+template <typename T>
+inline T read_raw(const char *p, bool swap) {
+    T value;
+    if (!swap) {
+        memcpy(&value, p, sizeof(T));
+    } else {
+        char bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); i++)
+            bytes[i] = p[sizeof(T) - 1 - i];
+        memcpy(&value, bytes, sizeof(T));
+    }
+    return value;
+}
+
+inline double read_value(const char *p, PlyType type, bool swap) {
+    switch (type) {
+        case PLY_INT8:    return (int8_t)*p;
+        case PLY_UINT8:   return (uint8_t)*p;
+        case PLY_INT16:   return read_raw<int16_t>(p, swap);
+        case PLY_UINT16:  return read_raw<uint16_t>(p, swap);
+        case PLY_INT32:   return read_raw<int32_t>(p, swap);
+        case PLY_UINT32:  return read_raw<uint32_t>(p, swap);
+        case PLY_FLOAT32: return read_raw<float>(p, swap);
+        case PLY_FLOAT64: return read_raw<double>(p, swap);
+        default:          return 0;
+    }
+}
+
+// reads a vertex index, UINT32_MAX if it is negative or not integral
+inline uint32_t read_index(const char *p, PlyType type, bool swap) {
+    double value = read_value(p, type, swap);
+    return value >= 0 && value < UINT32_MAX && value == (uint32_t)value ? (uint32_t)value : UINT32_MAX;
+}
+
+// splits a header line at blanks
+vector<string> split(const char *begin, const char *end) {
+    vector<string> words;
+    for (const char *p = skip_blanks(begin, end); p < end; p = skip_blanks(p, end)) {
+        const char *word_end = p;
+        while (word_end < end && !is_blank(*word_end))
+            word_end++;
+        words.emplace_back(p, word_end);
+        p = word_end;
+    }
+    return words;
+}
+
+// parses the header, returns the offset of the body
+size_t parse_ply_header(const string &filepath, const char *data, size_t size, vector<PlyElement> &elements, bool &swap) {
+    bool has_format = false;
+    for (size_t position = 0; ; ) {
+        const char *line = data + position;
+        const char *line_end = (const char *)memchr(line, '\n', size - position);
+        if (line_end == nullptr)
+            throw std::runtime_error("Missing end_header in file: '" + filepath + "'");
+        position = line_end - data + 1;
+
+        vector<string> words = split(line, line_end);
+        if (line == data) {
+            if (words.size() != 1 || words[0] != "ply")
+                throw std::runtime_error("Not a PLY file: '" + filepath + "'");
+        } else if (words.empty() || words[0] == "comment" || words[0] == "obj_info") {
+            continue;
+        } else if (words[0] == "format" && words.size() >= 2) {
+            if (words[1] != "binary_little_endian" && words[1] != "binary_big_endian")
+                throw std::runtime_error("Unsupported PLY format '" + words[1] + "' in file: '" + filepath + "'");
+            // the machines this runs on are little endian
+            swap = words[1] == "binary_big_endian";
+            has_format = true;
+        } else if (words[0] == "element" && words.size() == 3) {
+            size_t count = 0;
+            const char *begin = words[2].data(), *end = begin + words[2].size();
+            std::from_chars_result result = std::from_chars(begin, end, count);
+            if (result.ec != std::errc() || result.ptr != end)
+                throw std::runtime_error("Invalid PLY element count '" + words[2] + "' in file: '" + filepath + "'");
+            elements.push_back({words[1], count, {}});
+        } else if (words[0] == "property" && !elements.empty() && words.size() == 3 && get_plyType(words[1]) != PLY_INVALID) {
+            elements.back().properties.push_back({words[2], get_plyType(words[1])});
+        } else if (words[0] == "property" && !elements.empty() && words.size() == 5 && words[1] == "list"
+                && get_plyType(words[2]) != PLY_INVALID && get_plyType(words[3]) != PLY_INVALID) {
+            // lengths are cast to sizes, which a NaN or a huge float doesn't survive
+            if (get_plyType(words[2]) >= PLY_FLOAT32)
+                throw std::runtime_error("Unsupported PLY list length type '" + words[2] + "' in file: '" + filepath + "'");
+            elements.back().properties.push_back({words[4], get_plyType(words[3]), true, get_plyType(words[2])});
+        } else if (words[0] == "end_header") {
+            if (!has_format)
+                throw std::runtime_error("Missing PLY format in file: '" + filepath + "'");
+            return position;
+        } else {
+            throw_at("Invalid PLY header", filepath, data, line - data);
+        }
+    }
+}
+
+// gets the offset of the record following the one at position, or SIZE_MAX if it overruns the file
+size_t skip_record(const PlyElement &element, const char *data, size_t size, size_t position, bool swap) {
+    for (const PlyProperty &property : element.properties) {
+        if (property.is_list) {
+            if (position + PLY_TYPE_SIZE[property.count_type] > size)
+                return SIZE_MAX;
+            double length = read_value(data + position, property.count_type, swap);
+            position += PLY_TYPE_SIZE[property.count_type] + (size_t)std::max(length, 0.0) * PLY_TYPE_SIZE[property.type];
+        } else {
+            position += PLY_TYPE_SIZE[property.type];
+        }
+        if (position > size)
+            return SIZE_MAX;
+    }
+    return position;
+}
+
+// gets the offset of a property in a record of fixed properties
+size_t property_offset(const PlyElement &element, const string &name) {
+    size_t offset = 0;
+    for (const PlyProperty &property : element.properties) {
+        if (property.name == name)
+            return offset;
+        offset += PLY_TYPE_SIZE[property.type];
+    }
+    return SIZE_MAX;
+}
+
+const PlyProperty *find_property(const PlyElement &element, const string &name) {
+    for (const PlyProperty &property : element.properties)
+        if (property.name == name)
+            return &property;
+    return nullptr;
+}
+
+// reads the vertex positions, returns the offset after the element
+size_t read_ply_vertices(const string &filepath, const char *data, size_t size, size_t position,
+                         const PlyElement &element, bool swap, Mesh &mesh) {
+    size_t stride = element.fixed_stride();
+    const PlyProperty *x = find_property(element, "x"), *y = find_property(element, "y"), *z = find_property(element, "z");
+    if (stride == 0 || !x || !y || !z || x->is_list || y->is_list || z->is_list)
+        throw std::runtime_error("Unsupported PLY vertex properties in file: '" + filepath + "'");
+    if (element.count > UINT32_MAX)
+        throw std::runtime_error("Too many vertices in file: '" + filepath + "'");
+    if (element.count > (size - position) / stride)
+        throw std::runtime_error("Unexpected end of file: '" + filepath + "'");
+
+    size_t offsets[3] = {property_offset(element, "x"), property_offset(element, "y"), property_offset(element, "z")};
+    PlyType types[3] = {x->type, y->type, z->type};
+    mesh.x.resize(element.count);
+    mesh.y.resize(element.count);
+    mesh.z.resize(element.count);
+    float *components[3] = {mesh.x.data(), mesh.y.data(), mesh.z.data()};
+
+    const char *body = data + position;
+    parallel_blocks(element.count, [&](size_t begin, size_t end) {
+        for (int axis = 0; axis < 3; axis++) {
+            const char *p = body + offsets[axis];
+            float *component = components[axis];
+            if (types[axis] == PLY_FLOAT32 && !swap) {
+                for (size_t i = begin; i < end; i++)
+                    memcpy(&component[i], p + i * stride, sizeof(float));
+            } else {
+                for (size_t i = begin; i < end; i++)
+                    component[i] = (float)read_value(p + i * stride, types[axis], swap);
+            }
+        }
+    });
+    return position + element.count * stride;
+}
+
+// reads and triangulates the faces, returns the offset after the element
+size_t read_ply_faces(const string &filepath, const char *data, size_t size, size_t position,
+                      const PlyElement &element, bool swap, Mesh &mesh) {
+    const PlyProperty *list = find_property(element, "vertex_indices");
+    list = list ? list : find_property(element, "vertex_index");
+    if (list == nullptr || !list->is_list)
+        throw std::runtime_error("Missing PLY face vertex_indices in file: '" + filepath + "'");
+
+    size_t vertex_count = mesh.vertex_count();
+    size_t count_size = PLY_TYPE_SIZE[list->count_type], index_size = PLY_TYPE_SIZE[list->type];
+
+    // if the index list is the only list and every face is a triangle, the records have a fixed stride
+    // any record takes at least the bytes of a triangle and empty other lists
+    size_t stride = 0, list_offset = 0, minimum_size = 0;
+    bool fixed = true;
+    for (const PlyProperty &property : element.properties) {
+        if (&property == list) {
+            list_offset = stride;
+            stride += count_size + 3 * index_size;
+            minimum_size += count_size + 3 * index_size;
+        } else {
+            fixed = fixed && !property.is_list;
+            stride += PLY_TYPE_SIZE[property.type];
+            minimum_size += PLY_TYPE_SIZE[property.is_list ? property.count_type : property.type];
+        }
+    }
+    if (element.count > (size - position) / minimum_size)
+        throw std::runtime_error("Unexpected end of file: '" + filepath + "'");
+    const char *body = data + position;
+    if (fixed && element.count <= (size - position) / stride) {
+        std::atomic<bool> triangles{true};
+        parallel_blocks(element.count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end && triangles; i++)
+                if (read_value(body + i * stride + list_offset, list->count_type, swap) != 3)
+                    triangles = false;
+        });
+        fixed = triangles;
+    } else {
+        fixed = false;
+    }
+
+    if (fixed) {
+        mesh.indices.resize(3 * element.count);
+        std::atomic<bool> valid{true};
+        parallel_blocks(element.count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const char *p = body + i * stride + list_offset + count_size;
+                for (size_t corner = 0; corner < 3; corner++) {
+                    uint32_t index = read_index(p + corner * index_size, list->type, swap);
+                    valid = valid && index < vertex_count;
+                    mesh.indices[3 * i + corner] = index;
+                }
+            }
+        });
+        if (!valid)
+            throw std::runtime_error("Face references a missing vertex in file: '" + filepath + "'");
+        return position + element.count * stride;
+    }
+
+    // polygons or several lists, the records have to be walked one by one
+    mesh.indices.clear();
+    mesh.indices.reserve(3 * element.count);
+    for (size_t i = 0; i < element.count; i++) {
+        for (const PlyProperty &property : element.properties) {
+            if (&property != list) {
+                PlyElement single = {"", 1, {property}};
+                position = skip_record(single, data, size, position, swap);
+                if (position == SIZE_MAX)
+                    throw std::runtime_error("Unexpected end of file: '" + filepath + "'");
+                continue;
+            }
+            if (position + count_size > size)
+                throw std::runtime_error("Unexpected end of file: '" + filepath + "'");
+            double length = read_value(data + position, list->count_type, swap);
+            position += count_size;
+            if (length < 3 || position + (size_t)length * index_size > size)
+                throw std::runtime_error("Invalid PLY face " + std::to_string(i) + " in file: '" + filepath + "'");
+
+            const char *p = data + position;
+            uint32_t first = read_index(p, list->type, swap);
+            for (size_t corner = 1; corner + 1 < (size_t)length; corner++) {
+                uint32_t b = read_index(p + corner * index_size, list->type, swap);
+                uint32_t c = read_index(p + (corner + 1) * index_size, list->type, swap);
+                if (first >= vertex_count || b >= vertex_count || c >= vertex_count)
+                    throw std::runtime_error("Face references a missing vertex in file: '" + filepath + "'");
+                mesh.indices.insert(mesh.indices.end(), {first, b, c});
+            }
+            position += (size_t)length * index_size;
+        }
+    }
+    return position;
+}
+
+Mesh load_ply(const string &filepath, const char *data, size_t size) {
+    vector<PlyElement> elements;
+    bool swap = false;
+    size_t position = parse_ply_header(filepath, data, size, elements, swap);
+
+    Mesh mesh;
+    bool has_vertices = false, has_faces = false;
+    for (const PlyElement &element : elements) {
+        if (element.name == "vertex" && !has_vertices) {
+            position = read_ply_vertices(filepath, data, size, position, element, swap, mesh);
+            has_vertices = true;
+        } else if (element.name == "face" && !has_faces) {
+            if (!has_vertices)
+                throw std::runtime_error("PLY faces before vertices in file: '" + filepath + "'");
+            position = read_ply_faces(filepath, data, size, position, element, swap, mesh);
+            has_faces = true;
+        } else if (element.fixed_stride() > 0 && element.count <= (size - position) / element.fixed_stride()) {
+            position += element.count * element.fixed_stride();
+        } else {
+            for (size_t i = 0; i < element.count && position != SIZE_MAX; i++)
+                position = skip_record(element, data, size, position, swap);
+            if (position == SIZE_MAX)
+                throw std::runtime_error("Unexpected end of file: '" + filepath + "'");
+        }
+        if (has_vertices && has_faces)
+            break; // the rest of the file is of no interest
+    }
+    if (!has_vertices || !has_faces)
+        throw std::runtime_error("Missing PLY vertex or face element in file: '" + filepath + "'");
+    return mesh;
+}
+
+//
+// deduplication
+//
+
+inline uint32_t hash_position(float x, float y, float z) {
+    uint32_t bits[3];
+    memcpy(&bits[0], &x, 4);
+    memcpy(&bits[1], &y, 4);
+    memcpy(&bits[2], &z, 4);
+    uint64_t hash = (bits[0] * 0x9E3779B97F4A7C15ull) ^ (bits[1] * 0xC2B2AE3D27D4EB4Full) ^ (bits[2] * 0x165667B19E3779F9ull);
+    return (uint32_t)(hash >> 32);
+}
+
+void deduplicateVertices(Mesh &mesh) {
+    size_t count = mesh.vertex_count();
+    if (count == 0)
+        return;
+    const float *x = mesh.x.data(), *y = mesh.y.data(), *z = mesh.z.data();
+    auto bucket_of = [&](size_t i) { return hash_position(x[i], y[i], z[i]) >> 24; }; // the top 8 bits, DEDUP_BUCKETS
+
+    // partition the vertices into buckets by hash, each bucket in ascending vertex order
+    uint32_t blocks = block_count(count);
+    vector<uint32_t> offsets((size_t)blocks * DEDUP_BUCKETS, 0);
+    parallel_blocks(count, [&](size_t begin, size_t end) {
+        uint32_t *block_counts = &offsets[begin / BLOCK_SIZE * DEDUP_BUCKETS];
+        for (size_t i = begin; i < end; i++)
+            block_counts[bucket_of(i)]++;
+    });
+    vector<uint32_t> bucket_begin(DEDUP_BUCKETS + 1, 0);
+    uint32_t total = 0;
+    for (uint32_t bucket = 0; bucket < DEDUP_BUCKETS; bucket++) {
+        bucket_begin[bucket] = total;
+        for (uint32_t block = 0; block < blocks; block++) {
+            uint32_t block_count = offsets[block * DEDUP_BUCKETS + bucket];
+            offsets[block * DEDUP_BUCKETS + bucket] = total;
+            total += block_count;
+        }
+    }
+    bucket_begin[DEDUP_BUCKETS] = total;
+    vector<uint32_t> partitioned(count);
+    parallel_blocks(count, [&](size_t begin, size_t end) {
+        uint32_t *block_offsets = &offsets[begin / BLOCK_SIZE * DEDUP_BUCKETS];
+        for (size_t i = begin; i < end; i++)
+            partitioned[block_offsets[bucket_of(i)]++] = (uint32_t)i;
+    });
+
+    // find the first occurrence of every vertex's position, with an open addressing table per bucket
+    vector<uint32_t> first(count);
+    parallel_for(DEDUP_BUCKETS, [&](uint32_t bucket) {
+        uint32_t begin = bucket_begin[bucket], end = bucket_begin[bucket + 1];
+        size_t capacity = 16;
+        while (capacity < 2 * (size_t)(end - begin))
+            capacity *= 2;
+        vector<uint32_t> table(capacity, UINT32_MAX);
+        for (uint32_t j = begin; j < end; j++) {
+            uint32_t i = partitioned[j];
+            size_t slot = hash_position(x[i], y[i], z[i]) & (capacity - 1);
+            for (;; slot = (slot + 1) & (capacity - 1)) {
+                uint32_t other = table[slot];
+                if (other == UINT32_MAX) {
+                    table[slot] = first[i] = i;
+                    break;
+                }
+                if (memcmp(&x[i], &x[other], 4) == 0 && memcmp(&y[i], &y[other], 4) == 0 && memcmp(&z[i], &z[other], 4) == 0) {
+                    first[i] = other;
+                    break;
+                }
+            }
+        }
+    });
+
+    // number the kept vertices in order
+    vector<uint32_t> block_kept(blocks + 1, 0);
+    parallel_blocks(count, [&](size_t begin, size_t end) {
+        uint32_t kept = 0;
+        for (size_t i = begin; i < end; i++)
+            kept += first[i] == i;
+        block_kept[begin / BLOCK_SIZE + 1] = kept;
+    });
+    for (uint32_t block = 0; block < blocks; block++)
+        block_kept[block + 1] += block_kept[block];
+    if (block_kept[blocks] == count)
+        return;
+
+    // compact the positions and number the kept vertices, the partition isn't needed anymore
+    vector<uint32_t> &remap = partitioned;
+    Mesh result;
+    result.x.resize(block_kept[blocks]);
+    result.y.resize(block_kept[blocks]);
+    result.z.resize(block_kept[blocks]);
+    parallel_blocks(count, [&](size_t begin, size_t end) {
+        uint32_t next = block_kept[begin / BLOCK_SIZE];
+        for (size_t i = begin; i < end; i++) {
+            if (first[i] != i)
+                continue;
+            result.x[next] = x[i];
+            result.y[next] = y[i];
+            result.z[next] = z[i];
+            remap[i] = next++;
+        }
+    });
+    parallel_blocks(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            if (first[i] != i)
+                remap[i] = remap[first[i]];
+    });
+    parallel_blocks(mesh.indices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            mesh.indices[i] = remap[mesh.indices[i]];
+    });
+
+    mesh.x = std::move(result.x);
+    mesh.y = std::move(result.y);
+    mesh.z = std::move(result.z);
+}
+
+Mesh loadMesh(const string &filepath) {
+    MappedFile file;
+    if (!file.open(filepath))
+        throw std::runtime_error("Could not open file: '" + filepath + "'");
+
+    string extension = filepath.substr(std::min(filepath.find_last_of('.'), filepath.size()));
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    Mesh mesh;
+    if (extension == ".obj")
+        mesh = load_obj(filepath, file.data(), file.size());
+    else if (extension == ".ply")
+        mesh = load_ply(filepath, file.data(), file.size());
+    else
+        throw std::runtime_error("Unsupported mesh file format: '" + filepath + "'");
+
+    deduplicateVertices(mesh);
+    return mesh;
+}
@@ -0,0 +1,27 @@
+#ifndef _MESH_IMPORT_H_
+#define _MESH_IMPORT_H_
+
+#include <string>
+#include "Mesh.h"
+
+/*
+* Loads a triangle mesh from an OBJ (.obj) or binary PLY (.ply) file.
+* The file is memory mapped and split into chunks that are parsed in parallel, straight into the mesh's arrays.
+*   - OBJ: only positions (v) and faces (f) are read, texture coordinate and normal references are skipped
+*   - PLY: binary little or big endian, the x/y/z vertex properties and the vertex_indices face list
+*   - polygons are triangulated as fans
+*   - vertices with bitwise equal positions are merged
+* @param filepath The path to the file to load.
+* @return The mesh.
+* @throws std::runtime_error if the file could not be opened or is malformed.
+*/
+Mesh loadMesh(const std::string &filepath);
+
+/*
+* Merges the vertices of a mesh that have bitwise equal positions and remaps the indices, in parallel.
+* The first occurrence of a position is kept, so the order of the remaining vertices is preserved.
+* @param mesh The mesh to deduplicate.
+*/
+void deduplicateVertices(Mesh &mesh);
+
+#endif//_MESH_IMPORT_H_
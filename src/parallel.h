@@ -0,0 +1,91 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include "JobSystem.h"
+
+/**
+ * Calls fn(i) for every i in [0,count) on the JobSystem's threads and returns when all calls are done.
+ * Indices are handed out one at a time, so work that is unevenly distributed over the indices still balances.
+ * The calling thread works too, and runs other jobs while it waits for the last calls, so parallel_for nests.
+ * @param count The number of indices.
+ * @param fn The function to call, it must be safe to call concurrently.
+ */
+template <typename F>
+void parallel_for(uint32_t count, F fn) {
+    std::atomic<uint32_t> next{0};
+    auto worker = [&]() {
+        for (uint32_t i = next++; i < count; i = next++)
+            fn(i);
+    };
+
+    JobSystem &jobs = JobSystem::get();
+    unsigned num_jobs = std::min(jobs.get_thread_count(), count);
+    if (num_jobs <= 1) {
+        worker();
+        return;
+    }
+    JobSystem::JobHandle group = jobs.create(worker);
+    for (unsigned i = 1; i < num_jobs; i++)
+        jobs.run(jobs.create(worker, group));
+    jobs.run(group);
+    jobs.wait(group);
+}
+
+/**
+ * Sorts 64 bit keys by the bits [begin_bit, end_bit) on the JobSystem's threads, as a least significant digit first radix
+ * sort with 8 bit digits. The sort is stable, so keys equal in those bits keep their order.
+ * Every thread histograms and scatters its own chunk of the keys, the digits all keys share are skipped.
+ * @param keys The keys to sort.
+ * @param begin_bit The lowest bit to sort by.
+ * @param end_bit The bit after the highest bit to sort by, at most 64.
+ */
+inline void parallel_radix_sort(std::vector<uint64_t> &keys, int begin_bit, int end_bit) {
+    constexpr int DIGIT_BITS = 8;
+    constexpr uint32_t BUCKETS = 1u << DIGIT_BITS;
+    constexpr size_t MIN_CHUNK_SIZE = 16384; // smaller chunks cost more in histograms than they gain
+    size_t count = keys.size();
+    size_t threads = JobSystem::get().get_thread_count();
+    uint32_t chunks = (uint32_t)std::max<size_t>(1, std::min(threads, count / MIN_CHUNK_SIZE));
+    size_t chunk_size = (count + chunks - 1) / chunks;
+
+    std::vector<uint64_t> sorted(count);
+    std::vector<size_t> offsets(chunks * BUCKETS); // per chunk, where its keys of every digit go
+    for (int shift = begin_bit; shift < end_bit; shift += DIGIT_BITS) {
+        uint64_t mask = (1ull << std::min(DIGIT_BITS, end_bit - shift)) - 1;
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallel_for(chunks, [&](uint32_t chunk) {
+            size_t *histogram = &offsets[chunk * BUCKETS];
+            for (size_t i = chunk * chunk_size; i < std::min(count, (chunk + 1) * chunk_size); i++)
+                histogram[(keys[i] >> shift) & mask]++;
+        });
+
+        // the keys of a digit go after all smaller digits and, within the digit, after those of the previous chunks
+        size_t total = 0;
+        bool shared = false;
+        for (uint32_t digit = 0; digit < BUCKETS; digit++) {
+            size_t digit_count = 0;
+            for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+                size_t chunk_count = offsets[chunk * BUCKETS + digit];
+                offsets[chunk * BUCKETS + digit] = total;
+                total += chunk_count;
+                digit_count += chunk_count;
+            }
+            shared |= digit_count == count;
+        }
+        if (shared)
+            continue;
+
+        parallel_for(chunks, [&](uint32_t chunk) {
+            size_t *offset = &offsets[chunk * BUCKETS];
+            for (size_t i = chunk * chunk_size; i < std::min(count, (chunk + 1) * chunk_size); i++)
+                sorted[offset[(keys[i] >> shift) & mask]++] = keys[i];
+        });
+        keys.swap(sorted);
+    }
+}
+
+#endif//_PARALLEL_H_
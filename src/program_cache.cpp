@@ -0,0 +1,118 @@
+#include "program_cache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <GL/glew.h>
+#include <unistd.h>
+using std::string, std::vector;
+
+constexpr uint32_t CACHE_MAGIC = 0x50585452; // "RTXP"
+constexpr uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;    // guards against hash file name collisions and truncated copies
+    uint32_t format; // the GLenum binary format
+    uint32_t length; // the number of bytes following the header
+};
+
+// FNV-1a, 64 bit
+uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+uint64_t fnv1a(uint64_t hash, const char *string) {
+    // include the terminator, so ("ab","c") and ("a","bc") differ
+    return fnv1a(hash, string ? string : "", (string ? strlen(string) : 0) + 1);
+}
+
+string get_cacheDirectory() {
+    const char *directory = getenv("RTX_SHADER_CACHE");
+    return directory && *directory ? directory : "build/shader_cache";
+}
+
+string get_cachePath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+    return get_cacheDirectory() + name;
+}
+
+uint64_t programCacheKey(const string *sources, int count) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = fnv1a(hash, (const char *)glGetString(GL_VENDOR));
+    hash = fnv1a(hash, (const char *)glGetString(GL_RENDERER));
+    hash = fnv1a(hash, (const char *)glGetString(GL_VERSION));
+    for (int i = 0; i < count; i++)
+        hash = fnv1a(hash, sources[i].c_str());
+    return hash;
+}
+
+GLuint loadCachedProgram(uint64_t key) {
+    FILE *file = fopen(get_cachePath(key).c_str(), "rb");
+    if (file == nullptr)
+        return 0;
+
+    CacheHeader header;
+    vector<char> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == CACHE_MAGIC && header.version == CACHE_VERSION && header.key == key;
+    if (valid) {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!valid)
+        return 0;
+
+    // the driver may reject binaries of an older build of itself, the caller then compiles from source
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void storeCachedProgram(uint64_t key, GLuint program) {
+    GLint formats = 0, length = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (formats == 0 || length == 0)
+        return;
+
+    CacheHeader header = {CACHE_MAGIC, CACHE_VERSION, key, 0, 0};
+    vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.format = format;
+    header.length = (uint32_t)length;
+
+    std::error_code error;
+    std::filesystem::create_directories(get_cacheDirectory(), error);
+
+    // write to a temporary file of this process first, so concurrent runs never read or interleave half written binaries
+    string path = get_cachePath(key);
+    string temp_path = path + "." + std::to_string(getpid()) + ".tmp";
+    FILE *file = fopen(temp_path.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not write shader cache file: '%s'\n", temp_path.c_str());
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(binary.data(), 1, header.length, file) == header.length;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Could not write shader cache file: '%s'\n", path.c_str());
+        remove(temp_path.c_str());
+    }
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef _PROGRAM_CACHE_H_
+#define _PROGRAM_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <GL/glew.h>
+
+/*
+* An on-disk cache of linked shader programs (glGetProgramBinary), so warm starts skip compiling and linking.
+* Programs are keyed by a hash of their fully expanded sources and the driver's vendor, renderer and version,
+* a driver update therefore never sees the binaries of another one.
+* The cache lives in build/shader_cache, or in the directory named by the environment variable RTX_SHADER_CACHE.
+*/
+
+/*
+* Computes the cache key of a program for the current OpenGL context.
+* @param sources The fully expanded sources of all stages of the program, in a fixed order.
+* @param count The number of sources.
+* @return The key.
+*/
+uint64_t programCacheKey(const std::string *sources, int count);
+
+/*
+* Creates a program from a cached binary.
+* @param key The key of the program, see programCacheKey.
+* @return The linked program, or 0 if the key missed or the driver rejected the binary.
+*/
+GLuint loadCachedProgram(uint64_t key);
+
+/*
+* Stores the binary of a linked program in the cache. Does nothing if the driver has no binary formats.
+* The program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+* @param key The key of the program, see programCacheKey.
+* @param program The linked program.
+*/
+void storeCachedProgram(uint64_t key, GLuint program);
+
+#endif//_PROGRAM_CACHE_H_
@@ -0,0 +1,174 @@
+#include "scene_file.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+using std::string, std::vector;
+
+uint64_t align_offset(uint64_t offset) {
+    return (offset + SCENE_SECTION_ALIGNMENT - 1) / SCENE_SECTION_ALIGNMENT * SCENE_SECTION_ALIGNMENT;
+}
+
+// writes zeros up to the next section boundary
+bool write_padding(FILE *file, uint64_t &position) {
+    static const char zeros[SCENE_SECTION_ALIGNMENT] = {};
+    uint64_t padding = align_offset(position) - position;
+    position += padding;
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+void saveSceneFile(const string &filepath, const Scene &scene) {
+    struct SectionData { SceneSection section; const void *data; };
+    vector<SectionData> sections = {
+        {{SCENE_SECTION_TRIANGLES, sizeof(Triangle), 0, scene.bvh.triangles.size()}, scene.bvh.triangles.data()},
+        {{SCENE_SECTION_BVH_NODES, sizeof(BVHNode), 0, scene.bvh.nodes.size()}, scene.bvh.nodes.data()},
+    };
+    // the TLAS is not stored, it is quick to rebuild and changes whenever an instance moves
+    if (scene.is_instanced()) {
+        sections.push_back({{SCENE_SECTION_BLAS, sizeof(BLAS), 0, scene.blas.size()}, scene.blas.data()});
+        sections.push_back({{SCENE_SECTION_INSTANCES, sizeof(Instance), 0, scene.instances.size()}, scene.instances.data()});
+    }
+
+    uint64_t position = sizeof(SceneFileHeader) + sections.size() * sizeof(SceneSection);
+    for (SectionData &entry : sections) {
+        entry.section.offset = align_offset(position);
+        position = entry.section.offset + entry.section.count * entry.section.element_size;
+    }
+    SceneFileHeader header = {SCENE_FILE_MAGIC, SCENE_FILE_VERSION, SCENE_FILE_BYTE_ORDER, (uint32_t)sections.size(), position};
+
+    // write to a temporary file of this process first, so a failed or concurrent write never leaves a truncated scene behind
+    string temp_path = filepath + "." + std::to_string(getpid()) + ".tmp";
+    FILE *file = fopen(temp_path.c_str(), "wb");
+    if (file == nullptr)
+        throw std::runtime_error("Could not write file: '" + filepath + "'");
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (const SectionData &entry : sections)
+        written = written && fwrite(&entry.section, sizeof(SceneSection), 1, file) == 1;
+    position = sizeof(SceneFileHeader) + sections.size() * sizeof(SceneSection);
+    for (const SectionData &entry : sections) {
+        size_t length = entry.section.count * entry.section.element_size;
+        written = written && write_padding(file, position) && fwrite(entry.data, 1, length, file) == length;
+        position += length;
+    }
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temp_path.c_str(), filepath.c_str()) != 0) {
+        remove(temp_path.c_str());
+        throw std::runtime_error("Could not write file: '" + filepath + "'");
+    }
+}
+
+// gets the elements of a section, checking that they lie within the file and have the expected layout
+template <typename T>
+const T *get_section(const string &filepath, const MappedFile &file, const SceneSection &section) {
+    if (section.element_size != sizeof(T))
+        throw std::runtime_error("Unexpected scene section layout in file: '" + filepath + "'");
+    if (section.offset % SCENE_SECTION_ALIGNMENT != 0 || section.offset > file.size()
+            || section.count > (file.size() - section.offset) / sizeof(T))
+        throw std::runtime_error("Invalid scene section in file: '" + filepath + "'");
+    return (const T *)(file.data() + section.offset);
+}
+
+// checks that the nodes only reference nodes and triangles that exist and that no leaf lies deeper than the tracers'
+// traversal stacks reach, so a corrupt file can't send the tracers astray
+bool valid_hierarchy(const vector<BVHNode> &nodes, size_t triangle_count) {
+    // children always follow their parents, so every node's depth is known by the time it is checked
+    vector<uint32_t> depths(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const BVHNode &node = nodes[i];
+        bool valid = node.is_leaf()
+            ? node.index <= triangle_count && node.count <= triangle_count - node.index
+            : node.index > i + 1 && node.index < nodes.size() && depths[i] < BVH_MAX_DEPTH;
+        if (!valid)
+            return false;
+        if (!node.is_leaf()) {
+            depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+            depths[node.index] = std::max(depths[node.index], depths[i] + 1);
+        }
+    }
+    return true;
+}
+
+// checks that every BLAS is a range of the hierarchy and every instance references one by its root
+bool valid_instances(const vector<BLAS> &blas, const vector<Instance> &instances, size_t node_count, size_t triangle_count) {
+    for (const BLAS &entry : blas) {
+        bool valid = entry.root <= node_count && entry.node_count <= node_count - entry.root
+            && entry.first_triangle <= triangle_count && entry.triangle_count <= triangle_count - entry.first_triangle;
+        if (!valid)
+            return false;
+    }
+    for (const Instance &instance : instances) {
+        if (instance.blas >= blas.size() || instance.root != blas[instance.blas].root)
+            return false;
+    }
+    return true;
+}
+
+void loadSceneFile(const string &filepath, Scene &scene) {
+    MappedFile file;
+    if (!file.open(filepath))
+        throw std::runtime_error("Could not open file: '" + filepath + "'");
+
+    SceneFileHeader header;
+    if (file.size() < sizeof(header))
+        throw std::runtime_error("Not a scene file: '" + filepath + "'");
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != SCENE_FILE_MAGIC)
+        throw std::runtime_error("Not a scene file: '" + filepath + "'");
+    if (header.version < SCENE_FILE_MIN_VERSION || header.version > SCENE_FILE_VERSION || header.byte_order != SCENE_FILE_BYTE_ORDER)
+        throw std::runtime_error("Incompatible scene file version, convert it again: '" + filepath + "'");
+    if (header.file_size != file.size() || header.section_count > (file.size() - sizeof(header)) / sizeof(SceneSection))
+        throw std::runtime_error("Truncated scene file: '" + filepath + "'");
+
+    const SceneSection *sections = (const SceneSection *)(file.data() + sizeof(header));
+    const Triangle *triangles = nullptr;
+    const BVHNode *nodes = nullptr;
+    const BLAS *blas = nullptr;
+    const Instance *instances = nullptr;
+    size_t triangle_count = 0, node_count = 0, blas_count = 0, instance_count = 0;
+    for (uint32_t i = 0; i < header.section_count; i++) {
+        if (sections[i].type == SCENE_SECTION_TRIANGLES) {
+            triangles = get_section<Triangle>(filepath, file, sections[i]);
+            triangle_count = sections[i].count;
+        } else if (sections[i].type == SCENE_SECTION_BVH_NODES) {
+            nodes = get_section<BVHNode>(filepath, file, sections[i]);
+            node_count = sections[i].count;
+        } else if (sections[i].type == SCENE_SECTION_BLAS) {
+            blas = get_section<BLAS>(filepath, file, sections[i]);
+            blas_count = sections[i].count;
+        } else if (sections[i].type == SCENE_SECTION_INSTANCES) {
+            instances = get_section<Instance>(filepath, file, sections[i]);
+            instance_count = sections[i].count;
+        }
+    }
+    if (triangles == nullptr || nodes == nullptr || (instances != nullptr && blas == nullptr))
+        throw std::runtime_error("Missing scene section in file: '" + filepath + "'");
+
+    // the sections are laid out as the SSBOs, so loading is a copy per section
+    BVH bvh;
+    bvh.triangles.assign(triangles, triangles + triangle_count);
+    bvh.nodes.assign(nodes, nodes + node_count);
+    if (!valid_hierarchy(bvh.nodes, bvh.triangles.size()))
+        throw std::runtime_error("Invalid BVH in scene file: '" + filepath + "'");
+    if (blas == nullptr) {
+        scene.set_bvh(std::move(bvh));
+        return;
+    }
+
+    // an instanced scene, the BLAS are used as they are and only the TLAS is built
+    vector<BLAS> blas_list(blas, blas + blas_count);
+    vector<Instance> instance_list;
+    if (instances != nullptr)
+        instance_list.assign(instances, instances + instance_count);
+    if (!valid_instances(blas_list, instance_list, bvh.nodes.size(), bvh.triangles.size()))
+        throw std::runtime_error("Invalid instances in scene file: '" + filepath + "'");
+    scene.set_bvh(std::move(bvh));
+    scene.blas = std::move(blas_list);
+    scene.instances = std::move(instance_list);
+    scene.set_layout(scene.layout);
+    scene.build_tlas();
+}
@@ -0,0 +1,57 @@
+#ifndef _SCENE_FILE_H_
+#define _SCENE_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include "Scene.h"
+
+constexpr uint32_t SCENE_FILE_MAGIC = 0x53585452;   /** "RTXS" */
+constexpr uint32_t SCENE_FILE_VERSION = 2;          /** Bumped whenever a section's element layout or meaning changes. */
+constexpr uint32_t SCENE_FILE_MIN_VERSION = 1;      /** The oldest version that is still read, version 1 files have no instances. */
+constexpr uint32_t SCENE_FILE_BYTE_ORDER = 0x01020304; /** Reads back swapped on a machine of the other byte order. */
+constexpr uint64_t SCENE_SECTION_ALIGNMENT = 4096;  /** Sections start on page boundaries. */
+
+/** The kinds of sections of a scene file. Readers skip kinds they don't know. */
+enum SceneSectionType : uint32_t {
+    SCENE_SECTION_TRIANGLES = 1, /** Triangle, as the `Triangles` SSBO. */
+    SCENE_SECTION_BVH_NODES = 2, /** BVHNode, as the `BVHNodes` SSBO. */
+    SCENE_SECTION_MATERIALS = 3, /** Reserved, the tracer has no materials yet. */
+    SCENE_SECTION_INSTANCES = 4, /** Instance, in the order they were added. Requires SCENE_SECTION_BLAS. */
+    SCENE_SECTION_BLAS = 5,      /** BLAS, the meshes in BVH_NODES and TRIANGLES. Present if the scene is instanced. */
+};
+
+/** The header at the start of a scene file, followed by section_count SceneSections. */
+struct SceneFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t section_count;
+    uint64_t file_size; /** Guards against truncated copies. */
+};
+
+/** An entry of the section table. The elements are stored exactly as the tracers consume them. */
+struct SceneSection {
+    uint32_t type;         /** A SceneSectionType. */
+    uint32_t element_size; /** The size of an element, checked against the struct it is read as. */
+    uint64_t offset;       /** The offset of the first element from the start of the file, SCENE_SECTION_ALIGNMENT aligned. */
+    uint64_t count;        /** The number of elements. */
+};
+
+/*
+* Writes a scene's geometry and its built acceleration structure to a binary scene file.
+* @param filepath The path to write the file to.
+* @param scene The scene to write.
+* @throws std::runtime_error if the file could not be written.
+*/
+void saveSceneFile(const std::string &filepath, const Scene &scene);
+
+/*
+* Loads a binary scene file written by saveSceneFile, replacing the scene's geometry.
+* The file is memory mapped and its sections are copied as they are, the acceleration structure is not rebuilt.
+* @param filepath The path to the file to load.
+* @param scene The scene to load into.
+* @throws std::runtime_error if the file could not be opened, is malformed or was written by an incompatible version.
+*/
+void loadSceneFile(const std::string &filepath, Scene &scene);
+
+#endif//_SCENE_FILE_H_
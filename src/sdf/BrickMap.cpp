@@ -0,0 +1,141 @@
+#include "BrickMap.h"
+#include "../parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+using namespace glm;
+
+constexpr float SKIP_CELLS = 4.0f;  // the reach of the shapes gathered for a cell, in cells. At least two for the bricks' samples
+constexpr float MARGIN_CELLS = 1.0f; // the empty cells around the scene's bounds, so rays enter the grid before they near a surface
+
+void BrickMap::bake(const SDFScene &scene, float voxel_size) {
+    this->voxel_size = voxel_size;
+    cell_size = voxel_size * (float)(BRICK_SIZE - 1);
+    skip_distance = SKIP_CELLS * cell_size;
+    cells.clear();
+    bricks.clear();
+    free_bricks.clear();
+    changed_bricks.clear();
+    size = uvec3(0);
+    if (scene.shapes.empty())
+        return;
+
+    AABB bounds = scene.bounds();
+    origin = bounds.min - MARGIN_CELLS * cell_size;
+    size = uvec3(ceil((bounds.max + MARGIN_CELLS * cell_size - origin) / cell_size));
+    cells.assign((size_t)size.x * size.y * size.z, {BRICK_EMPTY, 0.0f});
+    gather_candidates(scene);
+    bake_cells(scene, uvec3(0), size);
+}
+
+void BrickMap::rebake(const SDFScene &scene, const AABB &changed) {
+    AABB bounds = scene.bounds();
+    vec3 grid_max = origin + vec3(size) * cell_size;
+    if (cells.empty() || any(lessThan(bounds.min, origin)) || any(greaterThan(bounds.max, grid_max))) {
+        bake(scene, voxel_size);
+        return;
+    }
+
+    // a shape only ever is a candidate of the cells within skip_distance of its influence, which changed contains before
+    // and after the move, so no other cell's candidates and therefore samples changed
+    gather_candidates(scene);
+    uvec3 begin, end;
+    cell_range({changed.min - skip_distance, changed.max + skip_distance}, begin, end);
+    bake_cells(scene, begin, end);
+}
+
+void BrickMap::cell_range(const AABB &box, uvec3 &begin, uvec3 &end) const {
+    ivec3 first = ivec3(floor((box.min - origin) / cell_size));
+    ivec3 last = ivec3(floor((box.max - origin) / cell_size));
+    begin = uvec3(clamp(first, ivec3(0), ivec3(size)));
+    end = uvec3(clamp(last + 1, ivec3(0), ivec3(size)));
+}
+
+void BrickMap::gather_candidates(const SDFScene &scene) {
+    // counted first, then every cell's range is filled, like a counting sort of the (cell, shape) pairs by cell
+    std::vector<uvec3> begins(scene.shapes.size()), ends(scene.shapes.size());
+    candidate_offsets.assign(cells.size() + 1, 0);
+    for (uint32_t s = 0; s < scene.shapes.size(); s++) {
+        AABB reach = scene.influence(s);
+        cell_range({reach.min - skip_distance, reach.max + skip_distance}, begins[s], ends[s]);
+        for (uint32_t z = begins[s].z; z < ends[s].z; z++)
+        for (uint32_t y = begins[s].y; y < ends[s].y; y++)
+        for (uint32_t x = begins[s].x; x < ends[s].x; x++)
+            candidate_offsets[((size_t)z * size.y + y) * size.x + x + 1]++;
+    }
+    for (size_t i = 1; i < candidate_offsets.size(); i++)
+        candidate_offsets[i] += candidate_offsets[i - 1];
+
+    std::vector<uint32_t> next(candidate_offsets.begin(), candidate_offsets.end() - 1);
+    candidates.resize(candidate_offsets.back());
+    for (uint32_t s = 0; s < scene.shapes.size(); s++) {
+        for (uint32_t z = begins[s].z; z < ends[s].z; z++)
+        for (uint32_t y = begins[s].y; y < ends[s].y; y++)
+        for (uint32_t x = begins[s].x; x < ends[s].x; x++)
+            candidates[next[((size_t)z * size.y + y) * size.x + x]++] = s;
+    }
+}
+
+void BrickMap::bake_cells(const SDFScene &scene, const uvec3 &begin, const uvec3 &end) {
+    if (any(lessThanEqual(end, begin)))
+        return;
+    uvec3 extent = end - begin;
+    auto cell_index = [&](uint32_t x, uint32_t y, uint32_t z) { return ((size_t)z * size.y + y) * size.x + x; };
+    auto evaluate = [&](const vec3 &p, size_t cell) {
+        uint32_t first = candidate_offsets[cell];
+        return scene.distance(p, candidates.data() + first, candidate_offsets[cell + 1] - first, skip_distance);
+    };
+
+    // the distance at every cell's center decides whether the surface may pass through the cell
+    std::vector<float> center_distance((size_t)extent.x * extent.y * extent.z);
+    parallel_for(extent.y * extent.z, [&](uint32_t row) {
+        uint32_t y = begin.y + row % extent.y, z = begin.z + row / extent.y;
+        for (uint32_t x = begin.x; x < end.x; x++) {
+            vec3 center = origin + (vec3(x, y, z) + 0.5f) * cell_size;
+            center_distance[(size_t)row * extent.x + (x - begin.x)] = evaluate(center, cell_index(x, y, z));
+        }
+    });
+
+    // bricks are handed out in order, so the layout doesn't depend on the threads
+    // every point of a cell is within half a diagonal of its center, a voxel more keeps the samples interpolated
+    // next to the surface in bricks
+    float half_diagonal = 0.5f * std::sqrt(3.0f) * cell_size;
+    std::vector<size_t> baked;
+    for (uint32_t z = begin.z; z < end.z; z++)
+    for (uint32_t y = begin.y; y < end.y; y++)
+    for (uint32_t x = begin.x; x < end.x; x++) {
+        BrickCell &cell = cells[cell_index(x, y, z)];
+        float d = center_distance[((size_t)(z - begin.z) * extent.y + (y - begin.y)) * extent.x + (x - begin.x)];
+        if (std::abs(d) <= half_diagonal + voxel_size) {
+            if (cell.brick == BRICK_EMPTY) {
+                if (free_bricks.empty()) {
+                    cell.brick = (uint32_t)(bricks.size() / BRICK_SAMPLES);
+                    bricks.resize(bricks.size() + BRICK_SAMPLES);
+                } else {
+                    cell.brick = free_bricks.back();
+                    free_bricks.pop_back();
+                }
+            }
+            cell.distance = 0.0f;
+            baked.push_back(cell_index(x, y, z));
+            changed_bricks.push_back(cell.brick);
+        } else {
+            if (cell.brick != BRICK_EMPTY)
+                free_bricks.push_back(cell.brick);
+            cell.brick = BRICK_EMPTY;
+            // the shapes that weren't gathered are further away than the gathered ones' distance is clamped to
+            cell.distance = d < 0.0f ? 0.0f : d - half_diagonal;
+        }
+    }
+
+    parallel_for((uint32_t)baked.size(), [&](uint32_t i) {
+        size_t index = baked[i];
+        uvec3 cell = uvec3(index % size.x, (index / size.x) % size.y, index / ((size_t)size.x * size.y));
+        vec3 corner = origin + vec3(cell) * cell_size;
+        float *samples = &bricks[(size_t)cells[index].brick * BRICK_SAMPLES];
+        for (uint32_t z = 0; z < BRICK_SIZE; z++)
+        for (uint32_t y = 0; y < BRICK_SIZE; y++)
+        for (uint32_t x = 0; x < BRICK_SIZE; x++)
+            *samples++ = evaluate(corner + vec3(x, y, z) * voxel_size, index);
+    });
+}
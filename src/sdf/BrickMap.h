@@ -0,0 +1,69 @@
+#ifndef _BRICKMAP_H_
+#define _BRICKMAP_H_
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "SDFScene.h"
+using namespace glm;
+
+constexpr uint32_t BRICK_SIZE = 8;                                   /** The samples along every edge of a brick. */
+constexpr uint32_t BRICK_SAMPLES = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE; /** The samples of a brick, x varying fastest. */
+constexpr uint32_t BRICK_EMPTY = 0xFFFFFFFF;                         /** The brick of a cell without one. */
+
+/** A cell of a brick map's indirection grid, as laid out in the `BrickCells` SSBO of tracing.glsl (std430). */
+struct BrickCell {
+    uint32_t brick; /** The index of the cell's brick, BRICK_EMPTY if no surface passes through the cell. */
+    float distance; /** Without a brick, how far the surface is at least from anywhere in the cell, 0 inside a shape. */
+};
+static_assert(sizeof(BrickCell) == 8, "BrickCell must match the std430 layout in tracing.glsl");
+
+/**
+ * A sparse sampling of an SDFScene's distance field, for sphere tracing at interactive rates.
+ * Space is split into a grid of cells. Only the cells the surface passes through get a brick, BRICK_SIZE³ samples of
+ * the distance at the cell's corners and in between, so neighboring bricks share their border samples and trilinear
+ * interpolation is seamless across them. The other cells only store a lower bound of the distance, which lets rays
+ * skip them and more in a single step.
+ * The shapes a cell has to evaluate are gathered first, so baking costs about the same for any number of shapes.
+ */
+struct BrickMap {
+    vec3 origin = vec3(0.0f);    /** The minimum corner of the grid. */
+    float voxel_size = 0.0f;     /** The spacing of the samples. */
+    float cell_size = 0.0f;      /** The edge length of a cell, BRICK_SIZE - 1 voxels. */
+    uvec3 size = uvec3(0);       /** The number of cells along every axis. */
+    std::vector<BrickCell> cells;   /** The indirection grid, x varying fastest. */
+    std::vector<float> bricks;      /** BRICK_SAMPLES distances per brick, including freed ones. */
+    std::vector<uint32_t> free_bricks;    /** Bricks no cell uses anymore, reused before new ones are added. */
+    std::vector<uint32_t> changed_bricks; /** The bricks baked since the GPU copy was last updated, see SDFVolume::upload. */
+
+    /**
+     * Bakes the whole scene, replacing any previous contents. The grid covers the scene's bounds with a margin.
+     * @param scene The scene to bake.
+     * @param voxel_size The spacing of the samples, smaller than the thinnest features to resolve.
+     */
+    void bake(const SDFScene &scene, float voxel_size);
+
+    /**
+     * Bakes the cells again that a change of the scene affects, e.g. after shapes moved, and reuses all others.
+     * Falls back to a full bake if the scene outgrew the grid.
+     * @param scene The changed scene.
+     * @param changed The box around everything that changed, the old and new influence of every moved shape.
+     */
+    void rebake(const SDFScene &scene, const AABB &changed);
+
+    /** @return The number of bricks cells use. */
+    inline uint32_t brick_count() const { return (uint32_t)(bricks.size() / BRICK_SAMPLES - free_bricks.size()); }
+private:
+    float skip_distance = 0.0f; // the reach of the shapes gathered for a cell, beyond it the distance is just bounded
+    std::vector<uint32_t> candidate_offsets; // for every cell, where its shapes begin in candidates, one past the end for the last
+    std::vector<uint32_t> candidates;        // the shapes that may be closer than skip_distance to each cell
+
+    // gathers the shapes that reach every cell
+    void gather_candidates(const SDFScene &scene);
+    // bakes the cells in [begin, end) on all cores, allocating and freeing their bricks
+    void bake_cells(const SDFScene &scene, const uvec3 &begin, const uvec3 &end);
+    // the first and one past the last cell a box overlaps, clamped to the grid
+    void cell_range(const AABB &box, uvec3 &begin, uvec3 &end) const;
+};
+
+#endif//_BRICKMAP_H_
@@ -0,0 +1,56 @@
+#include "SDFScene.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+using namespace glm;
+
+// the distance to the edges of a box with half extents b, whose bars are 2e thick
+float frame_distance(vec3 p, float b, float e) {
+    p = abs(p) - b;
+    vec3 q = abs(p + e) - e;
+    return std::min(std::min(
+        length(max(vec3(p.x, q.y, q.z), 0.0f)) + std::min(std::max(p.x, std::max(q.y, q.z)), 0.0f),
+        length(max(vec3(q.x, p.y, q.z), 0.0f)) + std::min(std::max(q.x, std::max(p.y, q.z)), 0.0f)),
+        length(max(vec3(q.x, q.y, p.z), 0.0f)) + std::min(std::max(q.x, std::max(q.y, p.z)), 0.0f));
+}
+
+// the cubic smooth minimum, which blends a and b within k of each other and never goes below min(a, b) - k / 6
+float smin(float a, float b, float k) {
+    float h = std::max(k - std::abs(a - b), 0.0f) / k;
+    return std::min(a, b) - h * h * h * k * (1.0f / 6.0f);
+}
+
+float shape_distance(const SDFShape &shape, const vec3 &p) {
+    vec3 local = p - shape.center;
+    float frame = frame_distance(local, shape.size, 0.5f * SDF_FRAME_THICKNESS * shape.size);
+    float sphere = length(local) - shape.size;
+    return smin(frame, sphere, SDF_BLEND * shape.size);
+}
+
+float SDFScene::distance(const vec3 &p) const {
+    float d = INFINITY;
+    for (const SDFShape &shape : shapes)
+        d = std::min(d, shape_distance(shape, p));
+    return d;
+}
+
+float SDFScene::distance(const vec3 &p, const uint32_t *candidates, size_t count, float max_distance) const {
+    float d = max_distance;
+    for (size_t i = 0; i < count; i++)
+        d = std::min(d, shape_distance(shapes[candidates[i]], p));
+    return d;
+}
+
+AABB SDFScene::influence(uint32_t shape) const {
+    // both parts lie within the frame's box, the blend reaches at most k / 6 beyond it
+    const SDFShape &s = shapes[shape];
+    float extent = s.size * (1.0f + SDF_BLEND / 6.0f);
+    return {s.center - extent, s.center + extent};
+}
+
+AABB SDFScene::bounds() const {
+    AABB bounds;
+    for (uint32_t i = 0; i < shapes.size(); i++)
+        bounds.grow(influence(i));
+    return bounds;
+}
@@ -0,0 +1,66 @@
+#ifndef _SDFSCENE_H_
+#define _SDFSCENE_H_
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "../bvh/BVH.h"
+using namespace glm;
+
+constexpr float SDF_FRAME_THICKNESS = 0.1f; // the bars of a shape's frame, relative to its size
+constexpr float SDF_BLEND = 1.0f;           // the smooth minimum's blend radius between a shape's frame and sphere, relative to its size
+
+/**
+ * A shape of an SDF scene: the box frame and the sphere of the original sphere tracing demo, blended into one blob
+ * with a smooth minimum. The blend only ever lowers the distance by SDF_BLEND / 6 * size.
+ */
+struct SDFShape {
+    vec3 center; /** The center of the frame and the sphere. */
+    float size;  /** The radius of the sphere and half the edge length of the frame. */
+};
+
+/**
+ * A scene described by a signed distance field, the union of its shapes.
+ * It is too expensive to evaluate per sphere tracing step for more than a few shapes, the tracers sample a BrickMap
+ * baked from it instead.
+ */
+struct SDFScene {
+    std::vector<SDFShape> shapes;
+
+    /**
+     * Evaluates the distance field.
+     * @param p The point to evaluate it at.
+     * @return The signed distance to the closest surface, negative inside a shape.
+     */
+    float distance(const vec3 &p) const;
+
+    /**
+     * Evaluates the distance field of some of the shapes only.
+     * @param p The point to evaluate it at.
+     * @param candidates The indices of the shapes to evaluate.
+     * @param count The number of candidates.
+     * @param max_distance The distance returned if no candidate is closer.
+     * @return The signed distance to the closest of the candidates' surfaces, at most max_distance.
+     */
+    float distance(const vec3 &p, const uint32_t *candidates, size_t count, float max_distance) const;
+
+    /**
+     * Gets the box around a shape's influence: from anywhere outside it, the shape is at least as far away as the box.
+     * @param shape The index of the shape.
+     * @return The box.
+     */
+    AABB influence(uint32_t shape) const;
+
+    /** @return The box around the influence of all shapes, an empty box if there are none. */
+    AABB bounds() const;
+};
+
+/**
+ * Evaluates a single shape, a port of sceneSDF in the original sphere tracing demo.
+ * @param shape The shape.
+ * @param p The point to evaluate it at.
+ * @return The signed distance to the shape's surface.
+ */
+float shape_distance(const SDFShape &shape, const vec3 &p);
+
+#endif//_SDFSCENE_H_
@@ -3,108 +3,216 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
-#include <sstream>
 #include <fstream>
-using std::string, std::unordered_map, std::unordered_set, std::stringstream, std::ifstream, std::vector;
-
-unordered_map<string, string> cache;
+#include <filesystem>
+using std::string, std::unordered_map, std::unordered_set, std::ifstream, std::vector;
+namespace fs = std::filesystem;
+
+// an #include directive of a file
+struct Include {
+    size_t line_begin, line_end; // the range of the directive's line in the file's content, including the '\n'
+    size_t linenum;              // the 1 based number of the line
+    string path;                 // the normalized path of the included file
+};
+
+// a node of the include graph
+struct SourceFile {
+    fs::file_time_type mtime;
+    string content;                // the file as it is on disk
+    vector<Include> includes;
+    unordered_set<string> dependents; // the files that include this one
+    string expanded;               // the expansion with all includes, only valid if expanded_valid
+    bool expanded_valid = false;
+    bool stale = true;             // re-read on the next load, regardless of the modification time
+};
+
+unordered_map<string, SourceFile> files; // by normalized path, persists between loads
 
 #define startswith(STRING,PREFIX) (STRING.rfind(PREFIX, 0) == 0)
 
-string get_siblingPath(string filepath, string sibling) {
+string normalizeShaderPath(const string &filepath) {
+    return fs::path(filepath).lexically_normal().generic_string();
+}
+
+string get_siblingPath(const string &filepath, const string &sibling) {
     size_t last_slash = filepath.find_last_of("/\\");
     if (last_slash == string::npos)
-        return sibling;
-    return filepath.substr(0, last_slash + 1) + sibling;
+        return normalizeShaderPath(sibling);
+    return normalizeShaderPath(filepath.substr(0, last_slash + 1) + sibling);
 }
 
 // converts "path/to/file.glsl" to "_PATH_TO_FILE_GLSL_"
-string get_includeName(string path) {
+string get_includeName(const string &path) {
     string result = "_";
     for(char c : path)
-        result += c == '/' || c == '\\' || c == '.' 
-            ? '_' 
+        result += c == '/' || c == '\\' || c == '.'
+            ? '_'
             : toupper(c);
     return result + "_";
 }
 
-string get_includeId(string path) {
+string get_includeId(const string &path) {
     return "0";
 }
 
-string read_file(string filepath)
+void read_file(const string &filepath, string &content)
 {
-    ifstream file(filepath);
+    ifstream file(filepath, std::ios::binary);
     if (!file.is_open())
         throw std::runtime_error("Could not open file: '" + filepath + "'");
 
-    stringstream buffer;
-    buffer << file.rdbuf();
+    // read in one go, straight into the node's string
+    file.seekg(0, std::ios::end);
+    content.resize((size_t)file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read(&content[0], content.size());
+}
 
-    return buffer.str();
+// marks the expansions of a file and everything that (indirectly) includes it as outdated
+void invalidate_expansions(const string &filepath) {
+    auto it = files.find(filepath);
+    if (it == files.end() || !it->second.expanded_valid)
+        return;
+    it->second.expanded_valid = false;
+    for (const string &dependent : it->second.dependents)
+        invalidate_expansions(dependent);
 }
 
-string parseFile(string filepath, unordered_set<string> already_included) {
-    string content = read_file(filepath);
-    stringstream instream(content), result;
+// finds the #include directives of a file
+void scan_includes(const string &filepath, SourceFile &file) {
+    file.includes.clear();
+    size_t linenum = 0;
+    for (size_t begin = 0; begin < file.content.size(); ) {
+        size_t end = file.content.find('\n', begin);
+        end = end == string::npos ? file.content.size() : end + 1;
+        linenum++;
 
-    string includeName = get_includeName(filepath);
-    string includeId = get_includeId(filepath);
-    string line;
-    getline(instream, line);
-    if(startswith(line,"#version")) {
-        result << line << '\n';
-        result << "#ifndef " << includeName << '\n';
-        result << "#define " << includeName << '\n';
-        result << "#line 2 " << includeId   << '\n';
-    } else {
-        result << "#ifndef " << includeName << '\n';
-        result << "#define " << includeName << '\n';
-        result << "#line 1 " << includeId   << '\n';
-        result << line << '\n';
-    }
+        size_t directive = file.content.find_first_not_of(" \t", begin);
+        if (directive < end && file.content.compare(directive, 8, "#include") == 0) {
+            size_t first_quote = file.content.find('"', directive);
+            size_t last_quote = file.content.rfind('"', end - 1);
+            if (first_quote >= end || last_quote == first_quote)
+                throw std::runtime_error("Invalid #include directive in file: '" + filepath + "'");
 
-    size_t linenum = 1; // compensate for already processed line 1
-    while (getline(instream, line)) {
-        linenum++;
-        if (line.find("#include") == string::npos) {
-            result << line << '\n';
-            continue;
+            string include_path = file.content.substr(first_quote + 1, last_quote - first_quote - 1);
+            file.includes.push_back({begin, end, linenum, get_siblingPath(filepath, include_path)});
         }
+        begin = end;
+    }
+}
 
-        size_t first_quote = line.find_first_of('"');
-        size_t last_quote = line.find_last_of('"');
-        if (first_quote == string::npos || last_quote == string::npos)
-            throw std::runtime_error("Invalid #include directive in file: '" + filepath + "'");
+// brings a file's node up to date with the disk, re-reading it only if it changed
+SourceFile &refresh(const string &filepath) {
+    SourceFile &file = files[filepath];
 
-        string include_path = line.substr(first_quote + 1, last_quote - first_quote - 1);
-        if (!already_included.insert(include_path).second)
-            throw std::runtime_error("Circular #include directive in file: '" + filepath + "'");
+    std::error_code error;
+    fs::file_time_type mtime = fs::last_write_time(filepath, error);
+    if (error)
+        throw std::runtime_error("Could not open file: '" + filepath + "'");
+    if (!file.stale && mtime == file.mtime)
+        return file;
 
-        if(cache.count(include_path) == 0) {
-            string content2include = parseFile(get_siblingPath(filepath, include_path), already_included);
-            cache[include_path] = content2include;
-        }
+    for (const Include &include : file.includes)
+        files[include.path].dependents.erase(filepath);
 
-        result << cache[include_path] << '\n';
-        result << "#line " << linenum+1 << "\n";
-    }
+    read_file(filepath, file.content);
+    file.mtime = mtime;
+    file.stale = false;
+    scan_includes(filepath, file);
+
+    for (const Include &include : file.includes)
+        files[include.path].dependents.insert(filepath);
 
-    result << "#endif" << "\n";
-    return result.str();
+    file.expanded_valid = true; // so invalidate_expansions reaches the dependents
+    invalidate_expansions(filepath);
+    return file;
 }
 
-string loadShaderSource(string filepath) {
-    string content;
+// expands a file with all its includes, reusing every expansion that is still up to date
+const string &expand(const string &filepath, unordered_set<string> &chain) {
+    if (!chain.insert(filepath).second)
+        throw std::runtime_error("Circular #include directive in file: '" + filepath + "'");
+
+    SourceFile &file = refresh(filepath);
     try {
-        content = parseFile(filepath, unordered_set<string>());
+        // expanding the includes first refreshes them, which may invalidate this file's expansion
+        for (const Include &include : file.includes)
+            expand(include.path, chain);
     } catch (std::runtime_error &e) {
-        cache.clear();
-        throw e;
+        file.stale = true; // try again next time, even if this file doesn't change
+        chain.erase(filepath);
+        throw;
+    }
+    chain.erase(filepath);
+    if (file.expanded_valid)
+        return file.expanded;
+
+    const string &content = file.content;
+    string &result = file.expanded;
+    size_t size = content.size() + 128;
+    for (const Include &include : file.includes)
+        size += files[include.path].expanded.size() + 16;
+    result.clear();
+    result.reserve(size);
+
+    string includeName = get_includeName(filepath);
+    string includeId = get_includeId(filepath);
+    size_t first_line_end = std::min(content.find('\n'), content.size());
+    size_t position = 0;
+    if(startswith(content,"#version")) {
+        result.append(content, 0, first_line_end).append("\n");
+        result.append("#ifndef ").append(includeName).append("\n");
+        result.append("#define ").append(includeName).append("\n");
+        result.append("#line 2 ").append(includeId).append("\n");
+        position = std::min(first_line_end + 1, content.size());
+    } else {
+        result.append("#ifndef ").append(includeName).append("\n");
+        result.append("#define ").append(includeName).append("\n");
+        result.append("#line 1 ").append(includeId).append("\n");
+    }
+
+    for (const Include &include : file.includes) {
+        if (include.line_begin < position) // an #include on the #version line
+            continue;
+        result.append(content, position, include.line_begin - position);
+        result.append(files[include.path].expanded).append("\n");
+        result.append("#line ").append(std::to_string(include.linenum + 1)).append("\n");
+        position = include.line_end;
     }
+    result.append(content, position, string::npos);
+    if (!result.empty() && result.back() != '\n')
+        result += '\n';
+
+    result.append("#endif\n");
+    file.expanded_valid = true;
+    return result;
+}
+
+string loadShaderSource(const string &filepath) {
+    unordered_set<string> chain;
+    return expand(normalizeShaderPath(filepath), chain);
+}
+
+void collect_dependencies(const string &filepath, unordered_set<string> &visited, vector<string> &result) {
+    if (!visited.insert(filepath).second)
+        return;
+    result.push_back(filepath);
+    auto it = files.find(filepath);
+    if (it == files.end())
+        return;
+    for (const Include &include : it->second.includes)
+        collect_dependencies(include.path, visited, result);
+}
 
-    printf(content.c_str());
+vector<string> getShaderDependencies(const string &filepath) {
+    unordered_set<string> visited;
+    vector<string> result;
+    collect_dependencies(normalizeShaderPath(filepath), visited, result);
+    return result;
+}
 
-    cache.clear();
-    return content;
+void invalidateShaderSource(const string &filepath) {
+    auto it = files.find(normalizeShaderPath(filepath));
+    if (it != files.end())
+        it->second.stale = true;
 }
\ No newline at end of file
@@ -1,11 +1,35 @@
 #include <string>
+#include <vector>
 /*
 * Loads a shader source file and returns its contents as a string.
 * extends glsl to support #include "file.glsl"
 *   - include paths are relative to the including file
 *   - includes are automatically equippet with guard macros
+* Files are kept in a persistent include graph: a file is only re-read when its modification time changed,
+* and expansions are only rebuilt when the file or one of its includes changed.
 * @param filepath The relative path to the file to load.
 * @return The contents of the file as a string.
 * @throws std::runtime_error if the file could not be opened.
 */
-std::string loadShaderSource(std::string filepath);
\ No newline at end of file
+std::string loadShaderSource(const std::string &filepath);
+
+/*
+* Gets the files a shader source file is made of, the file itself and everything it includes.
+* The file has to be loaded with loadShaderSource first.
+* @param filepath The relative path of the file.
+* @return The normalized paths of the files.
+*/
+std::vector<std::string> getShaderDependencies(const std::string &filepath);
+
+/*
+* Marks a file as changed, so the next loadShaderSource re-reads it even if its modification time is unchanged.
+* @param filepath The relative path of the file.
+*/
+void invalidateShaderSource(const std::string &filepath);
+
+/*
+* Normalizes a path the way the include graph stores them, e.g. "src/shaders/../shaders/a.glsl" to "src/shaders/a.glsl".
+* @param filepath The path to normalize.
+* @return The normalized path.
+*/
+std::string normalizeShaderPath(const std::string &filepath);
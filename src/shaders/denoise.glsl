@@ -0,0 +1,58 @@
+#version 430
+// a pass of the edge-avoiding à-trous wavelet filter, must match src/Denoiser.h and the kernels in src/cpu/simd_kernels.inl
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba32f, binding = 0) readonly uniform image2D color_in;      // the colors of the last pass, the noisy average first
+layout(rgba32f, binding = 1) readonly uniform image2D albedo;        // the average albedo of the first surfaces hit
+layout(rgba32f, binding = 2) readonly uniform image2D normal_depth;  // their average normal and distance from the camera
+layout(rgba32f, binding = 3) writeonly uniform image2D color_out;    // receives the filtered colors
+uniform int step_size;           // the distance between the taps, 2^pass pixels
+uniform float inv_sigma_color2;  // 1 / sigma² of the guides, see DenoiseSettings
+uniform float inv_sigma_normal2;
+uniform float inv_sigma_albedo2;
+uniform float sigma_depth2;      // relative to the filtered pixel's depth
+
+const float KERNEL[3] = float[](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0); // the B3 spline's taps by their distance from the center
+const float DEPTH_EPSILON = 1e-8; // keeps the depth term finite for a pixel that hit nothing, whose depth is 0
+
+// falls off like exp(-x), as the reciprocal of its Taylor polynomial, so the SIMD kernels on the CPU need no exp
+float edge_weight(float x) {
+    float x2 = x * x;
+    return 1.0 / ((1.0 + x) + x2 * ((1.0 / 2.0 + x * (1.0 / 6.0)) + x2 * (1.0 / 24.0)));
+}
+
+float length2(vec3 v) {
+    return dot(v, v);
+}
+
+// filters every pixel with the 25 taps around it, weighted down the more their guides differ from its own
+void main() {
+    ivec2 size = imageSize(color_out);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if(pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    vec3 color = imageLoad(color_in, pixel).rgb;
+    vec3 surface_albedo = imageLoad(albedo, pixel).rgb;
+    vec4 surface = imageLoad(normal_depth, pixel);
+    float inv_depth2 = 1.0 / (sigma_depth2 * surface.w * surface.w + DEPTH_EPSILON);
+    vec3 sum = vec3(0.0);
+    float weight_sum = 0.0;
+    for(int y = -2; y <= 2; y++)
+    for(int x = -2; x <= 2; x++) {
+        ivec2 tap = pixel + ivec2(x, y) * step_size;
+        if(tap.x < 0 || tap.y < 0 || tap.x >= size.x || tap.y >= size.y)
+            continue;
+        vec3 tap_color = imageLoad(color_in, tap).rgb;
+        vec4 tap_surface = imageLoad(normal_depth, tap);
+        float depth_difference = surface.w - tap_surface.w;
+        float difference = length2(color - tap_color) * inv_sigma_color2
+                         + length2(surface.xyz - tap_surface.xyz) * inv_sigma_normal2
+                         + length2(surface_albedo - imageLoad(albedo, tap).rgb) * inv_sigma_albedo2
+                         + depth_difference * depth_difference * inv_depth2;
+        float weight = KERNEL[abs(x)] * KERNEL[abs(y)] * edge_weight(difference);
+        sum += tap_color * weight;
+        weight_sum += weight;
+    }
+    // the pixel itself always has a weight
+    imageStore(color_out, pixel, vec4(sum / weight_sum, 1.0));
+}
@@ -1,5 +1,20 @@
-#version 420
+#version 430
 #include "tracing.glsl"
-out vec4 fragColor;
+uniform sampler2D accumulation;              // the average of the previous samples, their number in a
+uniform sampler2D accumulation_albedo;       // the average of their features, if the accumulation keeps them
+uniform sampler2D accumulation_normal_depth;
+uniform uint sample_index;                   // the index of the new sample, which seeds it
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 fragAlbedo;      // the new averages of the features, dropped without feature layers
+layout(location = 2) out vec4 fragNormalDepth;
 in vec2 uv;
-void main() {fragColor = vec4(trace(uv),1.0);}
\ No newline at end of file
+void main() {
+    Features features;
+    vec3 color = trace(uv, sample_index, features);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 average = texelFetch(accumulation, pixel, 0);
+    float weight = 1.0 / (average.a + 1.0);
+    fragColor = vec4(mix(average.rgb, color, weight), average.a + 1.0);
+    fragAlbedo = mix(texelFetch(accumulation_albedo, pixel, 0), vec4(features.albedo, 1.0), weight);
+    fragNormalDepth = mix(texelFetch(accumulation_normal_depth, pixel, 0), vec4(features.normal, features.depth), weight);
+}
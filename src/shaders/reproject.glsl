@@ -0,0 +1,100 @@
+#version 430
+// carries the accumulated average over to a new view, see src/Reprojector.h
+layout(local_size_x = 8, local_size_y = 8) in;
+// must match the units in src/Reprojector.cpp and the layers in src/AccumulationBuffer.h
+layout(binding = 4) uniform sampler2D sample_color;          // the new view's first sample, 1 in a
+layout(binding = 5) uniform sampler2D sample_albedo;
+layout(binding = 6) uniform sampler2D sample_normal_depth;
+layout(binding = 7) uniform sampler2D history_color;         // the previous view's average, the number of samples in a
+layout(binding = 8) uniform sampler2D history_albedo;
+layout(binding = 9) uniform sampler2D history_normal_depth;  // its distances are from the previous view's camera
+layout(rgba32f, binding = 0) writeonly uniform image2D reprojected_color; // receive the blended averages
+layout(rgba32f, binding = 1) writeonly uniform image2D reprojected_albedo;
+layout(rgba32f, binding = 2) writeonly uniform image2D reprojected_normal_depth;
+uniform mat4 cam2world;                // the new view, like in tracing.glsl
+uniform vec2 near_clip_data;
+uniform mat4 world2previous;           // world space into the camera space of the previous view
+uniform vec2 previous_near_clip_data;
+
+const float DEPTH_TOLERANCE = 0.05;  // how far a past texel's depth may be from the reprojected one, relative to it
+const float NORMAL_TOLERANCE = 0.9;  // the smallest cosine between a past texel's normal and the new one
+const float VARIANCE_CLAMP = 1.0;    // the standard deviations of the new samples around the pixel the past may be off by
+const float MAX_HISTORY = 32.0;      // the most samples the past counts as, so it follows lighting that changes
+const float MIN_COVERAGE = 0.01;     // the bilinear weight of the texels kept below which the past is dropped
+
+// whether a past texel shows the surface the new sample hit, at the depth it had from the previous view
+bool same_surface(vec4 past, vec4 surface, float expected_depth) {
+    if(abs(past.w - expected_depth) > DEPTH_TOLERANCE * expected_depth)
+        return false; // a miss, at depth 0, only matches misses
+    return surface.w == 0.0 || dot(past.xyz, surface.xyz) >= NORMAL_TOLERANCE * length(past.xyz) * length(surface.xyz);
+}
+
+void main() {
+    ivec2 size = imageSize(reprojected_color);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if(pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    vec3 color = texelFetch(sample_color, pixel, 0).rgb;
+    vec3 albedo = texelFetch(sample_albedo, pixel, 0).rgb;
+    vec4 surface = texelFetch(sample_normal_depth, pixel, 0);
+
+    // where the previous view saw the surface, a miss is infinitely far away and only moves with the view's rotation
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+    vec3 origin = cam2world[3].xyz;
+    vec3 dir = normalize((cam2world * vec4(near_clip_data * (uv - 0.5), 1.0, 1.0)).xyz - origin);
+    vec3 previous = surface.w > 0.0 ? (world2previous * vec4(origin + dir * surface.w, 1.0)).xyz : mat3(world2previous) * dir;
+    float expected_depth = surface.w > 0.0 ? length(previous) : 0.0;
+    vec2 texel = (previous.xy / (previous.z * previous_near_clip_data) + 0.5) * vec2(size) - 0.5;
+
+    // the bilinear average of the 4 past texels around it that show the same surface
+    vec4 past = vec4(0.0);
+    vec3 past_albedo = vec3(0.0);
+    vec3 past_normal = vec3(0.0);
+    float coverage = 0.0;
+    if(previous.z > 0.0) {
+        ivec2 base = ivec2(floor(texel));
+        vec2 f = texel - vec2(base);
+        for(int i = 0; i < 4; i++) {
+            ivec2 offset = ivec2(i & 1, i >> 1);
+            ivec2 tap = base + offset;
+            if(any(lessThan(tap, ivec2(0))) || any(greaterThanEqual(tap, size)))
+                continue;
+            vec4 tap_surface = texelFetch(history_normal_depth, tap, 0);
+            if(!same_surface(tap_surface, surface, expected_depth))
+                continue;
+            vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+            float weight = bilinear.x * bilinear.y;
+            past += texelFetch(history_color, tap, 0) * weight;
+            past_albedo += texelFetch(history_albedo, tap, 0).rgb * weight;
+            past_normal += tap_surface.xyz * weight;
+            coverage += weight;
+        }
+    }
+
+    float count = 0.0;
+    if(coverage > MIN_COVERAGE) {
+        past /= coverage;
+        past_albedo /= coverage;
+        past_normal /= coverage;
+        count = min(past.a, MAX_HISTORY);
+
+        // past that strays from what the new samples around the pixel agree on is stale, e.g. a moved shadow
+        vec3 mean = vec3(0.0), mean2 = vec3(0.0);
+        for(int y = -1; y <= 1; y++)
+        for(int x = -1; x <= 1; x++) {
+            vec3 neighbour = texelFetch(sample_color, clamp(pixel + ivec2(x, y), ivec2(0), size - 1), 0).rgb;
+            mean += neighbour;
+            mean2 += neighbour * neighbour;
+        }
+        mean /= 9.0;
+        vec3 deviation = sqrt(max(mean2 / 9.0 - mean * mean, 0.0));
+        past.rgb = clamp(past.rgb, mean - VARIANCE_CLAMP * deviation, mean + VARIANCE_CLAMP * deviation);
+    }
+
+    // the new sample's depth replaces the past's, which was measured from the previous view
+    float weight = 1.0 / (count + 1.0);
+    imageStore(reprojected_color, pixel, vec4(mix(past.rgb, color, weight), count + 1.0));
+    imageStore(reprojected_albedo, pixel, vec4(mix(past_albedo, albedo, weight), 1.0));
+    imageStore(reprojected_normal_depth, pixel, vec4(mix(past_normal, surface.xyz, weight), surface.w));
+}
@@ -2,6 +2,7 @@ struct Ray { vec3 origin; vec3 dir; vec3 invDir; };
 
 #define min3(a,b,c) min(min(a,b),c)
 #define max3(a,b,c) max(max(a,b),c)
+// returns the distance at which the ray enters the box, 0 if it starts inside, -1 on a miss
 float intsec_rayAABB(Ray ray, vec3 bbmin, vec3 bbmax) {
     vec3 t1 = (bbmin - ray.origin) * ray.invDir;
     vec3 t2 = (bbmax - ray.origin) * ray.invDir;
@@ -15,16 +16,13 @@ float intsec_rayAABB(Ray ray, vec3 bbmin, vec3 bbmax) {
     if(tNear > tFar || tFar < 0)
         return -1;
     
-    return tNear > 0 ? tNear : tFar;
+    return max(tNear, 0.0);
 }
 
-// Möller-Trumbore
-float intsec_rayTriangle(Ray ray, vec3 a, vec3 b, vec3 c) {
+// Möller-Trumbore with precomputed edges
+float intsec_rayTriangleEdges(Ray ray, vec3 a, vec3 edge1, vec3 edge2) {
     const float EPSILON = 0.0000001;
 
-    vec3 edge1 = b - a;
-    vec3 edge2 = c - a;
-
     vec3 h = cross(ray.dir, edge2);
     float a_dot_h = dot(edge1, h);
 
@@ -52,77 +50,416 @@ float intsec_rayTriangle(Ray ray, vec3 a, vec3 b, vec3 c) {
     return -1;
 }
 
+// Möller-Trumbore
+float intsec_rayTriangle(Ray ray, vec3 a, vec3 b, vec3 c) {
+    return intsec_rayTriangleEdges(ray, a, b - a, c - a);
+}
+
+// must match the structs in src/bvh/BVH.h and the bindings in src/Scene.h
+struct Triangle { vec3 a; float _pad0; vec3 b; float _pad1; vec3 c; float _pad2; };
+struct BVHNode {
+    vec3 bbmin; uint index; // inner node: index of the right child, leaf: index of the first triangle
+    vec3 bbmax; uint count; // number of triangles in the leaf, 0 for inner nodes
+};
+layout(std430, binding = 0) readonly buffer BVHNodes { BVHNode bvh_nodes[]; };
+layout(std430, binding = 1) readonly buffer Triangles { Triangle triangles[]; };
+
+struct Hit { float dst; int triangle; int instance; }; // triangle is -1 if nothing was hit, instance -1 outside instances
+
+#define BVH_STACK_SIZE 64 // BVH_MAX_DEPTH in src/bvh/BVH.h, the builders and the scene loader limit the tree depth accordingly
+// finds the closest hit in the tree below root that is closer than hit, instance is recorded with it
+void intsec_rayBLAS(Ray ray, uint root, int instance, inout Hit hit) {
+    if(intsec_rayAABB(ray, bvh_nodes[root].bbmin, bvh_nodes[root].bbmax) < 0)
+        return;
+
+    // the left child directly follows its parent, only far children are pushed
+    uint stack[BVH_STACK_SIZE];
+    float stack_dst[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    uint node_idx = root;
+    while(true) {
+        BVHNode node = bvh_nodes[node_idx];
+        if(node.count > 0) {
+            for(uint i = node.index; i < node.index + node.count; i++) {
+                float t = intsec_rayTriangle(ray, triangles[i].a, triangles[i].b, triangles[i].c);
+                if(t >= 0 && t < hit.dst) {
+                    hit.dst = t;
+                    hit.triangle = int(i);
+                    hit.instance = instance;
+                }
+            }
+        } else {
+            uint left = node_idx + 1;
+            uint right = node.index;
+            float tl = intsec_rayAABB(ray, bvh_nodes[left].bbmin, bvh_nodes[left].bbmax);
+            float tr = intsec_rayAABB(ray, bvh_nodes[right].bbmin, bvh_nodes[right].bbmax);
+            bool hit_left = tl >= 0 && tl < hit.dst;
+            bool hit_right = tr >= 0 && tr < hit.dst;
+
+            if(hit_left && hit_right) {
+                bool left_first = tl <= tr;
+                stack[stack_ptr] = left_first ? right : left;
+                stack_dst[stack_ptr] = left_first ? tr : tl;
+                stack_ptr++;
+                node_idx = left_first ? left : right;
+                continue;
+            }
+            if(hit_left)  { node_idx = left;  continue; }
+            if(hit_right) { node_idx = right; continue; }
+        }
+
+        // pop the next node that may still be closer than the closest hit
+        do {
+            if(stack_ptr == 0)
+                return;
+            stack_ptr--;
+        } while(stack_dst[stack_ptr] >= hit.dst);
+        node_idx = stack[stack_ptr];
+    }
+}
+
+// the top level of instanced scenes, must match the structs in src/bvh/TLAS.h
+// the transforms are transposed mat4x3, so vec4(p, 1) * m transforms a point
+struct Instance {
+    mat3x4 world_to_object;
+    mat3x4 object_to_world;
+    uint root; // the root node of the instanced BLAS in bvh_nodes
+    uint blas;
+    uint _pad0, _pad1;
+};
+layout(std430, binding = 4) readonly buffer TLASNodes { BVHNode tlas_nodes[]; }; // leaves reference ranges of instances
+layout(std430, binding = 5) readonly buffer Instances { Instance instances[]; };
+uniform int instance_count; // -1 if the scene is a single mesh, traced from bvh_nodes[0]
+
+// the rays are transformed into object space at the leaves, the direction is not normalized, so distances stay comparable
+void intsec_rayTLAS(Ray ray, inout Hit hit) {
+    if(intsec_rayAABB(ray, tlas_nodes[0].bbmin, tlas_nodes[0].bbmax) < 0)
+        return;
+
+    uint stack[BVH_STACK_SIZE];
+    float stack_dst[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    uint node_idx = 0;
+    while(true) {
+        BVHNode node = tlas_nodes[node_idx];
+        if(node.count > 0) {
+            for(uint i = node.index; i < node.index + node.count; i++) {
+                Ray local;
+                    local.origin = vec4(ray.origin, 1.0) * instances[i].world_to_object;
+                    local.dir = vec4(ray.dir, 0.0) * instances[i].world_to_object;
+                    local.invDir = 1/local.dir;
+                intsec_rayBLAS(local, instances[i].root, int(i), hit);
+            }
+        } else {
+            uint left = node_idx + 1;
+            uint right = node.index;
+            float tl = intsec_rayAABB(ray, tlas_nodes[left].bbmin, tlas_nodes[left].bbmax);
+            float tr = intsec_rayAABB(ray, tlas_nodes[right].bbmin, tlas_nodes[right].bbmax);
+            bool hit_left = tl >= 0 && tl < hit.dst;
+            bool hit_right = tr >= 0 && tr < hit.dst;
+
+            if(hit_left && hit_right) {
+                bool left_first = tl <= tr;
+                stack[stack_ptr] = left_first ? right : left;
+                stack_dst[stack_ptr] = left_first ? tr : tl;
+                stack_ptr++;
+                node_idx = left_first ? left : right;
+                continue;
+            }
+            if(hit_left)  { node_idx = left;  continue; }
+            if(hit_right) { node_idx = right; continue; }
+        }
+
+        do {
+            if(stack_ptr == 0)
+                return;
+            stack_ptr--;
+        } while(stack_dst[stack_ptr] >= hit.dst);
+        node_idx = stack[stack_ptr];
+    }
+}
+
+Hit intsec_rayBVH(Ray ray) {
+    Hit hit;
+        hit.dst = 1e30;
+        hit.triangle = -1;
+        hit.instance = -1;
+
+    if(instance_count > 0)
+        intsec_rayTLAS(ray, hit);
+    else if(instance_count < 0 && bvh_nodes.length() > 0)
+        intsec_rayBLAS(ray, 0u, -1, hit);
+    return hit;
+}
+
+// the compressed layout, must match the structs in src/bvh/CompressedBVH.h
+// a node is a uvec4: the children's boxes quantized relative to the node's box, and the link, see CompressedNode
+layout(std430, binding = 2) readonly buffer CompressedBVHNodes {
+    vec3 cbvh_root_min; uint cbvh_root_leaf; // the exact box of the root, and whether it is a leaf
+    vec3 cbvh_root_max; uint cbvh_node_count;
+    uvec4 cbvh_nodes[];
+};
+// TriangleRecord: the first vertex and both edges, 9 floats
+layout(std430, binding = 3) readonly buffer TriangleRecords { float triangle_records[]; };
+
+const uint LINK_INDEX = 0x3FFFFFFFu;
+const uint LINK_LEFT_LEAF = 1u << 30;
+const uint LINK_RIGHT_LEAF = 1u << 31;
+const uint STACK_LEAF = 1u << 31; // marks stack entries that are leaves
+const float COMPRESSED_STEP = 0.003937007874015748; // 1/254
+
+// decodes a corner stored in the low 24 bits of a node word, precise so it rounds exactly like the encoder
+vec3 dequantize(uint word, vec3 bbmin, vec3 scale) {
+    precise vec3 corner = bbmin + vec3(uvec3(word, word >> 8, word >> 16) & 0xFFu) * scale;
+    return corner;
+}
+
+void get_triangleRecord(uint i, out vec3 v0, out vec3 e1, out vec3 e2) {
+    uint base = i * 9u;
+    v0 = vec3(triangle_records[base + 0u], triangle_records[base + 1u], triangle_records[base + 2u]);
+    e1 = vec3(triangle_records[base + 3u], triangle_records[base + 4u], triangle_records[base + 5u]);
+    e2 = vec3(triangle_records[base + 6u], triangle_records[base + 7u], triangle_records[base + 8u]);
+}
+
+// intsec_rayBVH for the compressed layout, child boxes are decoded relative to the box of the current node
+Hit intsec_rayCompressedBVH(Ray ray) {
+    Hit hit;
+        hit.dst = 1e30;
+        hit.triangle = -1;
+        hit.instance = -1;
+
+    if(cbvh_node_count == 0u || intsec_rayAABB(ray, cbvh_root_min, cbvh_root_max) < 0)
+        return hit;
+
+    uint stack[BVH_STACK_SIZE];
+    vec3 stack_min[BVH_STACK_SIZE];
+    vec3 stack_max[BVH_STACK_SIZE];
+    float stack_dst[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    uint node_idx = 0u;
+    bool leaf = cbvh_root_leaf != 0u;
+    vec3 bbmin = cbvh_root_min, bbmax = cbvh_root_max;
+    while(true) {
+        uvec4 node = cbvh_nodes[node_idx];
+        if(leaf) {
+            for(uint i = node.x; i < node.x + node.y; i++) {
+                vec3 v0, e1, e2;
+                get_triangleRecord(i, v0, e1, e2);
+                float t = intsec_rayTriangleEdges(ray, v0, e1, e2);
+                if(t >= 0 && t < hit.dst) {
+                    hit.dst = t;
+                    hit.triangle = int(i);
+                }
+            }
+        } else {
+            precise vec3 scale = (bbmax - bbmin) * COMPRESSED_STEP;
+            vec3 lmin = dequantize(node.x, bbmin, scale), lmax = dequantize(node.y, bbmin, scale);
+            vec3 rmin = dequantize(node.z, bbmin, scale), rmax = dequantize(node.w, bbmin, scale);
+            uint link = (node.x >> 24) | ((node.y >> 24) << 8) | ((node.z >> 24) << 16) | (node.w & 0xFF000000u);
+            uint left = node_idx + 1u;
+            uint right = link & LINK_INDEX;
+            float tl = intsec_rayAABB(ray, lmin, lmax);
+            float tr = intsec_rayAABB(ray, rmin, rmax);
+            bool hit_left = tl >= 0 && tl < hit.dst;
+            bool hit_right = tr >= 0 && tr < hit.dst;
+
+            if(hit_left && hit_right) {
+                bool left_first = tl <= tr;
+                stack[stack_ptr] = left_first ? right | ((link & LINK_RIGHT_LEAF) != 0u ? STACK_LEAF : 0u)
+                                              : left  | ((link & LINK_LEFT_LEAF)  != 0u ? STACK_LEAF : 0u);
+                stack_min[stack_ptr] = left_first ? rmin : lmin;
+                stack_max[stack_ptr] = left_first ? rmax : lmax;
+                stack_dst[stack_ptr] = left_first ? tr : tl;
+                stack_ptr++;
+                hit_right = !left_first;
+                hit_left = left_first;
+            }
+            if(hit_left)  { node_idx = left;  leaf = (link & LINK_LEFT_LEAF) != 0u;  bbmin = lmin; bbmax = lmax; continue; }
+            if(hit_right) { node_idx = right; leaf = (link & LINK_RIGHT_LEAF) != 0u; bbmin = rmin; bbmax = rmax; continue; }
+        }
+
+        // pop the next node that may still be closer than the closest hit
+        do {
+            if(stack_ptr == 0)
+                return hit;
+            stack_ptr--;
+        } while(stack_dst[stack_ptr] >= hit.dst);
+        node_idx = stack[stack_ptr] & ~STACK_LEAF;
+        leaf = (stack[stack_ptr] & STACK_LEAF) != 0u;
+        bbmin = stack_min[stack_ptr];
+        bbmax = stack_max[stack_ptr];
+    }
+}
+
 uniform mat4 cam2world;
 uniform vec2 near_clip_data; //(width, height) just used for ray generation, we don't actually clip
+uniform vec2 pixel_size; // the size of a pixel in uv space
+uniform uint bvh_layout; // BVHLayout in src/Scene.h: 0 standard, 1 compressed
 
-vec3 trace(vec2 uv) {
+// the closest hit in the scene, in the layout in use
+Hit intsec_rayScene(Ray ray) {
+    return bvh_layout == 1u ? intsec_rayCompressedBVH(ray) : intsec_rayBVH(ray);
+}
+
+// the unnormalized geometric normal of a triangle in the layout in use
+vec3 get_triangleNormal(int i) {
+    if(bvh_layout == 1u) {
+        vec3 v0, e1, e2;
+        get_triangleRecord(uint(i), v0, e1, e2);
+        return cross(e1, e2);
+    }
+    Triangle tri = triangles[i];
+    return cross(tri.b - tri.a, tri.c - tri.a);
+}
+
+// the normalized geometric normal of a hit in world space
+vec3 get_hitNormal(Hit hit) {
+    vec3 normal = get_triangleNormal(hit.triangle);
+    // normals transform with the inverse transpose, whose columns are the rows of world_to_object's linear part
+    if(instance_count > 0 && hit.instance >= 0)
+        normal = mat3(instances[hit.instance].world_to_object) * normal;
+    return normalize(normal);
+}
+
+const vec3 LIGHT_DIR = vec3(0.486664, 0.811107, -0.324443);
+
+// the first surface a camera ray hits, which guides the denoiser, all zero on a miss
+struct Features { vec3 albedo; vec3 normal; float depth; };
+const Features NO_FEATURES = Features(vec3(0.0), vec3(0.0), 0.0);
+
+// the features of a surface hit at a distance along a ray, its normal facing the ray
+Features get_features(Ray ray, vec3 normal, float dst, vec3 albedo) {
+    return Features(albedo, dot(normal, ray.dir) > 0.0 ? -normal : normal, dst);
+}
+
+// the color of the background in a direction
+vec3 sky(vec3 dir) {
+    return dir;
+}
+
+// the sub-pixel position of a sample in [0,1]², following the R2 low discrepancy sequence
+// sample 0 is the pixel center, so a single sample looks like an unjittered render
+vec2 sample_jitter(uint sample_index) {
+    return fract(0.5 + float(sample_index) * vec2(0.7548776662, 0.5698402910));
+}
+
+// the camera ray through a pixel, uv is the pixel's center in [0,1]² across the image
+Ray camera_ray(vec2 uv, uint sample_index) {
+    uv += (sample_jitter(sample_index) - 0.5) * pixel_size;
     vec4 world_pos = cam2world * vec4(near_clip_data.xy * (uv - 0.5), 1.0, 1.0);
 
     Ray ray;
         ray.origin = cam2world[3].xyz;
         ray.dir = normalize(world_pos.xyz/world_pos.w - ray.origin);
         ray.invDir = 1/ray.dir;
+    return ray;
+}
+
+// must match BrickCell in src/sdf/BrickMap.h and the bindings in src/SDFVolume.h
+struct BrickCell { uint brick; float distance; }; // brick is BRICK_EMPTY without a surface, distance then bounds it
+layout(std430, binding = 10) readonly buffer BrickCells { BrickCell brick_cells[]; };
+// the bricks' samples, ATLAS_BRICKS x ATLAS_BRICKS bricks per layer. Bound to BRICK_ATLAS_TEXTURE_UNIT even in
+// triangle mode, where nothing sets it: the default unit 0 would clash with the accumulation's sampler2D
+layout(binding = 1) uniform sampler3D brick_atlas;
+uniform vec3 brick_map_origin;  // the minimum corner of the grid
+uniform float brick_cell_size;  // the edge length of a cell
+uniform ivec3 brick_map_size;   // the number of cells along every axis
+uniform uint render_mode;       // RenderMode in src/SDFVolume.h: 0 triangles, 1 SDF
 
-    float hitdst = intsec_rayTriangle(ray, vec3(-0.5,-0.5,0.0), vec3(0.0,0.5,0.0), vec3(0.5,-0.5,0.0));
-    if(hitdst >= 0)
-        return vec3(1.0, 1.0, 1.0);
-
-    return vec3(ray.dir);
-}
-
-// #define EPSILON 0.0001
-
-// float frameSDF(vec3 p) {
-//     vec3 b = vec3(0.5, 0.5, 0.5);
-//     float e = 0.05;
-//     p = abs(p  )-b;
-//     vec3 q = abs(p+e)-e;
-//     return min(min(
-//         length(max(vec3(p.x,q.y,q.z),0.0))+min(max(p.x,max(q.y,q.z)),0.0),
-//         length(max(vec3(q.x,p.y,q.z),0.0))+min(max(q.x,max(p.y,q.z)),0.0)),
-//         length(max(vec3(q.x,q.y,p.z),0.0))+min(max(q.x,max(q.y,p.z)),0.0));
-// }
-
-// float sphereSDF(vec3 p) {
-//     return length(p) - 0.5;
-// }
-
-// float smin(float a, float b, float k) {
-//     float h = max(k - abs(a - b), 0.0) / k;
-//     return min(a, b) - h * h * h * k * (1.0 / 6.0);
-// }
-
-// float sceneSDF(vec3 p) {
-//     return smin(frameSDF(p),sphereSDF(p),0.5);
-// }
-
-// vec3 estimateNormal(vec3 p) {
-//     return normalize(vec3(
-//         sceneSDF(vec3(p.x + EPSILON, p.y, p.z)) - sceneSDF(vec3(p.x - EPSILON, p.y, p.z)),
-//         sceneSDF(vec3(p.x, p.y + EPSILON, p.z)) - sceneSDF(vec3(p.x, p.y - EPSILON, p.z)),
-//         sceneSDF(vec3(p.x, p.y, p.z  + EPSILON)) - sceneSDF(vec3(p.x, p.y, p.z - EPSILON))
-//     ));
-// }
-
-// vec3 trace(vec2 uv) {
-//     vec4 world_pos = cam2world * vec4(near_clip_data.xy * (uv - 0.5), 1.0, 1.0);
-
-//     Ray ray;
-//         ray.origin = cam2world[3].xyz;
-//         ray.dir = normalize(world_pos.xyz/world_pos.w - ray.origin);
-//         ray.invDir = 1/ray.dir;
-
-//     float depth = 0;
-//     for(int i = 0; i < 100; i++) {
-//         vec3 rayend = ray.origin + ray.dir * depth;
-//         float dist = sceneSDF(rayend);
-//         if(dist < EPSILON) {
-//             float light = dot(estimateNormal(rayend), vec3(0.486664, 0.811107, -0.324443)) * 0.5 + 0.5;
-//             return vec3(1.0, 1.0, 1.0) * light;
-//         }
-
-//         depth += dist;
-//     }
-
-//     return vec3(0.0, 0.0, 0.0);
-// }
\ No newline at end of file
+#define BRICK_EMPTY 0xFFFFFFFFu
+#define BRICK_SIZE 8
+#define ATLAS_BRICKS 32u
+#define SDF_MAX_STEPS 256
+#define SDF_HIT_DISTANCE 0.01 // in cells, a tenth of a voxel
+
+// the cell of the grid containing a point, clamped to the grid, and the point's position in it in [0,1]³
+ivec3 get_brickCell(vec3 p, out vec3 local) {
+    vec3 grid = (p - brick_map_origin) / brick_cell_size;
+    ivec3 cell = clamp(ivec3(floor(grid)), ivec3(0), brick_map_size - 1);
+    local = clamp(grid - vec3(cell), 0.0, 1.0);
+    return cell;
+}
+
+BrickCell get_brickCell(ivec3 cell) {
+    return brick_cells[(cell.z * brick_map_size.y + cell.y) * brick_map_size.x + cell.x];
+}
+
+// the distance interpolated from a brick's samples, local is the position in its cell in [0,1]³
+float sample_brick(uint brick, vec3 local) {
+    uvec3 base = uvec3(brick % ATLAS_BRICKS, brick / ATLAS_BRICKS % ATLAS_BRICKS, brick / (ATLAS_BRICKS * ATLAS_BRICKS));
+    // the border samples sit on texel centers, so hardware filtering never mixes neighboring bricks in the atlas
+    vec3 texel = vec3(base * BRICK_SIZE) + 0.5 + local * float(BRICK_SIZE - 1);
+    return texture(brick_atlas, texel / vec3(textureSize(brick_atlas, 0))).r;
+}
+
+// the distance to the surface at a point, only a lower bound away from it
+float sdf_distance(vec3 p) {
+    vec3 local;
+    BrickCell cell = get_brickCell(get_brickCell(p, local));
+    return cell.brick == BRICK_EMPTY ? cell.distance : sample_brick(cell.brick, local);
+}
+
+// sphere traces the brick map, returns the distance of the hit or -1 on a miss
+// cells without a brick are left in a single step, or skipped further if their distance allows it
+float intsec_raySDF(Ray ray) {
+    vec3 bbmax = brick_map_origin + vec3(brick_map_size) * brick_cell_size;
+    float t = intsec_rayAABB(ray, brick_map_origin, bbmax);
+    if(t < 0)
+        return -1;
+    vec3 t_far = max((brick_map_origin - ray.origin) * ray.invDir, (bbmax - ray.origin) * ray.invDir);
+    float t_max = min3(t_far.x, t_far.y, t_far.z);
+
+    float hit_distance = brick_cell_size * SDF_HIT_DISTANCE;
+    vec3 exit_corner = step(0.0, ray.dir) * brick_cell_size; // the corner of a cell a ray leaves it towards
+    for(int i = 0; i < SDF_MAX_STEPS && t < t_max; i++) {
+        vec3 local;
+        ivec3 cell_idx = get_brickCell(ray.origin + ray.dir * t, local);
+        BrickCell cell = get_brickCell(cell_idx);
+        if(cell.brick == BRICK_EMPTY) {
+            vec3 t_exit = (brick_map_origin + vec3(cell_idx) * brick_cell_size + exit_corner - ray.origin) * ray.invDir;
+            t = max(t + cell.distance, min3(t_exit.x, t_exit.y, t_exit.z)) + hit_distance;
+            continue;
+        }
+        float d = sample_brick(cell.brick, local);
+        if(d < hit_distance)
+            return t;
+        t += d;
+    }
+    return -1;
+}
+
+// the normalized gradient of the brick map at a point on its surface, from central differences half a voxel apart
+vec3 get_sdfNormal(vec3 p) {
+    float h = brick_cell_size * 0.5 / float(BRICK_SIZE - 1);
+    return normalize(vec3(
+        sdf_distance(p + vec3(h, 0, 0)) - sdf_distance(p - vec3(h, 0, 0)),
+        sdf_distance(p + vec3(0, h, 0)) - sdf_distance(p - vec3(0, h, 0)),
+        sdf_distance(p + vec3(0, 0, h)) - sdf_distance(p - vec3(0, 0, h))
+    ));
+}
+
+// the color seen through a pixel, and the features of the surface it shows
+vec3 trace(vec2 uv, uint sample_index, out Features features) {
+    Ray ray = camera_ray(uv, sample_index);
+    features = NO_FEATURES;
+    if(render_mode == 1u) {
+        float t = intsec_raySDF(ray);
+        if(t >= 0) {
+            vec3 normal = get_sdfNormal(ray.origin + ray.dir * t);
+            features = get_features(ray, normal, t, vec3(1.0));
+            float light = dot(normal, LIGHT_DIR) * 0.5 + 0.5;
+            return vec3(1.0, 1.0, 1.0) * light;
+        }
+        return sky(ray.dir);
+    }
+
+    Hit hit = intsec_rayScene(ray);
+    if(hit.triangle >= 0) {
+        vec3 normal = get_hitNormal(hit);
+        features = get_features(ray, normal, hit.dst, vec3(1.0));
+        float light = dot(normal, LIGHT_DIR) * 0.5 + 0.5;
+        return vec3(1.0, 1.0, 1.0) * light;
+    }
+
+    return sky(ray.dir);
+}
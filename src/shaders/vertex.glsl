@@ -1,4 +1,4 @@
-#version 420
+#version 430
 
 layout(location = 0) in vec3 a_position;
 layout(location = 1) in vec2 a_uv;
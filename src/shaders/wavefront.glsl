@@ -0,0 +1,36 @@
+// shared by the kernels of the wavefront path tracer, must match the structs and bindings in src/WavefrontTracer.h
+// every kernel works through a queue in its own dispatch, so the lanes of a warp always run the same stage of a path
+#include "tracing.glsl"
+
+#define WAVEFRONT_GROUP_SIZE 64 // the workgroup size of the kernels working through a queue
+
+// a path's next ray, extend fills in its closest hit
+struct RayRecord {
+    vec3 origin; uint pixel;       // pixel: the index of the path's pixel, y * width + x
+    vec3 dir; float dst;           // dst: the distance to the closest hit
+    vec3 throughput; int triangle; // throughput: the fraction of the light along the ray reaching the camera, triangle: -1 on a miss
+    int instance; uint depth;      // depth: the number of bounces before this ray
+    uint _pad0, _pad1;
+};
+// a ray towards the light, and the light it adds to its pixel unless it is blocked
+struct ShadowRecord {
+    vec3 origin; uint pixel;
+    vec3 contribution; float _pad0;
+};
+
+layout(std430, binding = 6) buffer WavefrontQueues {
+    uvec4 extend_dispatch; // the workgroups for the rays in rays_in as (x,1,1), and the number of rays in w
+    uvec4 shadow_dispatch; // the workgroups for the rays in shadow_rays, and their number in w
+    uint next_ray_count;   // the rays shade appended to rays_out so far
+    uint shadow_count;     // the rays shade appended to shadow_rays so far
+};
+layout(std430, binding = 7) buffer RaysIn { RayRecord rays_in[]; };
+layout(std430, binding = 8) buffer RaysOut { RayRecord rays_out[]; };
+layout(std430, binding = 9) buffer ShadowRays { ShadowRecord shadow_rays[]; };
+layout(rgba32f, binding = 0) uniform image2D radiance_image; // the light each pixel's path gathered so far this sample
+
+// the pixel of a path in the images
+ivec2 get_pixel(uint index) {
+    uint width = uint(imageSize(radiance_image).x);
+    return ivec2(index % width, index / width);
+}
@@ -0,0 +1,17 @@
+#version 430
+#include "wavefront.glsl"
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba32f, binding = 1) readonly uniform image2D previous_average; // the average of the previous samples, their number in a
+layout(rgba32f, binding = 2) writeonly uniform image2D average;         // receives the new average
+
+// adds the finished sample of every pixel to the average
+void main() {
+    ivec2 size = imageSize(radiance_image);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if(pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    vec3 color = imageLoad(radiance_image, pixel).rgb;
+    vec4 previous = imageLoad(previous_average, pixel);
+    imageStore(average, pixel, vec4(mix(previous.rgb, color, 1.0 / (previous.a + 1.0)), previous.a + 1.0));
+}
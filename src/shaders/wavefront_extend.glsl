@@ -0,0 +1,19 @@
+#version 430
+#include "wavefront.glsl"
+layout(local_size_x = WAVEFRONT_GROUP_SIZE) in;
+
+// finds the closest hit of every queued ray
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= extend_dispatch.w)
+        return;
+
+    Ray ray;
+        ray.origin = rays_in[i].origin;
+        ray.dir = rays_in[i].dir;
+        ray.invDir = 1/ray.dir;
+    Hit hit = intsec_rayScene(ray);
+    rays_in[i].dst = hit.dst;
+    rays_in[i].triangle = hit.triangle;
+    rays_in[i].instance = hit.instance;
+}
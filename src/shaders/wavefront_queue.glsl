@@ -0,0 +1,12 @@
+#version 430
+#include "wavefront.glsl"
+layout(local_size_x = 1) in;
+
+// turns the queues shade appended to into the next extend and shadow dispatches, and starts them over
+void main() {
+    uint groups = uint(WAVEFRONT_GROUP_SIZE);
+    extend_dispatch = uvec4((next_ray_count + groups - 1u) / groups, 1u, 1u, next_ray_count);
+    shadow_dispatch = uvec4((shadow_count + groups - 1u) / groups, 1u, 1u, shadow_count);
+    next_ray_count = 0u;
+    shadow_count = 0u;
+}
@@ -0,0 +1,22 @@
+#version 430
+#include "wavefront.glsl"
+layout(local_size_x = 8, local_size_y = 8) in;
+uniform uint sample_index; // the number of samples accumulated so far
+
+// starts a path at every pixel, the camera rays are queued in scanline order
+void main() {
+    ivec2 size = imageSize(radiance_image);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if(pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    Ray ray = camera_ray((vec2(pixel) + 0.5) / vec2(size), sample_index);
+    RayRecord record;
+        record.origin = ray.origin;
+        record.pixel = uint(pixel.y * size.x + pixel.x);
+        record.dir = ray.dir;
+        record.throughput = vec3(1.0);
+        record.depth = 0u;
+    rays_in[record.pixel] = record;
+    imageStore(radiance_image, pixel, vec4(0.0));
+}
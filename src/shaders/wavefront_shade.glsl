@@ -0,0 +1,131 @@
+#version 430
+#include "wavefront.glsl"
+layout(local_size_x = WAVEFRONT_GROUP_SIZE) in;
+uniform uint sample_index; // the index of the sample, which seeds its random numbers
+uniform uint max_bounces;  // the bounces after the camera ray, 0 shades the first hit like the fragment kernel
+uniform uint write_features; // 1 if the camera rays' features are averaged into the accumulation's feature images
+layout(rgba32f, binding = 1) readonly uniform image2D previous_average;     // the number of samples in a, see wavefront_accumulate
+layout(rgba32f, binding = 3) readonly uniform image2D previous_albedo;       // the features of the previous samples
+layout(rgba32f, binding = 4) writeonly uniform image2D average_albedo;       // receive the new averages
+layout(rgba32f, binding = 5) readonly uniform image2D previous_normal_depth;
+layout(rgba32f, binding = 6) writeonly uniform image2D average_normal_depth;
+
+const float PI = 3.14159265;
+const float ALBEDO = 0.8;         // the fraction of the light every surface reflects, diffusely
+const float LIGHT_STRENGTH = 1.0; // the irradiance of the light at LIGHT_DIR over pi
+const float RAY_OFFSET = 1e-4;    // how far new rays start off the surface, relative to the magnitude of the position
+
+// the PCG hash, a well distributed permutation of 32 bits
+uint pcg_hash(uint value) {
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// two random numbers in [0,1), different for every pixel, sample and bounce
+vec2 random2(uint pixel, uint depth) {
+    uint first = pcg_hash(pixel ^ pcg_hash(sample_index ^ pcg_hash(depth)));
+    return vec2(first, pcg_hash(first)) * (1.0 / 4294967296.0);
+}
+
+// a direction in the hemisphere around a normal, with a density proportional to its cosine to the normal
+vec3 sample_cosine(vec3 normal, vec2 u) {
+    vec3 tangent = normalize(cross(abs(normal.x) > 0.5 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), normal));
+    vec3 bitangent = cross(normal, tangent);
+    float phi = 2.0 * PI * u.x;
+    float r = sqrt(u.y);
+    return normalize(tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + normal * sqrt(1.0 - u.y));
+}
+
+// adds the features of a camera ray's pixel to their averages, like wavefront_accumulate does with the colors
+void accumulate_features(ivec2 pixel, Features features) {
+    float weight = 1.0 / (imageLoad(previous_average, pixel).a + 1.0);
+    imageStore(average_albedo, pixel, mix(imageLoad(previous_albedo, pixel), vec4(features.albedo, 1.0), weight));
+    imageStore(average_normal_depth, pixel, mix(imageLoad(previous_normal_depth, pixel), vec4(features.normal, features.depth), weight));
+}
+
+// the rays a workgroup appends, counted in shared memory so every queue takes one global atomic per workgroup
+shared uint group_ray_count, group_shadow_count;
+shared uint group_ray_base, group_shadow_base;
+
+// adds the light of the paths that left the scene, and continues the others with a bounce and a shadow ray
+void main() {
+    if(gl_LocalInvocationIndex == 0u) {
+        group_ray_count = 0u;
+        group_shadow_count = 0u;
+    }
+    memoryBarrierShared();
+    barrier();
+
+    uint i = gl_GlobalInvocationID.x;
+    bool emit_ray = false, emit_shadow = false;
+    RayRecord next;
+    ShadowRecord shadow;
+    if(i < extend_dispatch.w) {
+        RayRecord ray = rays_in[i];
+        ivec2 pixel = get_pixel(ray.pixel);
+        Features features = NO_FEATURES;
+        if(ray.triangle < 0) {
+            // the background shows the direction, only its positive part lights the scene
+            vec3 background = ray.depth == 0u ? sky(ray.dir) : max(sky(ray.dir), 0.0);
+            imageStore(radiance_image, pixel, imageLoad(radiance_image, pixel) + vec4(ray.throughput * background, 0.0));
+        } else {
+            Hit hit;
+                hit.dst = ray.dst;
+                hit.triangle = ray.triangle;
+                hit.instance = ray.instance;
+            vec3 normal = get_hitNormal(hit);
+            features = get_features(Ray(ray.origin, ray.dir, 1.0 / ray.dir), normal, ray.dst, vec3(max_bounces == 0u ? 1.0 : ALBEDO));
+            if(max_bounces == 0u) {
+                float light = dot(normal, LIGHT_DIR) * 0.5 + 0.5;
+                imageStore(radiance_image, pixel, imageLoad(radiance_image, pixel) + vec4(ray.throughput * light, 0.0));
+            } else {
+                if(dot(normal, ray.dir) > 0.0)
+                    normal = -normal;
+                vec3 position = ray.origin + ray.dir * ray.dst;
+                position += normal * RAY_OFFSET * (1.0 + max3(abs(position.x), abs(position.y), abs(position.z)));
+                vec3 throughput = ray.throughput * ALBEDO;
+
+                // the light reflected straight to the camera, if nothing is in the way
+                float cos_light = dot(normal, LIGHT_DIR);
+                if(cos_light > 0.0) {
+                    emit_shadow = true;
+                    shadow.origin = position;
+                    shadow.pixel = ray.pixel;
+                    shadow.contribution = throughput * cos_light * LIGHT_STRENGTH;
+                }
+
+                // the cosine of the sampled direction cancels with its density, leaving the albedo
+                if(ray.depth < max_bounces) {
+                    emit_ray = true;
+                    next.origin = position;
+                    next.pixel = ray.pixel;
+                    next.dir = sample_cosine(normal, random2(ray.pixel, ray.depth));
+                    next.throughput = throughput;
+                    next.depth = ray.depth + 1u;
+                }
+            }
+        }
+        if(ray.depth == 0u && write_features != 0u)
+            accumulate_features(pixel, features);
+    }
+
+    // compact the new rays into the queues
+    uint ray_slot = 0u, shadow_slot = 0u;
+    if(emit_ray)
+        ray_slot = atomicAdd(group_ray_count, 1u);
+    if(emit_shadow)
+        shadow_slot = atomicAdd(group_shadow_count, 1u);
+    memoryBarrierShared();
+    barrier();
+    if(gl_LocalInvocationIndex == 0u) {
+        group_ray_base = atomicAdd(next_ray_count, group_ray_count);
+        group_shadow_base = atomicAdd(shadow_count, group_shadow_count);
+    }
+    memoryBarrierShared();
+    barrier();
+    if(emit_ray)
+        rays_out[group_ray_base + ray_slot] = next;
+    if(emit_shadow)
+        shadow_rays[group_shadow_base + shadow_slot] = shadow;
+}
@@ -0,0 +1,22 @@
+#version 430
+#include "wavefront.glsl"
+layout(local_size_x = WAVEFRONT_GROUP_SIZE) in;
+
+// adds the light every queued shadow ray carries to its pixel, unless something blocks it
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= shadow_dispatch.w)
+        return;
+
+    ShadowRecord shadow = shadow_rays[i];
+    Ray ray;
+        ray.origin = shadow.origin;
+        ray.dir = LIGHT_DIR;
+        ray.invDir = 1/ray.dir;
+    if(intsec_rayScene(ray).triangle >= 0)
+        return;
+
+    // a path queues at most one shadow ray per bounce, so no other invocation writes the pixel
+    ivec2 pixel = get_pixel(shadow.pixel);
+    imageStore(radiance_image, pixel, imageLoad(radiance_image, pixel) + vec4(shadow.contribution, 0.0));
+}
@@ -0,0 +1,33 @@
+#include "../mesh/mesh_import.h"
+#include "../scene_file.h"
+#include "../Scene.h"
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+// converts an OBJ or PLY mesh into a binary scene file with a prebuilt BVH, which rtx loads with --scene
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s model.obj|model.ply scene.rtxs\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+        Mesh mesh = loadMesh(argv[1]);
+        printf("Loaded '%s': %zu vertices, %zu triangles in %.3fs\n", argv[1], mesh.vertex_count(), mesh.triangle_count(), elapsed());
+
+        Scene scene;
+        scene.set_mesh(mesh);
+        printf("Built BVH: %zu nodes at %.3fs\n", scene.bvh.nodes.size(), elapsed());
+
+        saveSceneFile(argv[2], scene);
+        printf("Wrote '%s' at %.3fs\n", argv[2], elapsed());
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}